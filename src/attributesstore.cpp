@@ -0,0 +1,454 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "attributesstore.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+#include <QVector>
+#include <QtEndian>
+
+// Log layout: magic, then records of key (sha1 of the absolute file name), the five attribute values,
+// last use time in ms since epoch and a checksum over the record. A partial record left by a writer
+// that died while appending is cut off before the next append, so later records stay aligned.
+static const QByteArray storeMagic = QByteArrayLiteral("chrattr1");
+static const int keySize = 20;
+static const int recordDataSize = keySize + 5 * 4 + 8;
+static const int recordSize = recordDataSize + 2;
+
+static int maxEntriesSetting = 10000;
+
+static QHash<QString, AttributesStore*> &stores() {
+    static QHash<QString, AttributesStore*> instances;
+    return instances;
+}
+
+static bool writeAll(int fd, const QByteArray &data) {
+    const char *p = data.constData();
+    qint64 remaining = data.size();
+    while (remaining > 0) {
+        const ssize_t written = ::write(fd, p, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        remaining -= written;
+    }
+    return true;
+}
+
+
+AttributesStore::AttributesStore(const QString &attributesFile) : _lockMode(LOCK_UN) {
+    if (!attributesFile.isEmpty()) {
+        _storeFile = storeFileFor(attributesFile);
+        if (_storeFile.endsWith(QStringLiteral(".attributes"))) {
+            _jsonFile = _storeFile.left(_storeFile.size() - 11) + QStringLiteral(".json");
+        }
+    }
+}
+
+AttributesStore::~AttributesStore() {
+    flush();
+    close();
+}
+
+AttributesStore *AttributesStore::forFile(const QString &attributesFile) {
+    const QString path = QFileInfo(attributesFile).absoluteFilePath();
+    AttributesStore *&store = stores()[path];
+    if (!store) {
+        // Lives until the process ends, flushAll is called on exit.
+        store = new AttributesStore(path);
+    }
+    return store;
+}
+
+void AttributesStore::flushAll() {
+    for (AttributesStore *store: stores()) {
+        store->flush();
+    }
+}
+
+void AttributesStore::setMaxEntries(int maxEntries) {
+    maxEntriesSetting = std::max(1, maxEntries);
+}
+
+QString AttributesStore::storeFileFor(const QString &attributesFile) {
+    if (attributesFile.endsWith(QStringLiteral(".json"))) {
+        return attributesFile.left(attributesFile.size() - 5) + QStringLiteral(".attributes");
+    }
+    return attributesFile;
+}
+
+std::optional<FileAttributes> AttributesStore::value(const QString &filename) {
+    if (!open()) {
+        return std::nullopt;
+    }
+    // Pick up what other instances wrote since the last lookup.
+    if (!reopenIfReplaced()) {
+        readNewRecords();
+    }
+    auto it = _entries.constFind(keyFor(filename));
+    if (it == _entries.constEnd()) {
+        return std::nullopt;
+    }
+    return it->attributes;
+}
+
+void AttributesStore::setValue(const QString &filename, const FileAttributes &attributes) {
+    if (!open()) {
+        return;
+    }
+    const QByteArray key = keyFor(filename);
+    Entry &entry = _entries[key];
+    entry.attributes = attributes;
+    entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    _pending += encodeRecord(key, entry);
+
+    // Closing many windows at once results in one append.
+    if (!_flushScheduled) {
+        _flushScheduled = true;
+        QTimer::singleShot(0, &_flushContext, [this] {
+            _flushScheduled = false;
+            flush();
+        });
+    }
+}
+
+bool AttributesStore::flush() {
+    if (_pending.isEmpty()) {
+        return true;
+    }
+    if (!open()) {
+        _pending.clear();
+        return false;
+    }
+
+    // Appenders share the lock, compaction replaces the log while holding it exclusively.
+    lock(LOCK_SH);
+    reopenIfReplaced();
+    if (tornRecordBytes()) {
+        // Appends are written in one go, so with the exclusive lock no append is running anymore and
+        // a partial record is left over from a writer that died.
+        lock(LOCK_EX);
+        reopenIfReplaced();
+        truncateTornRecord();
+    }
+    const bool ok = writeAll(_fd, _pending);
+    lock(LOCK_UN);
+    if (!ok) {
+        qWarning("%s%s", "can not save attributes file: ", _storeFile.toUtf8().data());
+    }
+    _pending.clear();
+    // Reading back our own records is harmless and keeps the record count right.
+    readNewRecords();
+
+    // Keeps the log below twice the cap, with at most maxEntries live entries after compaction.
+    if (_logRecords > 2 * maxEntriesSetting) {
+        compact();
+    }
+    return ok;
+}
+
+QByteArray AttributesStore::keyFor(const QString &filename) {
+    return QCryptographicHash::hash(QFileInfo(filename).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+}
+
+QByteArray AttributesStore::encodeRecord(const QByteArray &key, const Entry &entry) {
+    QByteArray record;
+    record.reserve(recordSize);
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.writeRawData(key.constData(), keySize);
+    out << qint32(entry.attributes.cursorCodeUnit) << qint32(entry.attributes.cursorLine)
+        << qint32(entry.attributes.scrollColumn) << qint32(entry.attributes.scrollLine)
+        << qint32(entry.attributes.scrollFineLine) << qint64(entry.lastUsed);
+    out << quint16(qChecksum(record.constData(), recordDataSize));
+    return record;
+}
+
+bool AttributesStore::open() {
+    if (_fd != -1) {
+        return true;
+    }
+    if (_storeFile.isEmpty()) {
+        return false;
+    }
+
+    const QString dir = QFileInfo(_storeFile).absolutePath();
+    if (!QDir(dir).exists() && !QDir().mkpath(dir)) {
+        qWarning("%s%s", "can not create directory: ", dir.toUtf8().data());
+        _storeFile.clear();
+        return false;
+    }
+
+    _lockFd = ::open(QFile::encodeName(_storeFile + QStringLiteral(".lock")).constData(),
+                     O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (_lockFd == -1) {
+        qWarning("%s%s", "can not open attributes file: ", _storeFile.toUtf8().data());
+        _storeFile.clear();
+        return false;
+    }
+
+    if (!QFileInfo::exists(_storeFile)) {
+        lock(LOCK_EX);
+        // Another instance might have won the race to create it.
+        if (!QFileInfo::exists(_storeFile)) {
+            createLog();
+        }
+        lock(LOCK_UN);
+    }
+
+    _fd = ::open(QFile::encodeName(_storeFile).constData(), O_RDWR | O_APPEND | O_CLOEXEC);
+    if (_fd == -1) {
+        qWarning("%s%s", "can not open attributes file: ", _storeFile.toUtf8().data());
+        ::close(_lockFd);
+        _lockFd = -1;
+        _storeFile.clear();
+        return false;
+    }
+    _entries.clear();
+    _readOffset = 0;
+    _logRecords = 0;
+    readNewRecords();
+    return true;
+}
+
+void AttributesStore::close() {
+    if (_fd != -1) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    if (_lockFd != -1) {
+        ::close(_lockFd);
+        _lockFd = -1;
+        _lockMode = LOCK_UN;
+    }
+}
+
+bool AttributesStore::createLog() {
+    QHash<QByteArray, Entry> entries = readLegacyJson();
+    if (entries.size() > maxEntriesSetting) {
+        // The old format has no usage times, keep an arbitrary subset.
+        auto it = entries.begin();
+        while (entries.size() > maxEntriesSetting) {
+            it = entries.erase(it);
+        }
+    }
+    return writeLog(_storeFile, entries);
+}
+
+QHash<QByteArray, AttributesStore::Entry> AttributesStore::readLegacyJson() {
+    QHash<QByteArray, Entry> entries;
+    if (_jsonFile.isEmpty()) {
+        return entries;
+    }
+    QFile file(_jsonFile);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return entries;
+    }
+    const QJsonObject object = QJsonDocument::fromJson(file.readAll()).object();
+    const qint64 lastUsed = QFileInfo(file).lastModified().toMSecsSinceEpoch();
+    for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+        const QJsonObject data = it.value().toObject();
+        Entry entry;
+        if (data.contains("cursorPositionX") && data.contains("cursorPositionY")) {
+            entry.attributes.cursorCodeUnit = data.value("cursorPositionX").toInt();
+            entry.attributes.cursorLine = data.value("cursorPositionY").toInt();
+        } else {
+            entry.attributes.cursorCodeUnit = data.value("curOff").toInt();
+            entry.attributes.cursorLine = data.value("curLine").toInt();
+        }
+        entry.attributes.scrollColumn = data.value("sCol").toInt();
+        entry.attributes.scrollLine = data.value("sLine").toInt();
+        entry.attributes.scrollFineLine = data.value("sFine").toInt();
+        entry.lastUsed = lastUsed;
+        entries.insert(keyFor(it.key()), entry);
+    }
+    return entries;
+}
+
+bool AttributesStore::writeLog(const QString &path, const QHash<QByteArray, Entry> &entries) {
+    // Written under a temporary name and renamed, so readers see either the old or the new log.
+    const QString tmpPath = path + QStringLiteral(".tmp");
+    const int fd = ::open(QFile::encodeName(tmpPath).constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        qWarning("%s%s", "can not save attributes file: ", path.toUtf8().data());
+        return false;
+    }
+    QByteArray data = storeMagic;
+    data.reserve(storeMagic.size() + entries.size() * recordSize);
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        data += encodeRecord(it.key(), it.value());
+    }
+    const bool ok = writeAll(fd, data);
+    ::close(fd);
+    if (!ok || ::rename(QFile::encodeName(tmpPath).constData(), QFile::encodeName(path).constData()) != 0) {
+        qWarning("%s%s", "can not save attributes file: ", path.toUtf8().data());
+        ::unlink(QFile::encodeName(tmpPath).constData());
+        return false;
+    }
+    return true;
+}
+
+void AttributesStore::readNewRecords() {
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || st.st_size <= _readOffset) {
+        return;
+    }
+
+    QByteArray data(st.st_size - _readOffset, Qt::Uninitialized);
+    const ssize_t got = pread(_fd, data.data(), data.size(), _readOffset);
+    if (got <= 0) {
+        return;
+    }
+    data.truncate(got);
+
+    int pos = 0;
+    if (_readOffset == 0) {
+        if (!data.startsWith(storeMagic)) {
+            replaceInvalidLog();
+            return;
+        }
+        pos = storeMagic.size();
+    }
+
+    // A partial record at the end is still being written, it is read on the next call. If its writer died,
+    // the next flush cuts it off.
+    for (; pos + recordSize <= data.size(); pos += recordSize) {
+        const char *record = data.constData() + pos;
+        _logRecords++;
+        if (qFromBigEndian<quint16>(record + recordDataSize) != qChecksum(record, recordDataSize)) {
+            continue;
+        }
+        QDataStream in(QByteArray::fromRawData(record + keySize, recordDataSize - keySize));
+        qint32 cursorCodeUnit, cursorLine, scrollColumn, scrollLine, scrollFineLine;
+        qint64 lastUsed;
+        in >> cursorCodeUnit >> cursorLine >> scrollColumn >> scrollLine >> scrollFineLine >> lastUsed;
+        _entries.insert(QByteArray(record, keySize),
+                        Entry{{cursorCodeUnit, cursorLine, scrollColumn, scrollLine, scrollFineLine}, lastUsed});
+    }
+    _readOffset += pos;
+}
+
+void AttributesStore::lock(int mode) {
+    if (_lockMode != mode) {
+        flock(_lockFd, mode);
+        _lockMode = mode;
+    }
+}
+
+void AttributesStore::replaceInvalidLog() {
+    // Other instances append under the shared lock and may have replaced the file already, so check again
+    // with the lock held exclusively. A shared lock held by the caller is taken back afterwards.
+    const int previousLock = _lockMode;
+    lock(LOCK_EX);
+    if (!reopenIfReplaced()) {
+        QByteArray magic(storeMagic.size(), Qt::Uninitialized);
+        if (pread(_fd, magic.data(), magic.size(), 0) == static_cast<ssize_t>(magic.size()) && magic == storeMagic) {
+            readNewRecords();
+        } else {
+            qWarning("%s%s", "replacing invalid attributes file: ", _storeFile.toUtf8().data());
+            struct stat st;
+            if (fstat(_fd, &st) == 0) {
+                _readOffset = st.st_size;
+            }
+            if (writeLog(_storeFile, {})) {
+                reopenIfReplaced();
+            }
+        }
+    }
+    lock(previousLock);
+}
+
+qint64 AttributesStore::tornRecordBytes() {
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || st.st_size <= storeMagic.size()) {
+        return 0;
+    }
+    return (st.st_size - storeMagic.size()) % recordSize;
+}
+
+void AttributesStore::truncateTornRecord() {
+    struct stat st;
+    const qint64 torn = tornRecordBytes();
+    if (torn && (fstat(_fd, &st) != 0 || ftruncate(_fd, st.st_size - torn) != 0)) {
+        qWarning("%s%s", "can not repair attributes file: ", _storeFile.toUtf8().data());
+    }
+}
+
+bool AttributesStore::reopenIfReplaced() {
+    struct stat current, onDisk;
+    if (fstat(_fd, &current) != 0) {
+        return false;
+    }
+    if (stat(QFile::encodeName(_storeFile).constData(), &onDisk) == 0
+            && current.st_ino == onDisk.st_ino && current.st_dev == onDisk.st_dev) {
+        return false;
+    }
+
+    // Another instance compacted the log. Reload from the new file, what it dropped is gone for us too.
+    const int fd = ::open(QFile::encodeName(_storeFile).constData(), O_RDWR | O_APPEND | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    ::close(_fd);
+    _fd = fd;
+    _entries.clear();
+    _readOffset = 0;
+    _logRecords = 0;
+    readNewRecords();
+    return true;
+}
+
+void AttributesStore::compact() {
+    lock(LOCK_EX);
+    if (!reopenIfReplaced()) {
+        readNewRecords();
+    }
+
+    if (_entries.size() > maxEntriesSetting) {
+        // Drop the least recently used entries.
+        QVector<qint64> times;
+        times.reserve(_entries.size());
+        for (const Entry &entry: _entries) {
+            times.append(entry.lastUsed);
+        }
+        auto nth = times.begin() + (times.size() - maxEntriesSetting);
+        std::nth_element(times.begin(), nth, times.end());
+        const qint64 cutoff = *nth;
+        for (auto it = _entries.begin(); it != _entries.end() && _entries.size() > maxEntriesSetting;) {
+            if (it->lastUsed < cutoff) {
+                it = _entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    if (writeLog(_storeFile, _entries)) {
+        const int fd = ::open(QFile::encodeName(_storeFile).constData(), O_RDWR | O_APPEND | O_CLOEXEC);
+        if (fd != -1) {
+            ::close(_fd);
+            _fd = fd;
+            _readOffset = storeMagic.size() + _entries.size() * recordSize;
+            _logRecords = _entries.size();
+        }
+    }
+    lock(LOCK_UN);
+}
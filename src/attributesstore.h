@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef ATTRIBUTESSTORE_H
+#define ATTRIBUTESSTORE_H
+
+#include <optional>
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+
+struct FileAttributes {
+    int cursorCodeUnit = 0;
+    int cursorLine = 0;
+    int scrollColumn = 0;
+    int scrollLine = 0;
+    int scrollFineLine = 0;
+};
+
+// Remembered cursor and scroll positions of files, keyed by a hash of the absolute path.
+//
+// On disk this is a log of fixed size records that is appended to and read incrementally, so several
+// chr processes can use it at the same time and see each other's updates. All entries are kept in a
+// hash table in memory. When the log has grown to twice maxEntries records, it is compacted to the
+// most recently used maxEntries entries. The JSON file of older versions (chr.json next to
+// chr.attributes) is imported when the log is created.
+class AttributesStore {
+public:
+    explicit AttributesStore(const QString &attributesFile);
+    ~AttributesStore();
+
+public:
+    // Shared instance per attributes file for the whole process.
+    static AttributesStore *forFile(const QString &attributesFile);
+    static void flushAll();
+    static void setMaxEntries(int maxEntries);
+    // For an attributes file named *.json the log is stored next to it as *.attributes
+    static QString storeFileFor(const QString &attributesFile);
+
+public:
+    std::optional<FileAttributes> value(const QString &filename);
+    // Updates are written with the next flush, which is scheduled for the next event loop iteration.
+    void setValue(const QString &filename, const FileAttributes &attributes);
+    bool flush();
+
+private:
+    struct Entry {
+        FileAttributes attributes;
+        qint64 lastUsed = 0;
+    };
+
+private:
+    static QByteArray keyFor(const QString &filename);
+    static QByteArray encodeRecord(const QByteArray &key, const Entry &entry);
+    bool open();
+    void close();
+    bool createLog();
+    QHash<QByteArray, Entry> readLegacyJson();
+    bool writeLog(const QString &path, const QHash<QByteArray, Entry> &entries);
+    void readNewRecords();
+    // Takes the lock on the lock file in mode (see flock), the last mode is remembered.
+    void lock(int mode);
+    // The log does not start with the magic. Takes the lock exclusively for that.
+    void replaceInvalidLog();
+    // Size of a partial record at the end of the log.
+    qint64 tornRecordBytes();
+    // Only with the lock held exclusively, otherwise the partial record might still be written.
+    void truncateTornRecord();
+    bool reopenIfReplaced();
+    void compact();
+
+private:
+    QString _jsonFile;
+    QString _storeFile;
+    int _fd = -1;
+    int _lockFd = -1;
+    // LOCK_UN, LOCK_SH or LOCK_EX as last passed to flock
+    int _lockMode;
+    qint64 _readOffset = 0;
+    int _logRecords = 0;
+    QHash<QByteArray, Entry> _entries;
+    QByteArray _pending;
+    bool _flushScheduled = false;
+    QObject _flushContext; // cancels a scheduled flush when the store is destroyed
+};
+
+#endif // ATTRIBUTESSTORE_H
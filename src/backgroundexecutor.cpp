@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "backgroundexecutor.h"
+
+#include <algorithm>
+
+#include <QThread>
+
+
+static int configuredThreadCount = 0;
+
+// Set in the worker threads, so that tasks posted from a task go to the queue of that worker.
+static thread_local BackgroundExecutor *currentExecutor = nullptr;
+static thread_local int currentWorker = -1;
+
+BackgroundExecutor::BackgroundExecutor(int threadCount) {
+    if (threadCount <= 0) {
+        threadCount = std::max(1, QThread::idealThreadCount());
+    }
+    for (int i = 0; i < threadCount; i++) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threadCount; i++) {
+        _workers[i]->thread = std::thread([this, i] { workerMain(i); });
+    }
+}
+
+BackgroundExecutor::~BackgroundExecutor() {
+    {
+        std::unique_lock lock(_idleMutex);
+        _stop = true;
+    }
+    _idle.notify_all();
+    for (auto &worker: _workers) {
+        worker->thread.join();
+    }
+
+    // Tasks that did not start anymore still get to clean up.
+    for (auto &worker: _workers) {
+        for (auto &queue: worker->queues) {
+            for (Task &task: queue) {
+                task.run(true);
+            }
+        }
+    }
+}
+
+BackgroundExecutor *BackgroundExecutor::instance() {
+    static BackgroundExecutor executor(configuredThreadCount);
+    return &executor;
+}
+
+void BackgroundExecutor::configure(int threadCount) {
+    configuredThreadCount = threadCount;
+}
+
+int BackgroundExecutor::threadCount() const {
+    return _workers.size();
+}
+
+int BackgroundExecutor::backgroundLimit() const {
+    return std::max(1, threadCount() - 1);
+}
+
+void BackgroundExecutor::post(Priority priority, CancelToken token, std::function<void(bool cancelled)> task) {
+    int index = currentWorker;
+    if (currentExecutor != this) {
+        index = _nextWorker++ % _workers.size();
+    }
+    {
+        std::unique_lock lock(_workers[index]->mutex);
+        _workers[index]->queues[static_cast<int>(priority)].push_back({std::move(token), std::move(task)});
+    }
+    {
+        std::unique_lock lock(_idleMutex);
+        if (priority == Priority::Background) {
+            _pendingBackground++;
+        } else {
+            _pending++;
+        }
+    }
+    _idle.notify_one();
+}
+
+void BackgroundExecutor::workerMain(int index) {
+    currentExecutor = this;
+    currentWorker = index;
+    while (true) {
+        {
+            std::unique_lock lock(_idleMutex);
+            _idle.wait(lock, [this] {
+                return _stop || _pending > 0 || (_pendingBackground > 0 && _runningBackground < backgroundLimit());
+            });
+            if (_stop) {
+                return;
+            }
+        }
+        Task task;
+        bool background = false;
+        if (takeTask(index, &task, &background)) {
+            task.run(task.token && *task.token);
+            if (background) {
+                {
+                    std::unique_lock lock(_idleMutex);
+                    _runningBackground--;
+                }
+                // A Background task might have waited for this one to end.
+                _idle.notify_one();
+            }
+        }
+    }
+}
+
+// Takes the oldest task of the highest priority, first from the own queues, then from the other workers.
+// Background tasks are only taken while fewer than backgroundLimit() of them run.
+bool BackgroundExecutor::takeTask(int index, Task *task, bool *background) {
+    const int workerCount = _workers.size();
+    const int backgroundPriority = static_cast<int>(Priority::Background);
+    for (int priority = 0; priority < 3; priority++) {
+        if (priority == backgroundPriority) {
+            // Reserve the slot first, so that workers taking tasks at the same time don't exceed the limit.
+            std::unique_lock idleLock(_idleMutex);
+            if (_runningBackground >= backgroundLimit()) {
+                return false;
+            }
+            _runningBackground++;
+        }
+        for (int i = 0; i < workerCount; i++) {
+            Worker &worker = *_workers[(index + i) % workerCount];
+            std::unique_lock lock(worker.mutex);
+            std::deque<Task> &queue = worker.queues[priority];
+            if (!queue.empty()) {
+                *task = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+                std::unique_lock idleLock(_idleMutex);
+                if (priority == backgroundPriority) {
+                    _pendingBackground--;
+                } else {
+                    _pending--;
+                }
+                *background = priority == backgroundPriority;
+                return true;
+            }
+        }
+        if (priority == backgroundPriority) {
+            std::unique_lock idleLock(_idleMutex);
+            _runningBackground--;
+        }
+    }
+    return false;
+}
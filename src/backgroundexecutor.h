@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef BACKGROUNDEXECUTOR_H
+#define BACKGROUNDEXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QFuture>
+#include <QFutureInterface>
+
+
+// Set to cancel all tasks of one owner, usually a document, that have not started yet.
+using CancelToken = std::shared_ptr<std::atomic<bool>>;
+
+// Runs the background work of all editor windows on one set of worker threads. Each worker has a queue
+// per priority, the highest priority task anywhere runs first. Tasks posted from a worker go to its own
+// queue and idle workers steal from the others. Background tasks never occupy all workers, so that
+// visible and interactive work does not wait for long running jobs.
+class BackgroundExecutor {
+public:
+    enum class Priority {
+        // Work needed to show what is visible right now, like syntax highlighting.
+        Visible = 0,
+        // Work the user is waiting for, like search results.
+        Interactive = 1,
+        // Everything else, like long running jobs.
+        Background = 2,
+    };
+
+    // threadCount 0 uses one thread per core.
+    explicit BackgroundExecutor(int threadCount = 0);
+    ~BackgroundExecutor();
+
+public:
+    // The executor shared by the editor. configure() has to be called before its first use to take effect.
+    static BackgroundExecutor *instance();
+    static void configure(int threadCount);
+
+    int threadCount() const;
+    // Number of Background tasks that run at the same time at most, one less than threadCount but at least one.
+    int backgroundLimit() const;
+
+    // task is called with true instead of being run when token is set before the task starts.
+    void post(Priority priority, CancelToken token, std::function<void(bool cancelled)> task);
+
+    // Runs fn and makes its result available through the returned future. The future is cancelled when
+    // token is set before fn starts.
+    template<typename Fn>
+    auto run(Priority priority, CancelToken token, Fn fn) -> QFuture<decltype(fn())>;
+
+private:
+    struct Task {
+        CancelToken token;
+        std::function<void(bool cancelled)> run;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> queues[3];
+        std::thread thread;
+    };
+
+    void workerMain(int index);
+    bool takeTask(int index, Task *task, bool *background);
+
+private:
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<unsigned> _nextWorker{0};
+    // Guards sleeping and waking of idle workers, _pending counts queued Visible and Interactive tasks,
+    // _pendingBackground and _runningBackground the queued and running Background tasks.
+    std::mutex _idleMutex;
+    std::condition_variable _idle;
+    int _pending = 0;
+    int _pendingBackground = 0;
+    int _runningBackground = 0;
+    bool _stop = false;
+};
+
+template<typename Fn>
+auto BackgroundExecutor::run(Priority priority, CancelToken token, Fn fn) -> QFuture<decltype(fn())> {
+    using Result = decltype(fn());
+    auto futureInterface = std::make_shared<QFutureInterface<Result>>();
+    futureInterface->reportStarted();
+    QFuture<Result> future = futureInterface->future();
+    post(priority, std::move(token), [futureInterface, fn=std::move(fn)](bool cancelled) mutable {
+        if (cancelled || futureInterface->isCanceled()) {
+            futureInterface->reportCanceled();
+        } else {
+            futureInterface->reportResult(fn());
+        }
+        futureInterface->reportFinished();
+    });
+    return future;
+}
+
+#endif // BACKGROUNDEXECUTOR_H
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: BSL-1.0
+
+// Sorts the same input with sortLines and with GNU sort and prints the times.
+//
+// sort-benchmark [-n] [-f] [-k FIELD] [--lines N] [FILE]
+//
+// Without FILE random lines are generated. GNU sort runs with LC_ALL=C and -s, which
+// matches the ordering of sortLines for ASCII input.
+
+#include <stdio.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+#include "linesort.h"
+
+int main(int argc, char **argv) {
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption numericOption("n", "Numeric sort.");
+    parser.addOption(numericOption);
+    QCommandLineOption caseOption("f", "Ignore case.");
+    parser.addOption(caseOption);
+    QCommandLineOption fieldOption("k", "Sort by the blank separated field.", "field");
+    parser.addOption(fieldOption);
+    QCommandLineOption linesOption("lines", "Number of random lines to generate.", "lines", "2000000");
+    parser.addOption(linesOption);
+    parser.addPositionalArgument("file", "Input file.");
+    parser.process(app);
+
+    SortOptions options;
+    options.numeric = parser.isSet(numericOption);
+    options.caseInsensitive = parser.isSet(caseOption);
+    options.field = parser.value(fieldOption).toInt();
+
+    QStringList lines;
+    QString inputFile;
+    QTemporaryFile generated;
+    if (parser.positionalArguments().size()) {
+        inputFile = parser.positionalArguments().first();
+        QFile file(inputFile);
+        if (!file.open(QIODevice::ReadOnly)) {
+            fprintf(stderr, "Can't read %s\n", qPrintable(inputFile));
+            return 1;
+        }
+        lines = QString::fromUtf8(file.readAll()).split('\n');
+        if (lines.size() && lines.last().isEmpty()) {
+            lines.removeLast();
+        }
+    } else {
+        QRandomGenerator random(1);
+        const int count = parser.value(linesOption).toInt();
+        for (int i = 0; i < count; i++) {
+            lines.append(QString::number(random.bounded(1000000)) + " "
+                         + QString::number(random.generate64(), 36) + " " + QString::number(i));
+        }
+        if (!generated.open()) {
+            fprintf(stderr, "Can't create temporary file\n");
+            return 1;
+        }
+        generated.write(lines.join('\n').toUtf8() + '\n');
+        generated.flush();
+        inputFile = generated.fileName();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    std::optional<QStringList> result = sortLines(lines, options);
+    const qint64 chrMs = timer.elapsed();
+
+    QStringList gnuArgs = {"-s"};
+    if (options.numeric) {
+        gnuArgs.append("-n");
+    }
+    if (options.caseInsensitive) {
+        gnuArgs.append("-f");
+    }
+    if (options.field > 0) {
+        gnuArgs.append("-k" + QString::number(options.field) + "," + QString::number(options.field));
+    }
+    gnuArgs.append(inputFile);
+
+    QProcess gnuSort;
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("LC_ALL", "C");
+    gnuSort.setProcessEnvironment(env);
+    timer.restart();
+    gnuSort.start("sort", gnuArgs);
+    gnuSort.waitForFinished(-1);
+    const QByteArray gnuOutput = gnuSort.readAllStandardOutput();
+    const qint64 gnuMs = timer.elapsed();
+
+    QTextStream out(stdout);
+    out << lines.size() << " lines\n";
+    out << "sortLines: " << chrMs << " ms\n";
+    if (gnuSort.exitStatus() == QProcess::NormalExit && gnuSort.exitCode() == 0) {
+        out << "GNU sort:  " << gnuMs << " ms (including reading and writing)\n";
+        const bool same = result && (result->join('\n') + '\n').toUtf8() == gnuOutput;
+        out << "output " << (same ? "identical" : "differs") << "\n";
+    } else {
+        out << "GNU sort failed: " << gnuSort.errorString() << "\n";
+    }
+    return 0;
+}
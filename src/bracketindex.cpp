@@ -0,0 +1,414 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "bracketindex.h"
+
+#include <algorithm>
+
+#include "linerevisions.h"
+
+// Lines per block. Keeps the tree small, a search scans at most two blocks of summaries. Blocks grow to
+// twice this size by inserting lines before they are split.
+static const int blockLines = 32;
+
+
+BracketIndex::BracketIndex(QChar open, QChar close) : _open(open), _close(close) {
+}
+
+QChar BracketIndex::open() const {
+    return _open;
+}
+
+QChar BracketIndex::close() const {
+    return _close;
+}
+
+void BracketIndex::invalidate() {
+    _dirty = true;
+}
+
+void BracketIndex::clear() {
+    _blocks = {};
+    _lineCount = 0;
+    _tree = {};
+    _treeLines = {};
+    _leafCount = 0;
+    _dirty = true;
+    _built = false;
+}
+
+bool BracketIndex::isBuilt() const {
+    return _built;
+}
+
+qint64 BracketIndex::memoryUsage() const {
+    qint64 result = _blocks.capacity() * qint64(sizeof(Block)) + _tree.capacity() * qint64(sizeof(Summary))
+            + _treeLines.capacity() * qint64(sizeof(int));
+    for (const Block &block: _blocks) {
+        result += block.revisions.capacity() * qint64(sizeof(unsigned))
+                + block.lines.capacity() * qint64(sizeof(Summary));
+    }
+    return result;
+}
+
+void BracketIndex::sync(int lineCount, const std::function<unsigned(int)> &revision,
+                        const std::function<QString(int)> &text, const QVector<int> &hints, bool compareAll) {
+    if (!_dirty) {
+        return;
+    }
+    _dirty = false;
+    if (!_built) {
+        _built = true;
+        compareAll = true;
+    }
+
+    LineRevisionIndex index;
+    index.lineCount = [this] {
+        return _lineCount;
+    };
+    index.revision = [this] (int line) {
+        int indexInBlock = 0;
+        const int block = blockOf(line, &indexInBlock);
+        return _blocks[block].revisions[indexInBlock];
+    };
+    index.replace = [&] (int first, int removed, int inserted) {
+        replaceLines(first, removed, inserted, revision, text);
+    };
+    syncLineRevisions(index, lineCount, revision, hints, compareAll);
+}
+
+bool BracketIndex::findMatch(int line, int codeUnit, const std::function<QString(int)> &text,
+                             int *matchLine, int *matchCodeUnit) const {
+    if (line < 0 || line >= _lineCount) {
+        return false;
+    }
+
+    const QString lineText = text(line);
+    if (codeUnit < 0 || codeUnit >= lineText.size()) {
+        return false;
+    }
+
+    if (lineText[codeUnit] == _open) {
+        int depth = 1;
+        for (int i = codeUnit + 1; i < lineText.size(); i++) {
+            if (lineText[i] == _open) {
+                depth++;
+            } else if (lineText[i] == _close && --depth == 0) {
+                *matchLine = line;
+                *matchCodeUnit = i;
+                return true;
+            }
+        }
+        const int found = findForward(line + 1, &depth);
+        if (found < 0) {
+            return false;
+        }
+        const QString foundText = text(found);
+        for (int i = 0; i < foundText.size(); i++) {
+            if (foundText[i] == _open) {
+                depth++;
+            } else if (foundText[i] == _close && --depth == 0) {
+                *matchLine = found;
+                *matchCodeUnit = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (lineText[codeUnit] == _close) {
+        int depth = 1;
+        for (int i = codeUnit - 1; i >= 0; i--) {
+            if (lineText[i] == _close) {
+                depth++;
+            } else if (lineText[i] == _open && --depth == 0) {
+                *matchLine = line;
+                *matchCodeUnit = i;
+                return true;
+            }
+        }
+        const int found = findBackward(line - 1, &depth);
+        if (found < 0) {
+            return false;
+        }
+        const QString foundText = text(found);
+        for (int i = foundText.size() - 1; i >= 0; i--) {
+            if (foundText[i] == _close) {
+                depth++;
+            } else if (foundText[i] == _open && --depth == 0) {
+                *matchLine = found;
+                *matchCodeUnit = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    return false;
+}
+
+BracketIndex::Summary BracketIndex::combine(const Summary &left, const Summary &right) {
+    const int matched = std::min(left.opens, right.closes);
+    Summary result;
+    result.closes = left.closes + right.closes - matched;
+    result.opens = left.opens - matched + right.opens;
+    return result;
+}
+
+BracketIndex::Summary BracketIndex::summarize(const QString &text) const {
+    Summary result;
+    for (const QChar ch: text) {
+        if (ch == _open) {
+            result.opens++;
+        } else if (ch == _close) {
+            if (result.opens > 0) {
+                result.opens--;
+            } else {
+                result.closes++;
+            }
+        }
+    }
+    return result;
+}
+
+void BracketIndex::replaceLines(int first, int removed, int inserted, const std::function<unsigned(int)> &revision,
+                                const std::function<QString(int)> &text) {
+    QVector<unsigned> revisions(inserted);
+    QVector<Summary> lines(inserted);
+    for (int i = 0; i < inserted; i++) {
+        revisions[i] = revision(first + i);
+        lines[i] = summarize(text(first + i));
+    }
+
+    if (removed == inserted) {
+        for (int i = 0; i < inserted;) {
+            int indexInBlock = 0;
+            const int block = blockOf(first + i, &indexInBlock);
+            Block &b = _blocks[block];
+            for (; i < inserted && indexInBlock < b.lines.size(); i++, indexInBlock++) {
+                b.revisions[indexInBlock] = revisions[i];
+                b.lines[indexInBlock] = lines[i];
+            }
+            updateBlock(block);
+        }
+        return;
+    }
+
+    // The blocks holding the removed lines, or the block to insert into.
+    int firstBlock = 0;
+    int firstIndex = 0;
+    int endBlock = 0;
+    int lastEnd = 0;
+    if (!_blocks.isEmpty()) {
+        if (first == _lineCount) {
+            firstBlock = _blocks.size() - 1;
+            firstIndex = _blocks[firstBlock].lines.size();
+        } else {
+            firstBlock = blockOf(first, &firstIndex);
+        }
+        if (removed == 0) {
+            endBlock = firstBlock + 1;
+            lastEnd = firstIndex;
+        } else {
+            endBlock = blockOf(first + removed - 1, &lastEnd) + 1;
+            lastEnd++;
+        }
+    }
+    _lineCount += inserted - removed;
+
+    if (endBlock == firstBlock + 1) {
+        Block &block = _blocks[firstBlock];
+        const int size = block.lines.size() - removed + inserted;
+        if (size > 0 && size <= 2 * blockLines) {
+            // Stays within its block, the tree only changes along the path of that block.
+            block.revisions.remove(firstIndex, removed);
+            block.revisions.insert(firstIndex, inserted, 0);
+            std::copy(revisions.begin(), revisions.end(), block.revisions.begin() + firstIndex);
+            block.lines.remove(firstIndex, removed);
+            block.lines.insert(firstIndex, inserted, Summary());
+            std::copy(lines.begin(), lines.end(), block.lines.begin() + firstIndex);
+            updateBlock(firstBlock);
+            return;
+        }
+    }
+
+    // Split the lines of the affected blocks into new blocks and rebuild the tree over the blocks.
+    if (endBlock > firstBlock) {
+        const Block &head = _blocks[firstBlock];
+        const Block &tail = _blocks[endBlock - 1];
+        revisions = head.revisions.mid(0, firstIndex) + revisions + tail.revisions.mid(lastEnd);
+        lines = head.lines.mid(0, firstIndex) + lines + tail.lines.mid(lastEnd);
+    }
+    QVector<Block> blocks = _blocks.mid(0, firstBlock);
+    const int parts = (lines.size() + blockLines - 1) / blockLines;
+    for (int part = 0; part < parts; part++) {
+        const int start = static_cast<qint64>(lines.size()) * part / parts;
+        const int end = static_cast<qint64>(lines.size()) * (part + 1) / parts;
+        Block block;
+        block.revisions = revisions.mid(start, end - start);
+        block.lines = lines.mid(start, end - start);
+        blocks.append(block);
+    }
+    blocks += _blocks.mid(endBlock);
+    _blocks = blocks;
+    rebuild();
+}
+
+int BracketIndex::blockOf(int line, int *indexInBlock) const {
+    int node = 1;
+    while (node < _leafCount) {
+        node *= 2;
+        if (line >= _treeLines[node]) {
+            line -= _treeLines[node];
+            node++;
+        }
+    }
+    *indexInBlock = line;
+    return node - _leafCount;
+}
+
+int BracketIndex::linesBefore(int block) const {
+    int lines = 0;
+    for (int node = _leafCount + block; node > 1; node /= 2) {
+        if (node & 1) {
+            lines += _treeLines[node - 1];
+        }
+    }
+    return lines;
+}
+
+void BracketIndex::updateBlock(int block) {
+    Summary summary;
+    for (const Summary &line: _blocks[block].lines) {
+        summary = combine(summary, line);
+    }
+    int node = _leafCount + block;
+    _tree[node] = summary;
+    _treeLines[node] = _blocks[block].lines.size();
+    for (node /= 2; node > 0; node /= 2) {
+        _tree[node] = combine(_tree[2 * node], _tree[2 * node + 1]);
+        _treeLines[node] = _treeLines[2 * node] + _treeLines[2 * node + 1];
+    }
+}
+
+void BracketIndex::rebuild() {
+    const int blocks = _blocks.size();
+    _leafCount = 1;
+    while (_leafCount < blocks) {
+        _leafCount *= 2;
+    }
+    _tree = QVector<Summary>(2 * _leafCount);
+    _treeLines = QVector<int>(2 * _leafCount, 0);
+    for (int block = 0; block < blocks; block++) {
+        Summary summary;
+        for (const Summary &line: _blocks[block].lines) {
+            summary = combine(summary, line);
+        }
+        _tree[_leafCount + block] = summary;
+        _treeLines[_leafCount + block] = _blocks[block].lines.size();
+    }
+    for (int node = _leafCount - 1; node > 0; node--) {
+        _tree[node] = combine(_tree[2 * node], _tree[2 * node + 1]);
+        _treeLines[node] = _treeLines[2 * node] + _treeLines[2 * node + 1];
+    }
+}
+
+// Returns the first line at or after firstLine in which one of the *depth open brackets is closed and
+// sets *depth to the number still open at the start of that line, or returns -1.
+int BracketIndex::findForward(int firstLine, int *depth) const {
+    auto scanBlock = [&](int block, int from) {
+        const QVector<Summary> &lines = _blocks[block].lines;
+        for (int i = from; i < lines.size(); i++) {
+            if (lines[i].closes >= *depth) {
+                return linesBefore(block) + i;
+            }
+            *depth += lines[i].opens - lines[i].closes;
+        }
+        return -1;
+    };
+
+    if (firstLine >= _lineCount) {
+        return -1;
+    }
+    int firstIndex = 0;
+    const int firstBlock = blockOf(firstLine, &firstIndex);
+    const int found = scanBlock(firstBlock, firstIndex);
+    if (found >= 0) {
+        return found;
+    }
+
+    // Walk up from the leaf, passing over right siblings whose unmatched closes do not reach the depth.
+    int node = _leafCount + firstBlock;
+    while (true) {
+        while (node > 1 && (node & 1)) {
+            node /= 2;
+        }
+        if (node <= 1) {
+            return -1;
+        }
+        node++;
+        if (_tree[node].closes >= *depth) {
+            break;
+        }
+        *depth += _tree[node].opens - _tree[node].closes;
+    }
+    // Descend to the leftmost block that reaches the depth.
+    while (node < _leafCount) {
+        node *= 2;
+        if (_tree[node].closes < *depth) {
+            *depth += _tree[node].opens - _tree[node].closes;
+            node++;
+        }
+    }
+    return scanBlock(node - _leafCount, 0);
+}
+
+// Returns the last line at or before lastLine in which one of the *depth close brackets is opened and
+// sets *depth to the number still unmatched at the end of that line, or returns -1.
+int BracketIndex::findBackward(int lastLine, int *depth) const {
+    auto scanBlock = [&](int block, int from) {
+        const QVector<Summary> &lines = _blocks[block].lines;
+        for (int i = from; i >= 0; i--) {
+            if (lines[i].opens >= *depth) {
+                return linesBefore(block) + i;
+            }
+            *depth += lines[i].closes - lines[i].opens;
+        }
+        return -1;
+    };
+
+    if (lastLine < 0) {
+        return -1;
+    }
+    int lastIndex = 0;
+    const int lastBlock = blockOf(lastLine, &lastIndex);
+    const int found = scanBlock(lastBlock, lastIndex);
+    if (found >= 0) {
+        return found;
+    }
+
+    // Walk up from the leaf, passing over left siblings whose unmatched opens do not reach the depth.
+    int node = _leafCount + lastBlock;
+    while (true) {
+        while (node > 1 && !(node & 1)) {
+            node /= 2;
+        }
+        if (node <= 1) {
+            return -1;
+        }
+        node--;
+        if (_tree[node].opens >= *depth) {
+            break;
+        }
+        *depth += _tree[node].closes - _tree[node].opens;
+    }
+    // Descend to the rightmost block that reaches the depth.
+    while (node < _leafCount) {
+        node = 2 * node + 1;
+        if (_tree[node].opens < *depth) {
+            *depth += _tree[node].closes - _tree[node].opens;
+            node--;
+        }
+    }
+    const int block = node - _leafCount;
+    return scanBlock(block, _blocks[block].lines.size() - 1);
+}
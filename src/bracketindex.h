@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef BRACKETINDEX_H
+#define BRACKETINDEX_H
+
+#include <functional>
+
+#include <QChar>
+#include <QString>
+#include <QVector>
+
+
+// Finds the matching bracket of one bracket pair in a document of lines. Keeps the unmatched brackets
+// of each line in blocks of lines and a segment tree over the blocks, so that only the lines containing
+// the bracket and its match are scanned. Lines are only rescanned when their revision changes, and
+// inserting or removing lines only touches their block unless it has to be split or dropped.
+class BracketIndex {
+public:
+    BracketIndex(QChar open, QChar close);
+
+public:
+    QChar open() const;
+    QChar close() const;
+
+    // Marks the index as possibly outdated, the next sync compares line revisions.
+    void invalidate();
+    // Frees everything, the next sync scans all lines again.
+    void clear();
+    // False after clear until the next sync.
+    bool isBuilt() const;
+    qint64 memoryUsage() const;
+    // Changed lines are looked for around the hint lines, see syncLineRevisions. With compareAll, or when
+    // the line count differs after that, the revisions of all lines are compared.
+    void sync(int lineCount, const std::function<unsigned(int)> &revision, const std::function<QString(int)> &text,
+              const QVector<int> &hints = {}, bool compareAll = true);
+
+    // Position of the bracket matching the bracket at codeUnit in line. Returns false if there is none.
+    // text must return the same lines as for the last sync.
+    bool findMatch(int line, int codeUnit, const std::function<QString(int)> &text,
+                   int *matchLine, int *matchCodeUnit) const;
+
+private:
+    // Brackets of a range that are not matched within the range.
+    struct Summary {
+        int closes = 0;
+        int opens = 0;
+    };
+
+    struct Block {
+        QVector<unsigned> revisions;
+        QVector<Summary> lines;
+    };
+
+    static Summary combine(const Summary &left, const Summary &right);
+    Summary summarize(const QString &text) const;
+    void replaceLines(int first, int removed, int inserted, const std::function<unsigned(int)> &revision,
+                      const std::function<QString(int)> &text);
+    // Block of the line and the index of the line in it, line must be below _lineCount.
+    int blockOf(int line, int *indexInBlock) const;
+    int linesBefore(int block) const;
+    void updateBlock(int block);
+    void rebuild();
+    int findForward(int firstLine, int *depth) const;
+    int findBackward(int lastLine, int *depth) const;
+
+private:
+    QChar _open;
+    QChar _close;
+    bool _dirty = true;
+    bool _built = false;
+    QVector<Block> _blocks;
+    int _lineCount = 0;
+    // Segment tree over the blocks with their summaries and line counts, the leaves start at _leafCount.
+    QVector<Summary> _tree;
+    QVector<int> _treeLines;
+    int _leafCount = 0;
+};
+
+#endif // BRACKETINDEX_H
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "columnmap.h"
+
+#include <algorithm>
+
+static const int maxCacheEntries = 64 * 1024;
+
+static int nextTabStop(int column, int tabStopDistance) {
+    return (column / tabStopDistance + 1) * tabStopDistance;
+}
+
+// Printable ASCII takes one column and tabs extend to the next tab stop. Clusters and widths of
+// everything else depend on the terminal.
+static bool isSimple(QChar ch) {
+    return ch == '\t' || (ch.unicode() >= 0x20 && ch.unicode() < 0x7f);
+}
+
+bool columnPositionWithoutLayout(const QString &line, int column, int tabStopDistance, ColumnPosition *result) {
+    tabStopDistance = std::max(1, tabStopDistance);
+
+    int x = 0;
+    int codeUnit = -1;
+    for (int i = 0; i < line.size(); i++) {
+        const QChar ch = line[i];
+        if (!isSimple(ch)) {
+            return false;
+        }
+        if (codeUnit == -1 && x >= column) {
+            if (x != column) {
+                // inside of a tab
+                return false;
+            }
+            codeUnit = i;
+        }
+        x = ch == '\t' ? nextTabStop(x, tabStopDistance) : x + 1;
+    }
+    if (codeUnit == -1) {
+        if (x > column) {
+            return false;
+        }
+        codeUnit = line.size();
+    }
+
+    result->codeUnit = codeUnit;
+    result->width = x;
+    result->simple = true;
+    return true;
+}
+
+bool columnOfCodeUnitWithoutLayout(const QString &line, int codeUnit, int tabStopDistance, int *column) {
+    tabStopDistance = std::max(1, tabStopDistance);
+
+    int x = 0;
+    for (int i = 0; i < line.size(); i++) {
+        const QChar ch = line[i];
+        if (!isSimple(ch)) {
+            return false;
+        }
+        if (i < codeUnit) {
+            x = ch == '\t' ? nextTabStop(x, tabStopDistance) : x + 1;
+        }
+    }
+    *column = x;
+    return true;
+}
+
+
+std::optional<ColumnPosition> ColumnLayoutCache::find(const QString &line, int column, int tabStopDistance) const {
+    auto it = _entries.constFind(Key{line, column, tabStopDistance});
+    if (it == _entries.constEnd()) {
+        return std::nullopt;
+    }
+    return *it;
+}
+
+void ColumnLayoutCache::insert(const QString &line, int column, int tabStopDistance, ColumnPosition position) {
+    if (_entries.size() >= maxCacheEntries) {
+        _entries.clear();
+    }
+    _entries.insert(Key{line, column, tabStopDistance}, position);
+}
+
+void ColumnLayoutCache::clear() {
+    _entries.clear();
+}
+
+qint64 ColumnLayoutCache::memoryUsage() const {
+    // Hash nodes carry a next pointer and the hash value besides key and value.
+    return _entries.size() * qint64(sizeof(Key) + sizeof(ColumnPosition) + sizeof(void*) + sizeof(uint));
+}
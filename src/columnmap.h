@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef COLUMNMAP_H
+#define COLUMNMAP_H
+
+#include <optional>
+
+#include <QHash>
+#include <QString>
+
+
+// Where a display column falls in a line that is laid out without wrapping.
+struct ColumnPosition {
+    // The code unit xToCursor of the text layout returns for the column.
+    int codeUnit = 0;
+    // Width of the whole line in columns.
+    int width = 0;
+    // The line only contains printable ASCII and tabs, so every code unit is a cursor position.
+    bool simple = false;
+};
+
+// Maps a column in a line of printable ASCII and tabs without a text layout. Returns false for other lines
+// and if the column is in the middle of a tab, those are left to the text layout.
+bool columnPositionWithoutLayout(const QString &line, int column, int tabStopDistance, ColumnPosition *result);
+
+// Leading column of a code unit in a line of printable ASCII and tabs. Returns false for other lines.
+bool columnOfCodeUnitWithoutLayout(const QString &line, int codeUnit, int tabStopDistance, int *column);
+
+
+// Results for lines that needed the text layout. Entries are keyed by the text of the line, so edited
+// lines just miss. Bounded by discarding everything when full.
+class ColumnLayoutCache {
+public:
+    std::optional<ColumnPosition> find(const QString &line, int column, int tabStopDistance) const;
+    void insert(const QString &line, int column, int tabStopDistance, ColumnPosition position);
+    void clear();
+    // The text of the lines is shared with the document and not counted.
+    qint64 memoryUsage() const;
+
+private:
+    struct Key {
+        QString line;
+        int column;
+        int tabStopDistance;
+
+        bool operator==(const Key &other) const {
+            return column == other.column && tabStopDistance == other.tabStopDistance && line == other.line;
+        }
+        friend uint qHash(const Key &key, uint seed = 0) {
+            return qHash(key.line, seed) ^ (uint(key.column) * 31u + uint(key.tabStopDistance));
+        }
+    };
+
+    QHash<Key, ColumnPosition> _entries;
+};
+
+#endif // COLUMNMAP_H
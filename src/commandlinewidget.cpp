@@ -14,19 +14,25 @@ CommandLineWidget::CommandLineWidget(Tui::v0::ZWidget *parent) : Tui::ZWidget(pa
     setMaximumSize(Tui::tuiMaxSize, 1);
     setSizePolicyH(Tui::SizePolicy::Expanding);
     setSizePolicyV(Tui::SizePolicy::Fixed);
+}
 
-    cmdEntry.setParent(this);
-    auto pal = cmdEntry.palette();
-    pal.setColors({
-        { "lineedit.focused.bg", Tui::Colors::black},
-        { "lineedit.focused.fg", Tui::Colors::lightGray},
-        { "lineedit.bg", Tui::Colors::black},
-        { "lineedit.fg", Tui::Colors::lightGray}});
-    cmdEntry.setPalette(pal);
+Tui::ZInputBox *CommandLineWidget::entry() {
+    if (!_cmdEntry) {
+        _cmdEntry = new Tui::ZInputBox(this);
+        auto pal = _cmdEntry->palette();
+        pal.setColors({
+            { "lineedit.focused.bg", Tui::Colors::black},
+            { "lineedit.focused.fg", Tui::Colors::lightGray},
+            { "lineedit.bg", Tui::Colors::black},
+            { "lineedit.fg", Tui::Colors::lightGray}});
+        _cmdEntry->setPalette(pal);
+        _cmdEntry->setGeometry({2, 0, geometry().width() - 2, 1});
+    }
+    return _cmdEntry;
 }
 
 void CommandLineWidget::setCmdEntryText(QString text) {
-    cmdEntry.setText(text);
+    entry()->setText(text);
 }
 
 QSize CommandLineWidget::sizeHint() const {
@@ -45,23 +51,25 @@ void CommandLineWidget::paintEvent(Tui::ZPaintEvent *event) {
 void CommandLineWidget::keyEvent(Tui::ZKeyEvent *event) {
     if (event->key() == Qt::Key_Escape) {
         releaseKeyboard();
-        cmdEntry.setText("");
+        entry()->setText("");
         dismissed();
     } else if (event->key() == Qt::Key_Enter && event->modifiers() == 0) {
         releaseKeyboard();
-        QString cmd = cmdEntry.text();
-        cmdEntry.setText("");
+        QString cmd = entry()->text();
+        entry()->setText("");
         execute(cmd);
     } else {
-        cmdEntry.event(event);
+        entry()->event(event);
     }
 }
 
 void CommandLineWidget::pasteEvent(Tui::ZPasteEvent *event) {
-    cmdEntry.event(event);
+    entry()->event(event);
 }
 
 void CommandLineWidget::resizeEvent(Tui::ZResizeEvent *event) {
-    cmdEntry.setGeometry({2, 0, event->size().width() - 2, 1});
+    if (_cmdEntry) {
+        _cmdEntry->setGeometry({2, 0, event->size().width() - 2, 1});
+    }
     ZWidget::resizeEvent(event);
 }
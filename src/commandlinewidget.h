@@ -28,7 +28,11 @@ protected:
     void resizeEvent(Tui::ZResizeEvent *event) override;
 
 private:
-    Tui::ZInputBox cmdEntry;
+    Tui::ZInputBox *entry();
+
+private:
+    // created on first use, most sessions never open the command line
+    Tui::ZInputBox *_cmdEntry = nullptr;
 };
 
 #endif // COMMANDLINEWIDGET_H
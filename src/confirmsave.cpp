@@ -31,6 +31,11 @@ ConfirmSave::ConfirmSave(Tui::ZWidget *parent, QString filename, Type type, bool
         // `save` is not used in this mode
         save = "";
         mainLabel = "Discard changes to \"" + filename + "\"?";
+    } else if (type == Recover) {
+        title = "Recover";
+        nosave = "Discard";
+        save = "Recover";
+        mainLabel = "Recover unsaved changes to \"" + filename + "\"?";
     } else if (type == QuitUnnamed) {
         title = "Exit";
         nosave = "Quit";
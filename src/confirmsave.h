@@ -9,7 +9,7 @@
 class ConfirmSave : public Tui::ZDialog
 {
 public:
-    enum Type { Reload, Close, CloseUnnamed, Quit, QuitUnnamed };
+    enum Type { Reload, Close, CloseUnnamed, Quit, QuitUnnamed, Recover };
     Q_OBJECT
 public:
     explicit ConfirmSave(Tui::ZWidget *parent, QString filename, Type type, bool saveable);
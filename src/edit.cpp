@@ -16,11 +16,17 @@
 #include <Tui/ZVBoxLayout.h>
 
 #include "aboutdialog.h"
+#include "alert.h"
 #include "confirmsave.h"
+#include "filecategorize.h"
+#include "filelistparser.h"
 #include "formattingdialog.h"
 #include "gotoline.h"
 #include "insertcharacter.h"
+#include "memorybudget.h"
 #include "opendialog.h"
+#include "sortdialog.h"
+#include "startuptiming.h"
 
 
 Editor::Editor() {
@@ -71,7 +77,9 @@ void Editor::setupUi() {
                             {},
                             { "<m>G</m>oto Line", "Ctrl-G", "Gotoline", {}},
                             {},
-                            { "Sort Selcted Lines", "Alt-Shift-S", "SortSelectedLines", {}}
+                            { "Sort Selcted Lines", "Alt-Shift-S", "SortSelectedLines", {}},
+                            { "Sort Lines...", "", "SortLines", {}},
+                            { "Strip Trailing Whitespace", "", "StripTrailingWhitespace", {}}
                         }
                       },
                       { "<m>O</m>ptions", "", {}, {
@@ -167,6 +175,23 @@ void Editor::setupUi() {
         }
     });
 
+    _cmdSortLines = new Tui::ZCommandNotifier("SortLines", this);
+    QObject::connect(_cmdSortLines, &Tui::ZCommandNotifier::activated, this, [this] {
+        SortDialog *sortDialog = new SortDialog(this);
+        QObject::connect(sortDialog, &SortDialog::sortRequested, this, [this] (SortOptions options) {
+            if (_file) {
+                _file->sortSelectedLines(options);
+            }
+        });
+    });
+
+    _cmdStripTrailingWhitespace = new Tui::ZCommandNotifier("StripTrailingWhitespace", this);
+    QObject::connect(_cmdStripTrailingWhitespace, &Tui::ZCommandNotifier::activated, this, [this] {
+        if (_file) {
+            _file->stripTrailingWhitespace();
+        }
+    });
+
     //Options
     _cmdTab = new Tui::ZCommandNotifier("Tab", this);
     QObject::connect(_cmdTab, &Tui::ZCommandNotifier::activated, this, [this] {
@@ -181,9 +206,7 @@ void Editor::setupUi() {
                 }
                 QObject::connect(_tabDialog, &TabDialog::convert, this, [this] (bool useTabs, int indentSize) {
                     if (_file) {
-                        _file->setUseTabChar(useTabs);
-                        _file->setTabStopDistance(indentSize);
-                        _file->convertTabsToSpaces();
+                        _file->convertIndentation(useTabs, indentSize);
                     }
                 });
                 QObject::connect(_tabDialog, &TabDialog::settingsChanged, this, [this] (bool useTabs, int indentSize, bool eatSpaceBeforeTabs) {
@@ -247,8 +270,11 @@ void Editor::setupUi() {
                 _syntaxHighlightDialog = new SyntaxHighlightDialog(this);
                 QObject::connect(_syntaxHighlightDialog, &SyntaxHighlightDialog::settingsChanged, this, [this] (bool enable, QString lang) {
                     if (_file) {
-                        _file->setSyntaxHighlightingActive(enable);
-                        _file->setSyntaxHighlightingLanguage(lang);
+                        // The highlighting is stored in the document, so all its views use the same.
+                        for (File *view: _file->views()) {
+                            view->setSyntaxHighlightingActive(enable);
+                            view->setSyntaxHighlightingLanguage(lang);
+                        }
                     }
                 });
             }
@@ -308,7 +334,10 @@ void Editor::setupUi() {
         }
     );
 
-    ensureWindowCommands(24);
+    _cmdSplitWindow = new Tui::ZCommandNotifier("SplitWindow", this);
+    QObject::connect(_cmdSplitWindow, &Tui::ZCommandNotifier::activated, this, &Editor::splitWindow);
+
+    // Window switching commands are created in createFileWindow as windows are added.
 
     enableFileCommands(false);
 
@@ -346,6 +375,9 @@ void Editor::setupUi() {
 
     _statusBar = new StatusBar(this);
 
+    _fileLoader = new FileLoader(this);
+    _fileSaver = new FileSaver(this);
+
     Tui::ZVBoxLayout *rootLayout = new Tui::ZVBoxLayout();
     setLayout(rootLayout);
     rootLayout->addWidget(menu);
@@ -376,6 +408,8 @@ void Editor::terminalChanged() {
                 }
             }
             _mux.selectInput(_win);
+            _win->materialize();
+            _fileLoader->prioritize(_win);
         }
     });
 
@@ -403,15 +437,16 @@ void Editor::terminalChanged() {
         _pendingKeySequence->setGeometry({{0,0}, _pendingKeySequence->sizeHint()});
         _pendingKeySequence->setDefaultPlacement(Qt::AlignCenter);
     });
-    setupSearchDialogs();
+    startupTimingMark("editor ui created");
 
     for (auto &action: _startActions) {
         action();
     }
+    startupTimingMark("start actions done");
 }
 
-FileWindow *Editor::createFileWindow() {
-    FileWindow *win = new FileWindow(this);
+FileWindow *Editor::createFileWindow(FileWindow *splitOf) {
+    FileWindow *win = new FileWindow(this, splitOf);
     File *file = win->getFileWidget();
 
     _mux.connect(win, file, &File::cursorPositionChanged, _statusBar, &StatusBar::cursorPosition, 0, 0, 0, 0);
@@ -430,6 +465,11 @@ FileWindow *Editor::createFileWindow() {
     _mux.connect(win, win, &FileWindow::fileChangedExternally, _statusBar, &StatusBar::fileHasBeenChangedExternally, false);
     _mux.connect(win, file, &File::syntaxHighlightingEnabledChanged, _statusBar, &StatusBar::syntaxHighlightingEnabled, false);
     _mux.connect(win, file, &File::syntaxHighlightingLanguageChanged, _statusBar, &StatusBar::language, QString());
+    _mux.connect(win, win, &FileWindow::saveProgress, _statusBar, &StatusBar::saveProgress, -1);
+    _mux.connect(win, file, &File::jobProgress, _statusBar, &StatusBar::jobProgress, QString(), -1);
+
+    win->setFileSaver(_fileSaver);
+    win->setFileLoader(_fileLoader);
 
     _allWindows.append(win);
     ensureWindowCommands(_allWindows.size());
@@ -449,7 +489,11 @@ FileWindow *Editor::createFileWindow() {
             }
         }
         if (filename.size()) {
-            Q_ASSERT(!_nameToWindow.contains(filename));
+            // Other views of the document had the old name, one window per name is enough.
+            if (_nameToWindow.contains(filename)) {
+                Q_ASSERT(_nameToWindow.value(filename)->getFileWidget()->document() == win->getFileWidget()->document());
+                return;
+            }
             _nameToWindow[filename] = win;
         }
     });
@@ -461,7 +505,19 @@ FileWindow *Editor::createFileWindow() {
         while (iter.hasNext()) {
             iter.next();
             if (iter.value() == win) {
-                iter.remove();
+                // Another view of the same document takes over the name.
+                FileWindow *otherView = nullptr;
+                for (FileWindow *other: _allWindows) {
+                    if (other != win && other->getFileWidget()->getFilename() == iter.key()) {
+                        otherView = other;
+                        break;
+                    }
+                }
+                if (otherView) {
+                    iter.setValue(otherView);
+                } else {
+                    iter.remove();
+                }
                 break;
             }
         }
@@ -489,6 +545,11 @@ FileWindow *Editor::createFileWindow() {
         file->setAttributesFile(_file->attributesFile());
         file->setSyntaxHighlightingTheme(_initialFileSettings.syntaxHighlightingTheme);
         file->setSyntaxHighlightingActive(_file->syntaxHighlightingActive());
+        file->setSyncOnSave(_file->syncOnSave());
+        file->setStripTrailingWhitespaceOnSave(_file->stripTrailingWhitespaceOnSave());
+        file->setSortMemoryLimit(_file->sortMemoryLimit());
+        file->setUndoMemoryLimit(_file->undoMemoryLimit());
+        file->setJournalDirectory(_file->journalDirectory());
     } else {
         file->setTabStopDistance(_initialFileSettings.tabSize);
         file->setShowLineNumbers(_initialFileSettings.showLineNumber);
@@ -503,6 +564,11 @@ FileWindow *Editor::createFileWindow() {
         file->setAttributesFile(_initialFileSettings.attributesFile);
         file->setSyntaxHighlightingTheme(_initialFileSettings.syntaxHighlightingTheme);
         file->setSyntaxHighlightingActive(!_initialFileSettings.disableSyntaxHighlighting);
+        file->setSyncOnSave(_initialFileSettings.syncOnSave);
+        file->setStripTrailingWhitespaceOnSave(_initialFileSettings.stripTrailingWhitespaceOnSave);
+        file->setSortMemoryLimit(_initialFileSettings.sortMemoryLimit);
+        file->setUndoMemoryLimit(_initialFileSettings.undoMemoryLimit);
+        file->setJournalDirectory(_initialFileSettings.journalDirectory);
     }
 
     return win;
@@ -515,6 +581,7 @@ QVector<Tui::ZMenuItem> Editor::createWindowMenu() {
         {"Tile <m>V</m>ertically", "", "TileVert", {}},
         {"Tile <m>H</m>orizontally", "", "TileHorz", {}},
         {"Tile <m>F</m>ullscreen", "", "TileFull", {}},
+        {"<m>S</m>plit", "", "SplitWindow", {}},
     };
 
     if (_allWindows.size()) {
@@ -538,7 +605,11 @@ QVector<Tui::ZMenuItem> Editor::createWindowMenu() {
     return subitems;
 }
 
-void Editor::setupSearchDialogs() {
+void Editor::ensureSearchDialogs() {
+    if (_searchDialog) {
+        return;
+    }
+
     auto searchCancled = [this] {
         if (_file) {
             _file->setSearchText("");
@@ -634,6 +705,16 @@ void Editor::setupSearchDialogs() {
     });
     QObject::connect(_replaceDialog, &SearchDialog::searchReplaceAll, this, [this] (QString text, QString replacement) {
         if (_file) {
+            if (_file->matchesEmptyText(text)) {
+                Alert *e = new Alert(this);
+                e->setWindowTitle("Replace All");
+                e->setMarkup("Regex matches empty text, nothing replaced.");
+                e->setGeometry({15, 5, 50, 5});
+                e->setDefaultPlacement(Qt::AlignCenter);
+                e->setVisible(true);
+                e->setFocus();
+                return;
+            }
             _file->replaceAll(text, replacement);
         }
     });
@@ -670,6 +751,8 @@ void Editor::enableFileCommands(bool enable) {
     _cmdInsertCharacter->setEnabled(enable);
     _cmdGotoLine->setEnabled(enable);
     _cmdSortSelectedLines->setEnabled(enable);
+    _cmdSortLines->setEnabled(enable);
+    _cmdStripTrailingWhitespace->setEnabled(enable);
     _cmdTab->setEnabled(enable);
     _cmdLineNumbers->setEnabled(enable);
     //_cmdFormatting->setEnabled(enable);
@@ -680,21 +763,24 @@ void Editor::enableFileCommands(bool enable) {
     _cmdTileVert->setEnabled(enable);
     _cmdTileHorz->setEnabled(enable);
     _cmdTileFull->setEnabled(enable);
+    _cmdSplitWindow->setEnabled(enable);
     _cmdSearch->setEnabled(enable);
     _cmdReplace->setEnabled(enable);
 }
 
 void Editor::searchDialog() {
     if (_file) {
+        ensureSearchDialogs();
         _searchDialog->open();
         _searchDialog->setSearchText(_file->selectedText());
     }
 }
 
 void Editor::replaceDialog() {
-    if (_replaceDialog) {
+    if (_file) {
+        ensureSearchDialogs();
         _replaceDialog->open();
-       _replaceDialog->setSearchText(_file->selectedText());
+        _replaceDialog->setSearchText(_file->selectedText());
     }
 }
 
@@ -708,6 +794,27 @@ FileWindow *Editor::newFile(QString filename) {
     return win;
 }
 
+void Editor::splitWindow() {
+    if (!_win || _file->isLoading()) {
+        return;
+    }
+    File *source = _file;
+    FileWindow *win = createFileWindow(_win);
+    File *file = win->getFileWidget();
+    file->setSaveAs(source->isSaveAs());
+    file->setSyntaxHighlightingLanguage(source->syntaxHighlightingLanguage());
+    // Starts where the source view is, from there both move independently.
+    file->setTextCursor(source->textCursor());
+    file->setScrollPosition(source->scrollPositionColumn(), source->scrollPositionLine(),
+                            source->scrollPositionFineLine());
+    if (_mdiLayout->mode() == MdiLayout::LayoutMode::Base) {
+        // Split views are only useful side by side.
+        _mdiLayout->setMode(MdiLayout::LayoutMode::TileV);
+    }
+    _mdiLayout->addWindow(win);
+    file->setFocus();
+}
+
 void Editor::openFileMenu() {
     if (_file) {
         openFileDialog(_file->getFilename());
@@ -746,7 +853,8 @@ FileWindow* Editor::openFile(QString fileName) {
         return _nameToWindow.value(absFileName);
     }
 
-    if (_win && !_win->getFileWidget()->isModified() && _win->getFileWidget()->getFilename() == "NEWFILE") {
+    if (_win && !_win->getFileWidget()->isModified() && _win->getFileWidget()->getFilename() == "NEWFILE"
+            && _win->getFileWidget()->views().size() == 1) {
         _win->openFile(fileName);
         return _win;
     } else {
@@ -758,6 +866,54 @@ FileWindow* Editor::openFile(QString fileName) {
     }
 }
 
+FileWindow* Editor::openFileInBackground(QString fileName) {
+    QFileInfo filenameInfo(fileName);
+    QString absFileName = filenameInfo.absoluteFilePath();
+    if (_nameToWindow.contains(absFileName)) {
+        _nameToWindow.value(absFileName)->getFileWidget()->setFocus();
+        return _nameToWindow.value(absFileName);
+    }
+
+    FileWindow *win = _win;
+    if (!_win || _win->getFileWidget()->isModified() || _win->getFileWidget()->getFilename() != "NEWFILE"
+            || _win->getFileWidget()->views().size() > 1) {
+        win = createFileWindow();
+        _mdiLayout->addWindow(win);
+        win->getFileWidget()->setFocus();
+    }
+    win->openFileInBackground(absFileName, _fileLoader);
+    return win;
+}
+
+QString Editor::openRemoteFileList(QStringList args) {
+    QVector<FileListEntry> fles = parseFileList(args);
+    if (fles.empty()) {
+        return "Got file offset without file name.";
+    }
+
+    const QString error = checkFileList(fles);
+    if (!error.isEmpty()) {
+        return error;
+    }
+
+    for (const FileListEntry &fle: fles) {
+        FileCategory filecategory = fileCategorize(fle.fileName);
+        if (filecategory == FileCategory::open_file || filecategory == FileCategory::new_file) {
+            FileWindow *win = filecategory == FileCategory::open_file ? openFile(fle.fileName) : newFile(fle.fileName);
+            if (fle.search != "") {
+                win->getFileWidget()->setSearchText(fle.search);
+                win->getFileWidget()->runSearch(false);
+            }
+            if (fle.pos != "") {
+                win->getFileWidget()->gotoLine(fle.pos);
+            }
+        } else if (filecategory == FileCategory::dir) {
+            openFileDialog(fle.fileName);
+        }
+    }
+    return {};
+}
+
 void Editor::openFileDialog(QString path) {
     OpenDialog *openDialog = new OpenDialog(this, path);
     QObject::connect(openDialog, &OpenDialog::fileSelected, this, [this] (QString fileName) {
@@ -765,8 +921,114 @@ void Editor::openFileDialog(QString path) {
     });
 }
 
+void Editor::setSessionFile(QString sessionFile) {
+    _sessionFile = sessionFile;
+}
+
+bool Editor::restoreSession() {
+    if (_sessionFile.isEmpty()) {
+        return false;
+    }
+    // From now on the session is saved on exit, even if nothing could be restored.
+    _sessionActive = true;
+
+    Session session;
+    if (!readSession(_sessionFile, &session)) {
+        return false;
+    }
+
+    // Only create the windows here. The files are read when their window is first painted or focused,
+    // so restoring a big session is not slower than opening a single file.
+    FileWindow *active = nullptr;
+    FileWindow *last = nullptr;
+    for (int i = 0; i < session.windows.size(); i++) {
+        const SessionWindow &sessionWindow = session.windows[i];
+        if (fileCategorize(sessionWindow.fileName) != FileCategory::open_file
+                || _nameToWindow.contains(sessionWindow.fileName)) {
+            continue;
+        }
+
+        FileWindow *win = createFileWindow();
+        _mdiLayout->addWindow(win);
+        _mdiLayout->setWeight(win, sessionWindow.weight);
+        win->openFileDeferred(sessionWindow.fileName, _fileLoader);
+
+        _sessionPending.insert(win, sessionWindow);
+        QObject::connect(win, &QObject::destroyed, this, [this, win] {
+            _sessionPending.remove(win);
+        });
+        win->runWhenLoaded([this, win] {
+            if (!_sessionPending.contains(win)) {
+                return;
+            }
+            const SessionWindow sessionWindow = _sessionPending.take(win);
+            File *file = win->getFileWidget();
+            file->setCursorPosition(sessionWindow.cursor);
+            file->setScrollPosition(sessionWindow.scrollColumn, sessionWindow.scrollLine, sessionWindow.scrollFineLine);
+        });
+
+        if (i == session.activeWindow) {
+            active = win;
+        }
+        last = win;
+    }
+    _mdiLayout->setMode(session.mode);
+
+    if (!last) {
+        return false;
+    }
+    if (!active) {
+        active = last;
+    }
+    raiseOnActivate(active);
+    active->getFileWidget()->setFocus();
+    return true;
+}
+
+void Editor::saveSession() {
+    if (!_sessionActive) {
+        return;
+    }
+
+    Session session;
+    session.mode = _mdiLayout->mode();
+    for (Tui::ZWidget *w: _mdiLayout->windows()) {
+        FileWindow *win = qobject_cast<FileWindow*>(w);
+        if (!win) {
+            continue;
+        }
+        File *file = win->getFileWidget();
+        QFileInfo filenameInfo(file->getFilename());
+        if (!filenameInfo.exists()) {
+            // new files, standard input
+            continue;
+        }
+
+        SessionWindow sessionWindow;
+        if (_sessionPending.contains(win)) {
+            // never looked at, keep the position from the last session
+            sessionWindow = _sessionPending.value(win);
+        } else {
+            const File::ViewPosition position = file->viewPosition();
+            sessionWindow.cursor = position.cursor;
+            sessionWindow.scrollColumn = position.scrollColumn;
+            sessionWindow.scrollLine = position.scrollLine;
+            sessionWindow.scrollFineLine = position.scrollFineLine;
+        }
+        sessionWindow.fileName = filenameInfo.absoluteFilePath();
+        sessionWindow.weight = _mdiLayout->weight(win);
+        if (win == _win) {
+            session.activeWindow = session.windows.size();
+        }
+        session.windows.append(sessionWindow);
+    }
+
+    writeSession(_sessionFile, session);
+}
+
 void Editor::quitImpl(int i) {
     if (i >= _allWindows.size()) {
+        saveSession();
         // delete all windows so they can signal work in QtConcurrent to quit also.
         for (auto* win: _allWindows) {
             win->deleteLater();
@@ -782,13 +1044,19 @@ void Editor::quitImpl(int i) {
     auto *win = _allWindows[i];
     auto *file = win->getFileWidget();
     file->writeAttributes();
-    if (file->isModified()) {
+    // For documents shown in several windows only the last one asks.
+    bool laterView = false;
+    for (int j = i + 1; j < _allWindows.size(); j++) {
+        laterView |= _allWindows[j]->getFileWidget()->document() == file->document();
+    }
+    if (file->isModified() && !laterView) {
         ConfirmSave *quitDialog = new ConfirmSave(this, file->getFilename(),
                                                   file->isNewFile() ? ConfirmSave::QuitUnnamed : ConfirmSave::Quit,
                                                   file->getWritable());
 
-        QObject::connect(quitDialog, &ConfirmSave::discardSelected, this, [quitDialog,handleNext] {
+        QObject::connect(quitDialog, &ConfirmSave::discardSelected, this, [quitDialog,handleNext,file] {
             quitDialog->deleteLater();
+            file->discardJournal();
             handleNext();
         });
 
@@ -809,8 +1077,15 @@ void Editor::quitImpl(int i) {
     }
 }
 
+void Editor::flushJournals() {
+    for (FileWindow *win: _allWindows) {
+        win->getFileWidget()->flushJournal();
+    }
+}
+
 void Editor::quit() {
     if (_allWindows.isEmpty()) {
+        saveSession();
         QCoreApplication::instance()->quit();
         return;
     }
@@ -879,6 +1154,10 @@ void Editor::commandLineDismissed() {
     _commandLineWidget->setVisible(false);
 }
 
+static QString formatMiB(qint64 bytes) {
+    return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MiB";
+}
+
 void Editor::commandLineExecute(QString cmd) {
     commandLineDismissed();
     if (cmd.startsWith("screenshot-tpi ")) {
@@ -890,7 +1169,18 @@ void Editor::commandLineExecute(QString cmd) {
             });
         }
     } else if (cmd == "help") {
-        _commandLineWidget->setCmdEntryText("suspend shell");
+        _commandLineWidget->setCmdEntryText("memory suspend shell");
+        showCommandLine();
+    } else if (cmd == "memory") {
+        const MemoryBudget *budget = MemoryBudget::instance();
+        const MemoryUsage usage = budget->usage();
+        QString text = QString("%1 in %2 documents (text %3, highlighting %4, undo %5, caches %6)")
+                .arg(formatMiB(usage.total()), QString::number(budget->documentCount()), formatMiB(usage.text),
+                     formatMiB(usage.highlighting), formatMiB(usage.undo), formatMiB(usage.caches));
+        if (budget->limit() > 0) {
+            text += ", budget " + formatMiB(budget->limit());
+        }
+        _commandLineWidget->setCmdEntryText(text);
         showCommandLine();
     } else if (cmd == "suspend") {
         ::raise(SIGTSTP);
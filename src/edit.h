@@ -8,10 +8,13 @@
 
 #include "commandlinewidget.h"
 #include "file.h"
+#include "fileloader.h"
+#include "filesaver.h"
 #include "filewindow.h"
 #include "help.h"
 #include "mdilayout.h"
 #include "searchdialog.h"
+#include "session.h"
 #include "statemux.h"
 #include "statusbar.h"
 #include "syntaxhighlightdialog.h"
@@ -34,6 +37,11 @@ public:
     int rightMarginHint = 0;
     QString syntaxHighlightingTheme;
     bool disableSyntaxHighlighting = false;
+    bool syncOnSave = true;
+    bool stripTrailingWhitespaceOnSave = false;
+    qint64 sortMemoryLimit = SortOptions().memoryLimit;
+    qint64 undoMemoryLimit = 64 * 1024 * 1024;
+    QString journalDirectory;
 };
 
 class Editor : public Tui::ZRoot {
@@ -54,9 +62,13 @@ public:
     void setInitialFileSettings(const Settings &initial);
     void windowTitle(QString filename);
     FileWindow* openFile(QString fileName);
+    FileWindow* openFileInBackground(QString fileName);
+    QString openRemoteFileList(QStringList args);
     void openFileDialog(QString path = "");
     FileWindow* newFile(QString filename = "");
     void openFileMenu();
+    // Opens another window on the document of the current one.
+    void splitWindow();
 
     void gotoLineInCurrentFile(QString lineInfo);
     void followInCurrentFile(bool follow=true);
@@ -64,6 +76,10 @@ public:
     void watchPipe();
 
     void setStartActions(std::vector<std::function<void()>> actions);
+    void flushJournals();
+
+    void setSessionFile(QString sessionFile);
+    bool restoreSession();
 
 public slots:
     void showCommandLine();
@@ -77,11 +93,12 @@ protected:
 
 private:
     void setupUi();
-    void setupSearchDialogs();
+    void ensureSearchDialogs();
     void ensureWindowCommands(int count);
     void enableFileCommands(bool enable);
-    FileWindow *createFileWindow();
+    FileWindow *createFileWindow(FileWindow *splitOf = nullptr);
     QVector<Tui::ZMenuItem> createWindowMenu();
+    void saveSession();
     void quit();
     void quitImpl(int i);
     void searchDialog();
@@ -103,6 +120,8 @@ private:
     Tui::ZCommandNotifier *_cmdSyntaxHighlight = nullptr;
     QPointer<SyntaxHighlightDialog> _syntaxHighlightDialog = nullptr;
     StatusBar *_statusBar = nullptr;
+    FileLoader *_fileLoader = nullptr;
+    FileSaver *_fileSaver = nullptr;
     CommandLineWidget *_commandLineWidget = nullptr;
     Theme _theme = Theme::classic;
     Settings _initialFileSettings;
@@ -115,17 +134,24 @@ private:
     Tui::ZCommandNotifier *_cmdInsertCharacter = nullptr;
     Tui::ZCommandNotifier *_cmdGotoLine = nullptr;
     Tui::ZCommandNotifier *_cmdSortSelectedLines = nullptr;
+    Tui::ZCommandNotifier *_cmdSortLines = nullptr;
+    Tui::ZCommandNotifier *_cmdStripTrailingWhitespace = nullptr;
     Tui::ZCommandNotifier *_cmdLineNumbers = nullptr;
     Tui::ZCommandNotifier *_cmdFormatting = nullptr;
     Tui::ZCommandNotifier *_cmdBrackets = nullptr;
     Tui::ZCommandNotifier *_cmdTileVert = nullptr;
     Tui::ZCommandNotifier *_cmdTileHorz = nullptr;
     Tui::ZCommandNotifier *_cmdTileFull = nullptr;
+    Tui::ZCommandNotifier *_cmdSplitWindow = nullptr;
     int _tab = 8;
     Tui::ZWindow *_pendingKeySequence = nullptr;
     QTimer _pendingKeySequenceTimer;
     std::vector<std::function<void()>> _startActions;
     int _windowCommandsCreated = 0;
+    QString _sessionFile;
+    bool _sessionActive = false;
+    // positions of restored windows that were not read yet
+    QHash<FileWindow*, SessionWindow> _sessionPending;
 };
 
 #endif // EDIT_H
@@ -0,0 +1,449 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "editjournal.h"
+
+#include <algorithm>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+
+
+static const quint32 journalVersion = 1;
+static const int flushDelayMs = 1000;
+static const qint64 minCheckpointBytes = 1024 * 1024;
+// Journals contain unsaved text, so only the user may read them.
+static const QFileDevice::Permissions journalPermissions = QFileDevice::ReadOwner | QFileDevice::WriteOwner;
+static const QFileDevice::Permissions journalDirectoryPermissions = journalPermissions | QFileDevice::ExeOwner;
+
+enum RecordType : quint8 {
+    headerRecord = 1,
+    // One range of lines, written by older versions.
+    replaceRecord = 2,
+    checkpointRecord = 3,
+    // All ranges changed by one batch of edits, from top to bottom.
+    replaceRunsRecord = 4,
+};
+
+// Replaces the lines of each run in one pass. first of a run is where it starts after the runs above it
+// were applied. Returns false if the runs don't fit lines.
+static bool applyRuns(QStringList *lines, QDataStream &record, qint32 runCount) {
+    QStringList result;
+    result.reserve(lines->size());
+    int pos = 0;
+    for (qint32 run = 0; run < runCount; run++) {
+        qint32 first = 0;
+        qint32 removed = 0;
+        QStringList replacement;
+        record >> first >> removed >> replacement;
+        const int unchanged = first - result.size();
+        if (record.status() != QDataStream::Ok || unchanged < 0 || removed < 0
+                || pos + unchanged + removed > lines->size()) {
+            return false;
+        }
+        for (int i = 0; i < unchanged; i++) {
+            result.append(lines->at(pos + i));
+        }
+        result.append(replacement);
+        pos += unchanged + removed;
+    }
+    for (int i = pos; i < lines->size(); i++) {
+        result.append(lines->at(i));
+    }
+    *lines = std::move(result);
+    return true;
+}
+
+static QByteArray frameRecord(quint8 type, const QByteArray &payload) {
+    const QByteArray data = qCompress(payload);
+    QByteArray record;
+    QDataStream out(&record, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << type << data << qChecksum(data.constData(), data.size());
+    return record;
+}
+
+EditJournal::EditJournal(Tui::ZDocument *document, QObject *parent) : QObject(parent), _document(document) {
+    _flushTimer.setSingleShot(true);
+    _flushTimer.setInterval(flushDelayMs);
+    QObject::connect(&_flushTimer, &QTimer::timeout, this, &EditJournal::flush);
+
+    QObject::connect(_document, &Tui::ZDocument::contentsChanged, this, &EditJournal::documentChanged);
+    QObject::connect(_document, &Tui::ZDocument::crLfModeChanged, this, &EditJournal::documentChanged);
+}
+
+EditJournal::~EditJournal() {
+}
+
+QString EditJournal::journalFile(const QString &journalDirectory, const QString &filename) {
+    const QByteArray hash = QCryptographicHash::hash(QFileInfo(filename).absoluteFilePath().toUtf8(),
+                                                     QCryptographicHash::Sha1);
+    return journalDirectory + "/" + QString::fromLatin1(hash.toHex()) + ".journal";
+}
+
+bool EditJournal::replay(const QString &journalFile, const QString &filename,
+                         QStringList *lines, bool *crLfMode, bool *newlineAfterLastLineMissing) {
+    QFile file(journalFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QFileInfo info(filename);
+    QStringList result = *lines;
+    bool headerSeen = false;
+    // Edits can only be applied on the file they were recorded against, a checkpoint contains everything.
+    bool baseValid = false;
+    bool applied = false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    while (!in.atEnd()) {
+        quint8 type = 0;
+        QByteArray data;
+        quint16 checksum = 0;
+        in >> type >> data >> checksum;
+        if (in.status() != QDataStream::Ok || qChecksum(data.constData(), data.size()) != checksum) {
+            // Incomplete last record, the editor died while writing it.
+            break;
+        }
+
+        const QByteArray payload = qUncompress(data);
+        QDataStream record(payload);
+        record.setVersion(QDataStream::Qt_5_0);
+
+        if (type == headerRecord) {
+            quint32 version = 0;
+            QString journaledFilename;
+            qint64 baseSize = -1;
+            qint64 baseModified = 0;
+            record >> version >> journaledFilename >> baseSize >> baseModified;
+            if (version != journalVersion || journaledFilename != info.absoluteFilePath()) {
+                return false;
+            }
+            headerSeen = true;
+            baseValid = info.size() == baseSize && info.lastModified().toMSecsSinceEpoch() == baseModified;
+        } else if (!headerSeen) {
+            return false;
+        } else if (type == replaceRecord) {
+            qint32 first = 0;
+            qint32 removed = 0;
+            QStringList replacement;
+            bool crLf = false;
+            bool newlineMissing = false;
+            record >> first >> removed >> replacement >> crLf >> newlineMissing;
+            if (record.status() != QDataStream::Ok || !baseValid
+                    || first < 0 || removed < 0 || first + removed > result.size()) {
+                return false;
+            }
+            result.erase(result.begin() + first, result.begin() + first + removed);
+            for (int i = 0; i < replacement.size(); i++) {
+                result.insert(first + i, replacement[i]);
+            }
+            *crLfMode = crLf;
+            *newlineAfterLastLineMissing = newlineMissing;
+            applied = true;
+        } else if (type == replaceRunsRecord) {
+            qint32 runCount = 0;
+            record >> runCount;
+            if (record.status() != QDataStream::Ok || !baseValid || runCount < 0
+                    || !applyRuns(&result, record, runCount)) {
+                return false;
+            }
+            bool crLf = false;
+            bool newlineMissing = false;
+            record >> crLf >> newlineMissing;
+            if (record.status() != QDataStream::Ok) {
+                return false;
+            }
+            *crLfMode = crLf;
+            *newlineAfterLastLineMissing = newlineMissing;
+            applied = true;
+        } else if (type == checkpointRecord) {
+            QStringList content;
+            bool crLf = false;
+            bool newlineMissing = false;
+            record >> content >> crLf >> newlineMissing;
+            if (record.status() != QDataStream::Ok) {
+                return false;
+            }
+            result = content;
+            *crLfMode = crLf;
+            *newlineAfterLastLineMissing = newlineMissing;
+            baseValid = true;
+            applied = true;
+        }
+    }
+
+    if (!applied || result.isEmpty()) {
+        return false;
+    }
+    *lines = result;
+    return true;
+}
+
+void EditJournal::setJournalDirectory(const QString &journalDirectory) {
+    _journalDirectory = journalDirectory;
+}
+
+QString EditJournal::journalDirectory() const {
+    return _journalDirectory;
+}
+
+QString EditJournal::journalFile() const {
+    return journalFile(_journalDirectory, _filename);
+}
+
+void EditJournal::reset(const QString &filename, const Tui::ZDocumentSnapshot &base) {
+    _flushTimer.stop();
+    _file.close();
+    _dirty = false;
+    _filename = filename;
+
+    QFileInfo info(filename);
+    _active = !_journalDirectory.isEmpty() && !filename.isEmpty() && info.exists();
+    if (!_active) {
+        _revisions.clear();
+        return;
+    }
+
+    _baseSize = info.size();
+    _baseModified = info.lastModified().toMSecsSinceEpoch();
+    _revisions.resize(base.lineCount());
+    _maxRevision = 0;
+    for (int line = 0; line < base.lineCount(); line++) {
+        _revisions[line] = base.lineRevision(line);
+        _maxRevision = std::max(_maxRevision, _revisions[line]);
+    }
+    _crLfMode = _document->crLfMode();
+    _newlineAfterLastLineMissing = _document->newlineAfterLastLineMissing();
+    _bytesSinceCheckpoint = 0;
+    _checkpointThreshold = std::max(minCheckpointBytes, _baseSize);
+
+    if (!base.isUpToDate()) {
+        // edited since base was taken
+        documentChanged();
+    }
+}
+
+void EditJournal::discard() {
+    _flushTimer.stop();
+    _dirty = false;
+    _file.close();
+    if (!_filename.isEmpty() && !_journalDirectory.isEmpty()) {
+        QFile::remove(journalFile());
+    }
+}
+
+void EditJournal::disable() {
+    _flushTimer.stop();
+    _dirty = false;
+    _file.close();
+    _active = false;
+}
+
+void EditJournal::documentChanged() {
+    if (!_active) {
+        return;
+    }
+    _dirty = true;
+    // Not restarted on further changes, so at most one interval of editing is lost.
+    if (!_flushTimer.isActive()) {
+        _flushTimer.start();
+    }
+}
+
+void EditJournal::flush() {
+    _flushTimer.stop();
+    if (!_active || !_dirty) {
+        return;
+    }
+    _dirty = false;
+
+    // ZDocument does not tell which lines an edit touched, so the revisions of all lines are compared with
+    // the state of the journal. That is one pass over integers, the text written is only the changed lines.
+    const int lineCount = _document->lineCount();
+    QVector<unsigned> revisions(lineCount);
+    for (int line = 0; line < lineCount; line++) {
+        revisions[line] = _document->lineRevision(line);
+    }
+
+    if (!_document->isModified()) {
+        // Back at the saved state, there is nothing to recover.
+        discard();
+        _revisions = std::move(revisions);
+        _maxRevision = 0;
+        for (unsigned revision: _revisions) {
+            _maxRevision = std::max(_maxRevision, revision);
+        }
+        _crLfMode = _document->crLfMode();
+        _newlineAfterLastLineMissing = _document->newlineAfterLastLineMissing();
+        return;
+    }
+
+    const QVector<Run> runs = changedRuns(revisions);
+    const bool crLfMode = _document->crLfMode();
+    const bool newlineMissing = _document->newlineAfterLastLineMissing();
+    if (runs.isEmpty() && crLfMode == _crLfMode && newlineMissing == _newlineAfterLastLineMissing) {
+        return;
+    }
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << qint32(runs.size());
+    for (const Run &run: runs) {
+        QStringList replacement;
+        replacement.reserve(run.inserted);
+        for (int line = run.first; line < run.first + run.inserted; line++) {
+            replacement.append(_document->line(line));
+            _maxRevision = std::max(_maxRevision, revisions[line]);
+        }
+        out << qint32(run.first) << qint32(run.removed) << replacement;
+    }
+    out << crLfMode << newlineMissing;
+
+    _revisions = std::move(revisions);
+    _crLfMode = crLfMode;
+    _newlineAfterLastLineMissing = newlineMissing;
+
+    if (!writeRecord(replaceRunsRecord, payload)) {
+        qWarning("%s%s", "can not write edit journal: ", journalFile().toUtf8().data());
+        disable();
+        return;
+    }
+
+    if (_bytesSinceCheckpoint > _checkpointThreshold && !writeCheckpoint()) {
+        qWarning("%s%s", "can not write edit journal checkpoint: ", journalFile().toUtf8().data());
+        disable();
+    }
+}
+
+QVector<EditJournal::Run> EditJournal::changedRuns(const QVector<unsigned> &revisions) const {
+    // A line revision stands for one version of the text of a line. Lines with the same revision in the
+    // same order are unchanged, everything in between is a run. Edits give lines new revisions higher than
+    // all before, only undo brings back older ones.
+    const int lineCount = revisions.size();
+    const int oldLineCount = _revisions.size();
+    QVector<Run> runs;
+    int line = 0;
+    int oldLine = 0;
+
+    // Index of the journaled lines, only built when a revision is not found by scanning ahead.
+    QHash<unsigned, int> oldIndex;
+    bool indexed = false;
+    auto findOld = [&](unsigned revision) {
+        if (revision > _maxRevision) {
+            return -1;
+        }
+        if (indexed) {
+            const auto it = oldIndex.constFind(revision);
+            return it != oldIndex.constEnd() && *it >= oldLine ? *it : -1;
+        }
+        // Usually the lines skipped were removed, so oldLine moves past them anyway.
+        for (int i = oldLine; i < oldLineCount; i++) {
+            if (_revisions[i] == revision) {
+                return i;
+            }
+        }
+        oldIndex.reserve(oldLineCount - oldLine);
+        for (int i = oldLine; i < oldLineCount; i++) {
+            oldIndex.insert(_revisions[i], i);
+        }
+        indexed = true;
+        return -1;
+    };
+
+    while (line < lineCount || oldLine < oldLineCount) {
+        if (line < lineCount && oldLine < oldLineCount && revisions[line] == _revisions[oldLine]) {
+            line++;
+            oldLine++;
+            continue;
+        }
+        Run run;
+        run.first = line;
+        const int oldFirst = oldLine;
+        int match = -1;
+        while (line < lineCount && (match = findOld(revisions[line])) == -1) {
+            line++;
+        }
+        oldLine = line < lineCount ? match : oldLineCount;
+        run.removed = oldLine - oldFirst;
+        run.inserted = line - run.first;
+        runs.append(run);
+    }
+    return runs;
+}
+
+QByteArray EditJournal::headerPayload() const {
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << journalVersion << QFileInfo(_filename).absoluteFilePath() << _baseSize << _baseModified;
+    return payload;
+}
+
+bool EditJournal::writeRecord(quint8 type, const QByteArray &payload) {
+    const QByteArray record = frameRecord(type, payload);
+
+    if (!_file.isOpen()) {
+        // Start a new journal, replacing an old one atomically.
+        QDir dir(_journalDirectory);
+        if (!dir.exists() && (!dir.mkpath(".")
+                              || !QFile::setPermissions(_journalDirectory, journalDirectoryPermissions))) {
+            return false;
+        }
+        QSaveFile newJournal(journalFile());
+        if (!newJournal.open(QIODevice::WriteOnly) || !newJournal.setPermissions(journalPermissions)) {
+            return false;
+        }
+        newJournal.write(frameRecord(headerRecord, headerPayload()));
+        newJournal.write(record);
+        if (!newJournal.commit()) {
+            return false;
+        }
+        _file.setFileName(journalFile());
+        _bytesSinceCheckpoint = record.size();
+        return _file.open(QIODevice::WriteOnly | QIODevice::Append);
+    }
+
+    if (_file.write(record) != record.size() || !_file.flush()) {
+        return false;
+    }
+    _bytesSinceCheckpoint += record.size();
+    return true;
+}
+
+bool EditJournal::writeCheckpoint() {
+    QStringList content;
+    const int lineCount = _document->lineCount();
+    content.reserve(lineCount);
+    for (int line = 0; line < lineCount; line++) {
+        content.append(_document->line(line));
+    }
+
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << content << _crLfMode << _newlineAfterLastLineMissing;
+    const QByteArray record = frameRecord(checkpointRecord, payload);
+
+    _file.close();
+    QSaveFile newJournal(journalFile());
+    if (!newJournal.open(QIODevice::WriteOnly) || !newJournal.setPermissions(journalPermissions)) {
+        return false;
+    }
+    newJournal.write(frameRecord(headerRecord, headerPayload()));
+    newJournal.write(record);
+    if (!newJournal.commit()) {
+        return false;
+    }
+
+    _bytesSinceCheckpoint = 0;
+    _checkpointThreshold = std::max(minCheckpointBytes, static_cast<qint64>(record.size()));
+    _file.setFileName(journalFile());
+    return _file.open(QIODevice::WriteOnly | QIODevice::Append);
+}
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <QFile>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+
+#include <Tui/ZDocument.h>
+#include <Tui/ZDocumentSnapshot.h>
+
+
+// Append only journal of the unsaved edits of one document, used to recover after the editor was killed.
+//
+// The journal is relative to the file on disk. Every batch of edits is appended as one compressed record
+// that replaces each run of lines that changed since the previous record. Changed lines are found
+// by their line revision, so the amount of data written follows the amount of editing and not the size
+// of the document. When the journal got as big as the document, it is rewritten as a checkpoint with the
+// full content.
+class EditJournal : public QObject {
+    Q_OBJECT
+
+public:
+    EditJournal(Tui::ZDocument *document, QObject *parent = nullptr);
+    ~EditJournal() override;
+
+public:
+    static QString journalFile(const QString &journalDirectory, const QString &filename);
+    // Applies the journal onto lines, which must be the current content of filename.
+    static bool replay(const QString &journalFile, const QString &filename,
+                       QStringList *lines, bool *crLfMode, bool *newlineAfterLastLineMissing);
+
+public:
+    void setJournalDirectory(const QString &journalDirectory);
+    QString journalDirectory() const;
+    QString journalFile() const;
+
+    // The file on disk now has the content of base. Does not touch an existing journal file.
+    void reset(const QString &filename, const Tui::ZDocumentSnapshot &base);
+    // Removes the journal file, e.g. because the edits were saved or discarded.
+    void discard();
+    // Stop journaling this document and leave an existing journal file alone.
+    void disable();
+
+    void flush();
+
+private:
+    // first counts in the current document, runs above are already applied.
+    struct Run {
+        int first = 0;
+        int removed = 0;
+        int inserted = 0;
+    };
+
+    void documentChanged();
+    QVector<Run> changedRuns(const QVector<unsigned> &revisions) const;
+    bool writeRecord(quint8 type, const QByteArray &payload);
+    bool writeCheckpoint();
+    QByteArray headerPayload() const;
+
+private:
+    Tui::ZDocument *_document = nullptr;
+    QString _journalDirectory;
+    QString _filename;
+    bool _active = false;
+    bool _dirty = false;
+    QTimer _flushTimer;
+
+    qint64 _baseSize = -1;
+    qint64 _baseModified = 0;
+    // line revisions of the state the journal currently describes
+    QVector<unsigned> _revisions;
+    // Highest revision in _revisions or written before. Lines with a higher one are new edits.
+    unsigned _maxRevision = 0;
+    bool _crLfMode = false;
+    bool _newlineAfterLastLineMissing = false;
+
+    QFile _file;
+    qint64 _bytesSinceCheckpoint = 0;
+    qint64 _checkpointThreshold = 0;
+};
+
+#endif // EDITJOURNAL_H
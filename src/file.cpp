@@ -2,12 +2,15 @@
 
 #include "file.h"
 
-#include <QDir>
+#include <algorithm>
+
+#include <QBuffer>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
-#include <QJsonDocument>
-#include <QSaveFile>
-#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QThread>
+#include <QTimer>
 
 #ifdef SYNTAX_HIGHLIGHTING
 #include <KSyntaxHighlighting/Format>
@@ -26,20 +29,54 @@
 #include <Tui/ZTerminal.h>
 #include <Tui/ZTextMetrics.h>
 
+#include "linerevisions.h"
+#include "pastenormalize.h"
 #include "searchcount.h"
+#include "syntaxhighlightrepository.h"
+
+// Selections with more lines are sorted in the background.
+static const int backgroundSortLines = 100000;
+// Whole document operations on documents with more lines run in the background.
+static const int backgroundJobLines = 100000;
+// Edits made while a job runs restart it this often, before the job gives up.
+static const int jobRestarts = 2;
+// Lines at least this long are only laid out around the visible columns when not wrapping.
+static const int windowedLayoutCodeUnits = 4096;
+// Edited places remembered for the next wrap index sync, more make it compare the whole document.
+static const int maxWrapIndexHints = 64;
+// Regex search matches on such lines are only searched this far around the visible columns.
+static const int windowedSearchMarginCodeUnits = 4096;
+// Time the wrap index is filled per event loop iteration when wrapping.
+static const int wrapIndexSliceMs = 10;
+// Copies of at least this many code units are kept as a document range until they are pasted.
+static const int lazyCopyCodeUnits = 1 << 20;
+// Estimated bytes of a document line besides its text, for the string header and the line array entry.
+static const int lineOverheadBytes = 48;
+// Unloaded standard input is inserted again in edits of about this many bytes.
+static const int streamReloadBatchBytes = 16 << 20;
 
 // User Data values for ZFormatRange ranges.
 #define FR_UD_SELECTION 1
 #define FR_UD_LIVE_SEARCH 2
 #define FR_UD_SYNTAX 3
 
-File::File(Tui::ZTextMetrics textMetrics, Tui::ZWidget *parent)
-    : ZTextEdit(textMetrics, parent)
+File::File(Tui::ZTextMetrics textMetrics, Tui::ZWidget *parent, File *shareDocumentWith)
+    : File(textMetrics, shareDocumentWith ? shareDocumentWith->_shared : new SharedDocument(), parent)
+{
+}
+
+File::File(Tui::ZTextMetrics textMetrics, SharedDocument *shared, Tui::ZWidget *parent)
+    : ZTextEdit(textMetrics, shared->document(), parent), _shared(shared)
 {
     setInsertCursorStyle(Tui::CursorStyle::Underline);
     setOverwriteCursorStyle(Tui::CursorStyle::Block);
     setTabChangesFocus(false);
-    initText();
+    _journal = _shared->journal();
+    if (_shared->views().isEmpty()) {
+        initText();
+        addToMemoryBudget();
+    }
+    _shared->addView(this);
 
     registerCommandNotifiers(Qt::WindowShortcut);
 
@@ -59,6 +96,20 @@ File::File(Tui::ZTextMetrics textMetrics, Tui::ZWidget *parent)
             runSearch(true);
           });
 
+    QObject::connect(document(), &Tui::ZDocument::contentsChanged, this, [this] {
+        for (File *view: views()) {
+            addWrapIndexHint(view->textCursor().position().line);
+        }
+        _shared->hintEditedLine(textCursor().position().line);
+        _wrapIndexDirty = true;
+        scheduleWrapIndexFill();
+        if (_shared->views().size() > 1) {
+            // Edits in another view change whether this one is modified too.
+            modifiedChanged(isModified());
+        }
+    });
+    QObject::connect(this, &File::scrollPositionChanged, this, &File::emitRowScrollPosition);
+
     QObject::connect(document(), &Tui::ZDocument::lineMarkerChanged, this, [this](const Tui::ZDocumentLineMarker *marker) {
         if ((_blockSelectEndLine && marker == &*_blockSelectEndLine)) {
             // Recalculate the scroll position:
@@ -72,7 +123,7 @@ File::File(Tui::ZTextMetrics textMetrics, Tui::ZWidget *parent)
             // When in block selection mode, the block selection end line marker is what we expose as cursor position
             // line, so send an update out.
             const auto [cursorCodeUnit, cursorLine, cursorColumn] = cursorPositionOrBlockSelectionEnd();
-            int utf8PositionX = document()->line(cursorLine).left(cursorCodeUnit).toUtf8().size();
+            const int utf8PositionX = positionMap(cursorLine).utf8ForCodeUnit(cursorCodeUnit);
             cursorPositionChanged(cursorColumn, cursorCodeUnit, utf8PositionX, cursorLine);
         }
     });
@@ -80,9 +131,16 @@ File::File(Tui::ZTextMetrics textMetrics, Tui::ZWidget *parent)
 #ifdef SYNTAX_HIGHLIGHTING
     qRegisterMetaType<Updates>();
 
-    QObject::connect(document(), &Tui::ZDocument::contentsChanged, this, [this] {
-        updateSyntaxHighlighting(false);
+    QObject::connect(document(), &Tui::ZDocument::contentsChanged, this, &File::scheduleSyntaxHighlightingUpdate);
+    QObject::connect(_shared, &SharedDocument::highlightingChanged, this, [this](int first, int last) {
+        const int visibleLinesStart = scrollPositionLine();
+        const int visibleLinesEnd = visibleLinesStart + geometry().height();
+        if (first <= visibleLinesEnd && visibleLinesStart <= last) {
+            update();
+        }
     });
+    QObject::connect(_shared, &SharedDocument::highlightingAbandoned, this, &File::scheduleSyntaxHighlightingUpdate);
+    QObject::connect(_shared, &SharedDocument::cachesDropped, this, &File::scheduleSyntaxHighlightingUpdate);
 #endif
 
 }
@@ -90,7 +148,7 @@ File::File(Tui::ZTextMetrics textMetrics, Tui::ZWidget *parent)
 
 void File::emitCursorPostionChanged() {
     const auto [cursorCodeUnit, cursorLine, cursorColumn] = cursorPositionOrBlockSelectionEnd();
-    int utf8CodeUnit = document()->line(cursorLine).leftRef(cursorCodeUnit).toUtf8().size();
+    const int utf8CodeUnit = positionMap(cursorLine).utf8ForCodeUnit(cursorCodeUnit);
     cursorPositionChanged(cursorColumn, cursorCodeUnit, utf8CodeUnit, cursorLine);
 
     if (_stdin && document()->lineCount() - 1 == cursorLine) {
@@ -118,8 +176,18 @@ void File::updateSyntaxHighlighting(bool force = false) {
     SyntaxHighlightingSignalForwarder *forwarder = new SyntaxHighlightingSignalForwarder();
     forwarder->moveToThread(nullptr); // enable later pull to worker thread
     QObject::connect(forwarder, &SyntaxHighlightingSignalForwarder::updates, this, &File::ingestSyntaxHighlightingUpdates);
+    QObject::connect(forwarder, &SyntaxHighlightingSignalForwarder::finished, this, [this, revision=snapshot.revision()] {
+        --_syntaxHighlightingRunning;
+        releaseSyntaxHighlightingClaim(revision == document()->revision());
+    });
+    ++_syntaxHighlightingRunning;
 
-    QtConcurrent::run([forwarder, snapshot, &highlighter=_syntaxHighlightExporter] {
+    BackgroundExecutor::instance()->post(BackgroundExecutor::Priority::Visible, _cancelToken,
+                                         [forwarder, snapshot, &highlighter=_syntaxHighlightExporter](bool cancelled) {
+        if (cancelled) {
+            delete forwarder;
+            return;
+        }
         forwarder->moveToThread(QThread::currentThread());
 
         Updates updates;
@@ -144,6 +212,7 @@ void File::updateSyntaxHighlighting(bool force = false) {
         for (int line = 0; line < snapshot.lineCount(); line++) {
             if (!snapshot.isUpToDate()) {
                 // Abandon work, the document has changed
+                forwarder->finished();
                 delete forwarder;
                 return;
             }
@@ -165,12 +234,47 @@ void File::updateSyntaxHighlighting(bool force = false) {
         if (updates.data.size()) {
             sendData();
         }
+        forwarder->finished();
         delete forwarder;
     });
 }
 
+void File::scheduleSyntaxHighlightingUpdate() {
+    // Bulk operations like replace all change the document many times in a row. Each update takes a snapshot,
+    // and as long as a worker holds it the next edit has to copy the line array of the document. So restart
+    // highlighting only once per event loop iteration, keeping the cost of an edit independent of the size
+    // of the document.
+    if (!_onScreen) {
+        _syntaxHighlightingPending = true;
+        return;
+    }
+    if (!_syntaxHighlightingUpdateScheduled) {
+        if (!_shared->claimHighlightingUpdate(this)) {
+            // Another view of the document highlights it.
+            return;
+        }
+        _syntaxHighlightingUpdateScheduled = true;
+        QTimer::singleShot(0, this, [this] {
+            _syntaxHighlightingUpdateScheduled = false;
+            updateSyntaxHighlighting(false);
+            releaseSyntaxHighlightingClaim(true);
+        });
+    }
+}
+
+void File::releaseSyntaxHighlightingClaim(bool upToDate) {
+    // Other views only take over once the highlighting of this one is done, else a view closed while its
+    // task runs would leave the document without highlighting until the next edit.
+    if (!_syntaxHighlightingUpdateScheduled && _syntaxHighlightingRunning == 0) {
+        _shared->releaseHighlightingUpdate(this, upToDate);
+    }
+}
+
 void File::syntaxHighlightDefinition() {
     if (_syntaxHighlightDefinition.isValid()) {
+        // Definitions from the shared repository are loaded lazily. Force loading (including all referenced
+        // definitions) here on the UI thread, so worker threads of different files never race on that.
+        (void)_syntaxHighlightDefinition.includedDefinitions();
         _syntaxHighlightExporter.setTheme(_syntaxHighlightingTheme);
         _syntaxHighlightExporter.setDefinition(_syntaxHighlightDefinition);
         _syntaxHighlightExporter.defBg = getColor("chr.editBg");
@@ -186,10 +290,8 @@ void File::ingestSyntaxHighlightingUpdates(Updates updates) {
         return;
     }
 
-    const int visibleLinesStart = scrollPositionLine();
-    const int visibleLinesEnd = visibleLinesStart + geometry().height();
-
-    bool needRepaint = false;
+    int first = -1;
+    int last = -1;
 
     for (int i = 0; i < updates.lines.size(); i++) {
         const int line = updates.lines[i];
@@ -197,14 +299,17 @@ void File::ingestSyntaxHighlightingUpdates(Updates updates) {
         if (line < document()->lineCount() && document()->lineRevision(line) == updates.data[i]->lineRevision) {
             document()->setLineUserData(line, updates.data[i]);
 
-            if (visibleLinesStart <= line && line <= visibleLinesEnd) {
-                needRepaint = true;
+            if (first == -1) {
+                first = line;
             }
+            last = line;
         }
     }
 
-    if (needRepaint) {
-        update();
+    if (first != -1) {
+        // Every view of the document repaints if it shows one of the lines.
+        _shared->highlightingChanged(first, last);
+        _shared->scheduleMemoryMeasurement();
     }
 }
 
@@ -243,7 +348,7 @@ void HighlightExporter::applyFormat(int offset, int length, const KSyntaxHighlig
 void File::setSyntaxHighlightingTheme(QString themeName) {
 #ifdef SYNTAX_HIGHLIGHTING
     _syntaxHighlightingThemeName = themeName;
-    _syntaxHighlightingTheme = _syntaxHighlightRepo.theme(_syntaxHighlightingThemeName);
+    _syntaxHighlightingTheme = syntaxHighlightRepository().theme(_syntaxHighlightingThemeName);
     _syntaxHighlightExporter.setTheme(_syntaxHighlightingTheme);
     _syntaxHighlightExporter.defBg = getColor("chr.editBg");
     _syntaxHighlightExporter.defFg = getColor("chr.editFg");
@@ -258,7 +363,7 @@ void File::setSyntaxHighlightingTheme(QString themeName) {
 
 void File::setSyntaxHighlightingLanguage(QString language) {
 #ifdef SYNTAX_HIGHLIGHTING
-    _syntaxHighlightDefinition = _syntaxHighlightRepo.definitionForName(language);
+    _syntaxHighlightDefinition = syntaxHighlightRepository().definitionForName(language);
     syntaxHighlightDefinition();
     // rehighlight
     updateSyntaxHighlighting(true);
@@ -290,80 +395,70 @@ void File::setSyntaxHighlightingActive(bool active) {
 }
 
 File::~File() {
+    if (_shared->views().size() == 1) {
+        // Write what is not yet journaled while the document still exists.
+        _journal->flush();
+    }
+    cancelJob();
+    if (_reloading) {
+        // Another view has to read the text again.
+        _shared->setReloading(false);
+    }
+    // Queued highlighting, search counts and jobs of this file are not needed anymore.
+    *_cancelToken = true;
     if (_searchNextFuture) {
         _searchNextFuture->cancel();
         _searchNextFuture.reset();
     }
+    // Don't take the highlighting claim back while it is handed to the other views.
+    QObject::disconnect(_shared, nullptr, this, nullptr);
+    _shared->removeView(this);
 }
 
-bool File::readAttributes() {
-    if (_attributesFile.isEmpty()) {
-        return false;
+bool File::isModified() const {
+    if (_shared->isUnloaded() && _shared->isStream()) {
+        return _unloadedModified;
     }
-    QFile fileRead(_attributesFile);
-    if (!fileRead.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        //qDebug() << "File open error";
-        return false;
+    if (_shared->isModifiedWithoutHistory()) {
+        return true;
     }
-    QString val = fileRead.readAll();
-    fileRead.close();
+    return Tui::ZTextEdit::isModified();
+}
 
-    QJsonDocument jd = QJsonDocument::fromJson(val.toUtf8());
-    _attributeObject = jd.object();
-    return true;
+QList<File*> File::views() const {
+    QList<File*> result;
+    for (QObject *view: _shared->views()) {
+        result.append(static_cast<File*>(view));
+    }
+    return result;
 }
 
-Tui::ZDocumentCursor::Position File::getAttributes() {
+SharedDocument *File::sharedDocument() const {
+    return _shared;
+}
+
+std::optional<FileAttributes> File::getAttributes() {
     if (_attributesFile.isEmpty()) {
-        return {0, 0};
+        return std::nullopt;
     }
-    if (readAttributes()) {
-        QJsonObject data = _attributeObject.value(getFilename()).toObject();
-        if (data.contains("cursorPositionX") && data.contains("cursorPositionY")) {
-            return {data.value("cursorPositionX").toInt(), data.value("cursorPositionY").toInt()};
-        }
-        return {data.value("curOff").toInt(), data.value("curLine").toInt()};
-    }
-    return {0, 0};
+    return AttributesStore::forFile(_attributesFile)->value(getFilename());
 }
 
 bool File::writeAttributes() {
     QFileInfo filenameInfo(getFilename());
-    if (!filenameInfo.exists() || _attributesFile.isEmpty()) {
+    if (!filenameInfo.exists() || _attributesFile.isEmpty() || _loading) {
         return false;
     }
-    readAttributes();
 
     const auto [cursorCodeUnit, cursorLine] = cursorPosition();
 
-    QJsonObject data;
-    data.insert("curOff", cursorCodeUnit);
-    data.insert("curLine", cursorLine);
-    data.insert("sCol", scrollPositionColumn());
-    data.insert("sLine", scrollPositionLine());
-    data.insert("sFine", scrollPositionFineLine());
-    _attributeObject.insert(filenameInfo.absoluteFilePath(), data);
-
-    QJsonDocument jsonDoc;
-    jsonDoc.setObject(_attributeObject);
-
-    //Save
-    QDir d = QFileInfo(_attributesFile).absoluteDir();
-    QString absolute=d.absolutePath();
-    if (!QDir(absolute).exists()) {
-        if (QDir().mkdir(absolute)) {
-            qWarning("%s%s", "can not create directory: ", absolute.toUtf8().data());
-            return false;
-        }
-    }
-
-    QSaveFile file(_attributesFile);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        qWarning("%s%s", "can not save attributes file: ", _attributesFile.toUtf8().data());
-        return false;
-    }
-    file.write(jsonDoc.toJson());
-    file.commit();
+    FileAttributes attributes;
+    attributes.cursorCodeUnit = cursorCodeUnit;
+    attributes.cursorLine = cursorLine;
+    attributes.scrollColumn = scrollPositionColumn();
+    attributes.scrollLine = scrollPositionLine();
+    attributes.scrollFineLine = scrollPositionFineLine();
+    AttributesStore::forFile(_attributesFile)->setValue(filenameInfo.absoluteFilePath(), attributes);
     return true;
 }
 
@@ -381,14 +476,154 @@ QString File::attributesFile() {
     return _attributesFile;
 }
 
+template<typename Result>
+bool File::startJob(const QString &name, int restarts,
+                    std::function<std::optional<Result>(const Tui::ZDocumentSnapshot&, JobControl*)> compute,
+                    std::function<void(const Result&)> apply) {
+    if (_jobControl) {
+        return false;
+    }
+    auto control = std::make_shared<JobControl>();
+    _jobControl = control;
+    jobProgress(name, 0);
+
+    const Tui::ZDocumentSnapshot snapshot = document()->snapshot();
+    auto watcher = new QFutureWatcher<std::optional<Result>>(this);
+    QTimer *progressTimer = new QTimer(watcher);
+    QObject::connect(progressTimer, &QTimer::timeout, this, [this, name, control] {
+        jobProgress(name, control->progress);
+    });
+    progressTimer->start(100);
+
+    QObject::connect(watcher, &QFutureWatcher<std::optional<Result>>::finished, this,
+                     [this, watcher, snapshot, name, restarts, compute, apply] {
+        watcher->deleteLater();
+        _jobControl.reset();
+        jobProgress(name, -1);
+        if (watcher->isCanceled()) {
+            return;
+        }
+        const std::optional<Result> result = watcher->result();
+        if (!result) {
+            return;
+        }
+        if (snapshot.isUpToDate()) {
+            // The document is unchanged since the snapshot, so the result applies as it is.
+            apply(*result);
+        } else if (restarts > 0) {
+            startJob<Result>(name, restarts - 1, compute, apply);
+        }
+    });
+    watcher->setFuture(BackgroundExecutor::instance()->run(BackgroundExecutor::Priority::Background, _cancelToken,
+                                                           [snapshot, compute, control] {
+        return compute(snapshot, control.get());
+    }));
+    return true;
+}
+
+bool File::isJobRunning() const {
+    return _jobControl != nullptr;
+}
+
+void File::cancelJob() {
+    if (_jobControl) {
+        _jobControl->cancel = true;
+    }
+}
+
 int File::convertTabsToSpaces() {
-    auto undoGroup = startUndoGroup();
+    WhitespaceOptions options;
+    options.tabStopDistance = tabStopDistance();
+    options.expandTabs = true;
+    return transformWhitespace(options);
+}
+
+int File::convertIndentation(bool useTabs, int indentSize) {
+    WhitespaceOptions options;
+    options.tabStopDistance = tabStopDistance();
+    options.expandTabs = !useTabs;
+    options.reindent = true;
+    options.indentFrom = tabStopDistance();
+    options.indentTo = indentSize;
+    options.indentWithTabs = useTabs;
+    return transformWhitespace(options, true, [this, useTabs, indentSize] {
+        setUseTabChar(useTabs);
+        setTabStopDistance(indentSize);
+    });
+}
 
-    int count = 0;
+int File::stripTrailingWhitespace() {
+    WhitespaceOptions options;
+    options.tabStopDistance = tabStopDistance();
+    options.stripTrailingWhitespace = true;
+    return transformWhitespace(options);
+}
 
+int File::transformWhitespace(const WhitespaceOptions &options, bool background, std::function<void()> applied) {
+    // The layout based part runs when applying, with the options of the time the conversion was started.
     Tui::ZTextOption option = textOption();
     option.setWrapMode(Tui::ZTextOption::NoWrap);
 
+    if (!background || document()->lineCount() < backgroundJobLines) {
+        const int count = applyWhitespaceEdits(options, option, computeWhitespaceEdits(document()->snapshot(), options));
+        if (applied) {
+            applied();
+        }
+        return count;
+    }
+
+    auto compute = [options](const Tui::ZDocumentSnapshot &snapshot, JobControl *control) -> std::optional<WhitespaceEdits> {
+        WhitespaceEdits result = computeWhitespaceEdits(snapshot, options, control);
+        if (control->cancel) {
+            return std::nullopt;
+        }
+        return result;
+    };
+    const bool started = startJob<WhitespaceEdits>("CONVERTING", jobRestarts, compute,
+                                                   [this, options, option, applied](const WhitespaceEdits &result) {
+        applyWhitespaceEdits(options, option, result);
+        if (applied) {
+            applied();
+        }
+    });
+    return started ? -1 : 0;
+}
+
+int File::applyWhitespaceEdits(const WhitespaceOptions &options, const Tui::ZTextOption &option,
+                               WhitespaceEdits result) {
+    if (result.needsLayout.size()) {
+        // Expand the tabs of these lines with the layout, then the rest of the transformation does not need it.
+        WhitespaceOptions expandedOptions = options;
+        expandedOptions.expandTabs = false;
+        for (int line: result.needsLayout) {
+            const QString text = document()->line(line);
+            Tui::ZTextLayout lay = textLayoutForLine(option, line);
+            QString expanded;
+            expanded.reserve(text.size() + 8 * text.count('\t'));
+            for (int i = 0; i < text.size(); i++) {
+                if (text[i] == '\t') {
+                    const int columnStart = lay.lineAt(0).cursorToX(i, Tui::ZTextLayout::Leading);
+                    const int columnEnd = lay.lineAt(0).cursorToX(i, Tui::ZTextLayout::Trailing);
+                    expanded += QString(" ").repeated(columnEnd - columnStart);
+                } else {
+                    expanded += text[i];
+                }
+            }
+            QString transformed;
+            transformWhitespaceLine(expanded, expandedOptions, &transformed);
+            result.edits.append(WhitespaceEdit{line, transformed});
+        }
+        std::sort(result.edits.begin(), result.edits.end(), [](const WhitespaceEdit &a, const WhitespaceEdit &b) {
+            return a.line < b.line;
+        });
+    }
+
+    if (result.edits.isEmpty()) {
+        return 0;
+    }
+
+    auto undoGroup = startUndoGroup();
+
     // This changes code unit based positions in many lines. To avoid glitches reset selection and
     // manually save and restore cursor position. This should no longer be needed when TextCursor
     // is fixed to be able to keep its position even when edits happen.
@@ -397,23 +632,25 @@ int File::convertTabsToSpaces() {
     Tui::ZTextLayout lay = textLayoutForLine(option, cursorLine);
     int cursorPosition = lay.lineAt(0).cursorToX(cursorCodeUnit, Tui::ZTextLayout::Leading);
 
-    Tui::ZDocumentCursor cur = makeCursor();
-
-    for (int line = 0, found = -1; line < document()->lineCount(); line++) {
-        found = document()->line(line).lastIndexOf("\t");
-        if (found != -1) {
-            Tui::ZTextLayout lay = textLayoutForLine(option, line);
-            while (found != -1) {
-                int columnStart = lay.lineAt(0).cursorToX(found, Tui::ZTextLayout::Leading);
-                int columnEnd = lay.lineAt(0).cursorToX(found, Tui::ZTextLayout::Trailing);
-                cur.setPosition({found, line});
-                cur.moveCharacterRight(true);
-                cur.insertText(QString(" ").repeated(columnEnd-columnStart));
-                count++;
-                found = document()->line(line).lastIndexOf("\t", found);
-            }
+    // One edit from the first to the last changed line, the unchanged lines between are kept as they are.
+    const int first = result.edits.first().line;
+    const int last = result.edits.last().line;
+    QStringList lines;
+    lines.reserve(last - first + 1);
+    auto edit = result.edits.cbegin();
+    for (int line = first; line <= last; line++) {
+        if (edit->line == line) {
+            lines.append(edit->text);
+            ++edit;
+        } else {
+            lines.append(document()->line(line));
         }
     }
+    hintEditedLines(first);
+    Tui::ZDocumentCursor cur = makeCursor();
+    cur.setPosition({0, first});
+    cur.setPosition({document()->lineCodeUnits(last), last}, true);
+    cur.insertText(lines.join('\n'));
 
     // Restore cursor position
     lay = textLayoutForLine(option, cursorLine);
@@ -422,7 +659,7 @@ int File::convertTabsToSpaces() {
         setCursorPosition({newCursorPosition, cursorLine});
     }
 
-    return count;
+    return result.edits.size();
 }
 
 
@@ -464,6 +701,7 @@ bool File::stdinText() {
     document()->setFilename("STDIN");
     _stdin = true;
     initText();
+    _shared->setStreamRevision(document()->revision());
     setFollowStandardInput(true);
     followStandardInputChanged(true);
     modifiedChanged(true);
@@ -473,32 +711,128 @@ bool File::stdinText() {
 
 bool File::initText() {
     clear();
+    // Journaling starts when a file was read or saved.
+    _journal->reset(QString(), document()->snapshot());
+    _shared->setBaseLineRevision(std::nullopt);
+    _shared->setStreamRevision(std::nullopt);
+    _shared->streamArena().clear();
+    _shared->setModifiedWithoutHistory(false);
+    if (_shared->isUnloaded()) {
+        // The new text replaces the unloaded one.
+        setUnloaded(false);
+    }
     return true;
 }
 
 bool File::saveText() {
-    // QSaveFile does not take over the user and group. Therefore this should only be used if
-    // user and group are the same and the editor also runs under this user.
-    QFile file(getFilename());
-    //QSaveFile file(getFilename());
-    if (file.open(QIODevice::WriteOnly)) {
-        bool ok = writeTo(&file);
-        ok &= file.flush();
+    FileSaver::Job job = prepareSave();
+    if (!FileSaver::write(job)) {
+        return false;
+    }
+    finishSave(job);
+    return true;
+}
 
-        //file.commit();
-        file.close();
-        if (!ok) {
-            return false;
+FileSaver::Job File::prepareSave() {
+    if (_stripTrailingWhitespaceOnSave) {
+        // The file is written from the snapshot taken below, so this can't wait for a job.
+        WhitespaceOptions options;
+        options.tabStopDistance = tabStopDistance();
+        options.stripTrailingWhitespace = true;
+        transformWhitespace(options, false);
+    }
+
+    FileSaver::Job job;
+    job.snapshot = document()->snapshot();
+    job.crLfMode = document()->crLfMode();
+    job.newlineAfterLastLineMissing = document()->newlineAfterLastLineMissing();
+    job.filename = getFilename();
+    job.sync = _syncOnSave;
+    return job;
+}
+
+void File::finishSave(const FileSaver::Job &job) {
+    // Edits made while the save was running are not in the file, so the document stays modified then.
+    if (job.snapshot.isUpToDate()) {
+        document()->markUndoStateAsSaved();
+        _shared->setModifiedWithoutHistory(false);
+        for (File *view: views()) {
+            view->modifiedChanged(false);
         }
-        modifiedChanged(false);
-        setSaveAs(false);
-        checkWritable();
-        update();
-        writeAttributes();
-        return true;
     }
-    //TODO vernünfiges error Händling
-    return false;
+    setSaveAs(false);
+    checkWritable();
+    update();
+    writeAttributes();
+
+    // The file on disk now is the snapshot, edits made while saving are journaled against it.
+    _journal->discard();
+    _journal->reset(getFilename(), job.snapshot);
+}
+
+void File::setStripTrailingWhitespaceOnSave(bool strip) {
+    _stripTrailingWhitespaceOnSave = strip;
+}
+
+bool File::stripTrailingWhitespaceOnSave() const {
+    return _stripTrailingWhitespaceOnSave;
+}
+
+void File::setSyncOnSave(bool sync) {
+    _syncOnSave = sync;
+}
+
+bool File::syncOnSave() const {
+    return _syncOnSave;
+}
+
+void File::setJournalDirectory(QString journalDirectory) {
+    _journal->setJournalDirectory(journalDirectory);
+}
+
+QString File::journalDirectory() const {
+    return _journal->journalDirectory();
+}
+
+bool File::hasJournal() {
+    return !journalDirectory().isEmpty() && QFileInfo::exists(_journal->journalFile());
+}
+
+bool File::recoverFromJournal() {
+    QStringList lines;
+    for (int line = 0; line < document()->lineCount(); line++) {
+        lines.append(document()->line(line));
+    }
+    bool crLfMode = document()->crLfMode();
+    bool newlineAfterLastLineMissing = document()->newlineAfterLastLineMissing();
+    if (!EditJournal::replay(_journal->journalFile(), getFilename(), &lines, &crLfMode, &newlineAfterLastLineMissing)) {
+        return false;
+    }
+
+    // Replace everything in one step, so that the recovery can be undone as a whole.
+    const Tui::ZDocumentCursor::Position cursorPosition = this->cursorPosition();
+    auto undoGroup = startUndoGroup();
+    clearSelection();
+    Tui::ZDocumentCursor cur = makeCursor();
+    cur.setPosition({0, 0});
+    cur.moveToEndOfDocument(true);
+    cur.insertText(lines.join("\n"));
+    document()->setNewlineAfterLastLineMissing(newlineAfterLastLineMissing);
+    document()->setCrLfMode(crLfMode);
+    setCursorPosition(cursorPosition);
+    return true;
+}
+
+void File::discardJournal() {
+    _journal->discard();
+}
+
+void File::disableJournal() {
+    _journal->disable();
+}
+
+void File::flushJournal() {
+    _journal->flush();
 }
 
 void File::checkWritable() {
@@ -537,43 +871,61 @@ bool File::openText(QString filename) {
     setFilename(filename);
     QFile file(getFilename());
     if (file.open(QIODevice::ReadOnly)) {
-        initText();
-
-        Tui::ZDocumentCursor::Position initialPosition = getAttributes();
-        const bool ok = readFrom(&file, initialPosition);
+        const bool ok = openTextFrom(&file);
         file.close();
+        return ok;
+    }
+    return false;
+}
 
-        if (!ok) {
-            return false;
-        }
+bool File::openTextFrom(QIODevice *device) {
+    // The filename needs to be already set, it is used for the attributes and syntax detection.
+    initText();
 
-        if (getWritable()) {
-            setSaveAs(false);
-        } else {
-            setSaveAs(true);
-        }
+    const std::optional<FileAttributes> attributes = getAttributes();
+    Tui::ZDocumentCursor::Position initialPosition = {0, 0};
+    if (attributes) {
+        initialPosition = {attributes->cursorCodeUnit, attributes->cursorLine};
+    }
+    const bool ok = readFrom(device, initialPosition);
 
-        checkWritable();
+    if (!ok) {
+        return false;
+    }
 
-        modifiedChanged(false);
+    if (getWritable()) {
+        setSaveAs(false);
+    } else {
+        setSaveAs(true);
+    }
 
-        // TODO refactor this
-        if (!_attributeObject.isEmpty() && _attributeObject.contains(getFilename())) {
-            QJsonObject data = _attributeObject.value(getFilename()).toObject();
-            setScrollPosition(data.value("sCol").toInt(),
-                              data.value("sLine").toInt(),
-                              data.value("sFine").toInt());
-        }
-        adjustScrollPosition();
+    checkWritable();
+
+    modifiedChanged(false);
+    _journal->reset(getFilename(), document()->snapshot());
+    // Right away, so that edits from now on count as undo.
+    measureMemory();
+
+    if (attributes) {
+        setScrollPosition(attributes->scrollColumn, attributes->scrollLine, attributes->scrollFineLine);
+    }
+    adjustScrollPosition();
 
 #ifdef SYNTAX_HIGHLIGHTING
-        _syntaxHighlightDefinition = _syntaxHighlightRepo.definitionForFileName(getFilename());
-        syntaxHighlightDefinition();
+    _syntaxHighlightDefinition = syntaxHighlightRepository().definitionForFileName(getFilename());
+    syntaxHighlightDefinition();
 #endif
 
-        return true;
-    }
-    return false;
+    return true;
+}
+
+void File::setLoading(bool loading) {
+    _loading = loading;
+    update();
+}
+
+bool File::isLoading() const {
+    return _loading;
 }
 
 
@@ -606,38 +958,53 @@ void File::deleteLine() {
 }
 
 void File::copy() {
-    if (hasBlockSelection()) {
-        Tui::ZClipboard *clipboard = findFacet<Tui::ZClipboard>();
+    Tui::ZClipboard *clipboard = findFacet<Tui::ZClipboard>();
+    LazyClipboard *lazyClipboard = LazyClipboard::forClipboard(clipboard);
 
+    // Keep the selection as a range of a snapshot, small copies are then turned into text right away.
+    int size = 0;
+    if (hasBlockSelection()) {
         const int firstSelectBlockLine = std::min(_blockSelectStartLine->line(), _blockSelectEndLine->line());
         const int lastSelectBlockLine = std::max(_blockSelectStartLine->line(), _blockSelectEndLine->line());
         const int firstSelectBlockColumn = std::min(_blockSelectStartColumn, _blockSelectEndColumn);
         const int lastSelectBlockColumn = std::max(_blockSelectStartColumn, _blockSelectEndColumn);
 
-        QString selectedText;
+        QVector<std::pair<int, int>> spans;
         for (int line = firstSelectBlockLine; line < document()->lineCount() && line <= lastSelectBlockLine; line++) {
-            Tui::ZTextLayout laySel = textLayoutForLineWithoutWrapping(line);
-            Tui::ZTextLineRef tlrSel = laySel.lineAt(0);
-
-            const int selFirstCodeUnitInLine = tlrSel.xToCursor(firstSelectBlockColumn);
-            const int selLastCodeUnitInLine = tlrSel.xToCursor(lastSelectBlockColumn);
-            selectedText += document()->line(line).mid(selFirstCodeUnitInLine, selLastCodeUnitInLine - selFirstCodeUnitInLine);
-            if (line != lastSelectBlockLine) {
-                selectedText += "\n";
-            }
+            const int selFirstCodeUnitInLine = blockColumnPosition(line, firstSelectBlockColumn).codeUnit;
+            const int selLastCodeUnitInLine = blockColumnPosition(line, lastSelectBlockColumn).codeUnit;
+            spans.append({selFirstCodeUnitInLine, selLastCodeUnitInLine});
+            size += selLastCodeUnitInLine - selFirstCodeUnitInLine + 1;
         }
-        clipboard->setContents(selectedText);
+        lazyClipboard->setBlockRange(document()->snapshot(), document(), firstSelectBlockLine, spans);
     } else if (ZTextEdit::hasSelection()) {
-        Tui::ZClipboard *clipboard = findFacet<Tui::ZClipboard>();
-        clipboard->setContents(ZTextEdit::selectedText());
+        const Tui::ZDocumentCursor cursor = textCursor();
+        const auto [startCodeUnit, startLine] = cursor.selectionStartPos();
+        const auto [endCodeUnit, endLine] = cursor.selectionEndPos();
+        for (int line = startLine; line <= endLine && size < lazyCopyCodeUnits; line++) {
+            size += document()->lineCodeUnits(line) + 1;
+        }
+        lazyClipboard->setRange(document()->snapshot(), document(), startLine, startCodeUnit, endLine, endCodeUnit);
+    } else {
+        return;
+    }
+
+    if (size < lazyCopyCodeUnits) {
+        lazyClipboard->materialize();
+    } else {
+        _shared->setLazyClipboard(lazyClipboard);
     }
 }
 
 void File::paste() {
+    if (_loading) {
+        return;
+    }
     auto undoGroup = startUndoGroup();
     Tui::ZClipboard *clipboard = findFacet<Tui::ZClipboard>();
-    if (clipboard->contents().size()) {
-        insertText(clipboard->contents());
+    const QString text = LazyClipboard::forClipboard(clipboard)->contents();
+    if (text.size()) {
+        insertText(text);
         adjustScrollPosition();
     }
     document()->clearCollapseUndoStep();
@@ -775,11 +1142,8 @@ QString File::selectedText() {
         const int lastSelectBlockColumn = std::max(_blockSelectStartColumn, _blockSelectEndColumn);
 
         for (int line = firstSelectBlockLine; line < document()->lineCount() && line <= lastSelectBlockLine; line++) {
-            Tui::ZTextLayout laySel = textLayoutForLineWithoutWrapping(line);
-            Tui::ZTextLineRef tlrSel = laySel.lineAt(0);
-
-            const int selFirstCodeUnitInLine = tlrSel.xToCursor(firstSelectBlockColumn);
-            const int selLastCodeUnitInLine = tlrSel.xToCursor(lastSelectBlockColumn);
+            const int selFirstCodeUnitInLine = blockColumnPosition(line, firstSelectBlockColumn).codeUnit;
+            const int selLastCodeUnitInLine = blockColumnPosition(line, lastSelectBlockColumn).codeUnit;
             selectText += document()->line(line).mid(selFirstCodeUnitInLine, selLastCodeUnitInLine - selFirstCodeUnitInLine);
             if (line != lastSelectBlockLine) {
                 selectText += "\n";
@@ -870,80 +1234,168 @@ void File::disableBlockSelection() {
 
 void File::blockSelectRemoveSelectedAndConvertToMultiInsert() {
     const int firstSelectBlockLine = std::min(_blockSelectStartLine->line(), _blockSelectEndLine->line());
-    const int lastSelectBlockLine = std::max(_blockSelectStartLine->line(), _blockSelectEndLine->line());
+    const int lastSelectBlockLine = std::min(std::max(_blockSelectStartLine->line(), _blockSelectEndLine->line()),
+                                             document()->lineCount() - 1);
     const int firstSelectBlockColumn = std::min(_blockSelectStartColumn, _blockSelectEndColumn);
     const int lastSelectBlockColumn = std::max(_blockSelectStartColumn, _blockSelectEndColumn);
 
-    for (int line = firstSelectBlockLine; line < document()->lineCount() && line <= lastSelectBlockLine; line++) {
-        Tui::ZTextLayout laySel = textLayoutForLineWithoutWrapping(line);
-        Tui::ZTextLineRef tlrSel = laySel.lineAt(0);
-
-        const int selFirstCodeUnitInLine = tlrSel.xToCursor(firstSelectBlockColumn);
-        const int selLastCodeUnitInLine = tlrSel.xToCursor(lastSelectBlockColumn);
+    QStringList lines;
+    lines.reserve(lastSelectBlockLine - firstSelectBlockLine + 1);
+    for (int line = firstSelectBlockLine; line <= lastSelectBlockLine; line++) {
+        const int selFirstCodeUnitInLine = blockColumnPosition(line, firstSelectBlockColumn).codeUnit;
+        const int selLastCodeUnitInLine = blockColumnPosition(line, lastSelectBlockColumn).codeUnit;
 
-        Tui::ZDocumentCursor cur = makeCursor();
-        cur.setPosition({selFirstCodeUnitInLine, line});
-        cur.setPosition({selLastCodeUnitInLine, line}, true);
-        cur.removeSelectedText();
+        QString text = document()->line(line);
+        text.remove(selFirstCodeUnitInLine, selLastCodeUnitInLine - selFirstCodeUnitInLine);
+        lines.append(text);
     }
+    replaceBlockLines(firstSelectBlockLine, lines);
 
     _blockSelectStartColumn = _blockSelectEndColumn = firstSelectBlockColumn;
 }
 
-template<typename F>
-void File::multiInsertForEachCursor(int flags, F f) {
-    // pre-condition: hasMultiInsert() = true
+ColumnPosition File::blockColumnPosition(int line, int column) {
+    const QString text = document()->line(line);
+    ColumnPosition result;
+    if (columnPositionWithoutLayout(text, column, tabStopDistance(), &result)) {
+        return result;
+    }
+    if (auto cached = _shared->columnLayoutCache().find(text, column, tabStopDistance())) {
+        return *cached;
+    }
 
-    const int firstSelectBlockLine = std::min(_blockSelectStartLine->line(), _blockSelectEndLine->line());
-    const int lastSelectBlockLine = std::max(_blockSelectStartLine->line(), _blockSelectEndLine->line());
-    const int column = _blockSelectStartColumn;
+    Tui::ZTextLayout lay = textLayoutForLineWithoutWrapping(line);
+    Tui::ZTextLineRef tlr = lay.lineAt(0);
+    result.codeUnit = tlr.xToCursor(column);
+    result.width = tlr.width();
+    _shared->columnLayoutCache().insert(text, column, tabStopDistance(), result);
+    return result;
+}
 
-    bool endSkipped = false;
-    int fallbackColumn = _blockSelectStartColumn;
+int File::blockColumnOfCodeUnit(int line, int codeUnit) {
+    int column = 0;
+    if (columnOfCodeUnitWithoutLayout(document()->line(line), codeUnit, tabStopDistance(), &column)) {
+        return column;
+    }
+    Tui::ZTextLayout lay = textLayoutForLineWithoutWrapping(line);
+    return lay.lineAt(0).cursorToX(codeUnit, Tui::ZTextLayout::Leading);
+}
+
+void File::replaceBlockLines(int firstLine, const QStringList &lines) {
+    // Only the range from the first to the last changed line is replaced, in a single edit.
+    int begin = 0;
+    int end = lines.size();
+    while (begin < end && lines[begin] == document()->line(firstLine + begin)) {
+        begin++;
+    }
+    while (end > begin && lines[end - 1] == document()->line(firstLine + end - 1)) {
+        end--;
+    }
+    if (begin == end) {
+        return;
+    }
+
+    const int startLine = _blockSelectStartLine->line();
+    const int endLine = _blockSelectEndLine->line();
+
+    hintEditedLines(firstLine + begin);
+    Tui::ZDocumentCursor cur = makeCursor();
+    cur.setPosition({0, firstLine + begin});
+    cur.setPosition({document()->lineCodeUnits(firstLine + end - 1), firstLine + end - 1}, true);
+    cur.insertText(lines.mid(begin, end - begin).join('\n'));
 
-    for (int line = firstSelectBlockLine; line < document()->lineCount() && line <= lastSelectBlockLine; line++) {
-        Tui::ZTextLayout laySel = textLayoutForLineWithoutWrapping(line);
-        Tui::ZTextLineRef tlrSel = laySel.lineAt(0);
+    // The line count is unchanged, but replacing whole lines moves markers within the range.
+    _blockSelectStartLine->setLine(startLine);
+    _blockSelectEndLine->setLine(endLine);
+}
 
-        const int codeUnitInLine = tlrSel.xToCursor(column);
+template<typename F, typename G>
+void File::multiInsertForEachCursor(int flags, F textEdit, G cursorEdit) {
+    // pre-condition: hasMultiInsert() = true
 
-        Tui::ZDocumentCursor cur = makeCursor();
-        cur.setPosition({codeUnitInLine, line});
+    const int firstSelectBlockLine = std::min(_blockSelectStartLine->line(), _blockSelectEndLine->line());
+    const int lastSelectBlockLine = std::min(std::max(_blockSelectStartLine->line(), _blockSelectEndLine->line()),
+                                             document()->lineCount() - 1);
+    const int endLine = _blockSelectEndLine->line();
+    const int column = _blockSelectStartColumn;
 
+    bool endSkipped = false;
+    int endCodeUnit = -1;
+    int fallbackLine = -1;
+    int fallbackCodeUnit = 0;
+
+    // Each line is edited as a string and all lines are written back in one edit. Only edits that
+    // need the cluster or word rules of the text layout go through a cursor, line by line.
+    QStringList lines;
+    lines.reserve(lastSelectBlockLine - firstSelectBlockLine + 1);
+    for (int line = firstSelectBlockLine; line <= lastSelectBlockLine; line++) {
+        const ColumnPosition position = blockColumnPosition(line, column);
+        QString text = document()->line(line);
+        int codeUnit = position.codeUnit;
+
+        int padding = 0;
         bool skip = false;
-        if (tlrSel.width() < column) {
+        if (position.width < column) {
             if ((flags & mi_add_spaces)) {
-                cur.insertText(QString(" ").repeated(column - tlrSel.width()));
+                padding = column - position.width;
             } else if (flags & mi_skip_short_lines) {
                 skip = true;
             }
         }
 
         if (!skip) {
-            f(cur);
-
-            Tui::ZTextLayout layNew = textLayoutForLineWithoutWrapping(line);
-            Tui::ZTextLineRef tlrNew = layNew.lineAt(0);
-            fallbackColumn = tlrNew.cursorToX(cur.position().codeUnit, Tui::ZTextLayout::Leading);
+            QString edited = text;
+            int editedCodeUnit = codeUnit + padding;
+            edited.insert(codeUnit, QString(" ").repeated(padding));
+            if (textEdit(edited, editedCodeUnit, position.simple)) {
+                text = edited;
+                codeUnit = editedCodeUnit;
+            } else {
+                Tui::ZDocumentCursor cur = makeCursor();
+                cur.setPosition({codeUnit, line});
+                if (padding) {
+                    cur.insertText(QString(" ").repeated(padding));
+                }
+                cursorEdit(cur);
+                text = document()->line(line);
+                codeUnit = cur.position().codeUnit;
+            }
 
-            if (line == _blockSelectEndLine->line()) {
-                _blockSelectStartColumn = _blockSelectEndColumn = fallbackColumn;
+            fallbackLine = line;
+            fallbackCodeUnit = codeUnit;
+            if (line == endLine) {
+                endCodeUnit = codeUnit;
             }
         } else {
-            if (line == _blockSelectEndLine->line()) {
+            if (line == endLine) {
                 endSkipped = true;
             }
         }
+        lines.append(text);
     }
 
-    if (endSkipped) {
-        _blockSelectStartColumn = _blockSelectEndColumn = fallbackColumn;
+    replaceBlockLines(firstSelectBlockLine, lines);
+
+    if (endCodeUnit != -1) {
+        _blockSelectStartColumn = _blockSelectEndColumn = blockColumnOfCodeUnit(endLine, endCodeUnit);
+    } else if (endSkipped && fallbackLine != -1) {
+        _blockSelectStartColumn = _blockSelectEndColumn = blockColumnOfCodeUnit(fallbackLine, fallbackCodeUnit);
     }
 }
 
 void File::multiInsertDeletePreviousCharacter() {
     // pre-condition: hasMultiInsert() = true
-    multiInsertForEachCursor(mi_skip_short_lines, [&](Tui::ZDocumentCursor &cur) {
+    multiInsertForEachCursor(mi_skip_short_lines, [](QString &text, int &codeUnit, bool simple) {
+        if (codeUnit == 0) {
+            return true;
+        }
+        if (!simple) {
+            return false;
+        }
+        text.remove(codeUnit - 1, 1);
+        codeUnit -= 1;
+        return true;
+    }, [&](Tui::ZDocumentCursor &cur) {
         const auto [cursorCodeUnit, cursorLine] = cur.position();
         if (cursorCodeUnit > 0) {
             cur.deletePreviousCharacter();
@@ -953,7 +1405,11 @@ void File::multiInsertDeletePreviousCharacter() {
 
 void File::multiInsertDeletePreviousWord() {
     // pre-condition: hasMultiInsert() = true
-    multiInsertForEachCursor(mi_skip_short_lines, [&](Tui::ZDocumentCursor &cur) {
+    multiInsertForEachCursor(mi_skip_short_lines, [](QString &text, int &codeUnit, bool simple) {
+        (void)text;
+        (void)simple;
+        return codeUnit == 0;
+    }, [&](Tui::ZDocumentCursor &cur) {
         const auto [cursorCodeUnit, cursorLine] = cur.position();
         if (cursorCodeUnit > 0) {
             cur.deletePreviousWord();
@@ -963,7 +1419,16 @@ void File::multiInsertDeletePreviousWord() {
 
 void File::multiInsertDeleteCharacter() {
     // pre-condition: hasMultiInsert() = true
-    multiInsertForEachCursor(mi_skip_short_lines, [&](Tui::ZDocumentCursor &cur) {
+    multiInsertForEachCursor(mi_skip_short_lines, [](QString &text, int &codeUnit, bool simple) {
+        if (codeUnit >= text.size()) {
+            return true;
+        }
+        if (!simple) {
+            return false;
+        }
+        text.remove(codeUnit, 1);
+        return true;
+    }, [&](Tui::ZDocumentCursor &cur) {
         const auto [cursorCodeUnit, cursorLine] = cur.position();
         if (cursorCodeUnit < document()->lineCodeUnits(cursorLine)) {
             cur.deleteCharacter();
@@ -973,7 +1438,10 @@ void File::multiInsertDeleteCharacter() {
 
 void File::multiInsertDeleteWord() {
     // pre-condition: hasMultiInsert() = true
-    multiInsertForEachCursor(mi_skip_short_lines, [&](Tui::ZDocumentCursor &cur) {
+    multiInsertForEachCursor(mi_skip_short_lines, [](QString &text, int &codeUnit, bool simple) {
+        (void)simple;
+        return codeUnit >= text.size();
+    }, [&](Tui::ZDocumentCursor &cur) {
         const auto [cursorCodeUnit, cursorLine] = cur.position();
         if (cursorCodeUnit < document()->lineCodeUnits(cursorLine)) {
             cur.deleteWord();
@@ -983,13 +1451,19 @@ void File::multiInsertDeleteWord() {
 
 void File::multiInsertInsert(const QString &text) {
     // pre-condition: hasMultiInsert() = true
-    multiInsertForEachCursor(mi_add_spaces, [&](Tui::ZDocumentCursor &cur) {
+    multiInsertForEachCursor(mi_add_spaces, [&](QString &line, int &codeUnit, bool simple) {
+        (void)simple;
+        line.insert(codeUnit, text);
+        codeUnit += text.size();
+        return true;
+    }, [&](Tui::ZDocumentCursor &cur) {
         cur.insertText(text);
     });
 }
 
 void File::setSearchText(QString searchText) {
-    int gen = ++(*searchGeneration);
+    // Stops a count that is still running for the previous text.
+    ++(*searchGeneration);
     _searchText = searchText;
     searchTextChanged(_searchText);
 
@@ -1004,6 +1478,21 @@ void File::setSearchText(QString searchText) {
         setSearchVisible(true);
     }
 
+    updateSearchCount();
+}
+
+void File::updateSearchCount() {
+    if (_searchText == "") {
+        return;
+    }
+    if (!_onScreen) {
+        // Stop a running count, it's started again when the file is shown.
+        ++(*searchGeneration);
+        _searchCountPending = true;
+        return;
+    }
+    const int gen = ++(*searchGeneration);
+
     if (_searchRegex || _searchText.contains('\n')) {
         // SearchCount currently does not support regular expression and does not support multi line matches,
         // just disable the search count display in these cases for now.
@@ -1012,12 +1501,16 @@ void File::setSearchText(QString searchText) {
         SearchCountSignalForwarder *searchCountSignalForwarder = new SearchCountSignalForwarder();
         QObject::connect(searchCountSignalForwarder, &SearchCountSignalForwarder::searchCount, this, &File::searchCountChanged);
 
-        QtConcurrent::run([searchCountSignalForwarder](Tui::ZDocumentSnapshot snap, QString searchText, Qt::CaseSensitivity caseSensitivity, int gen, std::shared_ptr<std::atomic<int>> searchGen) {
-            SearchCount sc;
-            QObject::connect(&sc, &SearchCount::searchCount, searchCountSignalForwarder, &SearchCountSignalForwarder::searchCount);
-            sc.run(snap, searchText, caseSensitivity, gen, searchGen);
+        BackgroundExecutor::instance()->post(BackgroundExecutor::Priority::Interactive, _cancelToken,
+                                             [searchCountSignalForwarder, snap=document()->snapshot(), searchText=_searchText,
+                                              caseSensitivity=_searchCaseSensitivity, gen, searchGen=searchGeneration](bool cancelled) {
+            if (!cancelled) {
+                SearchCount sc;
+                QObject::connect(&sc, &SearchCount::searchCount, searchCountSignalForwarder, &SearchCountSignalForwarder::searchCount);
+                sc.run(snap, searchText, caseSensitivity, gen, searchGen);
+            }
             searchCountSignalForwarder->deleteLater();
-        }, document()->snapshot(), _searchText, _searchCaseSensitivity, gen, searchGeneration);
+        });
     }
 }
 
@@ -1056,18 +1549,392 @@ bool File::searchWrap() {
     return _searchWrap;
 }
 
-void File::setSearchDirection(bool searchDirection) {
-    _searchDirectionForward = searchDirection;
+void File::setSearchDirection(bool searchDirection) {
+    _searchDirectionForward = searchDirection;
+}
+
+void File::toggleShowLineNumbers() {
+    setShowLineNumbers(!showLineNumbers());
+}
+
+void File::setOnScreen(bool onScreen) {
+    if (_onScreen == onScreen) {
+        return;
+    }
+    _onScreen = onScreen;
+    if (!_onScreen) {
+        return;
+    }
+    MemoryBudget::instance()->touch(_shared);
+
+#ifdef SYNTAX_HIGHLIGHTING
+    if (_syntaxHighlightingPending) {
+        _syntaxHighlightingPending = false;
+        scheduleSyntaxHighlightingUpdate();
+    }
+#endif
+    if (_searchCountPending) {
+        _searchCountPending = false;
+        updateSearchCount();
+    }
+    if (wordWrapMode() != Tui::ZTextOption::WrapMode::NoWrap) {
+        scheduleWrapIndexFill();
+    }
+}
+
+bool File::isOnScreen() const {
+    return _onScreen;
+}
+
+namespace {
+    struct TextMemory {
+        MemoryUsage usage;
+        unsigned maxLineRevision = 0;
+    };
+}
+
+// Lines changed after the text was read, that is with a revision above baseLineRevision, are counted a
+// second time as undo, the document keeps their previous text. The size of that is not known, so this
+// assumes it is about the same.
+static TextMemory measureTextMemory(const Tui::ZDocumentSnapshot &snapshot, std::optional<unsigned> baseLineRevision) {
+    TextMemory result;
+    for (int line = 0; line < snapshot.lineCount(); line++) {
+        const qint64 bytes = snapshot.line(line).size() * qint64(sizeof(QChar)) + lineOverheadBytes;
+        const unsigned revision = snapshot.lineRevision(line);
+        result.usage.text += bytes;
+        result.maxLineRevision = std::max(result.maxLineRevision, revision);
+        if (baseLineRevision && revision > *baseLineRevision) {
+            result.usage.undo += bytes;
+        }
+        auto userData = std::static_pointer_cast<const ExtraData>(snapshot.lineUserData(line));
+        if (userData) {
+            result.usage.highlighting += sizeof(ExtraData)
+                    + userData->highlights.capacity() * qint64(sizeof(Tui::ZFormatRange));
+        }
+    }
+    return result;
+}
+
+void File::addToMemoryBudget() {
+    // The document outlives this view when it has others, so the first remaining view does the work.
+    SharedDocument *shared = _shared;
+    auto firstView = [shared]() -> File* {
+        return shared->views().isEmpty() ? nullptr : static_cast<File*>(shared->views().first());
+    };
+
+    MemoryBudget::Document document;
+    document.evictable = [firstView] {
+        File *view = firstView();
+        return view && view->canEvict();
+    };
+    document.dropCaches = [shared] {
+        shared->dropCaches();
+    };
+    document.unload = [firstView] {
+        if (File *view = firstView()) {
+            view->unloadText();
+        }
+    };
+    MemoryBudget::instance()->add(_shared, document);
+
+    QObject::connect(_shared, &SharedDocument::memoryMeasurementDue, _shared, [firstView] {
+        if (File *view = firstView()) {
+            view->measureMemory();
+        }
+    });
+}
+
+void File::measureMemory() {
+    // Runs on a snapshot in the background, the caches are measured here on the UI thread.
+    const Tui::ZDocumentSnapshot snapshot = document()->snapshot();
+    const std::optional<unsigned> baseLineRevision = _shared->baseLineRevision();
+
+    auto watcher = new QFutureWatcher<TextMemory>(this);
+    QObject::connect(watcher, &QFutureWatcher<TextMemory>::finished, this, [this, watcher, snapshot] {
+        watcher->deleteLater();
+        if (watcher->isCanceled()) {
+            return;
+        }
+        if (!snapshot.isUpToDate()) {
+            _shared->scheduleMemoryMeasurement();
+            return;
+        }
+        TextMemory result = watcher->result();
+        if (!_shared->baseLineRevision()) {
+            _shared->setBaseLineRevision(result.maxLineRevision);
+        }
+        result.usage.text += _shared->streamArena().memoryUsage();
+        result.usage.caches = _shared->cacheMemoryUsage();
+        MemoryBudget::instance()->setUsage(_shared, result.usage);
+        if (_undoMemoryLimit > 0 && result.usage.undo > _undoMemoryLimit) {
+            dropStreamHistory();
+        }
+    });
+    watcher->setFuture(BackgroundExecutor::instance()->run(BackgroundExecutor::Priority::Background, _cancelToken,
+                                                            [snapshot, baseLineRevision] {
+        return measureTextMemory(snapshot, baseLineRevision);
+    }));
+}
+
+bool File::canEvict() {
+    if (_shared->isUnloaded()) {
+        return false;
+    }
+    if (_shared->isStream()) {
+        if (!_shared->isStreamIntact()) {
+            // Edited, the input is not all there is to keep.
+            return false;
+        }
+    } else if (isModified() || !QFileInfo(getFilename()).isFile()) {
+        return false;
+    }
+    for (File *view: views()) {
+        if (view->_onScreen || view->focus() || view->_loading || view->isJobRunning()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void File::unloadText() {
+    const QFileInfo fileInfo(getFilename());
+    const bool modified = isModified();
+    for (File *view: views()) {
+        view->_unloadedPosition = view->viewPosition();
+        view->_unloadedFollow = view->_followMode;
+        view->_unloadedModified = modified;
+        view->_unloadedLastModified = fileInfo.lastModified();
+        view->_unloadedSize = fileInfo.size();
+    }
+    // A copy held as a range would keep the old text alive.
+    _shared->releaseLazyClipboard();
+
+    const bool stream = _shared->isStream();
+    LineArena arena;
+    if (stream) {
+        for (int line = 0; line < document()->lineCount(); line++) {
+            arena.append(Tui::Misc::SurrogateEscape::encode(document()->line(line)));
+        }
+    }
+    initText();
+    if (stream) {
+        _shared->streamArena() = std::move(arena);
+        _shared->setStreamRevision(document()->revision());
+    }
+    setUnloaded(true);
+    if (stream) {
+        // Clearing the document marked it as saved, but the input that is not saved is still there.
+        for (File *view: views()) {
+            view->modifiedChanged(view->isModified());
+        }
+    }
+}
+
+void File::setUnloaded(bool unloaded) {
+    _shared->setUnloaded(unloaded);
+    _shared->setReloading(false);
+    for (File *view: views()) {
+        view->_reloading = false;
+        view->setLoading(unloaded);
+    }
+}
+
+bool File::isUnloaded() const {
+    return _shared->isUnloaded();
+}
+
+File::ViewPosition File::viewPosition() {
+    if (_shared->isUnloaded()) {
+        return _unloadedPosition;
+    }
+    ViewPosition position;
+    position.cursor = cursorPosition();
+    position.scrollColumn = scrollPositionColumn();
+    position.scrollLine = scrollPositionLine();
+    position.scrollFineLine = scrollPositionFineLine();
+    return position;
+}
+
+bool File::changedOnDiskSinceUnload() {
+    if (!_shared->isUnloaded() || _shared->isStream()) {
+        return false;
+    }
+    const QFileInfo fileInfo(getFilename());
+    return fileInfo.lastModified() != _unloadedLastModified || fileInfo.size() != _unloadedSize;
+}
+
+bool File::beginReload() {
+    if (!_shared->isUnloaded() || _shared->isReloading()) {
+        return false;
+    }
+    _shared->setReloading(true);
+    _reloading = true;
+    return true;
+}
+
+bool File::reloadText(QIODevice *device) {
+    if (!_reloading) {
+        // The text was replaced meanwhile, e.g. by the reload command.
+        return true;
+    }
+    setUnloaded(false);
+
+    if (!readFrom(device, _unloadedPosition.cursor)) {
+        // Don't offer to save the partial text under the name of the file.
+        for (File *view: views()) {
+            view->setSaveAs(true);
+        }
+        return false;
+    }
+    _journal->reset(getFilename(), document()->snapshot());
+    _shared->setBaseLineRevision(std::nullopt);
+    measureMemory();
+    restoreViewPositions();
+    return true;
+}
+
+bool File::isStream() const {
+    return _shared->isStream();
+}
+
+void File::reloadStream() {
+    if (!_reloading) {
+        return;
+    }
+    LineArena arena = std::move(_shared->streamArena());
+    _shared->streamArena().clear();
+    setUnloaded(false);
+
+    // Batches keep the decoded text far below the size limit of QString.
+    for (int first = 0; first < arena.lineCount();) {
+        int count = 0;
+        int bytes = 0;
+        while (first + count < arena.lineCount() && (count == 0 || bytes < streamReloadBatchBytes)) {
+            bytes += arena.lineSize(first + count) + 1;
+            count++;
+        }
+        appendLine(Tui::Misc::SurrogateEscape::decode(arena.lines(first, count)));
+        first += count;
+    }
+    arena.clear();
+    if (!_unloadedModified) {
+        // The input was saved before unloading and nothing arrived since.
+        document()->markUndoStateAsSaved();
+    }
+    for (File *view: views()) {
+        view->modifiedChanged(view->isModified());
+    }
+
+    _shared->setStreamRevision(document()->revision());
+    _shared->setBaseLineRevision(std::nullopt);
+    measureMemory();
+    restoreViewPositions();
+}
+
+void File::dropStreamHistory() {
+    // Only input that nobody edited, so that undo has nothing to offer but removing input. Once saved the
+    // journal is based on the saved text, reading the text again would journal all of it.
+    if (!_shared->isStreamIntact() || !isSaveAs() || _shared->isUnloaded()) {
+        return;
+    }
+    const bool modified = isModified();
+    for (File *view: views()) {
+        view->_unloadedPosition = view->viewPosition();
+        view->_unloadedFollow = view->_followMode;
+    }
+
+    // ZDocument can't drop undo steps, reading the text again is the only way to clear its history.
+    QByteArray text;
+    for (int line = 0; line < document()->lineCount(); line++) {
+        if (line > 0) {
+            text += '\n';
+        }
+        text += Tui::Misc::SurrogateEscape::encode(document()->line(line));
+    }
+    if (!document()->newlineAfterLastLineMissing()) {
+        text += '\n';
+    }
+    const bool crLfMode = document()->crLfMode();
+    QBuffer buffer(&text);
+    buffer.open(QIODevice::ReadOnly);
+    readFrom(&buffer, _unloadedPosition.cursor);
+    document()->setCrLfMode(crLfMode);
+
+    _shared->setStreamRevision(document()->revision());
+    _shared->setBaseLineRevision(std::nullopt);
+    _shared->setModifiedWithoutHistory(modified);
+    for (File *view: views()) {
+        view->modifiedChanged(view->isModified());
+    }
+    restoreViewPositions();
+    measureMemory();
+}
+
+void File::restoreViewPositions() {
+    for (File *view: views()) {
+        if (view->_unloadedFollow) {
+            view->setCursorPosition({0, document()->lineCount() - 1});
+        } else {
+            const ViewPosition &position = view->_unloadedPosition;
+            view->setCursorPosition(position.cursor);
+            view->setScrollPosition(position.scrollColumn, position.scrollLine, position.scrollFineLine);
+        }
+        view->adjustScrollPosition();
+    }
 }
 
-void File::toggleShowLineNumbers() {
-    setShowLineNumbers(!showLineNumbers());
+void File::appendInput(const QByteArray &lines) {
+    if (_shared->isUnloaded() && _shared->isStream()) {
+        // Nobody looks at the input, so it stays compact until it is shown.
+        LineArena &arena = _shared->streamArena();
+        if (arena.lineCount() == 1 && arena.lineSize(0) == 0) {
+            // Like appendLine, the first input replaces the empty line of an empty document.
+            arena.clear();
+        }
+        arena.append(lines);
+        _shared->scheduleMemoryMeasurement();
+        if (!_unloadedModified) {
+            for (File *view: views()) {
+                view->_unloadedModified = true;
+                view->modifiedChanged(true);
+            }
+        }
+        return;
+    }
+    const bool intact = _shared->isStreamIntact();
+    appendLine(Tui::Misc::SurrogateEscape::decode(lines));
+    if (intact) {
+        _shared->setStreamRevision(document()->revision());
+    }
 }
 
 void File::setFollowStandardInput(bool follow) {
     _followMode = follow;
 }
 
+// Expands \1 to \9 and \\ in a regex replacement text.
+static QString expandReplacement(const QString &replaceText, const std::function<QString(int)> &capture) {
+    QString text;
+    bool esc = false;
+    for (QChar ch: replaceText) {
+        if (esc) {
+            if (ch >= '1' && ch <= '9') {
+                text += capture(ch.unicode() - '0');
+            } else if (ch == '\\') {
+                text += '\\';
+            }
+            esc = false;
+        } else {
+            if (ch == '\\') {
+                esc = true;
+            } else {
+                text += ch;
+            }
+        }
+    }
+    return text;
+}
+
 void File::replaceSelected() {
     if (!_currentSearchMatch || hasBlockSelection() || hasMultiInsert()) {
         return;
@@ -1077,28 +1944,14 @@ void File::replaceSelected() {
         QString text;
 
         if (_searchRegex) {
-            bool esc = false;
-            for (QChar ch: _replaceText) {
-                if (esc) {
-                    if (ch >= '1' && ch <= '9') {
-                        const int captureNumber = (ch.unicode() - '0');
-                        if (std::holds_alternative<Tui::ZDocumentFindAsyncResult>(*_currentSearchMatch)) {
-                            text += std::get<Tui::ZDocumentFindAsyncResult>(*_currentSearchMatch).regexCapture(captureNumber);
-                        } else if (std::holds_alternative<Tui::ZDocumentFindResult>(*_currentSearchMatch)) {
-                            text += std::get<Tui::ZDocumentFindResult>(*_currentSearchMatch).regexCapture(captureNumber);
-                        }
-                    } else if (ch == '\\') {
-                        text += '\\';
-                    }
-                    esc = false;
-                } else {
-                    if (ch == '\\') {
-                        esc = true;
-                    } else {
-                        text += ch;
-                    }
+            text = expandReplacement(_replaceText, [this](int captureNumber) {
+                if (std::holds_alternative<Tui::ZDocumentFindAsyncResult>(*_currentSearchMatch)) {
+                    return std::get<Tui::ZDocumentFindAsyncResult>(*_currentSearchMatch).regexCapture(captureNumber);
+                } else if (std::holds_alternative<Tui::ZDocumentFindResult>(*_currentSearchMatch)) {
+                    return std::get<Tui::ZDocumentFindResult>(*_currentSearchMatch).regexCapture(captureNumber);
                 }
-            }
+                return QString();
+            });
         } else {
             text = _replaceText;
         }
@@ -1175,6 +2028,84 @@ void File::runSearch(bool direction) {
     }
 }
 
+namespace {
+    struct ReplaceAllResult {
+        // Changed lines with their new text, ascending.
+        QVector<QPair<int, QString>> lines;
+        int count = 0;
+        // End of the last replacement in the new text.
+        int lastLine = 0;
+        int lastCodeUnit = 0;
+    };
+}
+
+// Replaces all matches line by line on a snapshot. Matches can't span lines here, like for regex searches
+// in the document.
+static std::optional<ReplaceAllResult> computeReplaceAll(const Tui::ZDocumentSnapshot &snapshot,
+                                                         const QString &searchText, const QString &replaceText,
+                                                         bool regex, Qt::CaseSensitivity caseSensitivity,
+                                                         JobControl *control) {
+    QRegularExpression expression;
+    if (regex) {
+        expression.setPattern(searchText);
+        if (caseSensitivity == Qt::CaseInsensitive) {
+            expression.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+        }
+        if (!expression.isValid()) {
+            return ReplaceAllResult();
+        }
+    }
+
+    ReplaceAllResult result;
+    const int lineCount = snapshot.lineCount();
+    for (int line = 0; line < lineCount; line++) {
+        if (line % 1024 == 0) {
+            if (control->cancel) {
+                return std::nullopt;
+            }
+            control->progress = static_cast<int>(100LL * line / lineCount);
+        }
+
+        const QString text = snapshot.line(line);
+        QString replaced;
+        int copied = 0;
+        if (regex) {
+            QRegularExpressionMatchIterator it = expression.globalMatch(text);
+            while (it.hasNext()) {
+                const QRegularExpressionMatch match = it.next();
+                if (match.capturedLength() == 0) {
+                    // Like searching does, e.g. for \b. Expressions that match an empty text are refused.
+                    continue;
+                }
+                replaced += QStringRef(&text, copied, match.capturedStart() - copied);
+                replaced += expandReplacement(replaceText, [&match](int captureNumber) {
+                    return match.captured(captureNumber);
+                });
+                copied = match.capturedEnd();
+                result.count++;
+                result.lastLine = line;
+                result.lastCodeUnit = replaced.size();
+            }
+        } else {
+            int found = text.indexOf(searchText, 0, caseSensitivity);
+            while (found >= 0) {
+                replaced += QStringRef(&text, copied, found - copied);
+                replaced += replaceText;
+                copied = found + searchText.size();
+                result.count++;
+                result.lastLine = line;
+                result.lastCodeUnit = replaced.size();
+                found = text.indexOf(searchText, copied, caseSensitivity);
+            }
+        }
+        if (copied) {
+            replaced += QStringRef(&text, copied, text.size() - copied);
+            result.lines.append({line, replaced});
+        }
+    }
+    return result;
+}
+
 int File::replaceAll(QString searchText, QString replaceText) {
     setSearchText(searchText);
     setReplaceText(replaceText);
@@ -1182,10 +2113,54 @@ int File::replaceAll(QString searchText, QString replaceText) {
     // Get rid of block selections and multi insert.
     clearSelection();
 
-    if (searchText.isEmpty()) {
+    if (searchText.isEmpty() || matchesEmptyText(searchText)) {
         return 0;
     }
 
+    // On a large document this is a job on a snapshot. Edits made while it runs restart it from scratch
+    // on a new snapshot, the replacements are not rebased onto the edits.
+    if (document()->lineCount() >= backgroundJobLines && !searchText.contains('\n')) {
+        auto compute = [searchText, replaceText, regex=_searchRegex, caseSensitivity=_searchCaseSensitivity]
+                (const Tui::ZDocumentSnapshot &snapshot, JobControl *control) {
+            return computeReplaceAll(snapshot, searchText, replaceText, regex, caseSensitivity, control);
+        };
+        const bool started = startJob<ReplaceAllResult>("REPLACING", jobRestarts, compute,
+                                                        [this](const ReplaceAllResult &result) {
+            if (result.count == 0) {
+                return;
+            }
+            clearSelection();
+            Tui::ZDocumentCursor cursor = textCursor();
+            auto undoGroup = document()->startUndoGroup(&cursor);
+            // One edit from the first to the last changed line.
+            const int first = result.lines.first().first;
+            const int last = result.lines.last().first;
+            QStringList lines;
+            lines.reserve(last - first + 1);
+            auto changed = result.lines.cbegin();
+            for (int line = first; line <= last; line++) {
+                if (changed->first == line) {
+                    lines.append(changed->second);
+                    ++changed;
+                } else {
+                    lines.append(document()->line(line));
+                }
+            }
+            hintEditedLines(first);
+            cursor.setPosition({0, first});
+            cursor.setPosition({document()->lineCodeUnits(last), last}, true);
+            cursor.insertText(lines.join('\n'));
+            cursor.setPosition({result.lastCodeUnit, result.lastLine});
+            setTextCursor(cursor);
+            if (result.lastLine - 1 > 0) {
+                setScrollPosition(scrollPositionColumn(), result.lastLine - 1, 0);
+            }
+            adjustScrollPosition();
+            updateSearchCount();
+        });
+        return started ? -1 : 0;
+    }
+
     Tui::ZDocumentCursor cursor = textCursor();
     auto undoGroup = document()->startUndoGroup(&cursor);
     int counter = 0;
@@ -1231,6 +2206,17 @@ int File::replaceAll(QString searchText, QString replaceText) {
     return counter;
 }
 
+bool File::matchesEmptyText(const QString &searchText) const {
+    if (!_searchRegex) {
+        return false;
+    }
+    QRegularExpression expression(searchText);
+    if (_searchCaseSensitivity == Qt::CaseInsensitive) {
+        expression.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+    }
+    return expression.isValid() && expression.match(QString()).hasMatch();
+}
+
 Tui::ZTextOption File::textOption() const {
     Tui::ZTextOption option;
     option.setWrapMode(wordWrapMode());
@@ -1296,58 +2282,34 @@ Tui::ZTextOption File::textOption() const {
 
 
 bool File::highlightBracketFind() {
-    QString openBracket = "{[(<";
-    QString closeBracket = "}])>";
-
     if (highlightBracket()) {
         const auto [cursorCodeUnit, cursorLine] = cursorPosition();
 
         if (cursorCodeUnit < document()->lineCodeUnits(cursorLine)) {
-            for (int i = 0; i < openBracket.size(); i++) {
-                if (document()->line(cursorLine)[cursorCodeUnit] == openBracket[i]) {
-                    int y = 0;
-                    int counter = 0;
-                    int startX = cursorCodeUnit + 1;
-                    for (int line = cursorLine; y++ < rect().height() && line < document()->lineCount(); line++) {
-                        for (; startX < document()->lineCodeUnits(line); startX++) {
-                            if (document()->line(line)[startX] == openBracket[i]) {
-                                counter++;
-                            } else if (document()->line(line)[startX] == closeBracket[i]) {
-                                if (counter > 0) {
-                                    counter--;
-                                } else {
-                                    _bracketPosition.line = line;
-                                    _bracketPosition.codeUnit = startX;
-                                    return true;
-                                }
-                            }
-                        }
-                        startX = 0;
-                    }
+            const QChar ch = document()->line(cursorLine)[cursorCodeUnit];
+            auto text = [this](int line) {
+                return document()->line(line);
+            };
+            for (BracketIndex &index: _shared->bracketIndexes()) {
+                if (ch != index.open() && ch != index.close()) {
+                    continue;
                 }
-
-                if (document()->line(cursorLine)[cursorCodeUnit] == closeBracket[i]) {
-                    int counter = 0;
-                    int startX = cursorCodeUnit - 1;
-                    for (int line = cursorLine; line >= 0;) {
-                        for (; startX >= 0; startX--) {
-                            if (document()->line(line)[startX] == closeBracket[i]) {
-                                counter++;
-                            } else if (document()->line(line)[startX] == openBracket[i]) {
-                                if (counter > 0) {
-                                    counter--;
-                                } else {
-                                    _bracketPosition.line = line;
-                                    _bracketPosition.codeUnit = startX;
-                                    return true;
-                                }
-                            }
-                        }
-                        if(--line >= 0) {
-                            startX = document()->lineCodeUnits(line) - 1;
-                        }
-                    }
+                QVector<int> hints;
+                for (File *view: views()) {
+                    // After removing lines at the end the cursor is on the line before them.
+                    const int line = view->textCursor().position().line;
+                    hints.append(line);
+                    hints.append(line + 1);
                 }
+                _shared->syncBracketIndexes(index, hints);
+                int matchLine = -1;
+                int matchCodeUnit = -1;
+                if (index.findMatch(cursorLine, cursorCodeUnit, text, &matchLine, &matchCodeUnit)) {
+                    _bracketPosition.line = matchLine;
+                    _bracketPosition.codeUnit = matchCodeUnit;
+                    return true;
+                }
+                break;
             }
         }
     }
@@ -1356,10 +2318,56 @@ bool File::highlightBracketFind() {
     return false;
 }
 
+// Appends the ranges of sorted, non overlapping highlights that reach into the window. Binary search
+// keeps this independent of the number of ranges in the line.
+static void appendHighlightsInWindow(QVector<Tui::ZFormatRange> &highlights,
+                                     const QVector<Tui::ZFormatRange> &lineHighlights,
+                                     int startCodeUnit, int endCodeUnit, bool toLineEnd) {
+    auto it = std::partition_point(lineHighlights.cbegin(), lineHighlights.cend(),
+                                   [startCodeUnit](const Tui::ZFormatRange &range) {
+        return range.start() + range.length() <= startCodeUnit;
+    });
+    for (; it != lineHighlights.cend() && (toLineEnd || it->start() < endCodeUnit); ++it) {
+        highlights.append(*it);
+    }
+}
+
+// Moves highlights from line code units to those of a layout of the window and drops what is outside.
+// Ranges past the end of the window are kept if the window reaches the end of the line.
+static void clipHighlightsToWindow(QVector<Tui::ZFormatRange> &highlights, int startCodeUnit, int endCodeUnit,
+                                   bool toLineEnd, int padding) {
+    QVector<Tui::ZFormatRange> clipped;
+    for (const Tui::ZFormatRange &range: highlights) {
+        const int start = std::max(range.start(), startCodeUnit);
+        const int end = toLineEnd ? range.start() + range.length() : std::min(range.start() + range.length(), endCodeUnit);
+        if (start >= end) {
+            continue;
+        }
+        Tui::ZFormatRange moved = range;
+        moved.setStart(start - startCodeUnit + padding);
+        moved.setLength(end - start);
+        clipped.append(moved);
+    }
+    highlights = clipped;
+}
+
 void File::paintEvent(Tui::ZPaintEvent *event) {
     Tui::ZColor fg = getColor("chr.editFg");
     Tui::ZColor bg = getColor("chr.editBg");
 
+    if (_loading) {
+        auto *painter = event->painter();
+        painter->clear(fg, bg);
+        painter->writeWithColors(lineNumberBorderWidth(), 0, "Loading…", Tui::Colors::darkGray, bg);
+        return;
+    }
+
+    if (!_onScreen) {
+        // Covered by other windows, skip the layouts.
+        event->painter()->clear(fg, bg);
+        return;
+    }
+
     setCursorColor(fg.redOrGuess(), fg.greenOrGuess(), fg.blueOrGuess());
 
     highlightBracketFind();
@@ -1428,6 +2436,12 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
     const auto [cursorCodeUnit, cursorLineReal] = cursor.position();
     const int cursorLine = _blockSelect ? _blockSelectEndLine->line() : cursorLineReal;
 
+    const bool wrapping = wordWrapMode() != Tui::ZTextOption::WrapMode::NoWrap;
+    bool wrappedRowsChanged = false;
+    if (wrapping) {
+        syncWrapIndex();
+    }
+
     QString strlinenumber;
     int y = -scrollPositionFineLine();
     int tmpLastLineWidth = 0;
@@ -1436,17 +2450,30 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
         const bool cursorAtEndOfCurrentLine = [&, cursorCodeUnit=cursorCodeUnit] {
             if (_blockSelect) {
                 if (multiIns && firstSelectBlockLine <= line && line <= lastSelectBlockLine) {
-                    auto testLayout = textLayoutForLineWithoutWrapping(line);
-                    auto testLayoutLine = testLayout.lineAt(0);
-                    return testLayoutLine.width() == firstSelectBlockColumn;
+                    return positionMap(line).width() == firstSelectBlockColumn;
                 }
                 return false;
             } else {
                 return line == cursorLine && document()->lineCodeUnits(cursorLine) == cursorCodeUnit;
             }
         }();
-        Tui::ZTextLayout lay = cursorAtEndOfCurrentLine ? textLayoutForLine(optionCursorAtEndOfLine, line)
-                                                        : textLayoutForLine(option, line);
+        const Tui::ZTextOption &lineOption = cursorAtEndOfCurrentLine ? optionCursorAtEndOfLine : option;
+        std::optional<LineWindow> window;
+        if (wordWrapMode() == Tui::ZTextOption::WrapMode::NoWrap) {
+            window = visibleLineWindow(line, scrollPositionColumns, rect().width() - lineNumberBorderWidth());
+        }
+        Tui::ZTextLayout lay = window ? textLayoutForLineWindow(lineOption, line, *window)
+                                      : textLayoutForLine(lineOption, line);
+        const int layoutOrigin = window ? window->originColumn : 0;
+        if (wrapping && (!_wrapIndex.isExact(line) || _wrapIndex.revision(line) != document()->lineRevision(line))) {
+            if (_wrapIndex.revision(line) != document()->lineRevision(line)) {
+                _wrapIndex.replace(line, 1, {document()->lineRevision(line)}, {lay.lineCount()});
+            }
+            // The index counts rows with the plain text option like the fill and scrolling do.
+            _wrapIndex.setRows(line, colorTrailingSpaces() && !cursorAtEndOfCurrentLine
+                                     ? wrappedRows(optionCursorAtEndOfLine, line) : lay.lineCount());
+            wrappedRowsChanged = true;
+        }
 
         // highlights
         highlights.clear();
@@ -1460,6 +2487,9 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
                     // the state can still be stale, but much more edits can be done without visible glitches
                     // with stale state.
                     highlights += std::get<1>(_syntaxHighlightExporter.highlightLineWrap(document()->line(line), extraData->stateBegin));
+                } else if (window) {
+                    appendHighlightsInWindow(highlights, extraData->highlights, window->startCodeUnit,
+                                             window->endCodeUnit, window->endCodeUnit == document()->lineCodeUnits(line));
                 } else {
                     highlights += extraData->highlights;
                 }
@@ -1476,11 +2506,19 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
                     if (_searchCaseSensitivity == Qt::CaseInsensitive) {
                         rx.setPatternOptions(QRegularExpression::PatternOption::CaseInsensitiveOption);
                     }
-                    QRegularExpressionMatchIterator i = rx.globalMatch(document()->line(line));
+                    // Matches reaching further than the margin out of the window are cut off there.
+                    int searchStart = 0;
+                    int searchEnd = document()->lineCodeUnits(line);
+                    if (window) {
+                        searchStart = std::max(0, window->startCodeUnit - windowedSearchMarginCodeUnits);
+                        searchEnd = std::min(searchEnd, window->endCodeUnit + windowedSearchMarginCodeUnits);
+                    }
+                    QRegularExpressionMatchIterator i = rx.globalMatch(window ? document()->line(line).mid(searchStart, searchEnd - searchStart)
+                                                                              : document()->line(line));
                     while (i.hasNext()) {
                         QRegularExpressionMatch match = i.next();
                         if (match.capturedLength() > 0) {
-                            highlights.append(Tui::ZFormatRange{match.capturedStart(), match.capturedLength(),
+                            highlights.append(Tui::ZFormatRange{searchStart + match.capturedStart(), match.capturedLength(),
                                                                 {Tui::Colors::darkGray, {0xff, 0xdd, 0}, Tui::ZTextAttribute::Bold},
                                                                 selectedFormatingChar,
                                                                 FR_UD_LIVE_SEARCH});
@@ -1488,7 +2526,13 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
                     }
                 }
             } else {
+                if (window) {
+                    found = std::max(0, window->startCodeUnit - _searchText.size()) - 1;
+                }
                 while ((found = document()->line(line).indexOf(_searchText, found + 1, _searchCaseSensitivity)) != -1) {
+                    if (window && found >= window->endCodeUnit) {
+                        break;
+                    }
                     highlights.append(Tui::ZFormatRange{found, _searchText.size(),
                                                         {Tui::Colors::darkGray, {0xff, 0xdd, 0}, Tui::ZTextAttribute::Bold},
                                                         selectedFormatingChar,
@@ -1508,15 +2552,12 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
         // selection
         if (_blockSelect) {
             if (line >= firstSelectBlockLine && line <= lastSelectBlockLine) {
-                Tui::ZTextLayout laySel = textLayoutForLineWithoutWrapping(line);
-                Tui::ZTextLineRef tlrSel = laySel.lineAt(0);
-
                 if (firstSelectBlockColumn == lastSelectBlockColumn) {
-                    highlights.append(Tui::ZFormatRange{tlrSel.xToCursor(firstSelectBlockColumn), 1,
+                    highlights.append(Tui::ZFormatRange{codeUnitForColumn(line, firstSelectBlockColumn), 1,
                                                         multiInsertChar, multiInsertFormatingChar, FR_UD_SELECTION});
                 } else {
-                    const int selFirstCodeUnitInLine = tlrSel.xToCursor(firstSelectBlockColumn);
-                    const int selLastCodeUnitInLine = tlrSel.xToCursor(lastSelectBlockColumn);
+                    const int selFirstCodeUnitInLine = codeUnitForColumn(line, firstSelectBlockColumn);
+                    const int selLastCodeUnitInLine = codeUnitForColumn(line, lastSelectBlockColumn);
                     highlights.append(Tui::ZFormatRange{selFirstCodeUnitInLine, selLastCodeUnitInLine - selFirstCodeUnitInLine,
                                                         selected, selectedFormatingChar, FR_UD_SELECTION});
                 }
@@ -1542,42 +2583,47 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
                                                     selected, selectedFormatingChar, FR_UD_SELECTION});
             }
         }
-        if (_rightMarginHint && lay.maximumWidth() > _rightMarginHint) {
+        if (window) {
+            clipHighlightsToWindow(highlights, window->startCodeUnit, window->endCodeUnit,
+                                   window->endCodeUnit == document()->lineCodeUnits(line), window->padding);
+        }
+        if (_rightMarginHint && layoutOrigin + lay.maximumWidth() > _rightMarginHint) {
             if (lay.lineCount() > leftOfMarginBuffer->height() && leftOfMarginBuffer->height() < rect().height()) {
                 leftOfMarginBuffer.emplace(terminal(), _rightMarginHint + 1,
                                            std::min(std::max(leftOfMarginBuffer->height() * 2, lay.lineCount()), rect().height()));
                 painterLeftOfMargin.emplace(leftOfMarginBuffer->painter());
             }
 
-            lay.draw(*painter, {-scrollPositionColumns + lineNumberBorderWidth(), y}, baseInMargin, &formatingCharInMargin, highlights);
+            lay.draw(*painter, {-scrollPositionColumns + lineNumberBorderWidth() + layoutOrigin, y}, baseInMargin, &formatingCharInMargin, highlights);
             painterLeftOfMargin->clearRect(0, 0, _rightMarginHint + 1, lay.lineCount(), base.foregroundColor(), base.backgroundColor());
-            lay.draw(*painterLeftOfMargin, {0, 0}, base, &formatingChar, highlights);
+            lay.draw(*painterLeftOfMargin, {layoutOrigin, 0}, base, &formatingChar, highlights);
             painter->drawImageWithTiling(-scrollPositionColumns + lineNumberBorderWidth(), y,
                                               *leftOfMarginBuffer, 0, 0, _rightMarginHint, lay.lineCount(),
                                               Tui::ZTilingMode::NoTiling, Tui::ZTilingMode::Put);
         } else {
             if (_formattingCharacters) {
-                lay.draw(*painter, {-scrollPositionColumns + lineNumberBorderWidth(), y}, base, &formatingChar, highlights);
+                lay.draw(*painter, {-scrollPositionColumns + lineNumberBorderWidth() + layoutOrigin, y}, base, &formatingChar, highlights);
             } else {
-                lay.draw(*painter, {-scrollPositionColumns + lineNumberBorderWidth(), y}, base, &base, highlights);
+                lay.draw(*painter, {-scrollPositionColumns + lineNumberBorderWidth() + layoutOrigin, y}, base, &base, highlights);
             }
         }
         Tui::ZTextLineRef lastLine = lay.lineAt(lay.lineCount()-1);
-        tmpLastLineWidth = lastLine.width();
+        const int lastLineWidth = window ? positionMap(line).width() : lastLine.width();
+        tmpLastLineWidth = lastLineWidth;
 
         bool lineBreakSelected = false;
         if (_blockSelect) {
             const int lastSelectBlockHighlightColumn = lastSelectBlockColumn + (multiIns ? 1 : 0);
             if (firstSelectBlockLine <= line && line <= lastSelectBlockLine) {
-                lineBreakSelected = firstSelectBlockColumn <= lastLine.width() && lastLine.width() < lastSelectBlockHighlightColumn;
+                lineBreakSelected = firstSelectBlockColumn <= lastLineWidth && lastLineWidth < lastSelectBlockHighlightColumn;
 
                 // FIXME this does not work with soft wrapped lines, so disable for now when in a wrapped line
-                if (lay.lineCount() == 1 && lastLine.width() + 1 < lastSelectBlockHighlightColumn) {
+                if (lay.lineCount() == 1 && lastLineWidth + 1 < lastSelectBlockHighlightColumn) {
                     Tui::ZTextStyle markStyle = selected;
                     if (firstSelectBlockColumn == lastSelectBlockColumn) {
                         markStyle = multiInsertChar;
                     }
-                    const int firstColumnAfterLineBreakMarker = std::max(lastLine.width() + 1, firstSelectBlockColumn);
+                    const int firstColumnAfterLineBreakMarker = std::max(lastLineWidth + 1, firstSelectBlockColumn);
                     painter->clearRect(-scrollPositionColumns + firstColumnAfterLineBreakMarker + lineNumberBorderWidth(),
                                        y + lastLine.y(), std::max(1, lastSelectBlockColumn - firstColumnAfterLineBreakMarker),
                                        1, markStyle.foregroundColor(), markStyle.backgroundColor());
@@ -1593,18 +2639,18 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
                 if (multiIns) {
                     markStyle = multiInsertChar;
                 }
-                painter->writeWithAttributes(-scrollPositionColumns + lastLine.width() + lineNumberBorderWidth(), y + lastLine.y(), QStringLiteral("¶"),
+                painter->writeWithAttributes(-scrollPositionColumns + lastLineWidth + lineNumberBorderWidth(), y + lastLine.y(), QStringLiteral("¶"),
                                          markStyle.foregroundColor(), markStyle.backgroundColor(), markStyle.attributes());
             } else {
                 Tui::ZTextStyle markStyle = selected;
                 if (multiIns) {
                     markStyle = multiInsertChar;
                 }
-                painter->clearRect(-scrollPositionColumns + lastLine.width() + lineNumberBorderWidth(), y + lastLine.y(), 1, 1, markStyle.foregroundColor(), markStyle.backgroundColor());
+                painter->clearRect(-scrollPositionColumns + lastLineWidth + lineNumberBorderWidth(), y + lastLine.y(), 1, 1, markStyle.foregroundColor(), markStyle.backgroundColor());
             }
         } else if (formattingCharacters()) {
-            const Tui::ZTextStyle &markStyle = (_rightMarginHint && lastLine.width() > _rightMarginHint) ? formatingCharInMargin : formatingChar;
-            painter->writeWithAttributes(-scrollPositionColumns + lastLine.width() + lineNumberBorderWidth(), y + lastLine.y(), QStringLiteral("¶"),
+            const Tui::ZTextStyle &markStyle = (_rightMarginHint && lastLineWidth > _rightMarginHint) ? formatingCharInMargin : formatingChar;
+            painter->writeWithAttributes(-scrollPositionColumns + lastLineWidth + lineNumberBorderWidth(), y + lastLine.y(), QStringLiteral("¶"),
                                          markStyle.foregroundColor(), markStyle.backgroundColor(), markStyle.attributes());
         }
 
@@ -1612,6 +2658,9 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
             if (focus()) {
                 if (_blockSelect) {
                     painter->setCursor(-scrollPositionColumns + lineNumberBorderWidth() + _blockSelectEndColumn, y);
+                } else if (window) {
+                    painter->setCursor(-scrollPositionColumns + lineNumberBorderWidth()
+                                       + positionMap(line).columnForCodeUnit(cursorCodeUnit), y);
                 } else {
                     lay.showCursor(*painter, {-scrollPositionColumns + lineNumberBorderWidth(), y}, cursorCodeUnit);
                 }
@@ -1641,6 +2690,10 @@ void File::paintEvent(Tui::ZPaintEvent *event) {
         }
         y += lay.lineCount();
     }
+    if (wrappedRowsChanged) {
+        // Updates the scroll bars from outside of painting.
+        scheduleWrapIndexFill();
+    }
     if (document()->newlineAfterLastLineMissing()) {
         if (formattingCharacters() && y < rect().height() && scrollPositionColumns == 0) {
             const Tui::ZTextStyle &markStyle = (_rightMarginHint && tmpLastLineWidth > _rightMarginHint) ? formatingCharInMargin : formatingChar;
@@ -1665,6 +2718,236 @@ int File::pageNavigationLineCount() const {
     return std::max(1, geometry().height() - 1);
 }
 
+void File::syncWrapIndex() {
+    const int width = std::max(1, rect().width() - lineNumberBorderWidth());
+    const int lineCount = document()->lineCount();
+    if (width != _wrapIndexWidth || wordWrapMode() != _wrapIndexMode || tabStopDistance() != _wrapIndexTabStop) {
+        // Row counts depend on all of these, so start over with estimates. The lines in view are laid out by
+        // the next paint and the background fill continues from there.
+        _wrapIndexWidth = width;
+        _wrapIndexMode = wordWrapMode();
+        _wrapIndexTabStop = tabStopDistance();
+        _wrapIndexDirty = false;
+        _wrapIndexUnverifiedLines = 0;
+        _wrapIndexHints.clear();
+        _wrapIndexHintsOverflow = false;
+        _wrapIndexFillLine = scrollPositionLine();
+        QVector<unsigned> revisions(lineCount);
+        QVector<int> estimates(lineCount);
+        for (int line = 0; line < lineCount; line++) {
+            revisions[line] = document()->lineRevision(line);
+            estimates[line] = estimatedWrappedRows(line);
+        }
+        _wrapIndex.reset(revisions, estimates);
+        scheduleWrapIndexFill();
+        return;
+    }
+
+    if (!_wrapIndexDirty) {
+        return;
+    }
+    _wrapIndexDirty = false;
+    // Hints can miss lines changed without changing the line count, the fill compares all revisions again.
+    _wrapIndexUnverifiedLines = lineCount;
+
+    // The document does not tell which lines changed. Edits happen at a cursor or in a range known to the
+    // bulk edits, so look for the changed lines there first, that only touches the changed lines.
+    const bool overflow = _wrapIndexHintsOverflow;
+    QVector<int> hints;
+    for (const Tui::ZDocumentLineMarker &marker: _wrapIndexHints) {
+        hints.append(marker.line());
+    }
+    _wrapIndexHints.clear();
+    _wrapIndexHintsOverflow = false;
+    for (File *view: views()) {
+        const int cursorLine = view->textCursor().position().line;
+        // After removing lines at the end the cursor is on the line before them.
+        hints.append(cursorLine);
+        hints.append(cursorLine + 1);
+    }
+
+    LineRevisionIndex index;
+    index.lineCount = [this] {
+        return _wrapIndex.lineCount();
+    };
+    index.revision = [this] (int line) {
+        return _wrapIndex.revision(line);
+    };
+    index.replace = [this] (int first, int removed, int inserted) {
+        QVector<unsigned> revisions(inserted);
+        QVector<int> estimates(inserted);
+        for (int i = 0; i < inserted; i++) {
+            revisions[i] = document()->lineRevision(first + i);
+            estimates[i] = estimatedWrappedRows(first + i);
+        }
+        _wrapIndex.replace(first, removed, revisions, estimates);
+        if (_wrapIndexFillLine > first) {
+            _wrapIndexFillLine = first;
+        }
+    };
+    if (syncLineRevisions(index, lineCount, [this] (int line) { return document()->lineRevision(line); },
+                          hints, overflow)) {
+        _wrapIndexUnverifiedLines = 0;
+    }
+}
+
+void File::addWrapIndexHint(int line) {
+    if (_wrapIndexWidth == -1 || _wrapIndexHintsOverflow) {
+        return;
+    }
+    if (!_wrapIndexHints.empty() && _wrapIndexHints.back().line() == line) {
+        return;
+    }
+    if (static_cast<int>(_wrapIndexHints.size()) >= maxWrapIndexHints) {
+        _wrapIndexHints.clear();
+        _wrapIndexHintsOverflow = true;
+        return;
+    }
+    _wrapIndexHints.emplace_back(document(), line);
+}
+
+void File::hintEditedLines(int line) {
+    for (File *view: views()) {
+        view->addWrapIndexHint(line);
+    }
+    _shared->hintEditedLine(line);
+}
+
+void File::scheduleWrapIndexFill() {
+    if (!_wrapIndexFillScheduled) {
+        _wrapIndexFillScheduled = true;
+        QTimer::singleShot(0, this, &File::fillWrapIndex);
+    }
+}
+
+void File::fillWrapIndex() {
+    _wrapIndexFillScheduled = false;
+    if (wordWrapMode() == Tui::ZTextOption::WrapMode::NoWrap || !_onScreen) {
+        return;
+    }
+    syncWrapIndex();
+
+    // Layouts need the terminal's text metrics, so this runs on the UI thread in short slices.
+    const Tui::ZTextOption option = textOption();
+    const int lineCount = _wrapIndex.lineCount();
+    QElapsedTimer timer;
+    timer.start();
+    for (int checked = 0; checked < lineCount && (_wrapIndex.estimatedLines() > 0 || _wrapIndexUnverifiedLines > 0);
+         checked++) {
+        if (_wrapIndexFillLine >= lineCount) {
+            _wrapIndexFillLine = 0;
+        }
+        const int line = _wrapIndexFillLine++;
+        if (_wrapIndexUnverifiedLines > 0) {
+            _wrapIndexUnverifiedLines--;
+            const unsigned revision = document()->lineRevision(line);
+            if (_wrapIndex.revision(line) != revision) {
+                _wrapIndex.replace(line, 1, {revision}, {estimatedWrappedRows(line)});
+            }
+        }
+        if (!_wrapIndex.isExact(line)) {
+            _wrapIndex.setRows(line, wrappedRows(option, line));
+        }
+        if ((checked & 63) == 63 && timer.elapsed() >= wrapIndexSliceMs) {
+            break;
+        }
+    }
+
+    emitRowScrollRange();
+    emitRowScrollPosition();
+    if (_wrapIndex.estimatedLines() > 0 || _wrapIndexUnverifiedLines > 0) {
+        scheduleWrapIndexFill();
+    }
+}
+
+int File::estimatedWrappedRows(int line) const {
+    return std::max(1, (document()->lineCodeUnits(line) + _wrapIndexWidth - 1) / _wrapIndexWidth);
+}
+
+int File::wrappedRows(const Tui::ZTextOption &option, int line) {
+    // Most lines are short enough that their width is known without a layout.
+    if (document()->lineCodeUnits(line) < _wrapIndexWidth) {
+        const QString text = document()->line(line);
+        int column = 0;
+        if (columnOfCodeUnitWithoutLayout(text, text.size(), tabStopDistance(), &column) && column < _wrapIndexWidth) {
+            return 1;
+        }
+    }
+    return textLayoutForLine(option, line).lineCount();
+}
+
+bool File::wrappedRowAbove(const Tui::ZTextOption &option, int line, int rowInLine, int rows,
+                           int *targetLine, int *targetRowInLine) {
+    while (true) {
+        const int targetRow = _wrapIndex.rowsBefore(line) + rowInLine - rows;
+        const int first = targetRow < 0 ? 0 : _wrapIndex.lineForRow(targetRow, targetRowInLine);
+        if (_wrapIndex.estimatedLines(first, line - 1) == 0) {
+            *targetLine = first;
+            return targetRow >= 0;
+        }
+        // Each line has at least one row, so this lays out at most rows lines.
+        for (int i = first; i < line; i++) {
+            if (!_wrapIndex.isExact(i)) {
+                _wrapIndex.setRows(i, wrappedRows(option, i));
+            }
+        }
+    }
+}
+
+void File::emitRowScrollPosition() {
+    if (wordWrapMode() == Tui::ZTextOption::WrapMode::NoWrap) {
+        rowScrollPositionChanged(scrollPositionColumn(), scrollPositionLine());
+        return;
+    }
+    syncWrapIndex();
+    rowScrollPositionChanged(scrollPositionColumn(),
+                             _wrapIndex.rowsBefore(scrollPositionLine()) + scrollPositionFineLine());
+}
+
+void File::emitRowScrollRange() {
+    if (wordWrapMode() == Tui::ZTextOption::WrapMode::NoWrap) {
+        if (_wrapIndex.lineCount()) {
+            _wrapIndex.clear();
+            _wrapIndexHints.clear();
+            _wrapIndexHintsOverflow = false;
+            _wrapIndexWidth = -1;
+        }
+        rowScrollRangeChanged(_rowScrollRangeColumns, std::max(0, document()->lineCount() - geometry().height()));
+        return;
+    }
+    syncWrapIndex();
+    rowScrollRangeChanged(_rowScrollRangeColumns, std::max(0, _wrapIndex.totalRows() - geometry().height()));
+}
+
+bool File::moveCursorByVisualRows(Tui::ZDocumentCursor &cursor, int rows, bool extendSelection) {
+    if (wordWrapMode() == Tui::ZTextOption::WrapMode::NoWrap) {
+        return false;
+    }
+    syncWrapIndex();
+
+    const Tui::ZTextOption option = textOption();
+    const auto [codeUnit, line] = cursor.position();
+    Tui::ZTextLayout lay = textLayoutForLine(option, line);
+    _wrapIndex.setRows(line, lay.lineCount());
+    const int targetRow = _wrapIndex.rowsBefore(line) + lay.lineForTextPosition(codeUnit).lineNumber() + rows;
+    if (targetRow < 0 || targetRow >= _wrapIndex.totalRows()) {
+        return false;
+    }
+
+    int rowInLine = 0;
+    const int targetLine = _wrapIndex.lineForRow(targetRow, &rowInLine);
+    if (_wrapIndex.estimatedLines(std::min(line, targetLine), std::max(line, targetLine)) > 0) {
+        return false;
+    }
+    Tui::ZTextLayout targetLay = textLayoutForLine(option, targetLine);
+    if (rowInLine >= targetLay.lineCount()) {
+        return false;
+    }
+    const int targetCodeUnit = targetLay.lineAt(rowInLine).xToCursor(cursor.verticalMovementColumn());
+    cursor.setPositionPreservingVerticalMovementColumn({targetCodeUnit, targetLine}, extendSelection);
+    return true;
+}
+
 void File::appendLine(const QString &line) {
     Tui::ZDocumentCursor cur = makeCursor();
     if (document()->lineCount() == 1 && document()->lineCodeUnits(0) == 0) {
@@ -1693,7 +2976,8 @@ void File::insertText(const QString &str) { // TODO das ist kein insertText... O
             blockSelectRemoveSelectedAndConvertToMultiInsert();
         }
 
-        QStringList source = str.split('\n');
+        // References into str, pasted text can be large.
+        QVector<QStringRef> source = str.splitRef('\n');
         if (source.last().isEmpty()) {
             source.removeLast();
         }
@@ -1705,24 +2989,25 @@ void File::insertText(const QString &str) { // TODO das ist kein insertText... O
 
             int sourceLine = 0;
 
+            // Edit the lines as strings and write them back in one edit.
+            QStringList lines;
+            int lastCodeUnit = -1;
             for (int line = firstSelectBlockLine; line < document()->lineCount() && line <= lastSelectBlockLine; line++) {
                 if (source.size() != 1 && sourceLine >= source.size()) {
                     break;
                 }
 
-                Tui::ZTextLayout laySel = textLayoutForLineWithoutWrapping(line);
-                Tui::ZTextLineRef tlrSel = laySel.lineAt(0);
-
-                Tui::ZDocumentCursor cur = makeCursor();
-
-                const int codeUnitInLine = tlrSel.xToCursor(column);
-                cur.setPosition({codeUnitInLine, line});
+                const ColumnPosition position = blockColumnPosition(line, column);
+                QString text = document()->line(line);
+                int codeUnit = position.codeUnit;
 
-                if (tlrSel.width() < column) {
-                    cur.insertText(QString(" ").repeated(column - tlrSel.width()));
+                if (position.width < column) {
+                    text.insert(codeUnit, QString(" ").repeated(column - position.width));
+                    codeUnit += column - position.width;
                 }
 
-                cur.insertText(source[sourceLine]);
+                text.insert(codeUnit, source[sourceLine]);
+                codeUnit += source[sourceLine].size();
 
                 if (source.size() > 1) {
                     sourceLine += 1;
@@ -1730,7 +3015,9 @@ void File::insertText(const QString &str) { // TODO das ist kein insertText... O
                         if (sourceLine < source.size()) {
                             // Now sure what do do with the overflowing lines, for now just dump them in the last line
                             for (; sourceLine < source.size(); sourceLine++) {
-                                cur.insertText("|" + source[sourceLine]);
+                                text.insert(codeUnit, QLatin1Char('|'));
+                                text.insert(codeUnit + 1, source[sourceLine]);
+                                codeUnit += 1 + source[sourceLine].size();
                             }
                         }
                     }
@@ -1738,10 +3025,15 @@ void File::insertText(const QString &str) { // TODO das ist kein insertText... O
                     // keep repeating the one line for all selected lines
                 }
                 if (line == lastSelectBlockLine) {
-                    Tui::ZTextLayout layNew = textLayoutForLineWithoutWrapping(line);
-                    Tui::ZTextLineRef tlrNew = layNew.lineAt(0);
-                    _blockSelectStartColumn = _blockSelectEndColumn = tlrNew.cursorToX(cur.position().codeUnit, Tui::ZTextLayout::Leading);
+                    lastCodeUnit = codeUnit;
                 }
+                lines.append(text);
+            }
+
+            replaceBlockLines(firstSelectBlockLine, lines);
+
+            if (lastCodeUnit != -1) {
+                _blockSelectStartColumn = _blockSelectEndColumn = blockColumnOfCodeUnit(lastSelectBlockLine, lastCodeUnit);
             }
         }
     } else {
@@ -1756,17 +3048,86 @@ void File::insertText(const QString &str) { // TODO das ist kein insertText... O
 }
 
 void File::sortSelecedLines() {
-    if (hasBlockSelection() || hasMultiInsert() || ZTextEdit::hasSelection()) {
-        const auto [startLine, endLine] = getSelectedLines();
-        auto lines = getSelectedLinesSort();
+    sortSelectedLines(SortOptions());
+}
 
-        Tui::ZDocumentCursor cursor = textCursor();
-        document()->sortLines(lines.first, lines.second + 1, &cursor);
-        selectLines(startLine, endLine);
+void File::sortSelectedLines(SortOptions options) {
+    if (_jobControl) {
+        // Only one job at a time.
+        return;
+    }
+    if (!hasBlockSelection() && !hasMultiInsert() && !ZTextEdit::hasSelection()) {
+        adjustScrollPosition();
+        return;
+    }
+
+    const auto [startLine, endLine] = getSelectedLines();
+    const auto [first, last] = getSelectedLinesSort();
+    const bool forward = startLine <= endLine;
+    options.memoryLimit = _sortMemoryLimit;
+
+    if (last - first + 1 < backgroundSortLines) {
+        QStringList lines;
+        lines.reserve(last - first + 1);
+        for (int line = first; line <= last; line++) {
+            lines.append(document()->line(line));
+        }
+        applySortedLines(first, last, forward, *sortLines(lines, options));
+        return;
+    }
+
+    // Large selections are sorted in the background. The selected lines are not known anymore after
+    // edits, so those discard the result.
+    auto compute = [first=first, last=last, options](const Tui::ZDocumentSnapshot &snapshot, JobControl *control) {
+        QStringList lines;
+        lines.reserve(last - first + 1);
+        for (int line = first; line <= last; line++) {
+            lines.append(snapshot.line(line));
+        }
+        return sortLines(lines, options, control);
+    };
+    startJob<QStringList>("SORTING", 0, compute, [this, first=first, last=last, forward](const QStringList &sorted) {
+        applySortedLines(first, last, forward, sorted);
+    });
+}
+
+void File::applySortedLines(int first, int last, bool forward, const QStringList &lines) {
+    auto undoGroup = startUndoGroup();
+    clearSelection();
+
+    // One edit for the whole range.
+    hintEditedLines(first);
+    Tui::ZDocumentCursor cur = makeCursor();
+    cur.setPosition({0, first});
+    cur.setPosition({document()->lineCodeUnits(last), last}, true);
+    cur.insertText(lines.join('\n'));
+
+    // With unique fewer lines might be left.
+    const int newLast = first + lines.size() - 1;
+    if (forward) {
+        selectLines(first, newLast);
+    } else {
+        selectLines(newLast, first);
     }
     adjustScrollPosition();
 }
 
+void File::setSortMemoryLimit(qint64 bytes) {
+    _sortMemoryLimit = bytes;
+}
+
+qint64 File::sortMemoryLimit() const {
+    return _sortMemoryLimit;
+}
+
+void File::setUndoMemoryLimit(qint64 bytes) {
+    _undoMemoryLimit = bytes;
+}
+
+qint64 File::undoMemoryLimit() const {
+    return _undoMemoryLimit;
+}
+
 bool File::event(QEvent *event) {
     if (!parent()) {
         return ZWidget::event(event);
@@ -1793,22 +3154,22 @@ bool File::followStandardInput() {
 }
 
 void File::pasteEvent(Tui::ZPasteEvent *event) {
-    QString text = event->text();
-    if (_formattingCharacters) {
-        text.replace(QString("·"), QString(" "));
-        text.replace(QString("→"), QString(" "));
-        text.replace(QString("¶"), QString(""));
+    if (_loading) {
+        return;
     }
-    text.replace(QString("\r\n"), QString('\n'));
-    text.replace(QString('\r'), QString('\n'));
+    QString text = event->text();
+    normalizePastedText(&text, _formattingCharacters);
 
     insertText(text);
     document()->clearCollapseUndoStep();
     adjustScrollPosition();
+    // Highlighting restarts on its own once the paste is done, the search count does not follow edits.
+    updateSearchCount();
 }
 
 void File::focusInEvent(Tui::ZFocusEvent *event) {
     Q_UNUSED(event);
+    MemoryBudget::instance()->touch(_shared);
     updateCommands();
     if (_searchText == "") {
         _cmdSearchNext->setEnabled(false);
@@ -1828,6 +3189,11 @@ bool File::isNewFile() {
 }
 
 void File::keyEvent(Tui::ZKeyEvent *event) {
+    if (_loading) {
+        // The document is replaced when loading finishes, don't accept edits that would be lost.
+        return;
+    }
+
     auto undoGroup = startUndoGroup();
 
     QString text = event->text();
@@ -2140,8 +3506,10 @@ void File::keyEvent(Tui::ZKeyEvent *event) {
             // Shift+PageUp/Down does not work with xterm's default settings.
             const bool extendSelection = event->modifiers() == Qt::ShiftModifier || selectMode();
             const int amount = pageNavigationLineCount();
-            for (int i = 0; i < amount; i++) {
-                cursor.moveDown(extendSelection);
+            if (!moveCursorByVisualRows(cursor, amount, extendSelection)) {
+                for (int i = 0; i < amount; i++) {
+                    cursor.moveDown(extendSelection);
+                }
             }
             setTextCursor(cursor);
         }
@@ -2162,8 +3530,10 @@ void File::keyEvent(Tui::ZKeyEvent *event) {
             // Shift+PageUp/Down does not work with xterm's default settings.
             const bool extendSelection = event->modifiers() == Qt::ShiftModifier || selectMode();
             const int amount = pageNavigationLineCount();
-            for (int i = 0; i < amount; i++) {
-                cursor.moveUp(extendSelection);
+            if (!moveCursorByVisualRows(cursor, -amount, extendSelection)) {
+                for (int i = 0; i < amount; i++) {
+                    cursor.moveUp(extendSelection);
+                }
             }
             setTextCursor(cursor);
         }
@@ -2190,7 +3560,13 @@ void File::keyEvent(Tui::ZKeyEvent *event) {
                 blockSelectRemoveSelectedAndConvertToMultiInsert();
             }
 
-            multiInsertForEachCursor(mi_add_spaces, [&](Tui::ZDocumentCursor &cur) {
+            // Tabs depend on the settings of the text edit, leave them to the cursor.
+            multiInsertForEachCursor(mi_add_spaces, [](QString &text, int &codeUnit, bool simple) {
+                (void)text;
+                (void)codeUnit;
+                (void)simple;
+                return false;
+            }, [&](Tui::ZDocumentCursor &cur) {
                 insertTabAt(cur);
             });
         } else if (ZTextEdit::hasSelection()) {
@@ -2350,6 +3726,7 @@ void File::keyEvent(Tui::ZKeyEvent *event) {
             adjustScrollPosition();
         }
     } else if (event->key() == Qt::Key_Escape && event->modifiers() == 0) {
+        cancelJob();
         disableDetachedScrolling();
         setSearchVisible(false);
         clearAdvancedSelection();
@@ -2370,18 +3747,76 @@ std::tuple<int, int, int> File::cursorPositionOrBlockSelectionEnd() {
     if (_blockSelect) {
         const int cursorLine = _blockSelectEndLine->line();
         const int cursorColumn = _blockSelectEndColumn;
-        Tui::ZTextLayout layNoWrap = textLayoutForLineWithoutWrapping(cursorLine);
-        const int cursorCodeUnit = layNoWrap.lineAt(0).xToCursor(cursorColumn);
+        const int cursorCodeUnit = codeUnitForColumn(cursorLine, cursorColumn);
         return std::make_tuple(cursorCodeUnit, cursorLine, cursorColumn);
     } else {
         const auto [cursorCodeUnit, cursorLine] = cursorPosition();
-        Tui::ZTextLayout layNoWrap = textLayoutForLineWithoutWrapping(cursorLine);
-        int cursorColumn = layNoWrap.lineAt(0).cursorToX(cursorCodeUnit, Tui::ZTextLayout::Leading);
-
+        const int cursorColumn = positionMap(cursorLine).columnForCodeUnit(cursorCodeUnit);
         return std::make_tuple(cursorCodeUnit, cursorLine, cursorColumn);
     }
 }
 
+const LinePositionMap &File::positionMap(int line) {
+    const QString text = document()->line(line);
+    const unsigned revision = document()->lineRevision(line);
+    if (const LinePositionMap *map = _shared->positionMapCache().find(line, revision, text, tabStopDistance())) {
+        return *map;
+    }
+
+    // The layout is only needed for lines with characters other than printable ASCII and tabs.
+    std::optional<Tui::ZTextLayout> lay;
+    return _shared->positionMapCache().insert(line, revision, LinePositionMap(text, tabStopDistance(), [&](int codeUnit) {
+        if (!lay) {
+            lay.emplace(textLayoutForLineWithoutWrapping(line));
+        }
+        return lay->lineAt(0).cursorToX(codeUnit, Tui::ZTextLayout::Leading);
+    }));
+}
+
+std::optional<File::LineWindow> File::visibleLineWindow(int line, int firstColumn, int columns) {
+    if (document()->lineCodeUnits(line) < windowedLayoutCodeUnits) {
+        return std::nullopt;
+    }
+
+    // Tabs and double wide characters at the edges need some extra room.
+    const int margin = tabStopDistance() + 2;
+    const LinePositionMap &map = positionMap(line);
+    LineWindow window;
+    int startColumn = 0;
+    window.startCodeUnit = map.windowStart(firstColumn - margin, &startColumn);
+    window.endCodeUnit = map.windowEnd(firstColumn + columns + margin);
+    if (window.startCodeUnit == 0 && window.endCodeUnit == document()->lineCodeUnits(line)) {
+        return std::nullopt;
+    }
+    window.padding = startColumn % std::max(1, tabStopDistance());
+    window.originColumn = startColumn - window.padding;
+    return window;
+}
+
+Tui::ZTextLayout File::textLayoutForLineWindow(const Tui::ZTextOption &option, int line, const LineWindow &window) {
+    const QString text = document()->line(line);
+    // The padding is not a space, so it does not show up as a formatting character. The character
+    // after a cut off end keeps spaces before it from being colored as trailing whitespace.
+    QString part = QString("x").repeated(window.padding)
+            + text.midRef(window.startCodeUnit, window.endCodeUnit - window.startCodeUnit);
+    if (window.endCodeUnit < text.size()) {
+        part += "x";
+    }
+    Tui::ZTextLayout lay(terminal()->textMetrics(), part);
+    lay.setTextOption(option);
+    lay.doLayout(std::max(rect().width() - lineNumberBorderWidth(), 0));
+    return lay;
+}
+
+int File::codeUnitForColumn(int line, int column) {
+    int codeUnit = 0;
+    if (positionMap(line).codeUnitForColumn(column, &codeUnit)) {
+        return codeUnit;
+    }
+    Tui::ZTextLayout lay = textLayoutForLineWithoutWrapping(line);
+    return lay.lineAt(0).xToCursor(column);
+}
+
 void File::adjustScrollPosition() {
     // diff to base class: uses cursorPositionOrBlockSelectionEnd(…)
     if (geometry().width() <= 0 && geometry().height() <= 0) {
@@ -2438,11 +3873,13 @@ void File::adjustScrollPosition() {
         }
     } else {
         Tui::ZTextOption option = textOption();
+        syncWrapIndex();
 
         const int availableLinesAbove = geometry().height() - 2;
 
         Tui::ZTextLayout layCursorLayout = textLayoutForLine(option, cursorLine);
-        int linesAbove = layCursorLayout.lineForTextPosition(cursorCodeUnit).lineNumber();
+        _wrapIndex.setRows(cursorLine, layCursorLayout.lineCount());
+        const int linesAbove = layCursorLayout.lineForTextPosition(cursorCodeUnit).lineNumber();
 
         if (linesAbove >= availableLinesAbove) {
             if (newScrollPositionLine < cursorLine) {
@@ -2455,29 +3892,21 @@ void File::adjustScrollPosition() {
                 }
             }
         } else {
-            for (int line = cursorLine - 1; line >= 0; line--) {
-                Tui::ZTextLayout lay = textLayoutForLine(option, line);
-                if (linesAbove + lay.lineCount() >= availableLinesAbove) {
-                    if (newScrollPositionLine < line) {
-                        newScrollPositionLine = line;
-                        newScrollPositionFineLine = (linesAbove + lay.lineCount()) - availableLinesAbove;
-                    }
-                    if (newScrollPositionLine == line) {
-                        if (newScrollPositionFineLine < (linesAbove + lay.lineCount()) - availableLinesAbove) {
-                            newScrollPositionFineLine = (linesAbove + lay.lineCount()) - availableLinesAbove;
-                        }
+            int line = 0;
+            int fineLine = 0;
+            if (wrappedRowAbove(option, cursorLine, linesAbove, availableLinesAbove, &line, &fineLine)) {
+                if (newScrollPositionLine < line) {
+                    newScrollPositionLine = line;
+                    newScrollPositionFineLine = fineLine;
+                }
+                if (newScrollPositionLine == line) {
+                    if (newScrollPositionFineLine < fineLine) {
+                        newScrollPositionFineLine = fineLine;
                     }
-
-                    //_scrollPositionY = line;
-                    //_scrollFineLine = (linesAbove + lay.lineCount()) - availableLinesAbove;
-                    break;
                 }
-                linesAbove += lay.lineCount();
             }
         }
 
-        linesAbove = layCursorLayout.lineForTextPosition(cursorCodeUnit).lineNumber();
-
         if (newScrollPositionLine == cursorLine) {
             if (linesAbove < newScrollPositionFineLine) {
                 newScrollPositionFineLine = linesAbove;
@@ -2489,22 +3918,14 @@ void File::adjustScrollPosition() {
 
         // scroll when window is larger than the document shown (unless scrolled to top)
         if (newScrollPositionLine && newScrollPositionLine + (geometry().height() - 1) > document()->lineCount()) {
-            int linesCounted = 0;
-            QVector<int> sizes;
-
-            for (int line = document()->lineCount() - 1; line >= 0; line--) {
-                Tui::ZTextLayout lay = textLayoutForLine(option, line);
-                sizes.append(lay.lineCount());
-                linesCounted += lay.lineCount();
-                if (linesCounted >= geometry().height() - 1) {
-                    if (newScrollPositionLine > line) {
-                        newScrollPositionLine = line;
-                        newScrollPositionFineLine = linesCounted - (geometry().height() - 1);
-                    } else if (newScrollPositionLine == line &&
-                               newScrollPositionFineLine > linesCounted - (geometry().height() - 1)) {
-                        newScrollPositionFineLine = linesCounted - (geometry().height() - 1);
-                    }
-                    break;
+            int line = 0;
+            int fineLine = 0;
+            if (wrappedRowAbove(option, document()->lineCount(), 0, geometry().height() - 1, &line, &fineLine)) {
+                if (newScrollPositionLine > line) {
+                    newScrollPositionLine = line;
+                    newScrollPositionFineLine = fineLine;
+                } else if (newScrollPositionLine == line && newScrollPositionFineLine > fineLine) {
+                    newScrollPositionFineLine = fineLine;
                 }
             }
         }
@@ -2519,6 +3940,8 @@ void File::adjustScrollPosition() {
         }
     }
     scrollRangeChanged(std::max(0, max - viewWidth), std::max(0, document()->lineCount() - geometry().height()));
+    _rowScrollRangeColumns = std::max(0, max - viewWidth);
+    emitRowScrollRange();
 
     update();
 }
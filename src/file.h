@@ -3,18 +3,19 @@
 #ifndef FILE_H
 #define FILE_H
 
+#include <functional>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <variant>
 
-#include <QJsonObject>
+#include <QDateTime>
 #include <QPair>
 
 #ifdef SYNTAX_HIGHLIGHTING
 #include <KSyntaxHighlighting/AbstractHighlighter>
 #include <KSyntaxHighlighting/Definition>
-#include <KSyntaxHighlighting/Repository>
 #include <KSyntaxHighlighting/State>
 #include <KSyntaxHighlighting/Theme>
 #endif
@@ -29,12 +30,27 @@
 #include <Tui/ZTextOption.h>
 #include <Tui/ZWidget.h>
 
+#include "attributesstore.h"
+#include "backgroundexecutor.h"
+#include "columnmap.h"
+#include "editjournal.h"
+#include "filesaver.h"
+#include "jobcontrol.h"
+#include "lazyclipboard.h"
+#include "linesort.h"
+#include "memorybudget.h"
+#include "positionmap.h"
+#include "shareddocument.h"
+#include "whitespace.h"
+#include "wrapindex.h"
+
 
 struct ExtraData : public Tui::ZDocumentLineUserData {
 #ifdef SYNTAX_HIGHLIGHTING
     KSyntaxHighlighting::State stateBegin;
     KSyntaxHighlighting::State stateEnd;
 #endif
+    // Ascending and not overlapping, in the order the highlighter reports them.
     QVector<Tui::ZFormatRange> highlights;
     unsigned lineRevision = -1;
 };
@@ -50,6 +66,8 @@ class SyntaxHighlightingSignalForwarder : public QObject {
     Q_OBJECT
 signals:
     void updates(Updates);
+    // Sent after the last updates, also when the highlighting was abandoned.
+    void finished();
 };
 
 #ifdef SYNTAX_HIGHLIGHTING
@@ -78,12 +96,36 @@ class File : public Tui::ZTextEdit {
     Q_OBJECT
 
 public:
-    explicit File(Tui::ZTextMetrics textMetrics, Tui::ZWidget *parent);
+    // With shareDocumentWith set, the new file is another view of the same document, with its own cursor,
+    // selection and scroll position.
+    explicit File(Tui::ZTextMetrics textMetrics, Tui::ZWidget *parent, File *shareDocumentWith = nullptr);
     ~File();
+    // All views of the document, including this one.
+    QList<File*> views() const;
+    SharedDocument *sharedDocument() const;
+    // Like ZTextEdit::isModified(), but standard input that is unloaded counts too. It only exists in
+    // memory then.
+    bool isModified() const;
     bool setFilename(QString _filename);
     QString getFilename();
     bool saveText();
+    FileSaver::Job prepareSave();
+    void finishSave(const FileSaver::Job &job);
+    void setSyncOnSave(bool sync);
+    bool syncOnSave() const;
+    void setStripTrailingWhitespaceOnSave(bool strip);
+    bool stripTrailingWhitespaceOnSave() const;
+    void setJournalDirectory(QString journalDirectory);
+    QString journalDirectory() const;
+    bool hasJournal();
+    bool recoverFromJournal();
+    void discardJournal();
+    void disableJournal();
+    void flushJournal();
     bool openText(QString filename);
+    bool openTextFrom(QIODevice *device);
+    void setLoading(bool loading);
+    bool isLoading() const;
     void cutline();
     void deleteLine();
     void copy() override;
@@ -100,7 +142,10 @@ public:
     QString selectedText();
     bool hasSelection();
     bool removeSelectedText();
+    // Appends one or more lines (separated by \n) to the end of the document as one edit.
     void appendLine(const QString &line);
+    // Appends lines read from standard input, separated by \n.
+    void appendInput(const QByteArray &lines);
     void insertText(const QString &str);
     void setSearchText(QString searchText);
     void setSearchCaseSensitivity(Qt::CaseSensitivity searchCaseSensitivity);
@@ -114,8 +159,16 @@ public:
     bool writeAttributes();
     void setAttributesFile(QString attributesFile);
     QString attributesFile();
+    // Whitespace conversions are applied as one undo step and return the number of changed lines.
+    // On large documents they and replaceAll run as a job and return -1, or 0 while another job runs.
     int convertTabsToSpaces();
+    // Converts the indentation from the current tab width to indentSize and switches the file to that.
+    int convertIndentation(bool useTabs, int indentSize);
+    int stripTrailingWhitespace();
     int replaceAll(QString searchText, QString replaceText);
+    // Whether searchText is a regular expression, in regex search mode, that matches an empty text like ^ or $.
+    // replaceAll refuses those, searching skips empty matches.
+    bool matchesEmptyText(const QString &searchText) const;
     void setRightMarginHint(int hint);
     int rightMarginHint() const;
     bool isNewFile();
@@ -138,6 +191,45 @@ public:
     bool newText(QString filename);
     bool stdinText();
     void sortSelecedLines();
+    void sortSelectedLines(SortOptions options);
+    // Whole document operations on large documents run as a job in the background, one at a time.
+    bool isJobRunning() const;
+    void cancelJob();
+    void setSortMemoryLimit(qint64 bytes);
+    qint64 sortMemoryLimit() const;
+    // Standard input that was neither edited nor saved drops its undo history when that takes more. 0 means
+    // no limit.
+    void setUndoMemoryLimit(qint64 bytes);
+    qint64 undoMemoryLimit() const;
+    // Done when a memory measurement finds more undo history than that.
+    void dropStreamHistory();
+    // Files that can't be seen pause highlighting, search counting and filling the wrap index, and don't
+    // paint. They catch up when they are on screen again.
+    void setOnScreen(bool onScreen);
+    bool isOnScreen() const;
+    // Unmodified documents that can't be seen may have their text unloaded to stay within the memory
+    // budget. Their views are loading until one of them read the file again with beginReload() and
+    // reloadText(). beginReload() returns false if the text is not unloaded or another view reloads it.
+    bool isUnloaded() const;
+    // Drops the text, see MemoryBudget. Only for documents that were allowed to be evicted.
+    void unloadText();
+    // Size or modification time of the file differ from when the text was unloaded. The text read again
+    // is not the one that was unloaded.
+    bool changedOnDiskSinceUnload();
+    bool beginReload();
+    bool reloadText(QIODevice *device);
+    // Standard input that was only appended to is kept as compact UTF-8 while it is unloaded, as it can't
+    // be read again. Input arriving meanwhile is added there. reloadStream() decodes it again.
+    bool isStream() const;
+    void reloadStream();
+    struct ViewPosition {
+        Tui::ZDocumentCursor::Position cursor = {0, 0};
+        int scrollColumn = 0;
+        int scrollLine = 0;
+        int scrollFineLine = 0;
+    };
+    // Cursor and scroll position, for an unloaded document where they were before unloading.
+    ViewPosition viewPosition();
 
     bool event(QEvent *event) override;
     bool followStandardInput();
@@ -153,6 +245,11 @@ signals:
     void searchVisibleChanged(bool visible);
     void syntaxHighlightingLanguageChanged(QString language);
     void syntaxHighlightingEnabledChanged(bool enable);
+    // percent is -1 when no job is running
+    void jobProgress(QString name, int percent);
+    // Like scrollPositionChanged and scrollRangeChanged, but y counts visual rows when wrapping.
+    void rowScrollPositionChanged(int x, int y);
+    void rowScrollRangeChanged(int x, int y);
 
 protected:
     void paintEvent(Tui::ZPaintEvent *event) override;
@@ -166,7 +263,17 @@ protected:
     bool canCopy() override;
 
 private:
+    File(Tui::ZTextMetrics textMetrics, SharedDocument *shared, Tui::ZWidget *parent);
     bool initText();
+    // memory budget
+    void addToMemoryBudget();
+    void measureMemory();
+    bool canEvict();
+    void setUnloaded(bool unloaded);
+    void restoreViewPositions();
+    // Tells the wrap indexes of all views and the bracket indexes that an edit of lines starting at line follows.
+    void hintEditedLines(int line);
+    void addWrapIndexHint(int line);
     void adjustScrollPosition() override;
     void emitCursorPostionChanged() override;
 
@@ -176,27 +283,62 @@ private:
     Tui::ZTextOption textOption() const override;
 
     bool highlightBracketFind();
+    void updateSearchCount();
     void searchSelect(int line, int found, int length, bool direction);
     int pageNavigationLineCount() const override;
+
+    // wrap index
+    void syncWrapIndex();
+    void scheduleWrapIndexFill();
+    void fillWrapIndex();
+    int estimatedWrappedRows(int line) const;
+    int wrappedRows(const Tui::ZTextOption &option, int line);
+    // Finds the visual row rows rows above row rowInLine of line. Lays out the lines in between that only have
+    // an estimate. Returns false if that row is above the start of the document.
+    bool wrappedRowAbove(const Tui::ZTextOption &option, int line, int rowInLine, int rows,
+                         int *targetLine, int *targetRowInLine);
+    void emitRowScrollPosition();
+    void emitRowScrollRange();
+    // Moves by visual rows using the wrap index. Returns false if the cursor needs to be moved row by row,
+    // because the rows in between are not known yet or the movement hits the start or end of the document.
+    bool moveCursorByVisualRows(Tui::ZDocumentCursor &cursor, int rows, bool extendSelection);
     void checkWritable();
 
     QPair<int, int> getSelectedLinesSort();
     QPair<int, int> getSelectedLines();
     void selectLines(int startY, int endY);
 
-    bool readAttributes();
-    Tui::ZDocumentCursor::Position getAttributes();
+    std::optional<FileAttributes> getAttributes();
 
     std::tuple<int, int, int> cursorPositionOrBlockSelectionEnd();
+    // Column, code unit and UTF-8 conversions for a line without wrapping, cached per line.
+    const LinePositionMap &positionMap(int line);
+    int codeUnitForColumn(int line, int column);
+    // Part of a long line that is laid out when painting without wrapping.
+    struct LineWindow {
+        int startCodeUnit = 0;
+        int endCodeUnit = 0;
+        // Column of the line at which the layout starts.
+        int originColumn = 0;
+        // Code units the layout has in front of startCodeUnit, to keep tab stops aligned.
+        int padding = 0;
+    };
+    std::optional<LineWindow> visibleLineWindow(int line, int firstColumn, int columns);
+    Tui::ZTextLayout textLayoutForLineWindow(const Tui::ZTextOption &option, int line, const LineWindow &window);
 
     // block selection
     void activateBlockSelection();
     void disableBlockSelection();
     void blockSelectRemoveSelectedAndConvertToMultiInsert();
+    ColumnPosition blockColumnPosition(int line, int column);
+    int blockColumnOfCodeUnit(int line, int codeUnit);
+    void replaceBlockLines(int firstLine, const QStringList &lines);
     static const int mi_add_spaces = 1;
     static const int mi_skip_short_lines = 2;
-    template<typename F>
-    void multiInsertForEachCursor(int flags, F f);
+    // textEdit(text, codeUnit, simple) edits the line as a string and returns false if the edit needs
+    // to be done by cursorEdit instead. simple is set for lines of printable ASCII and tabs.
+    template<typename F, typename G>
+    void multiInsertForEachCursor(int flags, F textEdit, G cursorEdit);
     void multiInsertDeletePreviousCharacter();
     void multiInsertDeletePreviousWord();
     void multiInsertDeleteCharacter();
@@ -205,8 +347,22 @@ private:
 #ifdef SYNTAX_HIGHLIGHTING
     void ingestSyntaxHighlightingUpdates(Updates);
     void updateSyntaxHighlighting(bool force);
+    void scheduleSyntaxHighlightingUpdate();
+    void releaseSyntaxHighlightingClaim(bool upToDate);
     void syntaxHighlightDefinition();
 #endif
+    // Runs compute on a snapshot in the background and apply with its result on the UI thread, if the
+    // document is still unchanged. Otherwise compute is started again on a new snapshot, at most restarts
+    // times. compute returns nullopt when cancelled. Returns false if another job is running.
+    template<typename Result>
+    bool startJob(const QString &name, int restarts,
+                  std::function<std::optional<Result>(const Tui::ZDocumentSnapshot&, JobControl*)> compute,
+                  std::function<void(const Result&)> apply);
+    // background allows running as a job on large documents. applied is called after the edits are made.
+    int transformWhitespace(const WhitespaceOptions &options, bool background = true,
+                            std::function<void()> applied = nullptr);
+    int applyWhitespaceEdits(const WhitespaceOptions &options, const Tui::ZTextOption &option, WhitespaceEdits result);
+    void applySortedLines(int first, int last, bool forward, const QStringList &lines);
 
 private:
     // block selection
@@ -215,6 +371,31 @@ private:
     std::optional<Tui::ZDocumentLineMarker> _blockSelectEndLine;
     int _blockSelectStartColumn = -1;
     int _blockSelectEndColumn = -1;
+    // The wrap index is valid for this layout width, wrap mode and tab stop distance.
+    WrapIndex _wrapIndex;
+    int _wrapIndexWidth = -1;
+    Tui::ZTextOption::WrapMode _wrapIndexMode = Tui::ZTextOption::WrapMode::NoWrap;
+    int _wrapIndexTabStop = -1;
+    bool _wrapIndexDirty = false;
+    // Lines the fill still has to compare with the document, changes away from the cursors are found that way.
+    int _wrapIndexUnverifiedLines = 0;
+    // Places edited since the last sync besides the current cursors: cursors of earlier edits and the
+    // starts of bulk edits. The markers move with later edits, the sync starts looking for changes there.
+    std::list<Tui::ZDocumentLineMarker> _wrapIndexHints;
+    // More places were edited than are remembered, the sync compares the whole document.
+    bool _wrapIndexHintsOverflow = false;
+    bool _wrapIndexFillScheduled = false;
+    int _wrapIndexFillLine = 0;
+    int _rowScrollRangeColumns = 0;
+    bool _onScreen = true;
+    bool _searchCountPending = false;
+    // Where the view was when the text was unloaded.
+    ViewPosition _unloadedPosition;
+    bool _unloadedFollow = false;
+    bool _unloadedModified = false;
+    QDateTime _unloadedLastModified;
+    qint64 _unloadedSize = -1;
+    bool _reloading = false;
 
     bool _eatSpaceBeforeTabs = true;
     QString _searchText;
@@ -229,9 +410,19 @@ private:
     std::optional<QFuture<Tui::ZDocumentFindAsyncResult>> _searchNextFuture;
     bool _followMode = false;
     bool _stdin = false;
+    bool _loading = false;
+    bool _syncOnSave = true;
+    bool _stripTrailingWhitespaceOnSave = false;
+    std::shared_ptr<JobControl> _jobControl;
+    // Set when the file is closed, drops its queued background work.
+    CancelToken _cancelToken = std::make_shared<std::atomic<bool>>(false);
+    qint64 _sortMemoryLimit = SortOptions().memoryLimit;
+    qint64 _undoMemoryLimit = 0;
+    // Owns the document, the journal and the line caches.
+    SharedDocument *_shared = nullptr;
+    EditJournal *_journal = nullptr;
     Position _bracketPosition;
     bool _bracket = false;
-    QJsonObject _attributeObject;
     QString _attributesFile;
     bool _saveAs = true;
     bool _formattingCharacters = true;
@@ -247,10 +438,14 @@ private:
     QString _syntaxHighlightingLanguage = "None";
     bool _syntaxHighlightingActive = false;
 #ifdef SYNTAX_HIGHLIGHTING
-    KSyntaxHighlighting::Repository _syntaxHighlightRepo;
     KSyntaxHighlighting::Theme _syntaxHighlightingTheme;
     KSyntaxHighlighting::Definition _syntaxHighlightDefinition;
     HighlightExporter _syntaxHighlightExporter;
+    bool _syntaxHighlightingUpdateScheduled = false;
+    bool _syntaxHighlightingPending = false;
+    // Highlighting tasks of this view that have not finished yet. The claim on the shared document is held
+    // until they are done.
+    int _syntaxHighlightingRunning = 0;
 #endif
 };
 
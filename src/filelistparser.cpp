@@ -2,6 +2,8 @@
 
 #include "filelistparser.h"
 
+#include "filecategorize.h"
+
 
 QVector<FileListEntry> parseFileList(QStringList args)
 {
@@ -45,3 +47,24 @@ QVector<FileListEntry> parseFileList(QStringList args)
     }
     return res;
 }
+
+QString checkFileList(const QVector<FileListEntry> &entries) {
+    for (const FileListEntry &fle: entries) {
+        FileCategory filecategory = fileCategorize(fle.fileName);
+        if (filecategory == FileCategory::open_file || filecategory == FileCategory::new_file
+                || filecategory == FileCategory::dir) {
+            continue;
+        } else if (filecategory == FileCategory::invalid_file_not_readable) {
+            return "File not readable: " + fle.fileName;
+        } else if (filecategory == FileCategory::invalid_filetype) {
+            return "File type cannot be opened: " + fle.fileName;
+        } else if (filecategory == FileCategory::invalid_dir_not_exist) {
+            return "Directory not exist, cannot be opened: " + fle.fileName;
+        } else if (filecategory == FileCategory::invalid_dir_not_writable) {
+            return "Directory not writable, cannot be opened: " + fle.fileName;
+        } else {
+            return "Invalid error.";
+        }
+    }
+    return {};
+}
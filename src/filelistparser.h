@@ -16,4 +16,8 @@ struct FileListEntry {
 
 QVector<FileListEntry> parseFileList(QStringList args);
 
+// Returns the message for the first entry that can't be opened by a running editor or an empty string
+// when all of them can, so that a list is either opened completely or not at all.
+QString checkFileList(const QVector<FileListEntry> &entries);
+
 #endif // FILELISTPARSER_H
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "fileloader.h"
+
+#include <algorithm>
+
+#include <QFile>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrent>
+
+
+FileLoader::FileLoader(QObject *parent) : QObject(parent) {
+    // Reading is mostly waiting for storage, so use at least a few threads even on small machines.
+    _pool.setMaxThreadCount(std::max(4, QThread::idealThreadCount()));
+}
+
+FileLoader::~FileLoader() {
+    _queue.clear();
+    // Running jobs reference this object, wait for them. Their queued completions are dropped with us.
+    _pool.waitForDone();
+}
+
+void FileLoader::load(QObject *requester, const QString &filename, std::function<void(QByteArray, bool)> done) {
+    _queue.append(Request{requester, filename, done});
+    scheduleDispatch();
+}
+
+void FileLoader::prioritize(QObject *requester) {
+    for (int i = 0; i < _queue.size(); i++) {
+        if (_queue[i].requester == requester) {
+            _queue.move(i, 0);
+            return;
+        }
+    }
+}
+
+void FileLoader::scheduleDispatch() {
+    // Defer starting jobs to the event loop, so that all requests issued during startup and the
+    // prioritization of the window that ends up with focus are known before the first job starts.
+    if (!_dispatchScheduled) {
+        _dispatchScheduled = true;
+        QTimer::singleShot(0, this, [this] {
+            _dispatchScheduled = false;
+            dispatch();
+        });
+    }
+}
+
+void FileLoader::dispatch() {
+    while (_running < _pool.maxThreadCount() && !_queue.isEmpty()) {
+        Request request = _queue.takeFirst();
+        if (!request.requester) {
+            // requesting window was closed in the meantime
+            continue;
+        }
+
+        _running++;
+        QtConcurrent::run(&_pool, [this, request] {
+            QByteArray data;
+            bool ok = false;
+            QFile file(request.filename);
+            if (file.open(QIODevice::ReadOnly)) {
+                data = file.readAll();
+                ok = file.error() == QFileDevice::NoError;
+                file.close();
+            }
+
+            QMetaObject::invokeMethod(this, [this, request, data, ok] {
+                _running--;
+                if (request.requester) {
+                    request.done(data, ok);
+                }
+                dispatch();
+            }, Qt::QueuedConnection);
+        });
+    }
+}
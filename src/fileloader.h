@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef FILELOADER_H
+#define FILELOADER_H
+
+#include <functional>
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+
+
+// Reads files on a pool of worker threads. Requests are started in order, except that a prioritized
+// request jumps the queue. Completion callbacks are run on the thread the loader lives in, but only
+// as long as the requesting object is still alive.
+class FileLoader : public QObject {
+    Q_OBJECT
+
+public:
+    explicit FileLoader(QObject *parent = nullptr);
+    ~FileLoader() override;
+
+public:
+    void load(QObject *requester, const QString &filename, std::function<void(QByteArray data, bool ok)> done);
+    void prioritize(QObject *requester);
+
+private:
+    void scheduleDispatch();
+    void dispatch();
+
+private:
+    struct Request {
+        QPointer<QObject> requester;
+        QString filename;
+        std::function<void(QByteArray data, bool ok)> done;
+    };
+
+    QList<Request> _queue;
+    int _running = 0;
+    bool _dispatchScheduled = false;
+    QThreadPool _pool;
+};
+
+#endif // FILELOADER_H
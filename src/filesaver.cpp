@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "filesaver.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QtConcurrent>
+
+#include <Tui/Misc/SurrogateEscape.h>
+
+
+static const int chunkSize = 4 * 1024 * 1024;
+
+static bool writeLines(QFileDevice *file, const FileSaver::Job &job, const std::function<void(int percent)> &progress) {
+    const int lineCount = job.snapshot.lineCount();
+    const QByteArray newline = job.crLfMode ? "\r\n" : "\n";
+
+    QByteArray buffer;
+    buffer.reserve(chunkSize + 64 * 1024);
+    int lastPercent = -1;
+
+    for (int line = 0; line < lineCount; line++) {
+        buffer += Tui::Misc::SurrogateEscape::encode(job.snapshot.line(line));
+        if (line + 1 < lineCount || !job.newlineAfterLastLineMissing) {
+            buffer += newline;
+        }
+
+        if (buffer.size() >= chunkSize) {
+            if (file->write(buffer) != buffer.size()) {
+                return false;
+            }
+            // resize instead of clear to keep the allocation for the next chunk
+            buffer.resize(0);
+
+            const int percent = static_cast<int>(static_cast<qint64>(line) * 100 / lineCount);
+            if (progress && percent != lastPercent) {
+                lastPercent = percent;
+                progress(percent);
+            }
+        }
+    }
+
+    if (buffer.size() && file->write(buffer) != buffer.size()) {
+        return false;
+    }
+    return file->flush();
+}
+
+static void syncDirectory(const QString &path) {
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+FileSaver::FileSaver(QObject *parent) : QObject(parent) {
+    _pool.setMaxThreadCount(2);
+}
+
+FileSaver::~FileSaver() {
+    // Never leave a save half done, wait for running jobs.
+    _pool.waitForDone();
+}
+
+void FileSaver::save(QObject *requester, Job job, std::function<void(int)> progress, std::function<void(bool)> done) {
+    QPointer<QObject> requesterPtr = requester;
+    QtConcurrent::run(&_pool, [this, requesterPtr, job, progress, done] {
+        const bool ok = write(job, [this, requesterPtr, progress] (int percent) {
+            QMetaObject::invokeMethod(this, [requesterPtr, progress, percent] {
+                if (requesterPtr && progress) {
+                    progress(percent);
+                }
+            }, Qt::QueuedConnection);
+        });
+
+        QMetaObject::invokeMethod(this, [requesterPtr, done, ok] {
+            if (requesterPtr && done) {
+                done(ok);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+bool FileSaver::write(const Job &job, const std::function<void(int)> &progress) {
+    QString target = job.filename;
+    QFileInfo targetInfo(target);
+    if (targetInfo.isSymLink()) {
+        // Replace the file the link points to, not the link itself.
+        target = targetInfo.symLinkTarget();
+        targetInfo = QFileInfo(target);
+    }
+
+    struct stat st;
+    const bool exists = ::stat(QFile::encodeName(target).constData(), &st) == 0;
+
+    // Write to a temporary file and rename it over the original, so an interrupted save does not leave
+    // a truncated file behind. That only works if the new file gets the same owner, group and mode and
+    // there are no other hard links to the file. Otherwise overwrite the file in place.
+    if (exists && S_ISREG(st.st_mode) && st.st_nlink == 1) {
+        QTemporaryFile tmp(targetInfo.absolutePath() + "/." + targetInfo.fileName() + ".chr-XXXXXX");
+        if (tmp.open()) {
+            const int fd = tmp.handle();
+            bool attributesOk = true;
+            // change owner first, it can reset the setuid and setgid bits
+            if (st.st_uid != geteuid() || st.st_gid != getegid()) {
+                attributesOk = ::fchown(fd, st.st_uid, st.st_gid) == 0;
+            }
+            attributesOk = attributesOk && ::fchmod(fd, st.st_mode & 07777) == 0;
+
+            if (attributesOk) {
+                if (!writeLines(&tmp, job, progress)) {
+                    return false;
+                }
+                if (job.sync && ::fsync(fd) != 0) {
+                    return false;
+                }
+                if (::rename(QFile::encodeName(tmp.fileName()).constData(), QFile::encodeName(target).constData()) != 0) {
+                    return false;
+                }
+                tmp.setAutoRemove(false);
+                if (job.sync) {
+                    syncDirectory(targetInfo.absolutePath());
+                }
+                return true;
+            }
+        }
+    }
+
+    QFile file(target);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    if (!writeLines(&file, job, progress)) {
+        return false;
+    }
+    if (job.sync && ::fsync(file.handle()) != 0) {
+        return false;
+    }
+    return true;
+}
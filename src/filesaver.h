@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef FILESAVER_H
+#define FILESAVER_H
+
+#include <functional>
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QThreadPool>
+
+#include <Tui/ZDocumentSnapshot.h>
+
+
+// Writes document snapshots to disk on worker threads, so that saving big files does not block the
+// UI thread and editing can continue while the save is running.
+class FileSaver : public QObject {
+    Q_OBJECT
+
+public:
+    struct Job {
+        Tui::ZDocumentSnapshot snapshot;
+        bool crLfMode = false;
+        bool newlineAfterLastLineMissing = false;
+        QString filename;
+        bool sync = true;
+    };
+
+public:
+    explicit FileSaver(QObject *parent = nullptr);
+    ~FileSaver() override;
+
+public:
+    // progress and done are called on the thread the saver lives in, as long as requester is alive.
+    // The file is written completely even if requester is destroyed in the meantime.
+    void save(QObject *requester, Job job, std::function<void(int percent)> progress, std::function<void(bool ok)> done);
+
+    // Synchronous write, also used by the workers.
+    static bool write(const Job &job, const std::function<void(int percent)> &progress = {});
+
+private:
+    QThreadPool _pool;
+};
+
+#endif // FILESAVER_H
@@ -4,7 +4,10 @@
 
 #include <unistd.h>
 
-#include <Tui/Misc/SurrogateEscape.h>
+#include <QBuffer>
+#include <QFile>
+#include <QPointer>
+
 #include <Tui/ZSymbol.h>
 #include <Tui/ZTerminal.h>
 
@@ -12,18 +15,21 @@
 #include "confirmsave.h"
 
 
-FileWindow::FileWindow(Tui::ZWidget *parent) : Tui::ZWindow(parent) {
+// Lines read from standard input are appended this often while the window can't be seen.
+static const int pipeAppendIntervalMs = 500;
+
+FileWindow::FileWindow(Tui::ZWidget *parent, FileWindow *splitOf) : Tui::ZWindow(parent) {
     setOptions(Tui::ZWindow::CloseOption | Tui::ZWindow::DeleteOnClose
                | Tui::ZWindow::MoveOption | Tui::ZWindow::ResizeOption
                | Tui::ZWindow::AutomaticOption);
     setBorderEdges({ Qt::TopEdge });
 
-    _file = new File(terminal()->textMetrics(), this);
+    _file = new File(terminal()->textMetrics(), this, splitOf ? splitOf->getFileWidget() : nullptr);
 
     _scrollbarVertical = new ScrollBar(this);
     _scrollbarVertical->setTransparent(true);
-    QObject::connect(_file, &File::scrollPositionChanged, _scrollbarVertical, &ScrollBar::scrollPosition);
-    QObject::connect(_file, &File::scrollRangeChanged, _scrollbarVertical, &ScrollBar::positonMax);
+    QObject::connect(_file, &File::rowScrollPositionChanged, _scrollbarVertical, &ScrollBar::scrollPosition);
+    QObject::connect(_file, &File::rowScrollRangeChanged, _scrollbarVertical, &ScrollBar::positonMax);
 
     _scrollbarHorizontal = new ScrollBar(this);
     QObject::connect(_file, &File::scrollPositionChanged, _scrollbarHorizontal, &ScrollBar::scrollPosition);
@@ -39,6 +45,11 @@ FileWindow::FileWindow(Tui::ZWidget *parent) : Tui::ZWindow(parent) {
     _winLayout->setBottomBorderLeftAdjust(-1);
     _winLayout->setCentralWidget(_file);
 
+    _pipeAppendTimer = new QTimer(this);
+    _pipeAppendTimer->setSingleShot(true);
+    _pipeAppendTimer->setInterval(pipeAppendIntervalMs);
+    QObject::connect(_pipeAppendTimer, &QTimer::timeout, this, &FileWindow::appendPipeLines);
+
 
     QObject::connect(_file, &File::modifiedChanged, this,
             [this] {
@@ -163,15 +174,68 @@ void FileWindow::setWrap(Tui::ZTextOption::WrapMode wrap) {
     }
 }
 
-bool FileWindow::saveFile(QString filename, std::optional<bool> crlfMode) {
+void FileWindow::setFileSaver(FileSaver *saver) {
+    _fileSaver = saver;
+}
+
+void FileWindow::setFileLoader(FileLoader *loader) {
+    _fileLoader = loader;
+}
+
+void FileWindow::saveFile(QString filename, std::optional<bool> crlfMode, std::function<void(bool)> callback) {
+    if (_file->isLoading()) {
+        // Saving now would replace the file with the empty placeholder document.
+        if (callback) {
+            callback(false);
+        }
+        return;
+    }
+    SharedDocument *shared = _file->sharedDocument();
+    if (shared->isSaving()) {
+        // Start after the running save of any view, so that no two saves of the document write at once.
+        QPointer<FileWindow> window = this;
+        shared->runAfterSave([window, filename, crlfMode, callback] {
+            if (window) {
+                window->saveFile(filename, crlfMode, callback);
+            }
+        });
+        return;
+    }
+
     _file->setFilename(filename);
     backingFileChanged(_file->getFilename());
     watcherRemove();
     if (crlfMode.has_value()) {
         _file->document()->setCrLfMode(*crlfMode);
     }
-    const bool ok = _file->saveText();
+
+    const FileSaver::Job job = _file->prepareSave();
+    if (!_fileSaver) {
+        finishSave(job, FileSaver::write(job), callback);
+        return;
+    }
+
+    // Writing happens on a snapshot in the background, editing can continue meanwhile. The save belongs
+    // to the document, so that it ends even when this window is closed before it is done.
+    shared->setSaving(true);
+    saveProgress(0);
+    QPointer<FileWindow> window = this;
+    _fileSaver->save(shared, job, [window] (int percent) {
+        if (window) {
+            window->saveProgress(percent);
+        }
+    }, [window, shared, job, callback] (bool ok) {
+        if (window) {
+            window->saveProgress(-1);
+            window->finishSave(job, ok, callback);
+        }
+        shared->setSaving(false);
+    });
+}
+
+void FileWindow::finishSave(const FileSaver::Job &job, bool ok, std::function<void(bool)> callback) {
     if (ok) {
+        _file->finishSave(job);
         //windowTitle(filename);
         update();
         fileChangedExternally(false);
@@ -187,7 +251,9 @@ bool FileWindow::saveFile(QString filename, std::optional<bool> crlfMode) {
     watcherAdd();
 
     _cmdReload->setEnabled(true);
-    return ok;
+    if (callback) {
+        callback(ok);
+    }
 }
 
 WrapDialog *FileWindow::wrapDialog() {
@@ -198,10 +264,7 @@ WrapDialog *FileWindow::wrapDialog() {
 SaveDialog *FileWindow::saveFileDialog(std::function<void(bool)> callback) {
     SaveDialog *saveDialog = new SaveDialog(parentWidget(), _file);
     QObject::connect(saveDialog, &SaveDialog::fileSelected, this, [this,callback](const QString &filename, bool crlfMode) {
-        const bool ok = saveFile(filename, crlfMode);
-        if (callback) {
-            callback(ok);
-        }
+        saveFile(filename, crlfMode, callback);
     });
     return saveDialog;
 }
@@ -211,10 +274,7 @@ SaveDialog *FileWindow::saveOrSaveas(std::function<void(bool)> callback) {
         SaveDialog *q = saveFileDialog(callback);
         return q;
     } else {
-        const bool ok = saveFile(_file->getFilename(), std::nullopt);
-        if (callback) {
-            callback(ok);
-        }
+        saveFile(_file->getFilename(), std::nullopt, callback);
         return nullptr;
     }
 }
@@ -235,7 +295,8 @@ void FileWindow::newFile(QString filename) {
 void FileWindow::openFile(QString filename) {
     closePipe();
     watcherRemove();
-    if (!_file->openText(filename)) {
+    const bool ok = _file->openText(filename);
+    if (!ok) {
         Alert *e = new Alert(parentWidget());
         e->setWindowTitle("Error");
         e->setMarkup("Error while reading file.");
@@ -249,9 +310,109 @@ void FileWindow::openFile(QString filename) {
     watcherAdd();
 
     _cmdReload->setEnabled(true);
+    if (ok) {
+        offerJournalRecovery();
+    }
+}
+
+void FileWindow::offerJournalRecovery() {
+    if (!_file->hasJournal()) {
+        return;
+    }
+
+    ConfirmSave *recoverDialog = new ConfirmSave(parentWidget(), _file->getFilename(), ConfirmSave::Recover, true);
+    QObject::connect(recoverDialog, &ConfirmSave::saveSelected, this, [this, recoverDialog] {
+        recoverDialog->deleteLater();
+        if (!_file->recoverFromJournal()) {
+            Alert *e = new Alert(parentWidget());
+            e->setWindowTitle("Error");
+            e->setMarkup("Unsaved changes could not be recovered.");
+            e->setGeometry({15, 5, 50, 5});
+            e->setDefaultPlacement(Qt::AlignCenter);
+            e->setVisible(true);
+            e->setFocus();
+        }
+    });
+    QObject::connect(recoverDialog, &ConfirmSave::discardSelected, this, [this, recoverDialog] {
+        recoverDialog->deleteLater();
+        _file->discardJournal();
+    });
+    QObject::connect(recoverDialog, &ConfirmSave::rejected, this, [this, recoverDialog] {
+        recoverDialog->deleteLater();
+        // Keep the journal for the next time the file is opened.
+        _file->disableJournal();
+    });
+}
+
+void FileWindow::openFileInBackground(QString filename, FileLoader *loader) {
+    openFileDeferred(filename, loader);
+    materialize();
+}
+
+void FileWindow::openFileDeferred(QString filename, FileLoader *loader) {
+    closePipe();
+    watcherRemove();
+    // Show the window with its final name right away, the content follows when the loader is done.
+    _file->newText(filename);
+    _file->setLoading(true);
+    backingFileChanged(_file->getFilename());
+    fileChangedExternally(false);
+
+    _deferredLoader = loader;
+}
+
+void FileWindow::materialize() {
+    if (!_deferredLoader) {
+        return;
+    }
+    FileLoader *loader = _deferredLoader;
+    _deferredLoader = nullptr;
+
+    loader->load(this, _file->getFilename(), [this] (QByteArray data, bool ok) {
+        finishBackgroundOpen(data, ok);
+    });
+}
+
+void FileWindow::finishBackgroundOpen(QByteArray data, bool ok) {
+    _file->setLoading(false);
+
+    QBuffer buffer(&data);
+    ok = ok && buffer.open(QIODevice::ReadOnly) && _file->openTextFrom(&buffer);
+    if (!ok) {
+        Alert *e = new Alert(parentWidget());
+        e->setWindowTitle("Error");
+        e->setMarkup("Error while reading file.");
+        e->setGeometry({15, 5, 50, 5});
+        e->setDefaultPlacement(Qt::AlignCenter);
+        e->setVisible(true);
+        e->setFocus();
+    }
+    fileChangedExternally(false);
+    watcherAdd();
+
+    _cmdReload->setEnabled(true);
+    if (ok) {
+        offerJournalRecovery();
+    }
+
+    auto callbacks = std::move(_whenLoaded);
+    _whenLoaded.clear();
+    for (auto &callback: callbacks) {
+        callback();
+    }
+}
+
+void FileWindow::runWhenLoaded(std::function<void()> callback) {
+    if (_file->isLoading()) {
+        _whenLoaded.push_back(callback);
+    } else {
+        callback();
+    }
 }
 
 void FileWindow::reload() {
+    // changes are discarded by reloading
+    _file->discardJournal();
     closePipe();
     _file->clearSelection();
     Tui::ZDocumentCursor::Position cursorPosition = _file->cursorPosition();
@@ -270,6 +431,89 @@ void FileWindow::reload() {
     watcherAdd();
 }
 
+void FileWindow::reloadUnloadedText() {
+    if (!_file->beginReload()) {
+        return;
+    }
+    if (_file->isStream()) {
+        _file->reloadStream();
+        return;
+    }
+
+    // The undo history went with the unloaded text, so a different version on disk would silently replace
+    // what the user saw before.
+    const bool changedOnDisk = _file->changedOnDiskSinceUnload();
+
+    auto finish = [this, changedOnDisk] (bool ok) {
+        if (!ok) {
+            Alert *e = new Alert(parentWidget());
+            e->setWindowTitle("Error");
+            e->setMarkup("Error while reading file.");
+            e->setGeometry({15, 5, 50, 5});
+            e->setDefaultPlacement(Qt::AlignCenter);
+            e->setVisible(true);
+            e->setFocus();
+        } else if (changedOnDisk) {
+            fileChangedExternally(true);
+            Alert *e = new Alert(parentWidget());
+            e->setWindowTitle("File changed on disk");
+            e->setMarkup("The file was changed while it was unloaded. Showing the new version, undo is lost.");
+            e->setGeometry({15, 5, 50, 5});
+            e->setDefaultPlacement(Qt::AlignCenter);
+            e->setVisible(true);
+            e->setFocus();
+        }
+    };
+
+    if (!_fileLoader) {
+        QFile file(_file->getFilename());
+        finish(file.open(QIODevice::ReadOnly) && _file->reloadText(&file));
+        return;
+    }
+    _fileLoader->load(this, _file->getFilename(), [this, finish] (QByteArray data, bool ok) {
+        QBuffer buffer(&data);
+        finish(ok && buffer.open(QIODevice::ReadOnly) && _file->reloadText(&buffer));
+    });
+    _fileLoader->prioritize(this);
+}
+
+bool FileWindow::isCoveredByOtherWindow() {
+    // Windows later in the parent's children are painted on top. In the full window layout all windows
+    // have the same geometry and only the top most one is actually visible.
+    if (!parentWidget()) {
+        return false;
+    }
+    const QObjectList siblings = parentWidget()->children();
+    for (int i = siblings.indexOf(this) + 1; i < siblings.size(); i++) {
+        auto *window = qobject_cast<Tui::ZWindow*>(siblings[i]);
+        if (window && window->isVisible() && window->geometry().contains(geometry())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileWindow::paintEvent(Tui::ZPaintEvent *event) {
+    // All windows are painted when anything changes, also those covered by others. So this is where
+    // changes in what the user can see show up.
+    const bool onScreen = !geometry().isEmpty() && !isCoveredByOtherWindow();
+    // A deferred document is read as soon as the user can see the window.
+    if (_deferredLoader && onScreen) {
+        materialize();
+    }
+    if (onScreen && _file->isUnloaded()) {
+        // Not while painting.
+        QTimer::singleShot(0, this, &FileWindow::reloadUnloadedText);
+    }
+    // The file is painted after this, so it already knows whether it needs to paint itself.
+    _file->setOnScreen(onScreen);
+    if (onScreen && _pipeAppendTimer->isActive()) {
+        // Not while painting.
+        _pipeAppendTimer->start(0);
+    }
+    Tui::ZWindow::paintEvent(event);
+}
+
 void FileWindow::closeEvent(Tui::ZCloseEvent *event) {
     if (!event->skipChecks().contains("unsaved")) {
         closeRequested();
@@ -346,13 +590,17 @@ void FileWindow::updateTitle() {
 
 void FileWindow::closeRequested() {
     _file->writeAttributes();
-    if (_file->isModified()) {
+    if (_file->views().size() > 1) {
+        // The document stays open in the other windows.
+        deleteLater();
+    } else if (_file->isModified()) {
         ConfirmSave *closeDialog = new ConfirmSave(parentWidget(), _file->getFilename(),
                                                    _file->isNewFile() ? ConfirmSave::CloseUnnamed : ConfirmSave::Close,
                                                    _file->getWritable());
 
         QObject::connect(closeDialog, &ConfirmSave::discardSelected, this, [this, closeDialog] {
             closeDialog->deleteLater();
+            _file->discardJournal();
             deleteLater();
         });
 
@@ -387,6 +635,7 @@ void FileWindow::watcherRemove() {
 
 
 void FileWindow::closePipe() {
+    appendPipeLines();
     if (_pipeSocketNotifier != nullptr && _pipeSocketNotifier->isEnabled()) {
         _pipeSocketNotifier->setEnabled(false);
         _pipeSocketNotifier->deleteLater();
@@ -405,12 +654,14 @@ void FileWindow::watchPipe() {
 
 
 void FileWindow::inputPipeReadable(int socket) {
-    char buff[1024];
-    int bytes = read(socket, buff, 1024);
+    char buff[64 * 1024];
+    int bytes = read(socket, buff, sizeof(buff));
     if (bytes == 0) {
         // EOF
+        appendPipeLines();
         if (!_pipeLineBuffer.isEmpty()) {
-            _file->appendLine(Tui::Misc::SurrogateEscape::decode(_pipeLineBuffer));
+            _file->appendInput(_pipeLineBuffer);
+            _pipeLineBuffer.clear();
         }
         _pipeSocketNotifier->deleteLater();
         _pipeSocketNotifier = nullptr;
@@ -420,10 +671,11 @@ void FileWindow::inputPipeReadable(int socket) {
         _pipeSocketNotifier = nullptr;
     } else {
         _pipeLineBuffer.append(buff, bytes);
-        int index;
-        while ((index = _pipeLineBuffer.indexOf('\n')) != -1) {
-            _file->appendLine(Tui::Misc::SurrogateEscape::decode(_pipeLineBuffer.left(index)));
-            _pipeLineBuffer = _pipeLineBuffer.mid(index + 1);
+        if (_file->isOnScreen()) {
+            appendPipeLines();
+        } else if (!_pipeAppendTimer->isActive()) {
+            // Nobody sees the lines, so append them in larger batches. Each append repaints the terminal.
+            _pipeAppendTimer->start();
         }
         _file->modifiedChanged(true);
     }
@@ -436,6 +688,18 @@ void FileWindow::inputPipeReadable(int socket) {
 }
 
 
+void FileWindow::appendPipeLines() {
+    // Append all complete lines with one edit. Every edit is a step in the undo history of the document,
+    // one step per line made long running streams use an unbounded amount of memory.
+    _pipeAppendTimer->stop();
+    _pipeAppendTimer->setInterval(pipeAppendIntervalMs);
+    const int index = _pipeLineBuffer.lastIndexOf('\n');
+    if (index != -1) {
+        _file->appendInput(_pipeLineBuffer.left(index));
+        _pipeLineBuffer.remove(0, index + 1);
+    }
+}
+
 void FileWindow::setFollow(bool follow) {
     _follow = follow;
     _file->setFollowStandardInput(getFollow());
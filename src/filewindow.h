@@ -6,11 +6,14 @@
 #include <functional>
 
 #include <QSocketNotifier>
+#include <QTimer>
 
 #include <Tui/ZWindow.h>
 #include <Tui/ZWindowLayout.h>
 
 #include "file.h"
+#include "fileloader.h"
+#include "filesaver.h"
 #include "savedialog.h"
 #include "scrollbar.h"
 #include "wrapdialog.h"
@@ -19,14 +22,22 @@
 class FileWindow : public Tui::ZWindow {
     Q_OBJECT
 public:
-    FileWindow(Tui::ZWidget *parent);
+    // With splitOf set, the window shows the document of splitOf.
+    FileWindow(Tui::ZWidget *parent, FileWindow *splitOf = nullptr);
 
 public:
     File *getFileWidget();
     void setWrap(Tui::ZTextOption::WrapMode wrap);
-    bool saveFile(QString filename, std::optional<bool> crlfMode);
+    void setFileSaver(FileSaver *saver);
+    // Used to read the text again after it was unloaded to stay within the memory budget.
+    void setFileLoader(FileLoader *loader);
+    void saveFile(QString filename, std::optional<bool> crlfMode, std::function<void(bool)> callback = {});
     void newFile(QString filename);
     void openFile(QString filename);
+    void openFileInBackground(QString filename, FileLoader *loader);
+    void openFileDeferred(QString filename, FileLoader *loader);
+    void materialize();
+    void runWhenLoaded(std::function<void()> callback);
 
     void closePipe();
     void watchPipe();
@@ -40,8 +51,10 @@ signals:
     void followStandadInput(bool follow);
     void fileChangedExternally(bool fileChangedExternally);
     void backingFileChanged(QString filename);
+    void saveProgress(int percent);
 
 protected:
+    void paintEvent(Tui::ZPaintEvent *event) override;
     void closeEvent(Tui::ZCloseEvent *event) override;
     void resizeEvent(Tui::ZResizeEvent *event) override;
     void moveEvent(Tui::ZMoveEvent *event) override;
@@ -53,11 +66,17 @@ private:
     SaveDialog *saveFileDialog(std::function<void(bool)> callback = {});
     WrapDialog *wrapDialog();
     void reload();
+    void reloadUnloadedText();
+    void finishBackgroundOpen(QByteArray data, bool ok);
+    void offerJournalRecovery();
+    void finishSave(const FileSaver::Job &job, bool ok, std::function<void(bool)> callback);
+    bool isCoveredByOtherWindow();
 
     void watcherAdd();
     void watcherRemove();
 
     void inputPipeReadable(int socket);
+    void appendPipeLines();
 
 private:
     File *_file = nullptr;
@@ -72,6 +91,11 @@ private:
     Tui::ZCommandNotifier *_cmdInputPipe = nullptr;
     QSocketNotifier *_pipeSocketNotifier = nullptr;
     QByteArray _pipeLineBuffer;
+    QTimer *_pipeAppendTimer = nullptr;
+    std::vector<std::function<void()>> _whenLoaded;
+    FileLoader *_deferredLoader = nullptr;
+    FileLoader *_fileLoader = nullptr;
+    FileSaver *_fileSaver = nullptr;
 };
 
 
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef JOBCONTROL_H
+#define JOBCONTROL_H
+
+#include <atomic>
+
+
+// Shared between an operation running in the background and the UI thread, which polls the progress
+// and requests cancellation.
+struct JobControl {
+    std::atomic<bool> cancel{false};
+    // Percent done.
+    std::atomic<int> progress{0};
+};
+
+#endif // JOBCONTROL_H
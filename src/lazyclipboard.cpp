@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "lazyclipboard.h"
+
+// Length of the placeholder at most, so that copying from a single huge line does not copy the line.
+static const int maxPlaceholderCodeUnits = 256;
+
+LazyClipboard *LazyClipboard::forClipboard(Tui::ZClipboard *clipboard) {
+    LazyClipboard *lazy = clipboard->findChild<LazyClipboard*>(QString(), Qt::FindDirectChildrenOnly);
+    if (!lazy) {
+        lazy = new LazyClipboard(clipboard);
+    }
+    return lazy;
+}
+
+LazyClipboard::LazyClipboard(Tui::ZClipboard *clipboard) : QObject(clipboard), _clipboard(clipboard) {
+    QObject::connect(_clipboard, &Tui::ZClipboard::contentsChanged, this, [this] {
+        if (!_settingPlaceholder) {
+            _range.reset();
+        }
+    });
+}
+
+void LazyClipboard::setRange(const Tui::ZDocumentSnapshot &snapshot, const void *source,
+                             int firstLine, int firstCodeUnit, int lastLine, int lastCodeUnit) {
+    Range range{snapshot, source, firstLine, firstCodeUnit, lastLine, lastCodeUnit, {}};
+    setRangeWithPlaceholder(std::move(range));
+}
+
+void LazyClipboard::setBlockRange(const Tui::ZDocumentSnapshot &snapshot, const void *source,
+                                  int firstLine, const QVector<std::pair<int, int>> &spans) {
+    Range range{snapshot, source, firstLine, 0, firstLine + spans.size() - 1, 0, spans};
+    setRangeWithPlaceholder(std::move(range));
+}
+
+void LazyClipboard::setRangeWithPlaceholder(Range range) {
+    // ZTextEdit only enables Paste while the clipboard is not empty. The placeholder is the start of the
+    // range up to its first line break, so that reading the clipboard directly still gives sensible text.
+    const QString firstLine = range.snapshot.line(range.firstLine);
+    const int start = range.spans.size() ? range.spans.first().first : range.firstCodeUnit;
+    int end = range.spans.size() ? range.spans.first().second
+                                 : range.firstLine == range.lastLine ? range.lastCodeUnit : firstLine.size();
+    if (end - start > maxPlaceholderCodeUnits) {
+        end = start + maxPlaceholderCodeUnits;
+        if (firstLine[end - 1].isHighSurrogate()) {
+            end--;
+        }
+    }
+    QString placeholder = firstLine.mid(start, end - start);
+    if (placeholder.isEmpty()) {
+        placeholder = QStringLiteral("\n");
+    }
+
+    _range.reset();
+    _settingPlaceholder = true;
+    _clipboard->setContents(placeholder);
+    _settingPlaceholder = false;
+    _range = std::move(range);
+}
+
+bool LazyClipboard::hasRange() const {
+    return _range.has_value();
+}
+
+QString LazyClipboard::contents() const {
+    if (!_range) {
+        return _clipboard->contents();
+    }
+
+    const Range &range = *_range;
+    const Tui::ZDocumentSnapshot &snapshot = range.snapshot;
+
+    // Size the result up front, the whole point is that ranges are large.
+    int size = 0;
+    for (int line = range.firstLine; line <= range.lastLine; line++) {
+        size += snapshot.line(line).size() + 1;
+    }
+    QString text;
+    text.reserve(size);
+
+    for (int line = range.firstLine; line <= range.lastLine; line++) {
+        const QString lineText = snapshot.line(line);
+        if (range.spans.size()) {
+            const auto [start, end] = range.spans[line - range.firstLine];
+            text.append(lineText.constData() + start, end - start);
+        } else {
+            const int start = line == range.firstLine ? range.firstCodeUnit : 0;
+            const int end = line == range.lastLine ? range.lastCodeUnit : lineText.size();
+            text.append(lineText.constData() + start, end - start);
+        }
+        if (line != range.lastLine) {
+            text += '\n';
+        }
+    }
+    return text;
+}
+
+void LazyClipboard::materialize() {
+    if (_range) {
+        const QString text = contents();
+        // The clipboard might already hold the same text as placeholder.
+        _range.reset();
+        _clipboard->setContents(text);
+    }
+}
+
+void LazyClipboard::releaseSource(const void *source) {
+    if (_range && _range->source == source) {
+        materialize();
+    }
+}
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef LAZYCLIPBOARD_H
+#define LAZYCLIPBOARD_H
+
+#include <optional>
+#include <utility>
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+#include <Tui/ZClipboard.h>
+#include <Tui/ZDocumentSnapshot.h>
+
+
+// Holds a large copy as a range of an immutable document snapshot instead of its text. While a range
+// is held, the clipboard itself only holds the start of the range as placeholder, cut off after a few
+// hundred code units. Setting the clipboard
+// contents any other way drops the range. The text is only built when pasting, or when materialize moves
+// it to the clipboard.
+class LazyClipboard : public QObject {
+    Q_OBJECT
+
+public:
+    // Shared instance for a clipboard, lives as long as the clipboard.
+    static LazyClipboard *forClipboard(Tui::ZClipboard *clipboard);
+
+public:
+    // Text from (firstCodeUnit, firstLine) to (lastCodeUnit, lastLine).
+    void setRange(const Tui::ZDocumentSnapshot &snapshot, const void *source,
+                  int firstLine, int firstCodeUnit, int lastLine, int lastCodeUnit);
+    // For each line starting at firstLine the code units [first, second), joined with line breaks.
+    void setBlockRange(const Tui::ZDocumentSnapshot &snapshot, const void *source,
+                       int firstLine, const QVector<std::pair<int, int>> &spans);
+    bool hasRange() const;
+    // Text of the range if there is one, otherwise the clipboard contents.
+    QString contents() const;
+    // Replaces the range with its text in the clipboard.
+    void materialize();
+    // Materializes if the range was copied from source, so that its snapshot can be freed.
+    void releaseSource(const void *source);
+
+private:
+    explicit LazyClipboard(Tui::ZClipboard *clipboard);
+
+private:
+    struct Range {
+        Tui::ZDocumentSnapshot snapshot;
+        const void *source = nullptr;
+        int firstLine = 0;
+        int firstCodeUnit = 0;
+        int lastLine = 0;
+        int lastCodeUnit = 0;
+        // Empty for a linear range.
+        QVector<std::pair<int, int>> spans;
+    };
+
+    void setRangeWithPlaceholder(Range range);
+
+private:
+    Tui::ZClipboard *_clipboard;
+    std::optional<Range> _range;
+    bool _settingPlaceholder = false;
+};
+
+#endif // LAZYCLIPBOARD_H
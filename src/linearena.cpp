@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "linearena.h"
+
+#include <algorithm>
+
+#include <Tui/Misc/SurrogateEscape.h>
+
+
+// Size of the chunks lines are stored in. Longer lines get a chunk of their own.
+static const int chunkBytes = 4 << 20;
+
+void LineArena::append(const QByteArray &lines) {
+    int start = 0;
+    while (true) {
+        const int end = lines.indexOf('\n', start);
+        if (end == -1) {
+            appendLine(lines.constData() + start, lines.size() - start);
+            return;
+        }
+        appendLine(lines.constData() + start, end - start);
+        start = end + 1;
+    }
+}
+
+void LineArena::appendLine(const char *data, int size) {
+    if (_chunks.isEmpty() || _chunks.last().size() + size > _chunks.last().capacity()) {
+        // Chunks never grow, so appending to one does not move the lines already in it.
+        _chunks.append(QByteArray());
+        _chunks.last().reserve(std::max(chunkBytes, size));
+    }
+    QByteArray &chunk = _chunks.last();
+    _lines.append({_chunks.size() - 1, chunk.size(), size});
+    chunk.append(data, size);
+}
+
+int LineArena::lineCount() const {
+    return _lines.size();
+}
+
+int LineArena::lineSize(int line) const {
+    return _lines[line].size;
+}
+
+QByteArray LineArena::lineBytes(int line) const {
+    const Line &entry = _lines[line];
+    return _chunks[entry.chunk].mid(entry.offset, entry.size);
+}
+
+QString LineArena::line(int line) const {
+    return Tui::Misc::SurrogateEscape::decode(lineBytes(line));
+}
+
+QByteArray LineArena::lines(int first, int count) const {
+    int size = std::max(0, count - 1);
+    for (int line = first; line < first + count; line++) {
+        size += _lines[line].size;
+    }
+    QByteArray result;
+    result.reserve(size);
+    for (int line = first; line < first + count; line++) {
+        if (line != first) {
+            result.append('\n');
+        }
+        const Line &entry = _lines[line];
+        result.append(_chunks[entry.chunk].constData() + entry.offset, entry.size);
+    }
+    return result;
+}
+
+qint64 LineArena::memoryUsage() const {
+    qint64 bytes = _lines.capacity() * qint64(sizeof(Line));
+    for (const QByteArray &chunk: _chunks) {
+        bytes += chunk.capacity();
+    }
+    return bytes;
+}
+
+void LineArena::clear() {
+    _chunks = {};
+    _lines = {};
+}
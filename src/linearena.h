@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef LINEARENA_H
+#define LINEARENA_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+
+// Lines of text kept as raw bytes in large append-only chunks, plus where each line starts. Mostly ASCII
+// text takes about a byte per character and 12 bytes per line, compared to two bytes per character and
+// an allocation per line for QString lines.
+class LineArena {
+public:
+    // Appends one or more lines separated by \n. A trailing \n appends an empty line.
+    void append(const QByteArray &lines);
+    int lineCount() const;
+    int lineSize(int line) const;
+    QByteArray lineBytes(int line) const;
+    // Decoded like files, bytes that are not valid UTF-8 are kept as surrogate escapes.
+    QString line(int line) const;
+    // count lines starting at first, separated by \n.
+    QByteArray lines(int first, int count) const;
+    qint64 memoryUsage() const;
+    void clear();
+
+private:
+    void appendLine(const char *data, int size);
+
+private:
+    struct Line {
+        int chunk;
+        int offset;
+        int size;
+    };
+    QVector<QByteArray> _chunks;
+    QVector<Line> _lines;
+};
+
+#endif // LINEARENA_H
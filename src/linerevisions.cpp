@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "linerevisions.h"
+
+#include <algorithm>
+
+// Passes over the hints, a range found can make another one findable.
+static const int hintPasses = 4;
+
+
+bool syncLineRevisions(const LineRevisionIndex &index, int lineCount, const std::function<unsigned(int)> &revision,
+                       const QVector<int> &hints, bool compareAll) {
+    auto delta = [&] {
+        return lineCount - index.lineCount();
+    };
+    auto alignedAbove = [&] (int line) {
+        return line < index.lineCount() && revision(line) == index.revision(line);
+    };
+    auto alignedBelow = [&] (int line, int shift) {
+        return line - shift >= 0 && line - shift < index.lineCount() && revision(line) == index.revision(line - shift);
+    };
+    auto changedRangeAt = [&] (int hint, int shift, int *first, int *last) {
+        // [first, last] is valid when the lines before it are unchanged and the lines after it only moved
+        // by shift. Grow it over lines that are neither, give up at a line that only moved or only stayed.
+        // The lines it replaces have to exist in the index, which a shift other than the line count
+        // difference does not ensure at the end.
+        *first = hint;
+        *last = hint - 1;
+        while (*first > 0 && !alignedAbove(*first - 1)) {
+            if (alignedBelow(*first - 1, shift)) {
+                return false;
+            }
+            (*first)--;
+        }
+        while (*last + 1 < lineCount && !alignedBelow(*last + 1, shift)) {
+            if (alignedAbove(*last + 1)) {
+                return false;
+            }
+            (*last)++;
+        }
+        return *last - shift >= *first - 1 && *last - shift < index.lineCount();
+    };
+    auto replaceLines = [&] (int first, int last, int shift) {
+        const int removed = last - shift - first + 1;
+        const int inserted = last - first + 1;
+        if (removed == 0 && inserted == 0) {
+            return false;
+        }
+        index.replace(first, removed, inserted);
+        return true;
+    };
+
+    // Each range found is taken over right away, so that the next hint compares against the lines it moved.
+    // A range moves the lines after it by its own difference in lines, when several edits changed the line
+    // count that is only the total for the last of them. Ranges that keep the line count are tried too, and
+    // ranges found may make others findable, so repeat a few times while something is found.
+    bool found = !compareAll;
+    for (int pass = 0; found && pass < hintPasses; pass++) {
+        found = false;
+        for (int hint: hints) {
+            hint = std::clamp(hint, 0, lineCount);
+            for (int shift: {delta(), 0}) {
+                int first, last;
+                if (changedRangeAt(hint, shift, &first, &last) && (last >= first || shift != 0)
+                        && replaceLines(first, last, shift)) {
+                    found = true;
+                    break;
+                }
+                if (shift == 0) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if (delta() == 0 && !compareAll) {
+        return false;
+    }
+    // Same as in the edit journal: lines with unchanged revision at the start and the end are kept.
+    const int shift = delta();
+    const int common = std::min(lineCount, index.lineCount());
+    int first = 0;
+    while (first < common && alignedAbove(first)) {
+        first++;
+    }
+    int suffix = 0;
+    while (suffix < common - first && alignedBelow(lineCount - 1 - suffix, shift)) {
+        suffix++;
+    }
+    replaceLines(first, lineCount - 1 - suffix, shift);
+    return true;
+}
@@ -0,0 +1,27 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef LINEREVISIONS_H
+#define LINEREVISIONS_H
+
+#include <functional>
+
+#include <QVector>
+
+
+// An index with data per document line that keeps the line revision the data belongs to.
+struct LineRevisionIndex {
+    std::function<int()> lineCount;
+    std::function<unsigned(int)> revision;
+    // Replaces removed lines of the index starting at first by inserted lines of the document starting there.
+    std::function<void(int first, int removed, int inserted)> replace;
+};
+
+// Updates the index to the lines of the document whose revision changed. The document does not tell which
+// lines changed, so changed ranges are first looked for around the hint lines, which only touches the
+// changed lines. If the line counts still differ after that or compareAll is set, the lines with unchanged
+// revision at the start and the end are skipped instead. Returns true if that compared all lines, otherwise
+// changes away from the hints that keep the line count may be left.
+bool syncLineRevisions(const LineRevisionIndex &index, int lineCount, const std::function<unsigned(int)> &revision,
+                       const QVector<int> &hints, bool compareAll);
+
+#endif // LINEREVISIONS_H
@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "linesort.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <QFuture>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+
+// Below this many lines per thread splitting the work is not worth it.
+static const int minLinesPerJob = 16 * 1024;
+// Indices read at once from a spilled run while merging.
+static const int runReadBuffer = 64 * 1024;
+
+
+namespace {
+
+struct Item {
+    int line = 0;
+    double number = 0;
+    QString key;
+};
+
+bool isBlank(QChar ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+QStringRef fieldOf(const QString &line, int field, const QString &separator) {
+    if (field <= 0) {
+        return QStringRef(&line);
+    }
+
+    if (!separator.isEmpty()) {
+        int start = 0;
+        for (int i = 1; i < field; i++) {
+            const int next = line.indexOf(separator, start);
+            if (next == -1) {
+                return QStringRef();
+            }
+            start = next + separator.size();
+        }
+        int end = line.indexOf(separator, start);
+        if (end == -1) {
+            end = line.size();
+        }
+        return line.midRef(start, end - start);
+    }
+
+    // Like sort without -t: leading blanks do not start an empty field.
+    int pos = 0;
+    for (int i = 1;; i++) {
+        while (pos < line.size() && isBlank(line[pos])) {
+            pos++;
+        }
+        const int start = pos;
+        while (pos < line.size() && !isBlank(line[pos])) {
+            pos++;
+        }
+        if (i == field) {
+            return line.midRef(start, pos - start);
+        }
+        if (pos >= line.size()) {
+            return QStringRef();
+        }
+    }
+}
+
+// Leading number of the key, 0 if there is none.
+double numberOf(QStringRef key) {
+    int i = 0;
+    while (i < key.size() && isBlank(key[i])) {
+        i++;
+    }
+    bool negative = false;
+    if (i < key.size() && (key[i] == '-' || key[i] == '+')) {
+        negative = key[i] == '-';
+        i++;
+    }
+    double value = 0;
+    for (; i < key.size() && key[i].isDigit(); i++) {
+        value = value * 10 + key[i].digitValue();
+    }
+    if (i < key.size() && key[i] == '.') {
+        double scale = 0.1;
+        for (i++; i < key.size() && key[i].isDigit(); i++) {
+            value += key[i].digitValue() * scale;
+            scale /= 10;
+        }
+    }
+    return negative ? -value : value;
+}
+
+
+class Sorter {
+public:
+    Sorter(const QStringList &lines, const SortOptions &options, SortControl *control)
+        : _lines(lines), _options(options), _control(control)
+    {
+        _threads = std::max(1, QThread::idealThreadCount());
+    }
+
+public:
+    std::optional<QStringList> run();
+
+private:
+    struct Run {
+        // nullptr if the run is kept in buffer completely
+        std::unique_ptr<QTemporaryFile> file;
+        QVector<qint32> buffer;
+        int pos = 0;
+        Item head;
+    };
+
+private:
+    Item makeItem(int line) const;
+    qint64 extraBytes(const Item &item) const;
+    int compare(const Item &a, const Item &b) const;
+    bool less(const Item &a, const Item &b) const;
+    bool sortItems(QVector<Item> &items);
+    bool spill(QVector<Item> &items);
+    bool readNext(Run &run);
+    std::optional<QVector<int>> mergeRuns();
+    bool cancelled() const;
+    void setProgress(int percent);
+
+private:
+    const QStringList &_lines;
+    const SortOptions &_options;
+    SortControl *_control;
+    int _threads = 1;
+    std::vector<std::unique_ptr<Run>> _runs;
+};
+
+Item Sorter::makeItem(int line) const {
+    Item item;
+    item.line = line;
+    const QString &text = _lines[line];
+    const QStringRef key = fieldOf(text, _options.field, _options.fieldSeparator);
+    if (_options.numeric) {
+        item.number = numberOf(key);
+    } else if (_options.field <= 0) {
+        // shares the data with the line
+        item.key = text;
+    } else {
+        item.key = key.toString();
+    }
+    return item;
+}
+
+qint64 Sorter::extraBytes(const Item &item) const {
+    if (_options.field <= 0) {
+        return 0;
+    }
+    return item.key.size() * 2;
+}
+
+int Sorter::compare(const Item &a, const Item &b) const {
+    int result;
+    if (_options.numeric) {
+        result = a.number < b.number ? -1 : (a.number > b.number ? 1 : 0);
+    } else {
+        result = QString::compare(a.key, b.key,
+                                  _options.caseInsensitive ? Qt::CaseInsensitive : Qt::CaseSensitive);
+    }
+    return _options.reverse ? -result : result;
+}
+
+bool Sorter::less(const Item &a, const Item &b) const {
+    const int result = compare(a, b);
+    if (result != 0) {
+        return result < 0;
+    }
+    return a.line < b.line;
+}
+
+bool Sorter::cancelled() const {
+    return _control && _control->cancel;
+}
+
+void Sorter::setProgress(int percent) {
+    if (_control) {
+        _control->progress = percent;
+    }
+}
+
+bool Sorter::sortItems(QVector<Item> &items) {
+    // Sort parts in parallel, then merge neighbours in parallel until one part is left.
+    const int parts = std::max(1, std::min(_threads, items.size() / minLinesPerJob));
+    QVector<int> bounds;
+    for (int i = 0; i < parts; i++) {
+        bounds.append(static_cast<qint64>(items.size()) * i / parts);
+    }
+    bounds.append(items.size());
+
+    auto lessFn = [this](const Item &a, const Item &b) { return less(a, b); };
+
+    QVector<QFuture<void>> jobs;
+    for (int i = 0; i + 1 < bounds.size(); i++) {
+        jobs.append(QtConcurrent::run([&items, &lessFn, start=bounds[i], end=bounds[i + 1]] {
+            std::sort(items.begin() + start, items.begin() + end, lessFn);
+        }));
+    }
+    for (QFuture<void> &job: jobs) {
+        job.waitForFinished();
+    }
+
+    QVector<Item> buffer(items.size());
+    while (bounds.size() > 2) {
+        if (cancelled()) {
+            return false;
+        }
+        jobs.clear();
+        QVector<int> merged;
+        for (int i = 0; i + 1 < bounds.size(); i += 2) {
+            merged.append(bounds[i]);
+            const int start = bounds[i];
+            const int middle = bounds[i + 1];
+            const int end = i + 2 < bounds.size() ? bounds[i + 2] : middle;
+            jobs.append(QtConcurrent::run([&items, &buffer, &lessFn, start, middle, end] {
+                std::merge(std::make_move_iterator(items.begin() + start), std::make_move_iterator(items.begin() + middle),
+                           std::make_move_iterator(items.begin() + middle), std::make_move_iterator(items.begin() + end),
+                           buffer.begin() + start, lessFn);
+            }));
+        }
+        merged.append(items.size());
+        for (QFuture<void> &job: jobs) {
+            job.waitForFinished();
+        }
+        std::swap(items, buffer);
+        bounds = merged;
+    }
+    return !cancelled();
+}
+
+bool Sorter::spill(QVector<Item> &items) {
+    if (!sortItems(items)) {
+        return false;
+    }
+    auto run = std::make_unique<Run>();
+    run->buffer.reserve(items.size());
+    for (const Item &item: items) {
+        run->buffer.append(item.line);
+    }
+    items.clear();
+
+    // If the temporary file can't be written the run stays in memory, that still drops its keys.
+    auto file = std::make_unique<QTemporaryFile>();
+    const qint64 bytes = run->buffer.size() * static_cast<qint64>(sizeof(qint32));
+    if (file->open() && file->write(reinterpret_cast<const char*>(run->buffer.constData()), bytes) == bytes
+            && file->seek(0)) {
+        run->buffer.clear();
+        run->file = std::move(file);
+    }
+    _runs.push_back(std::move(run));
+    return true;
+}
+
+bool Sorter::readNext(Run &run) {
+    if (run.pos >= run.buffer.size()) {
+        if (!run.file) {
+            return false;
+        }
+        run.buffer.resize(runReadBuffer);
+        const qint64 got = run.file->read(reinterpret_cast<char*>(run.buffer.data()),
+                                          runReadBuffer * static_cast<qint64>(sizeof(qint32)));
+        if (got <= 0) {
+            run.buffer.clear();
+            return false;
+        }
+        run.buffer.resize(got / sizeof(qint32));
+        run.pos = 0;
+    }
+    run.head = makeItem(run.buffer[run.pos++]);
+    return true;
+}
+
+std::optional<QVector<int>> Sorter::mergeRuns() {
+    QVector<int> order;
+    order.reserve(_lines.size());
+
+    std::vector<Run*> heap;
+    for (auto &run: _runs) {
+        if (readNext(*run)) {
+            heap.push_back(run.get());
+        }
+    }
+    // std heaps keep the largest element in front
+    auto greater = [this](const Run *a, const Run *b) { return less(b->head, a->head); };
+    std::make_heap(heap.begin(), heap.end(), greater);
+
+    while (!heap.empty()) {
+        if ((order.size() & 0xffff) == 0) {
+            if (cancelled()) {
+                return std::nullopt;
+            }
+            setProgress(60 + static_cast<qint64>(order.size()) * 35 / std::max(1, _lines.size()));
+        }
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        Run *run = heap.back();
+        order.append(run->head.line);
+        if (readNext(*run)) {
+            std::push_heap(heap.begin(), heap.end(), greater);
+        } else {
+            heap.pop_back();
+        }
+    }
+    return order;
+}
+
+std::optional<QStringList> Sorter::run() {
+    QVector<int> order;
+
+    QVector<Item> items;
+    qint64 bytes = 0;
+    for (int line = 0; line < _lines.size(); line++) {
+        if ((line & 0xffff) == 0) {
+            if (cancelled()) {
+                return std::nullopt;
+            }
+            setProgress(static_cast<qint64>(line) * 60 / _lines.size());
+        }
+        items.append(makeItem(line));
+        bytes += static_cast<qint64>(sizeof(Item)) + extraBytes(items.last());
+        if (bytes > _options.memoryLimit) {
+            if (!spill(items)) {
+                return std::nullopt;
+            }
+            bytes = 0;
+        }
+    }
+
+    if (_runs.empty()) {
+        if (!sortItems(items)) {
+            return std::nullopt;
+        }
+        order.reserve(items.size());
+        for (const Item &item: items) {
+            order.append(item.line);
+        }
+        items.clear();
+    } else {
+        if (items.size() && !spill(items)) {
+            return std::nullopt;
+        }
+        auto merged = mergeRuns();
+        if (!merged) {
+            return std::nullopt;
+        }
+        order = std::move(*merged);
+        _runs.clear();
+    }
+    setProgress(95);
+
+    QStringList result;
+    result.reserve(order.size());
+    Item previous;
+    for (int i = 0; i < order.size(); i++) {
+        if (_options.unique) {
+            Item item = makeItem(order[i]);
+            if (i > 0 && compare(previous, item) == 0) {
+                continue;
+            }
+            previous = std::move(item);
+        }
+        result.append(_lines[order[i]]);
+    }
+    setProgress(100);
+    return result;
+}
+
+}
+
+
+std::optional<QStringList> sortLines(const QStringList &lines, const SortOptions &options, SortControl *control) {
+    Sorter sorter(lines, options, control);
+    return sorter.run();
+}
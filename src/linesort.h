@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef LINESORT_H
+#define LINESORT_H
+
+#include <optional>
+
+#include <QString>
+#include <QStringList>
+
+#include "jobcontrol.h"
+
+
+struct SortOptions {
+    bool numeric = false;
+    bool caseInsensitive = false;
+    bool reverse = false;
+    // Keep only the first of lines with equal keys.
+    bool unique = false;
+    // 1 based field used as key, 0 for the whole line. Fields are separated by fieldSeparator or,
+    // if that is empty, by runs of spaces and tabs.
+    int field = 0;
+    QString fieldSeparator;
+    // When the sort keys are estimated to need more memory, the line order of sorted runs is written to
+    // temporary files and merged from there. The lines themselves are not counted, they are shared with
+    // the caller and stay in memory. Whole line keys share them too and only count their fixed size.
+    qint64 memoryLimit = 256 * 1024 * 1024;
+};
+
+using SortControl = JobControl;
+
+// Sorts with all cores. The sort is stable, lines with equal keys keep their order, also when reversed.
+// Returns nullopt if cancelled.
+std::optional<QStringList> sortLines(const QStringList &lines, const SortOptions &options,
+                                     SortControl *control = nullptr);
+
+#endif // LINESORT_H
@@ -15,14 +15,21 @@
 #include <Tui/ZSimpleStringLogger.h>
 #include <Tui/ZTerminal.h>
 
+#include "attributesstore.h"
+#include "backgroundexecutor.h"
 #include "edit.h"
 #include "filecategorize.h"
 #include "filelistparser.h"
+#include "memorybudget.h"
+#include "remote.h"
+#include "startuptiming.h"
+#include "syntaxhighlightrepository.h"
 
 #include "version_git.h"
 #include "version.h"
 
 int main(int argc, char **argv) {
+    startupTimingStart();
 
 #ifdef SYNTAX_HIGHLIGHTING
     Q_INIT_RESOURCE(syntax);
@@ -80,7 +87,7 @@ int main(int argc, char **argv) {
 
     // safe attributes
     QCommandLineOption attributesfileOption("attributesfile",
-                    QCoreApplication::translate("main", "Safe file for attributes, default ~/.cache/chr/chr.json"),
+                    QCoreApplication::translate("main", "Safe file for attributes, default ~/.cache/chr/chr.attributes"),
                     QCoreApplication::translate("main", "config"));
     parser.addOption(attributesfileOption);
 
@@ -90,6 +97,29 @@ int main(int argc, char **argv) {
                     QCoreApplication::translate("main", "config"));
     parser.addOption(configOption);
 
+    // client/server
+    QCommandLineOption serverOption("server",
+                    QCoreApplication::translate("main", "Accept files from chr --remote while running"));
+    parser.addOption(serverOption);
+
+    QCommandLineOption remoteOption("remote",
+                    QCoreApplication::translate("main", "Open the files in an already running chr started with --server"));
+    parser.addOption(remoteOption);
+
+    QCommandLineOption serverSocketOption("server-socket",
+                    QCoreApplication::translate("main", "Socket used by --server and --remote, default is per user in the runtime directory"),
+                    QCoreApplication::translate("main", "path"));
+    parser.addOption(serverSocketOption);
+
+    // session
+    QCommandLineOption sessionOption({"s", "session"},
+                    QCoreApplication::translate("main", "Restore the windows of the last session and save them again on exit"));
+    parser.addOption(sessionOption);
+
+    QCommandLineOption startupTimingOption("startup-timing",
+                    QCoreApplication::translate("main", "Print how long the phases of startup took after exit, up to the first painted frame"));
+    parser.addOption(startupTimingOption);
+
     // syntax
 #ifdef SYNTAX_HIGHLIGHTING
     QCommandLineOption syntaxHighlightingTheme("syntax-highlighting-theme",
@@ -118,11 +148,34 @@ int main(int argc, char **argv) {
     parser.parse(QCoreApplication::arguments());
     const QStringList args = parser.positionalArguments();
     QTextStream out(stdout);
+    startupTimingMark("arguments parsed");
+
+    const QString serverSocket = parser.isSet(serverSocketOption) ? parser.value(serverSocketOption) : defaultRemoteSocketPath();
+
+    if (parser.isSet(remoteOption)) {
+        // Only hand over the file list, don't set up anything of the editor itself.
+        if (args.empty()) {
+            out << "No file given for --remote.\n";
+            return 1;
+        }
+        QString error;
+        if (!sendRemoteOpenRequest(serverSocket, args, &error)) {
+            out << error << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+#ifdef SYNTAX_HIGHLIGHTING
+    // Load syntax definitions in the background while config and terminal are set up.
+    preloadSyntaxHighlightRepository();
+#endif
 
     // START EDITOR
     Tui::ZTerminal terminal;
     Editor *root = new Editor();
     terminal.setMainWidget(root);
+    startupTimingMark("terminal created");
 
     // READ CONFIG FILE AND SET DEFAULT OPTIONS
     QString configDir = "";
@@ -193,7 +246,7 @@ int main(int argc, char **argv) {
 
     // default cache file
     const QString userConfigPath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
-    QString attributesfileDefault = qsettings->value("attributes_file", userConfigPath + "/chr.json").toString();
+    QString attributesfileDefault = qsettings->value("attributes_file", userConfigPath + "/chr.attributes").toString();
     if (attributesfile.isEmpty()) {
         QDir dir(QFileInfo(attributesfileDefault).absolutePath());
 
@@ -220,6 +273,24 @@ int main(int argc, char **argv) {
 
     }
     settings.attributesFile = attributesfile;
+    AttributesStore::setMaxEntries(qsettings->value("attributes_max_entries", "10000").toInt());
+
+    // Unsaved edits are journaled to the cache, under the same conditions as the attributes file.
+    if (qsettings->value("edit_journal", "true").toBool() && !attributesfile.isEmpty()) {
+        settings.journalDirectory = userConfigPath + "/journal";
+    }
+
+    // The session lives next to the attributes and is only used when the cache directory is usable.
+    // Without files on the command line the session option in the config is enough to restore it.
+    const bool restoreSession = parser.isSet(sessionOption)
+            || (args.empty() && qsettings->value("session", "false").toBool());
+    if (restoreSession) {
+        if (attributesfile.isEmpty()) {
+            qDebug() << "Session disabled because the attributes file is disabled";
+        } else {
+            root->setSessionFile(qsettings->value("session_file", userConfigPath + "/session.json").toString());
+        }
+    }
 
     QString wl = parser.value(wraplines).toLower();
     if (wl == "") {
@@ -239,6 +310,13 @@ int main(int argc, char **argv) {
     bool hb = qsettings->value("highlight_bracket", "true").toBool();
     settings.highlightBracket = hb;
 
+    settings.syncOnSave = qsettings->value("fsync_on_save", "true").toBool();
+    settings.stripTrailingWhitespaceOnSave = qsettings->value("strip_trailing_whitespace_on_save", "false").toBool();
+    settings.sortMemoryLimit = qsettings->value("sort_memory_limit", "256").toLongLong() * 1024 * 1024;
+    settings.undoMemoryLimit = qsettings->value("undo_memory_limit", "64").toLongLong() * 1024 * 1024;
+    BackgroundExecutor::configure(qsettings->value("worker_threads", "0").toInt());
+    MemoryBudget::instance()->setLimit(qsettings->value("memory_budget", "0").toLongLong() * 1024 * 1024);
+
     root->setInitialFileSettings(settings);
 
     qDebug("%i chr starting", (int)QCoreApplication::applicationPid());
@@ -253,14 +331,31 @@ int main(int argc, char **argv) {
 
     std::vector<std::function<void()>> actions;
 
-    if (args.empty()) {
+    if (restoreSession) {
+        actions.push_back([root, newFileIfEmpty=args.empty()] {
+            if (!root->restoreSession() && newFileIfEmpty) {
+                root->newFile("");
+            }
+        });
+    } else if (args.empty()) {
         actions.push_back([root] { root->newFile(""); });
-    } else {
+    }
+
+    if (!args.empty()) {
         QVector<FileListEntry> fles = parseFileList(args);
         if (fles.empty()) {
             out << "Got file offset without file name.\n";
             return 0;
         }
+        // With several files on the command line create all windows at once and read the files in parallel.
+        int filesToOpen = 0;
+        for (const FileListEntry &fle: fles) {
+            if (fileCategorize(fle.fileName) == FileCategory::open_file) {
+                filesToOpen++;
+            }
+        }
+        const bool openInBackground = filesToOpen > 1;
+
         for (FileListEntry fle: fles) {
             FileCategory filecategory = fileCategorize(fle.fileName);
             if (filecategory == FileCategory::stdin_file) {
@@ -301,15 +396,17 @@ int main(int argc, char **argv) {
                         << "MB). Please start with -b for big files.\n";
                     return 0;
                 }
-                actions.push_back([root, name=fileInfo.absoluteFilePath(), pos=fle.pos, search=fle.search] {
-                    FileWindow* win = root->openFile(name);
-                    if (search != "") {
-                        win->getFileWidget()->setSearchText(search);
-                        win->getFileWidget()->runSearch(false);
-                    }
-                    if (pos != "") {
-                        win->getFileWidget()->gotoLine(pos);
-                    }
+                actions.push_back([root, name=fileInfo.absoluteFilePath(), pos=fle.pos, search=fle.search, openInBackground] {
+                    FileWindow* win = openInBackground ? root->openFileInBackground(name) : root->openFile(name);
+                    win->runWhenLoaded([win, pos, search] {
+                        if (search != "") {
+                            win->getFileWidget()->setSearchText(search);
+                            win->getFileWidget()->runSearch(false);
+                        }
+                        if (pos != "") {
+                            win->getFileWidget()->gotoLine(pos);
+                        }
+                    });
                 });
             } else if (filecategory == FileCategory::invalid_filetype) {
                 out << "File type cannot be opened.\n";
@@ -334,10 +431,20 @@ int main(int argc, char **argv) {
     */
 
     root->setStartActions(actions);
+    startupTimingMark("config read");
+
+    std::unique_ptr<RemoteServer> remoteServer;
+    if (parser.isSet(serverOption) || qsettings->value("server", "false").toBool()) {
+        remoteServer = std::make_unique<RemoteServer>([root] (QStringList files) {
+            return root->openRemoteFileList(files);
+        });
+        remoteServer->listen(serverSocket);
+    }
 
     QObject::connect(&terminal, &Tui::ZTerminal::terminalConnectionLost, [=] {
-        //TODO file save
         //qDebug("%i terminalConnectionLost", (int)QCoreApplication::applicationPid());
+        // Unsaved changes can be recovered from the journal on the next start.
+        root->flushJournals();
         QCoreApplication::quit();
     });
 
@@ -352,10 +459,31 @@ int main(int argc, char **argv) {
         QCoreApplication::quit();
     });
 
+    std::unique_ptr<PosixSignalNotifier> sigHupNotifier(new PosixSignalNotifier(SIGHUP));
+    QObject::connect(sigHupNotifier.get(), &PosixSignalNotifier::activated, [root] {
+        root->flushJournals();
+        QCoreApplication::quit();
+    });
+
+    QMetaObject::Connection firstPaintConnection = QObject::connect(&terminal, &Tui::ZTerminal::afterRendering, [&] {
+        startupTimingMark("first paint");
+        QObject::disconnect(firstPaintConnection);
+    });
+
     app.exec();
-    if (Tui::ZSimpleStringLogger::getMessages().size() > 0) {
+    // Positions of the windows closed on quit are still pending.
+    AttributesStore::flushAll();
+    const bool printStartupTiming = parser.isSet(startupTimingOption);
+    if (Tui::ZSimpleStringLogger::getMessages().size() > 0 || printStartupTiming) {
         terminal.pauseOperation();
+    }
+    if (Tui::ZSimpleStringLogger::getMessages().size() > 0) {
         printf("\e[90m%s\e[0m", Tui::ZSimpleStringLogger::getMessages().toUtf8().data());
+        fflush(stdout);
+    }
+    if (printStartupTiming) {
+        out << startupTimingReport();
+        out.flush();
     }
     return 0;
 }
@@ -165,6 +165,36 @@ void MdiLayout::setMode(MdiLayout::LayoutMode mode) {
     relayout();
 }
 
+MdiLayout::LayoutMode MdiLayout::mode() const {
+    return _mode;
+}
+
+QVector<Tui::ZWidget*> MdiLayout::windows() const {
+    QVector<Tui::ZWidget*> result;
+    for (const Item &item: _items) {
+        result.append(item.item);
+    }
+    return result;
+}
+
+double MdiLayout::weight(Tui::ZWidget *w) const {
+    for (const Item &item: _items) {
+        if (item.item == w) {
+            return item.weight;
+        }
+    }
+    return 1;
+}
+
+void MdiLayout::setWeight(Tui::ZWidget *w, double weight) {
+    for (Item &item: _items) {
+        if (item.item == w) {
+            item.weight = weight;
+        }
+    }
+    relayout();
+}
+
 void MdiLayout::setGeometry(QRect r) {
     height = r.height();
     width = r.width();
@@ -41,6 +41,11 @@ public:
     void addWindow(Tui::ZWidget *w);
 
     void setMode(LayoutMode _mode);
+    LayoutMode mode() const;
+
+    QVector<Tui::ZWidget*> windows() const;
+    double weight(Tui::ZWidget *w) const;
+    void setWeight(Tui::ZWidget *w, double weight);
 
 public:
     void setGeometry(QRect r) override;
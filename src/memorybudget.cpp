@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "memorybudget.h"
+
+#include <algorithm>
+
+#include <QTimer>
+
+
+qint64 MemoryUsage::total() const {
+    return text + highlighting + undo + caches;
+}
+
+MemoryUsage &MemoryUsage::operator+=(const MemoryUsage &other) {
+    text += other.text;
+    highlighting += other.highlighting;
+    undo += other.undo;
+    caches += other.caches;
+    return *this;
+}
+
+MemoryBudget::MemoryBudget(QObject *parent) : QObject(parent) {
+}
+
+MemoryBudget *MemoryBudget::instance() {
+    static MemoryBudget budget;
+    return &budget;
+}
+
+void MemoryBudget::setLimit(qint64 bytes) {
+    _limit = bytes;
+    scheduleEnforce();
+}
+
+qint64 MemoryBudget::limit() const {
+    return _limit;
+}
+
+void MemoryBudget::add(QObject *owner, Document document) {
+    Entry entry;
+    entry.owner = owner;
+    entry.document = std::move(document);
+    entry.lastUsed = ++_clock;
+    _entries.append(std::move(entry));
+    QObject::connect(owner, &QObject::destroyed, this, [this, owner] {
+        remove(owner);
+    });
+}
+
+void MemoryBudget::remove(QObject *owner) {
+    _entries.erase(std::remove_if(_entries.begin(), _entries.end(), [owner](const Entry &entry) {
+        return entry.owner == owner;
+    }), _entries.end());
+}
+
+MemoryBudget::Entry *MemoryBudget::find(QObject *owner) {
+    for (Entry &entry: _entries) {
+        if (entry.owner == owner) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void MemoryBudget::setUsage(QObject *owner, const MemoryUsage &usage) {
+    Entry *entry = find(owner);
+    if (!entry) {
+        return;
+    }
+    entry->usage = usage;
+    scheduleEnforce();
+}
+
+void MemoryBudget::touch(QObject *owner) {
+    Entry *entry = find(owner);
+    if (entry) {
+        entry->lastUsed = ++_clock;
+    }
+}
+
+MemoryUsage MemoryBudget::usage() const {
+    MemoryUsage sum;
+    for (const Entry &entry: _entries) {
+        sum += entry.usage;
+    }
+    return sum;
+}
+
+int MemoryBudget::documentCount() const {
+    return _entries.size();
+}
+
+void MemoryBudget::scheduleEnforce() {
+    // Documents report their usage one after the other, e.g. when a session is restored.
+    if (_enforceScheduled || _limit <= 0) {
+        return;
+    }
+    _enforceScheduled = true;
+    QTimer::singleShot(0, this, [this] {
+        _enforceScheduled = false;
+        enforce();
+    });
+}
+
+void MemoryBudget::enforce() {
+    if (_limit <= 0) {
+        return;
+    }
+    qint64 total = usage().total();
+    if (total <= _limit) {
+        return;
+    }
+
+    QList<QObject*> candidates;
+    {
+        QList<Entry*> sorted;
+        for (Entry &entry: _entries) {
+            sorted.append(&entry);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const Entry *a, const Entry *b) {
+            return a->lastUsed < b->lastUsed;
+        });
+        for (const Entry *entry: sorted) {
+            candidates.append(entry->owner);
+        }
+    }
+
+    // Caches are cheap to rebuild, so they go first for all documents before any text is unloaded.
+    for (QObject *owner: candidates) {
+        Entry *entry = find(owner);
+        if (!entry || entry->usage.highlighting + entry->usage.caches == 0 || !entry->document.evictable()) {
+            continue;
+        }
+        entry->document.dropCaches();
+        entry = find(owner);
+        if (entry) {
+            total -= entry->usage.highlighting + entry->usage.caches;
+            entry->usage.highlighting = 0;
+            entry->usage.caches = 0;
+        }
+        if (total <= _limit) {
+            return;
+        }
+    }
+
+    for (QObject *owner: candidates) {
+        Entry *entry = find(owner);
+        if (!entry || entry->usage.total() == 0 || !entry->document.evictable()) {
+            continue;
+        }
+        entry->document.unload();
+        entry = find(owner);
+        if (entry) {
+            total -= entry->usage.total();
+            entry->usage = MemoryUsage();
+        }
+        if (total <= _limit) {
+            return;
+        }
+    }
+}
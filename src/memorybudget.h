@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <functional>
+
+#include <QList>
+#include <QObject>
+
+
+// Estimated memory of one document in bytes.
+struct MemoryUsage {
+    qint64 text = 0;
+    // Syntax highlighting state and format ranges stored as line user data.
+    qint64 highlighting = 0;
+    // Old versions of lines kept for undo.
+    qint64 undo = 0;
+    // Bracket indexes and line layout caches.
+    qint64 caches = 0;
+
+    qint64 total() const;
+    MemoryUsage &operator+=(const MemoryUsage &other);
+};
+
+// Accounts the memory of all open documents against one process wide limit. When the limit is exceeded,
+// the least recently used documents that allow it first drop their caches and then unload their text.
+class MemoryBudget : public QObject {
+    Q_OBJECT
+
+public:
+    struct Document {
+        // Whether the document can be evicted now, e.g. it is unmodified and can't be seen.
+        std::function<bool()> evictable;
+        std::function<void()> dropCaches;
+        // Drops the text, it is read from disk again when it is needed.
+        std::function<void()> unload;
+    };
+
+public:
+    explicit MemoryBudget(QObject *parent = nullptr);
+
+public:
+    // The budget shared by the editor.
+    static MemoryBudget *instance();
+
+    // bytes 0 means no limit.
+    void setLimit(qint64 bytes);
+    qint64 limit() const;
+
+    // The document is removed again when owner is destroyed.
+    void add(QObject *owner, Document document);
+    void setUsage(QObject *owner, const MemoryUsage &usage);
+    // Marks the document as most recently used.
+    void touch(QObject *owner);
+
+    MemoryUsage usage() const;
+    int documentCount() const;
+
+    // Evicts documents until the usage is within the limit, as far as they allow it.
+    void enforce();
+
+private:
+    struct Entry {
+        QObject *owner = nullptr;
+        Document document;
+        MemoryUsage usage;
+        quint64 lastUsed = 0;
+    };
+
+    void remove(QObject *owner);
+    Entry *find(QObject *owner);
+    void scheduleEnforce();
+
+private:
+    QList<Entry> _entries;
+    qint64 _limit = 0;
+    quint64 _clock = 0;
+    bool _enforceScheduled = false;
+};
+
+#endif // MEMORYBUDGET_H
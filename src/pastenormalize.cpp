@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "pastenormalize.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const ushort carriageReturn = 0x0d;
+static const ushort pilcrow = 0x00b6;
+static const ushort middleDot = 0x00b7;
+static const ushort rightArrow = 0x2192;
+
+
+static bool isSpecial(ushort ch, bool formattingCharacters) {
+    return ch == carriageReturn || (formattingCharacters && (ch == pilcrow || ch == middleDot || ch == rightArrow));
+}
+
+// Index of the first code unit at or after start that needs to be changed, or size.
+static int findSpecial(const ushort *data, int start, int size, bool formattingCharacters) {
+    int i = start;
+#ifdef __SSE2__
+    // Pasted text can be many megabytes, check 8 code units at a time.
+    const __m128i cr = _mm_set1_epi16(carriageReturn);
+    const __m128i pc = _mm_set1_epi16(pilcrow);
+    const __m128i md = _mm_set1_epi16(middleDot);
+    const __m128i ra = _mm_set1_epi16(static_cast<short>(rightArrow));
+    for (; i + 8 <= size; i += 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i matches = _mm_cmpeq_epi16(chunk, cr);
+        if (formattingCharacters) {
+            matches = _mm_or_si128(matches, _mm_or_si128(_mm_cmpeq_epi16(chunk, pc),
+                                                         _mm_or_si128(_mm_cmpeq_epi16(chunk, md),
+                                                                      _mm_cmpeq_epi16(chunk, ra))));
+        }
+        const int mask = _mm_movemask_epi8(matches);
+        if (mask) {
+            return i + __builtin_ctz(mask) / 2;
+        }
+    }
+#endif
+    for (; i < size; i++) {
+        if (isSpecial(data[i], formattingCharacters)) {
+            return i;
+        }
+    }
+    return size;
+}
+
+void normalizePastedText(QString *text, bool replaceFormattingCharacters) {
+    const int size = text->size();
+    int in = findSpecial(text->utf16(), 0, size, replaceFormattingCharacters);
+    if (in == size) {
+        return;
+    }
+
+    ushort *data = reinterpret_cast<ushort*>(text->data());
+    int out = in;
+    while (in < size) {
+        const int next = findSpecial(data, in, size, replaceFormattingCharacters);
+        if (next > in) {
+            if (out != in) {
+                memmove(data + out, data + in, (next - in) * sizeof(ushort));
+            }
+            out += next - in;
+            in = next;
+            if (in == size) {
+                break;
+            }
+        }
+
+        const ushort ch = data[in];
+        if (ch == carriageReturn) {
+            // Markers are removed before line endings are converted, so "\r¶\n" is one line break.
+            int after = in + 1;
+            while (replaceFormattingCharacters && after < size && data[after] == pilcrow) {
+                after++;
+            }
+            data[out++] = '\n';
+            in = (after < size && data[after] == '\n') ? after + 1 : in + 1;
+        } else if (ch == pilcrow) {
+            in++;
+        } else {
+            data[out++] = ' ';
+            in++;
+        }
+    }
+    text->truncate(out);
+}
@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef PASTENORMALIZE_H
+#define PASTENORMALIZE_H
+
+#include <QString>
+
+
+// Converts CR LF and lone CR line endings of pasted text to LF. With replaceFormattingCharacters the
+// markers shown for formatting characters are reverted: "·" and "→" become spaces and "¶" is removed.
+// Works in a single pass in place and does not detach text if nothing needs to change.
+void normalizePastedText(QString *text, bool replaceFormattingCharacters);
+
+#endif // PASTENORMALIZE_H
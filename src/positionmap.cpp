@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "positionmap.h"
+
+#include <algorithm>
+
+#include <QTextBoundaryFinder>
+
+// Longest run of code units scanned by a lookup.
+static const int checkpointDistance = 64;
+// Checkpoints windowStart looks at before giving up.
+static const int maxWindowStartSteps = 256;
+// Context around a code unit that is enough to decide grapheme boundaries in practice.
+static const int boundaryContext = 16;
+static const int maxCacheEntries = 256;
+
+static int nextTabStop(int column, int tabStopDistance) {
+    return (column / tabStopDistance + 1) * tabStopDistance;
+}
+
+static bool isSimple(QChar ch) {
+    return ch == '\t' || (ch.unicode() >= 0x20 && ch.unicode() < 0x7f);
+}
+
+// Bytes of the code unit in QString::toUtf8. A surrogate pair counts as 4 bytes at the high surrogate,
+// unpaired surrogates are replaced by a single '?'.
+static int utf8Bytes(const QString &text, int codeUnit) {
+    const QChar ch = text[codeUnit];
+    if (ch.unicode() < 0x80) {
+        return 1;
+    }
+    if (ch.unicode() < 0x800) {
+        return 2;
+    }
+    if (ch.isHighSurrogate()) {
+        if (codeUnit + 1 < text.size() && text[codeUnit + 1].isLowSurrogate()) {
+            return 4;
+        }
+        return 1;
+    }
+    if (ch.isLowSurrogate()) {
+        if (codeUnit > 0 && text[codeUnit - 1].isHighSurrogate()) {
+            return 0;
+        }
+        return 1;
+    }
+    return 3;
+}
+
+
+LinePositionMap::LinePositionMap(const QString &text, int tabStopDistance, const std::function<int(int)> &leadingColumn)
+    : _text(text), _tabStopDistance(std::max(1, tabStopDistance))
+{
+    // Every code unit that is not simple and the first code unit after it get a checkpoint with the
+    // column from the text layout. Between checkpoints all code units are simple.
+    int column = 0;
+    int utf8 = 0;
+    int sinceCheckpoint = checkpointDistance;
+    bool afterComplex = false;
+    for (int i = 0; i < text.size(); i++) {
+        const QChar ch = text[i];
+        if (isSimple(ch)) {
+            if (afterComplex) {
+                column = leadingColumn(i);
+                afterComplex = false;
+                sinceCheckpoint = checkpointDistance;
+            }
+            if (sinceCheckpoint >= checkpointDistance) {
+                _checkpoints.append(Checkpoint{i, column, utf8});
+                sinceCheckpoint = 0;
+            }
+            column = ch == '\t' ? nextTabStop(column, _tabStopDistance) : column + 1;
+            sinceCheckpoint++;
+        } else {
+            _checkpoints.append(Checkpoint{i, leadingColumn(i), utf8});
+            afterComplex = true;
+        }
+        utf8 += utf8Bytes(text, i);
+    }
+    if (afterComplex) {
+        column = leadingColumn(text.size());
+    }
+    _width = column;
+    _checkpoints.append(Checkpoint{static_cast<int>(text.size()), column, utf8});
+}
+
+int LinePositionMap::checkpointForCodeUnit(int codeUnit) const {
+    auto it = std::upper_bound(_checkpoints.begin(), _checkpoints.end(), codeUnit,
+                               [](int codeUnit, const Checkpoint &checkpoint) {
+        return codeUnit < checkpoint.codeUnit;
+    });
+    return std::max(0, static_cast<int>(it - _checkpoints.begin()) - 1);
+}
+
+int LinePositionMap::columnForCodeUnit(int codeUnit) const {
+    codeUnit = std::clamp(codeUnit, 0, static_cast<int>(_text.size()));
+    const Checkpoint &checkpoint = _checkpoints[checkpointForCodeUnit(codeUnit)];
+    int column = checkpoint.column;
+    for (int i = checkpoint.codeUnit; i < codeUnit; i++) {
+        column = _text[i] == '\t' ? nextTabStop(column, _tabStopDistance) : column + 1;
+    }
+    return column;
+}
+
+int LinePositionMap::utf8ForCodeUnit(int codeUnit) const {
+    codeUnit = std::clamp(codeUnit, 0, static_cast<int>(_text.size()));
+    const Checkpoint &checkpoint = _checkpoints[checkpointForCodeUnit(codeUnit)];
+    // only simple code units after a checkpoint
+    return checkpoint.utf8 + (codeUnit - checkpoint.codeUnit);
+}
+
+bool LinePositionMap::codeUnitForColumn(int column, int *codeUnit) const {
+    if (column >= _width) {
+        *codeUnit = _text.size();
+        return true;
+    }
+    if (column < 0) {
+        return false;
+    }
+
+    auto it = std::upper_bound(_checkpoints.begin(), _checkpoints.end(), column,
+                               [](int column, const Checkpoint &checkpoint) {
+        return column < checkpoint.column;
+    });
+    if (it == _checkpoints.begin()) {
+        return false;
+    }
+    const int index = static_cast<int>(it - _checkpoints.begin()) - 1;
+    const Checkpoint &checkpoint = _checkpoints[index];
+    if (index > 0 && _checkpoints[index - 1].column == checkpoint.column) {
+        // zero width characters, leave it to the layout
+        return false;
+    }
+    const int end = index + 1 < _checkpoints.size() ? _checkpoints[index + 1].codeUnit : _text.size();
+
+    int x = checkpoint.column;
+    for (int i = checkpoint.codeUnit; i < end; i++) {
+        if (!isSimple(_text[i])) {
+            return false;
+        }
+        if (x == column) {
+            *codeUnit = i;
+            return true;
+        }
+        x = _text[i] == '\t' ? nextTabStop(x, _tabStopDistance) : x + 1;
+        if (x > column) {
+            // inside of a tab
+            return false;
+        }
+    }
+    if (x == column) {
+        *codeUnit = end;
+        return true;
+    }
+    return false;
+}
+
+int LinePositionMap::width() const {
+    return _width;
+}
+
+int LinePositionMap::windowStart(int column, int *startColumn) const {
+    auto it = std::upper_bound(_checkpoints.begin(), _checkpoints.end(), column,
+                               [](int column, const Checkpoint &checkpoint) {
+        return column < checkpoint.column;
+    });
+    int index = static_cast<int>(it - _checkpoints.begin()) - 1;
+    for (int steps = 0; index > 0 && steps < maxWindowStartSteps; index--, steps++) {
+        const Checkpoint &checkpoint = _checkpoints[index];
+        if (checkpoint.codeUnit < _text.size() && isGraphemeBoundary(checkpoint.codeUnit)) {
+            *startColumn = checkpoint.column;
+            return checkpoint.codeUnit;
+        }
+    }
+    *startColumn = 0;
+    return 0;
+}
+
+int LinePositionMap::windowEnd(int column) const {
+    auto it = std::lower_bound(_checkpoints.begin(), _checkpoints.end(), column,
+                               [](const Checkpoint &checkpoint, int column) {
+        return checkpoint.column < column;
+    });
+    if (it == _checkpoints.end()) {
+        return _text.size();
+    }
+    return it->codeUnit;
+}
+
+bool LinePositionMap::isGraphemeBoundary(int codeUnit) const {
+    if (isSimple(_text[codeUnit]) && (codeUnit == 0 || isSimple(_text[codeUnit - 1]))) {
+        return true;
+    }
+    const int from = std::max(0, codeUnit - boundaryContext);
+    QTextBoundaryFinder finder(QTextBoundaryFinder::Grapheme, _text.mid(from, 2 * boundaryContext));
+    finder.setPosition(codeUnit - from);
+    return finder.isAtBoundary();
+}
+
+const QString &LinePositionMap::text() const {
+    return _text;
+}
+
+int LinePositionMap::tabStopDistance() const {
+    return _tabStopDistance;
+}
+
+qint64 LinePositionMap::memoryUsage() const {
+    return sizeof(LinePositionMap) + _checkpoints.capacity() * qint64(sizeof(Checkpoint));
+}
+
+
+const LinePositionMap *PositionMapCache::find(int line, unsigned revision, const QString &text, int tabStopDistance) const {
+    auto it = _entries.constFind(line);
+    if (it == _entries.constEnd()) {
+        return nullptr;
+    }
+    if (it->revision != revision || it->map.tabStopDistance() != std::max(1, tabStopDistance) || it->map.text() != text) {
+        return nullptr;
+    }
+    return &it->map;
+}
+
+const LinePositionMap &PositionMapCache::insert(int line, unsigned revision, const LinePositionMap &map) {
+    if (_entries.size() >= maxCacheEntries) {
+        _entries.clear();
+    }
+    Entry &entry = _entries[line];
+    entry.revision = revision;
+    entry.map = map;
+    return entry.map;
+}
+
+void PositionMapCache::clear() {
+    _entries.clear();
+}
+
+qint64 PositionMapCache::memoryUsage() const {
+    qint64 bytes = 0;
+    for (const Entry &entry: _entries) {
+        bytes += sizeof(int) + sizeof(unsigned) + entry.map.memoryUsage();
+    }
+    return bytes;
+}
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef POSITIONMAP_H
+#define POSITIONMAP_H
+
+#include <functional>
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+
+// Maps between code units, display columns and UTF-8 offsets of a line laid out without wrapping.
+// Keeps sparse checkpoints, so a lookup only scans a few code units.
+class LinePositionMap {
+public:
+    LinePositionMap() = default;
+    // leadingColumn(codeUnit) is only called for code units next to characters other than printable
+    // ASCII and tabs. It returns the leading x of the code unit in a text layout without wrapping.
+    LinePositionMap(const QString &text, int tabStopDistance, const std::function<int(int)> &leadingColumn);
+
+public:
+    int columnForCodeUnit(int codeUnit) const;
+    int utf8ForCodeUnit(int codeUnit) const;
+    // Like xToCursor of the text layout. Returns false if the column is inside of a tab or at a character
+    // other than printable ASCII and tabs, those need the text layout.
+    bool codeUnitForColumn(int column, int *codeUnit) const;
+    int width() const;
+
+    // Code unit at or before column from which a layout of the rest of the line can start, *startColumn
+    // is set to its column. Falls back to 0 if no grapheme boundary with a known column is close.
+    int windowStart(int column, int *startColumn) const;
+    // Code unit at or after column, or the end of the line.
+    int windowEnd(int column) const;
+
+    const QString &text() const;
+    int tabStopDistance() const;
+    // The text is shared with the document and not counted.
+    qint64 memoryUsage() const;
+
+private:
+    struct Checkpoint {
+        int codeUnit;
+        int column;
+        int utf8;
+    };
+
+    int checkpointForCodeUnit(int codeUnit) const;
+    bool isGraphemeBoundary(int codeUnit) const;
+
+private:
+    QString _text;
+    int _tabStopDistance = 8;
+    int _width = 0;
+    QVector<Checkpoint> _checkpoints;
+};
+
+
+// Position maps of recently used lines. An entry is only used while revision, text and tab stop
+// distance of the line are unchanged.
+class PositionMapCache {
+public:
+    const LinePositionMap *find(int line, unsigned revision, const QString &text, int tabStopDistance) const;
+    const LinePositionMap &insert(int line, unsigned revision, const LinePositionMap &map);
+    void clear();
+    qint64 memoryUsage() const;
+
+private:
+    struct Entry {
+        unsigned revision = 0;
+        LinePositionMap map;
+    };
+
+    QHash<int, Entry> _entries;
+};
+
+#endif // POSITIONMAP_H
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "remote.h"
+
+#include <unistd.h>
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocalSocket>
+#include <QStandardPaths>
+
+#include "filelistparser.h"
+
+// The protocol is one request per connection: the client sends the version and a QStringList with the
+// file list, the server answers with a QString that is empty on success or contains an error message.
+static const quint32 remoteProtocolVersion = 1;
+static const int remoteTimeoutMs = 5000;
+
+
+QString defaultRemoteSocketPath() {
+    // The runtime directory is private to the user. Include the uid anyway, in case it falls back to
+    // a shared location.
+    QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (runtimeDir.isEmpty()) {
+        runtimeDir = QDir::tempPath();
+    }
+    return runtimeDir + "/chr-" + QString::number(geteuid()) + ".socket";
+}
+
+bool sendRemoteOpenRequest(const QString &socketPath, const QStringList &args, QString *error) {
+    QVector<FileListEntry> fles = parseFileList(args);
+    if (fles.empty()) {
+        *error = "Got file offset without file name.";
+        return false;
+    }
+
+    // Rebuild the file list with absolute names, the server runs in a different directory.
+    QStringList request;
+    for (const FileListEntry &fle: fles) {
+        if (fle.fileName == "-") {
+            *error = "Standard input can not be passed to a running instance.";
+            return false;
+        }
+        if (fle.pos != "") {
+            request.append(fle.pos);
+        }
+        if (fle.search != "") {
+            request.append("+/" + fle.search);
+        }
+        request.append(QFileInfo(fle.fileName).absoluteFilePath());
+    }
+
+    QLocalSocket socket;
+    socket.connectToServer(socketPath);
+    if (!socket.waitForConnected(remoteTimeoutMs)) {
+        *error = "No running chr server found at " + socketPath + ".";
+        return false;
+    }
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << remoteProtocolVersion << request;
+    socket.write(data);
+
+    QDataStream in(&socket);
+    in.setVersion(QDataStream::Qt_5_0);
+    while (true) {
+        in.startTransaction();
+        QString reply;
+        in >> reply;
+        if (in.commitTransaction()) {
+            if (!reply.isEmpty()) {
+                *error = reply;
+                return false;
+            }
+            return true;
+        }
+        if (!socket.waitForReadyRead(remoteTimeoutMs)) {
+            *error = "No reply from chr server.";
+            return false;
+        }
+    }
+}
+
+
+RemoteServer::RemoteServer(std::function<QString(QStringList)> handler, QObject *parent)
+    : QObject(parent), _handler(handler)
+{
+    _server.setSocketOptions(QLocalServer::UserAccessOption);
+    QObject::connect(&_server, &QLocalServer::newConnection, this, &RemoteServer::newConnection);
+}
+
+bool RemoteServer::listen(const QString &socketPath) {
+    if (_server.listen(socketPath)) {
+        return true;
+    }
+
+    if (_server.serverError() == QAbstractSocket::AddressInUseError) {
+        // Either another instance is serving or a previous one did not clean up.
+        QLocalSocket probe;
+        probe.connectToServer(socketPath);
+        if (probe.waitForConnected(100)) {
+            qDebug() << "chr server already running on" << socketPath;
+            return false;
+        }
+        QLocalServer::removeServer(socketPath);
+        if (_server.listen(socketPath)) {
+            return true;
+        }
+    }
+
+    qDebug() << "Can't listen on" << socketPath << ":" << _server.errorString();
+    return false;
+}
+
+void RemoteServer::newConnection() {
+    while (QLocalSocket *socket = _server.nextPendingConnection()) {
+        QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        QObject::connect(socket, &QLocalSocket::readyRead, this, [this, socket] {
+            QDataStream in(socket);
+            in.setVersion(QDataStream::Qt_5_0);
+            in.startTransaction();
+            quint32 version = 0;
+            QStringList args;
+            in >> version >> args;
+            if (!in.commitTransaction()) {
+                // incomplete, wait for more data
+                return;
+            }
+
+            QString reply;
+            if (version != remoteProtocolVersion) {
+                reply = "Protocol version mismatch with running chr.";
+            } else {
+                reply = _handler(args);
+            }
+
+            QByteArray data;
+            QDataStream out(&data, QIODevice::WriteOnly);
+            out.setVersion(QDataStream::Qt_5_0);
+            out << reply;
+            socket->write(data);
+            socket->disconnectFromServer();
+        });
+    }
+}
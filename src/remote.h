@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include <functional>
+
+#include <QLocalServer>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+
+// Default path of the per user socket a chr started with --server listens on.
+QString defaultRemoteSocketPath();
+
+// Client side of --remote. Sends a file list in the grammar of parseFileList to the running instance.
+// Relative file names are resolved against the current directory of the client.
+// Returns false and sets error if the request could not be delivered or was rejected.
+bool sendRemoteOpenRequest(const QString &socketPath, const QStringList &args, QString *error);
+
+
+class RemoteServer : public QObject {
+    Q_OBJECT
+
+public:
+    // The handler gets the file list and returns an error message or an empty string on success.
+    RemoteServer(std::function<QString(QStringList)> handler, QObject *parent = nullptr);
+
+public:
+    bool listen(const QString &socketPath);
+
+private:
+    void newConnection();
+
+private:
+    QLocalServer _server;
+    std::function<QString(QStringList)> _handler;
+};
+
+#endif // REMOTE_H
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "session.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+
+
+static const int sessionVersion = 1;
+
+static QString layoutModeName(MdiLayout::LayoutMode mode) {
+    switch (mode) {
+        case MdiLayout::LayoutMode::Base:
+            return "full";
+        case MdiLayout::LayoutMode::TileH:
+            return "tileH";
+        case MdiLayout::LayoutMode::TileV:
+            break;
+    }
+    return "tileV";
+}
+
+static MdiLayout::LayoutMode layoutModeFromName(const QString &name) {
+    if (name == "full") {
+        return MdiLayout::LayoutMode::Base;
+    } else if (name == "tileH") {
+        return MdiLayout::LayoutMode::TileH;
+    }
+    return MdiLayout::LayoutMode::TileV;
+}
+
+QJsonObject sessionToJson(const Session &session) {
+    QJsonArray windows;
+    for (const SessionWindow &window: session.windows) {
+        // Same keys as the per file attributes
+        QJsonObject data;
+        data.insert("file", window.fileName);
+        data.insert("weight", window.weight);
+        data.insert("curOff", window.cursor.codeUnit);
+        data.insert("curLine", window.cursor.line);
+        data.insert("sCol", window.scrollColumn);
+        data.insert("sLine", window.scrollLine);
+        data.insert("sFine", window.scrollFineLine);
+        windows.append(data);
+    }
+
+    QJsonObject json;
+    json.insert("version", sessionVersion);
+    json.insert("layout", layoutModeName(session.mode));
+    json.insert("active", session.activeWindow);
+    json.insert("windows", windows);
+    return json;
+}
+
+bool sessionFromJson(const QJsonObject &json, Session *session) {
+    if (json.value("version").toInt() != sessionVersion) {
+        return false;
+    }
+
+    Session result;
+    result.mode = layoutModeFromName(json.value("layout").toString());
+
+    const QJsonArray windows = json.value("windows").toArray();
+    for (const QJsonValue &value: windows) {
+        const QJsonObject data = value.toObject();
+        SessionWindow window;
+        window.fileName = data.value("file").toString();
+        if (window.fileName.isEmpty()) {
+            continue;
+        }
+        window.weight = data.value("weight").toDouble(1);
+        if (window.weight <= 0) {
+            window.weight = 1;
+        }
+        window.cursor = {data.value("curOff").toInt(), data.value("curLine").toInt()};
+        window.scrollColumn = data.value("sCol").toInt();
+        window.scrollLine = data.value("sLine").toInt();
+        window.scrollFineLine = data.value("sFine").toInt();
+        result.windows.append(window);
+    }
+
+    result.activeWindow = json.value("active").toInt(-1);
+    if (result.activeWindow >= result.windows.size()) {
+        result.activeWindow = -1;
+    }
+
+    *session = result;
+    return true;
+}
+
+bool readSession(const QString &sessionFile, Session *session) {
+    QFile file(sessionFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QJsonDocument jsonDoc = QJsonDocument::fromJson(file.readAll());
+    return sessionFromJson(jsonDoc.object(), session);
+}
+
+bool writeSession(const QString &sessionFile, const Session &session) {
+    QDir dir = QFileInfo(sessionFile).absoluteDir();
+    if (!dir.exists() && !dir.mkpath(".")) {
+        qWarning("%s%s", "can not create directory: ", dir.absolutePath().toUtf8().data());
+        return false;
+    }
+
+    QSaveFile file(sessionFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("%s%s", "can not save session file: ", sessionFile.toUtf8().data());
+        return false;
+    }
+    file.write(QJsonDocument(sessionToJson(session)).toJson());
+    return file.commit();
+}
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include <Tui/ZDocumentCursor.h>
+
+#include "mdilayout.h"
+
+
+struct SessionWindow {
+    QString fileName;
+    double weight = 1;
+    Tui::ZDocumentCursor::Position cursor = {0, 0};
+    int scrollColumn = 0;
+    int scrollLine = 0;
+    int scrollFineLine = 0;
+};
+
+struct Session {
+    MdiLayout::LayoutMode mode = MdiLayout::LayoutMode::TileV;
+    // windows in layout order
+    QVector<SessionWindow> windows;
+    int activeWindow = -1;
+};
+
+QJsonObject sessionToJson(const Session &session);
+bool sessionFromJson(const QJsonObject &json, Session *session);
+
+bool readSession(const QString &sessionFile, Session *session);
+bool writeSession(const QString &sessionFile, const Session &session);
+
+#endif // SESSION_H
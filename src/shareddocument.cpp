@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "shareddocument.h"
+
+#include <algorithm>
+
+
+// Memory usage of a document is measured at most this often while it is edited. Measuring holds a snapshot,
+// so the next edit has to copy the line array.
+static const int memoryMeasurementIntervalMs = 5000;
+// Edited lines remembered for the next bracket index sync, more make it compare the whole document.
+static const int maxBracketIndexHints = 64;
+
+SharedDocument::SharedDocument() {
+    _document = new Tui::ZDocument(this);
+    _journal = new EditJournal(_document, this);
+    QObject::connect(_document, &Tui::ZDocument::contentsChanged, this, [this] {
+        for (BracketIndex &index: _bracketIndexes) {
+            index.invalidate();
+        }
+        scheduleMemoryMeasurement();
+    });
+    _memoryTimer.setSingleShot(true);
+    _memoryTimer.setInterval(memoryMeasurementIntervalMs);
+    QObject::connect(&_memoryTimer, &QTimer::timeout, this, &SharedDocument::memoryMeasurementDue);
+}
+
+SharedDocument::~SharedDocument() {
+    // Whichever view copied the range, it must not outlive the document.
+    releaseLazyClipboard();
+}
+
+Tui::ZDocument *SharedDocument::document() const {
+    return _document;
+}
+
+EditJournal *SharedDocument::journal() const {
+    return _journal;
+}
+
+void SharedDocument::addView(QObject *view) {
+    _views.append(view);
+}
+
+void SharedDocument::removeView(QObject *view) {
+    _views.removeAll(view);
+    if (_views.isEmpty()) {
+        // The text edit of the last view still uses the document while it is destroyed.
+        deleteLater();
+        return;
+    }
+    if (_highlightingView == view) {
+        // Its running highlighting is cancelled, one of the remaining views claims it and starts again.
+        _highlightingView = nullptr;
+        _highlightingRequested = false;
+        highlightingAbandoned();
+    }
+}
+
+QList<QObject*> SharedDocument::views() const {
+    return _views;
+}
+
+void SharedDocument::setLazyClipboard(LazyClipboard *clipboard) {
+    _lazyClipboard = clipboard;
+}
+
+void SharedDocument::releaseLazyClipboard() {
+    if (_lazyClipboard) {
+        _lazyClipboard->releaseSource(_document);
+    }
+}
+
+std::array<BracketIndex, 4> &SharedDocument::bracketIndexes() {
+    return _bracketIndexes;
+}
+
+void SharedDocument::hintEditedLine(int line) {
+    const bool built = std::any_of(_bracketIndexes.begin(), _bracketIndexes.end(), [](const BracketIndex &index) {
+        return index.isBuilt();
+    });
+    if (!built || _bracketIndexHintsOverflow) {
+        return;
+    }
+    if (!_bracketIndexHints.empty() && _bracketIndexHints.back().line() == line) {
+        return;
+    }
+    if (static_cast<int>(_bracketIndexHints.size()) >= maxBracketIndexHints) {
+        _bracketIndexHints.clear();
+        _bracketIndexHintsOverflow = true;
+        return;
+    }
+    _bracketIndexHints.emplace_back(_document, line);
+}
+
+void SharedDocument::syncBracketIndexes(BracketIndex &index, const QVector<int> &hints) {
+    // The bracket indexes have nothing that finds changes later, so without a complete list of edited
+    // lines all line revisions are compared.
+    const bool compareAll = _bracketIndexHintsOverflow;
+    QVector<int> lines = hints;
+    for (const Tui::ZDocumentLineMarker &marker: _bracketIndexHints) {
+        lines.append(marker.line());
+    }
+    _bracketIndexHints.clear();
+    _bracketIndexHintsOverflow = false;
+
+    auto revision = [this](int line) {
+        return _document->lineRevision(line);
+    };
+    auto text = [this](int line) {
+        return _document->line(line);
+    };
+    for (BracketIndex &other: _bracketIndexes) {
+        if (&other == &index || other.isBuilt()) {
+            other.sync(_document->lineCount(), revision, text, lines, compareAll);
+        }
+    }
+}
+
+ColumnLayoutCache &SharedDocument::columnLayoutCache() {
+    return _columnLayoutCache;
+}
+
+PositionMapCache &SharedDocument::positionMapCache() {
+    return _positionMapCache;
+}
+
+bool SharedDocument::claimHighlightingUpdate(QObject *view) {
+    if (_highlightingView && _highlightingView != view) {
+        _highlightingRequested = true;
+        return false;
+    }
+    _highlightingView = view;
+    return true;
+}
+
+void SharedDocument::releaseHighlightingUpdate(QObject *view, bool upToDate) {
+    if (_highlightingView != view) {
+        return;
+    }
+    _highlightingView = nullptr;
+    const bool requested = _highlightingRequested;
+    _highlightingRequested = false;
+    if (requested && !upToDate) {
+        // Another view was turned away while the highlighting ran and the view did not pick up the changes.
+        highlightingAbandoned();
+    }
+}
+
+void SharedDocument::scheduleMemoryMeasurement() {
+    if (!_memoryTimer.isActive()) {
+        _memoryTimer.start();
+    }
+}
+
+qint64 SharedDocument::cacheMemoryUsage() const {
+    qint64 bytes = _columnLayoutCache.memoryUsage() + _positionMapCache.memoryUsage();
+    for (const BracketIndex &index: _bracketIndexes) {
+        bytes += index.memoryUsage();
+    }
+    return bytes;
+}
+
+void SharedDocument::dropCaches() {
+    for (BracketIndex &index: _bracketIndexes) {
+        index.clear();
+    }
+    _bracketIndexHints.clear();
+    _bracketIndexHintsOverflow = false;
+    _columnLayoutCache.clear();
+    _positionMapCache.clear();
+    for (int line = 0; line < _document->lineCount(); line++) {
+        _document->setLineUserData(line, nullptr);
+    }
+    cachesDropped();
+}
+
+std::optional<unsigned> SharedDocument::baseLineRevision() const {
+    return _baseLineRevision;
+}
+
+void SharedDocument::setBaseLineRevision(std::optional<unsigned> revision) {
+    _baseLineRevision = revision;
+}
+
+bool SharedDocument::isUnloaded() const {
+    return _unloaded;
+}
+
+void SharedDocument::setUnloaded(bool unloaded) {
+    _unloaded = unloaded;
+}
+
+bool SharedDocument::isReloading() const {
+    return _reloading;
+}
+
+void SharedDocument::setReloading(bool reloading) {
+    _reloading = reloading;
+}
+
+std::optional<unsigned> SharedDocument::streamRevision() const {
+    return _streamRevision;
+}
+
+void SharedDocument::setStreamRevision(std::optional<unsigned> revision) {
+    _streamRevision = revision;
+}
+
+bool SharedDocument::isStream() const {
+    return _streamRevision.has_value();
+}
+
+bool SharedDocument::isStreamIntact() const {
+    return _streamRevision && *_streamRevision == _document->revision();
+}
+
+LineArena &SharedDocument::streamArena() {
+    return _streamArena;
+}
+
+bool SharedDocument::isModifiedWithoutHistory() const {
+    return _modifiedWithoutHistory;
+}
+
+void SharedDocument::setModifiedWithoutHistory(bool modified) {
+    _modifiedWithoutHistory = modified;
+}
+
+bool SharedDocument::isSaving() const {
+    return _saving;
+}
+
+void SharedDocument::setSaving(bool saving) {
+    _saving = saving;
+    if (!saving) {
+        auto afterSave = std::move(_afterSave);
+        _afterSave.clear();
+        for (auto &next: afterSave) {
+            next();
+        }
+    }
+}
+
+void SharedDocument::runAfterSave(std::function<void()> fn) {
+    _afterSave.push_back(std::move(fn));
+}
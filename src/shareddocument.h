@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SHAREDDOCUMENT_H
+#define SHAREDDOCUMENT_H
+
+#include <array>
+#include <functional>
+#include <list>
+#include <optional>
+#include <vector>
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <Tui/ZDocument.h>
+#include <Tui/ZDocumentLineMarker.h>
+
+#include "bracketindex.h"
+#include "columnmap.h"
+#include "editjournal.h"
+#include "lazyclipboard.h"
+#include "linearena.h"
+#include "memorybudget.h"
+#include "positionmap.h"
+
+
+// A document with everything derived from it that does not depend on how it is viewed. Shared by all
+// views (split windows) of one file. Deletes itself after the last view is removed.
+class SharedDocument : public QObject {
+    Q_OBJECT
+
+public:
+    SharedDocument();
+    ~SharedDocument() override;
+
+public:
+    Tui::ZDocument *document() const;
+    EditJournal *journal() const;
+
+    void addView(QObject *view);
+    void removeView(QObject *view);
+    QList<QObject*> views() const;
+
+    // Clipboard holding a range of the document copied by one of the views.
+    void setLazyClipboard(LazyClipboard *clipboard);
+    // Materializes that range, so that it does not keep the old text alive.
+    void releaseLazyClipboard();
+
+    // Built on first use for each bracket pair, invalidated by every change of the document.
+    std::array<BracketIndex, 4> &bracketIndexes();
+    // Tells the bracket indexes that lines starting at line were or will be edited.
+    void hintEditedLine(int line);
+    // Syncs index and every other bracket index built so far, so that the edited lines are only needed
+    // once. hints are added to the edited lines, e.g. the cursor lines of the views.
+    void syncBracketIndexes(BracketIndex &index, const QVector<int> &hints);
+    ColumnLayoutCache &columnLayoutCache();
+    PositionMapCache &positionMapCache();
+
+    // Syntax highlighting is run by one view for all. Returns false if another view already has an update
+    // scheduled or running. The view releases the claim when its highlighting is done, upToDate tells
+    // whether that highlighting covers the current text.
+    bool claimHighlightingUpdate(QObject *view);
+    void releaseHighlightingUpdate(QObject *view, bool upToDate);
+
+    // Memory accounting, see MemoryBudget. Measuring runs at most once per interval.
+    void scheduleMemoryMeasurement();
+    qint64 cacheMemoryUsage() const;
+    // Frees the bracket indexes, the line caches and the syntax highlighting stored in the document.
+    void dropCaches();
+    // Lines with a higher revision were changed after the text was read, their old text is kept for undo.
+    // Unset until the first measurement after the text was read.
+    std::optional<unsigned> baseLineRevision() const;
+    void setBaseLineRevision(std::optional<unsigned> revision);
+    // The text was dropped to stay within the memory budget and has to be read from disk again. Reloading
+    // is set while a view does that.
+    bool isUnloaded() const;
+    void setUnloaded(bool unloaded);
+    bool isReloading() const;
+    void setReloading(bool reloading);
+    // Set for standard input. The document holds exactly the input read so far as long as its revision
+    // is still the stream revision.
+    std::optional<unsigned> streamRevision() const;
+    void setStreamRevision(std::optional<unsigned> revision);
+    bool isStream() const;
+    bool isStreamIntact() const;
+    // Holds the input while the document is unloaded.
+    LineArena &streamArena();
+    // Set while one of the views writes the document in the background. Saves from all views wait for it
+    // with runAfterSave, so that an older snapshot is never written after a newer one. Clearing it runs
+    // the waiting saves.
+    bool isSaving() const;
+    void setSaving(bool saving);
+    void runAfterSave(std::function<void()> fn);
+    // The text was read again to drop the undo history of standard input, which marked it as saved even
+    // though it was not.
+    bool isModifiedWithoutHistory() const;
+    void setModifiedWithoutHistory(bool modified);
+
+signals:
+    // Highlighting of the lines first to last was stored in the document.
+    void highlightingChanged(int first, int last);
+    // The view that highlights the document was closed, or finished after another view was turned away.
+    // One of the views has to claim it again.
+    void highlightingAbandoned();
+    void memoryMeasurementDue();
+    void cachesDropped();
+
+private:
+    Tui::ZDocument *_document = nullptr;
+    EditJournal *_journal = nullptr;
+    QList<QObject*> _views;
+    QPointer<LazyClipboard> _lazyClipboard;
+    std::array<BracketIndex, 4> _bracketIndexes = {BracketIndex('{', '}'), BracketIndex('[', ']'),
+                                                   BracketIndex('(', ')'), BracketIndex('<', '>')};
+    std::list<Tui::ZDocumentLineMarker> _bracketIndexHints;
+    bool _bracketIndexHintsOverflow = false;
+    ColumnLayoutCache _columnLayoutCache;
+    PositionMapCache _positionMapCache;
+    QPointer<QObject> _highlightingView;
+    bool _highlightingRequested = false;
+    QTimer _memoryTimer;
+    std::optional<unsigned> _baseLineRevision;
+    bool _unloaded = false;
+    bool _reloading = false;
+    std::optional<unsigned> _streamRevision;
+    LineArena _streamArena;
+    bool _modifiedWithoutHistory = false;
+    bool _saving = false;
+    std::vector<std::function<void()>> _afterSave;
+};
+
+#endif // SHAREDDOCUMENT_H
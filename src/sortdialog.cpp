@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "sortdialog.h"
+
+#include <Tui/ZButton.h>
+#include <Tui/ZHBoxLayout.h>
+#include <Tui/ZLabel.h>
+#include <Tui/ZVBoxLayout.h>
+
+
+SortDialog::SortDialog(Tui::ZWidget *parent) : Tui::ZDialog(parent) {
+    setOptions(Tui::ZWindow::CloseOption | Tui::ZWindow::MoveOption | Tui::ZWindow::AutomaticOption
+               | Tui::ZWindow::DeleteOnClose);
+    setFocus();
+    setWindowTitle("Sort Lines");
+    setContentsMargins({1, 1, 1, 1});
+
+    Tui::ZVBoxLayout *vbox = new Tui::ZVBoxLayout();
+    setLayout(vbox);
+    vbox->setSpacing(1);
+
+    Tui::ZHBoxLayout *hbox1 = new Tui::ZHBoxLayout();
+    _numeric = new Tui::ZCheckBox(this);
+    _numeric->setMarkup("<m>N</m>umeric");
+    _numeric->setFocus();
+    hbox1->addWidget(_numeric);
+
+    _caseInsensitive = new Tui::ZCheckBox(this);
+    _caseInsensitive->setMarkup("<m>I</m>gnore case");
+    hbox1->addWidget(_caseInsensitive);
+    vbox->add(hbox1);
+
+    Tui::ZHBoxLayout *hbox2 = new Tui::ZHBoxLayout();
+    _reverse = new Tui::ZCheckBox(this);
+    _reverse->setMarkup("<m>R</m>everse");
+    hbox2->addWidget(_reverse);
+
+    _unique = new Tui::ZCheckBox(this);
+    _unique->setMarkup("<m>U</m>nique");
+    hbox2->addWidget(_unique);
+    vbox->add(hbox2);
+
+    Tui::ZHBoxLayout *hbox3 = new Tui::ZHBoxLayout();
+    Tui::ZLabel *fieldLabel = new Tui::ZLabel(this);
+    fieldLabel->setMarkup("<m>F</m>ield (0 = line): ");
+    hbox3->addWidget(fieldLabel);
+
+    _field = new Tui::ZInputBox(this);
+    _field->setText("0");
+    fieldLabel->setBuddy(_field);
+    hbox3->addWidget(_field);
+    vbox->add(hbox3);
+
+    Tui::ZHBoxLayout *hbox4 = new Tui::ZHBoxLayout();
+    Tui::ZLabel *separatorLabel = new Tui::ZLabel(this);
+    separatorLabel->setMarkup("<m>S</m>eparator (empty = blanks): ");
+    hbox4->addWidget(separatorLabel);
+
+    _separator = new Tui::ZInputBox(this);
+    separatorLabel->setBuddy(_separator);
+    hbox4->addWidget(_separator);
+    vbox->add(hbox4);
+    vbox->addStretch();
+
+    Tui::ZHBoxLayout *hbox5 = new Tui::ZHBoxLayout();
+
+    hbox5->addStretch();
+
+    Tui::ZButton *cancelButton = new Tui::ZButton(this);
+    cancelButton->setText("Cancel");
+    hbox5->addWidget(cancelButton);
+
+    Tui::ZButton *sortButton = new Tui::ZButton(this);
+    sortButton->setText("Sort");
+    sortButton->setDefault(true);
+    hbox5->addWidget(sortButton);
+    vbox->add(hbox5);
+
+    QObject::connect(_field, &Tui::ZInputBox::textChanged, this, [this, sortButton] {
+        bool ok = false;
+        const int field = _field->text().toInt(&ok);
+        sortButton->setEnabled(ok && field >= 0);
+    });
+
+    QObject::connect(sortButton, &Tui::ZButton::clicked, this, [this] {
+        SortOptions options;
+        options.numeric = _numeric->checkState() == Qt::CheckState::Checked;
+        options.caseInsensitive = _caseInsensitive->checkState() == Qt::CheckState::Checked;
+        options.reverse = _reverse->checkState() == Qt::CheckState::Checked;
+        options.unique = _unique->checkState() == Qt::CheckState::Checked;
+        options.field = _field->text().toInt();
+        options.fieldSeparator = _separator->text();
+        sortRequested(options);
+        deleteLater();
+    });
+
+    QObject::connect(cancelButton, &Tui::ZButton::clicked, [this] {
+        deleteLater();
+    });
+}
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SORTDIALOG_H
+#define SORTDIALOG_H
+
+#include <Tui/ZCheckBox.h>
+#include <Tui/ZDialog.h>
+#include <Tui/ZInputBox.h>
+
+#include "linesort.h"
+
+
+class SortDialog : public Tui::ZDialog {
+    Q_OBJECT
+public:
+    SortDialog(Tui::ZWidget *parent);
+
+signals:
+    void sortRequested(SortOptions options);
+
+private:
+    Tui::ZCheckBox *_numeric = nullptr;
+    Tui::ZCheckBox *_caseInsensitive = nullptr;
+    Tui::ZCheckBox *_reverse = nullptr;
+    Tui::ZCheckBox *_unique = nullptr;
+    Tui::ZInputBox *_field = nullptr;
+    Tui::ZInputBox *_separator = nullptr;
+};
+
+#endif // SORTDIALOG_H
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "startuptiming.h"
+
+#include <QElapsedTimer>
+#include <QVector>
+
+
+namespace {
+    struct Mark {
+        const char *phase;
+        qint64 nsecs;
+    };
+
+    QElapsedTimer timer;
+    QVector<Mark> marks;
+}
+
+void startupTimingStart() {
+    timer.start();
+}
+
+void startupTimingMark(const char *phase) {
+    if (!timer.isValid()) {
+        return;
+    }
+    marks.append(Mark{phase, timer.nsecsElapsed()});
+}
+
+QString startupTimingReport() {
+    QString report;
+    qint64 previous = 0;
+    for (const Mark &mark: marks) {
+        report += QStringLiteral("%1 %2 ms (+%3 ms)\n")
+                .arg(QString::fromUtf8(mark.phase), -24)
+                .arg(mark.nsecs / 1000000.0, 8, 'f', 2)
+                .arg((mark.nsecs - previous) / 1000000.0, 0, 'f', 2);
+        previous = mark.nsecs;
+    }
+    return report;
+}
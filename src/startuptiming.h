@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef STARTUPTIMING_H
+#define STARTUPTIMING_H
+
+#include <QString>
+
+// Phase breakdown of the startup for --startup-timing. Times are measured from startupTimingStart(),
+// which main calls first thing. Marks are cheap and always recorded, the report is only printed on request.
+void startupTimingStart();
+void startupTimingMark(const char *phase);
+QString startupTimingReport();
+
+#endif // STARTUPTIMING_H
@@ -196,6 +196,33 @@ QString StatusBar::viewLanguage() {
     }
 }
 
+void StatusBar::saveProgress(int percent) {
+    _saveProgress = percent;
+    update();
+}
+
+QString StatusBar::viewSaveProgress() {
+    QString text;
+    if (_saveProgress >= 0) {
+        text += "SAVING " + QString::number(_saveProgress) + "%";
+    }
+    return text;
+}
+
+void StatusBar::jobProgress(QString name, int percent) {
+    _jobName = name;
+    _jobProgress = percent;
+    update();
+}
+
+QString StatusBar::viewJobProgress() {
+    QString text;
+    if (_jobProgress >= 0) {
+        text += _jobName + " " + QString::number(_jobProgress) + "%";
+    }
+    return text;
+}
+
 void StatusBar::switchToNormalDisplay() {
     if (_showHelp) {
         if (_helpHoldOff < QDateTime::currentDateTimeUtc()) {
@@ -242,6 +269,8 @@ void StatusBar::paintEvent(Tui::ZPaintEvent *event) {
 
     QString text;
     text += slash(viewLanguage());
+    text += slash(viewSaveProgress());
+    text += slash(viewJobProgress());
     text += slash(viewFileChanged());
     text += slash(viewSelectMode());
     text += slash(viewModifiedFile());
@@ -23,6 +23,8 @@ public:
     QString viewSelectMode();
     QString viewStandardInput();
     QString viewLanguage();
+    QString viewSaveProgress();
+    QString viewJobProgress();
     void switchToNormalDisplay();
 
 public:
@@ -44,6 +46,8 @@ public slots:
     void overwrite(bool overwrite);
     void syntaxHighlightingEnabled(bool enable);
     void language(QString language);
+    void saveProgress(int percent);
+    void jobProgress(QString name, int percent);
 
 public:
     static void notifyQtLog();
@@ -74,6 +78,9 @@ private:
     bool _overwrite = false;
     QString _language = "None";
     bool _syntaxHighlightingEnabled = false;
+    int _saveProgress = -1;
+    QString _jobName;
+    int _jobProgress = -1;
     Tui::ZColor _bg;
 
     static bool _qtMessage;
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "syntaxhighlightrepository.h"
+
+#ifdef SYNTAX_HIGHLIGHTING
+
+#include <mutex>
+
+#include <QFuture>
+#include <QThread>
+#include <QtConcurrent>
+
+static std::once_flag repositoryLoadStarted;
+static QFuture<KSyntaxHighlighting::Repository*> repositoryFuture;
+
+void preloadSyntaxHighlightRepository() {
+    std::call_once(repositoryLoadStarted, [] {
+        QThread *uiThread = QThread::currentThread();
+        repositoryFuture = QtConcurrent::run([uiThread] {
+            // Loading scans all syntax definition and theme files, that is what we want to keep off the UI thread.
+            // Afterwards the repository is only used from the UI thread, so hand it over.
+            auto *repository = new KSyntaxHighlighting::Repository();
+            repository->moveToThread(uiThread);
+            return repository;
+        });
+    });
+}
+
+KSyntaxHighlighting::Repository &syntaxHighlightRepository() {
+    preloadSyntaxHighlightRepository();
+    return *repositoryFuture.result();
+}
+
+#endif
@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef SYNTAXHIGHLIGHTREPOSITORY_H
+#define SYNTAXHIGHLIGHTREPOSITORY_H
+
+#ifdef SYNTAX_HIGHLIGHTING
+
+#include <KSyntaxHighlighting/Repository>
+
+// Starts loading the process wide syntax definition repository on a worker thread.
+// Must be called from the UI thread. Calling it more than once is harmless.
+void preloadSyntaxHighlightRepository();
+
+// Returns the process wide repository. Only blocks if the background load has not yet finished.
+// The repository lives until the process exits and must only be used from the UI thread.
+KSyntaxHighlighting::Repository &syntaxHighlightRepository();
+
+#endif
+
+#endif // SYNTAXHIGHLIGHTREPOSITORY_H
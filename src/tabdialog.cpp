@@ -45,7 +45,7 @@ TabDialog::TabDialog(Tui::ZWidget *parent) : Tui::ZDialog(parent) {
 
     Tui::ZHBoxLayout *hbox3 = new Tui::ZHBoxLayout();
     Tui::ZLabel *tabtospaceLabel = new Tui::ZLabel(this);
-    tabtospaceLabel->setText("Tab to Space: ");
+    tabtospaceLabel->setText("Convert indentation: ");
     hbox3->addWidget(tabtospaceLabel);
 
     Tui::ZButton *convertButton = new Tui::ZButton(this);
@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include "attributesstore.h"
+
+static FileAttributes attributes(int n) {
+    FileAttributes result;
+    result.cursorCodeUnit = n;
+    result.cursorLine = n + 1;
+    result.scrollColumn = n + 2;
+    result.scrollLine = n + 3;
+    result.scrollFineLine = n + 4;
+    return result;
+}
+
+TEST_CASE("attributesstore") {
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const QString storeFile = dir.path() + "/chr.attributes";
+
+    SECTION("set and get") {
+        AttributesStore store(storeFile);
+        CHECK(!store.value("/tmp/a.txt").has_value());
+        store.setValue("/tmp/a.txt", attributes(1));
+        auto result = store.value("/tmp/a.txt");
+        REQUIRE(result.has_value());
+        CHECK(result->cursorCodeUnit == 1);
+        CHECK(result->cursorLine == 2);
+        CHECK(result->scrollColumn == 3);
+        CHECK(result->scrollLine == 4);
+        CHECK(result->scrollFineLine == 5);
+        CHECK(!store.value("/tmp/b.txt").has_value());
+    }
+
+    SECTION("persisted") {
+        {
+            AttributesStore store(storeFile);
+            store.setValue("/tmp/a.txt", attributes(1));
+            store.setValue("/tmp/a.txt", attributes(10));
+            CHECK(store.flush());
+        }
+        AttributesStore store(storeFile);
+        auto result = store.value("/tmp/a.txt");
+        REQUIRE(result.has_value());
+        CHECK(result->cursorCodeUnit == 10);
+        CHECK(result->scrollFineLine == 14);
+    }
+
+    SECTION("shared between instances") {
+        AttributesStore a(storeFile);
+        AttributesStore b(storeFile);
+        CHECK(!b.value("/tmp/a.txt").has_value());
+        a.setValue("/tmp/a.txt", attributes(7));
+        a.flush();
+        auto result = b.value("/tmp/a.txt");
+        REQUIRE(result.has_value());
+        CHECK(result->cursorCodeUnit == 7);
+    }
+
+    SECTION("torn record") {
+        {
+            AttributesStore store(storeFile);
+            store.setValue("/tmp/a.txt", attributes(1));
+            store.flush();
+        }
+        QFile file(storeFile);
+        REQUIRE(file.open(QIODevice::Append));
+        file.write("partial");
+        file.close();
+
+        AttributesStore store(storeFile);
+        auto result = store.value("/tmp/a.txt");
+        REQUIRE(result.has_value());
+        CHECK(result->cursorCodeUnit == 1);
+    }
+
+    SECTION("append after torn record") {
+        {
+            AttributesStore store(storeFile);
+            store.setValue("/tmp/a.txt", attributes(1));
+            store.flush();
+        }
+        const qint64 sizeBefore = QFileInfo(storeFile).size();
+        QFile file(storeFile);
+        REQUIRE(file.open(QIODevice::Append));
+        file.write("partial");
+        file.close();
+
+        {
+            AttributesStore store(storeFile);
+            store.setValue("/tmp/b.txt", attributes(2));
+            CHECK(store.flush());
+            store.setValue("/tmp/c.txt", attributes(3));
+            CHECK(store.flush());
+        }
+        // The partial record is replaced by the two new records of 50 bytes each.
+        CHECK(QFileInfo(storeFile).size() == sizeBefore + 2 * 50);
+
+        AttributesStore store(storeFile);
+        auto a = store.value("/tmp/a.txt");
+        REQUIRE(a.has_value());
+        CHECK(a->cursorCodeUnit == 1);
+        auto b = store.value("/tmp/b.txt");
+        REQUIRE(b.has_value());
+        CHECK(b->cursorCodeUnit == 2);
+        auto c = store.value("/tmp/c.txt");
+        REQUIRE(c.has_value());
+        CHECK(c->cursorCodeUnit == 3);
+    }
+
+    SECTION("invalid file replaced") {
+        {
+            QFile file(storeFile);
+            REQUIRE(file.open(QIODevice::WriteOnly));
+            file.write("not an attributes file at all");
+        }
+        AttributesStore store(storeFile);
+        CHECK(!store.value("/tmp/a.txt").has_value());
+        store.setValue("/tmp/a.txt", attributes(4));
+        CHECK(store.flush());
+        {
+            QFile file(storeFile);
+            REQUIRE(file.open(QIODevice::ReadOnly));
+            CHECK(file.readAll().startsWith("chrattr1"));
+        }
+
+        AttributesStore other(storeFile);
+        auto result = other.value("/tmp/a.txt");
+        REQUIRE(result.has_value());
+        CHECK(result->cursorCodeUnit == 4);
+    }
+
+    SECTION("lru cap") {
+        AttributesStore::setMaxEntries(10);
+        {
+            AttributesStore store(storeFile);
+            for (int i = 0; i < 50; i++) {
+                store.setValue("/tmp/" + QString::number(i), attributes(i));
+                // lastUsed has millisecond resolution
+                QThread::msleep(1);
+                store.flush();
+            }
+        }
+        AttributesStore::setMaxEntries(10000);
+
+        AttributesStore store(storeFile);
+        CHECK(store.value("/tmp/49").has_value());
+        CHECK(store.value("/tmp/40").has_value());
+        CHECK(!store.value("/tmp/0").has_value());
+        CHECK(QFileInfo(storeFile).size() < 50 * 50);
+    }
+
+    SECTION("json migration") {
+        QFile json(dir.path() + "/chr.json");
+        REQUIRE(json.open(QIODevice::WriteOnly));
+        json.write(R"({"/tmp/a.txt": {"curOff": 3, "curLine": 4, "sCol": 1, "sLine": 2, "sFine": 0},
+                       "/tmp/b.txt": {"cursorPositionX": 5, "cursorPositionY": 6}})");
+        json.close();
+
+        AttributesStore store(dir.path() + "/chr.json");
+        auto a = store.value("/tmp/a.txt");
+        REQUIRE(a.has_value());
+        CHECK(a->cursorCodeUnit == 3);
+        CHECK(a->cursorLine == 4);
+        CHECK(a->scrollColumn == 1);
+        CHECK(a->scrollLine == 2);
+        auto b = store.value("/tmp/b.txt");
+        REQUIRE(b.has_value());
+        CHECK(b->cursorCodeUnit == 5);
+        CHECK(b->cursorLine == 6);
+        CHECK(QFileInfo::exists(storeFile));
+    }
+}
@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <future>
+
+#include <QEventLoop>
+#include <QTimer>
+
+#include <Tui/ZRoot.h>
+#include <Tui/ZTerminal.h>
+#include <Tui/ZWindow.h>
+
+#include "backgroundexecutor.h"
+#include "eventrecorder.h"
+#include "file.h"
+
+TEST_CASE("backgroundexecutor") {
+
+    SECTION("priority-order") {
+        BackgroundExecutor executor(1);
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        executor.post(BackgroundExecutor::Priority::Visible, nullptr, [released](bool) { released.wait(); });
+
+        std::mutex mutex;
+        std::vector<int> order;
+        std::promise<void> done;
+        auto record = [&](int id) {
+            return [&, id](bool) {
+                std::unique_lock lock(mutex);
+                order.push_back(id);
+                if (order.size() == 5) {
+                    done.set_value();
+                }
+            };
+        };
+        executor.post(BackgroundExecutor::Priority::Background, nullptr, record(4));
+        executor.post(BackgroundExecutor::Priority::Interactive, nullptr, record(2));
+        executor.post(BackgroundExecutor::Priority::Background, nullptr, record(5));
+        executor.post(BackgroundExecutor::Priority::Visible, nullptr, record(1));
+        executor.post(BackgroundExecutor::Priority::Interactive, nullptr, record(3));
+        release.set_value();
+        done.get_future().wait();
+        CHECK(order == std::vector<int>{1, 2, 3, 4, 5});
+    }
+
+    SECTION("background-leaves-a-worker") {
+        BackgroundExecutor executor(2);
+        CHECK(executor.backgroundLimit() == 1);
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::atomic<int> started{0};
+        std::atomic<int> finished{0};
+        std::promise<void> done;
+        for (int i = 0; i < 2; i++) {
+            executor.post(BackgroundExecutor::Priority::Background, nullptr, [&, released](bool) {
+                started++;
+                released.wait();
+                if (++finished == 2) {
+                    done.set_value();
+                }
+            });
+        }
+
+        // Runs while one Background task blocks its worker and the other one waits.
+        std::promise<void> visible;
+        executor.post(BackgroundExecutor::Priority::Visible, nullptr, [&](bool) { visible.set_value(); });
+        CHECK(visible.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+        CHECK(started <= 1);
+
+        release.set_value();
+        done.get_future().wait();
+        CHECK(started == 2);
+    }
+
+    SECTION("cancelled") {
+        BackgroundExecutor executor(1);
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        executor.post(BackgroundExecutor::Priority::Visible, nullptr, [released](bool) { released.wait(); });
+
+        CancelToken token = std::make_shared<std::atomic<bool>>(false);
+        std::promise<bool> cancelled;
+        executor.post(BackgroundExecutor::Priority::Visible, token, [&](bool c) { cancelled.set_value(c); });
+        *token = true;
+        release.set_value();
+        CHECK(cancelled.get_future().get());
+    }
+
+    SECTION("future") {
+        BackgroundExecutor executor(2);
+        QFuture<int> future = executor.run(BackgroundExecutor::Priority::Interactive, nullptr, [] { return 42; });
+        future.waitForFinished();
+        CHECK_FALSE(future.isCanceled());
+        CHECK(future.result() == 42);
+
+        CancelToken token = std::make_shared<std::atomic<bool>>(true);
+        QFuture<int> cancelledFuture = executor.run(BackgroundExecutor::Priority::Interactive, token, [] { return 1; });
+        cancelledFuture.waitForFinished();
+        CHECK(cancelledFuture.isCanceled());
+    }
+
+    SECTION("tasks-posting-tasks") {
+        BackgroundExecutor executor(4);
+        std::atomic<int> count{0};
+        std::promise<void> done;
+        for (int i = 0; i < 10; i++) {
+            executor.post(BackgroundExecutor::Priority::Background, nullptr, [&](bool) {
+                for (int j = 0; j < 100; j++) {
+                    executor.post(BackgroundExecutor::Priority::Background, nullptr, [&](bool) {
+                        if (++count == 1000) {
+                            done.set_value();
+                        }
+                    });
+                }
+            });
+        }
+        done.get_future().wait();
+        CHECK(count == 1000);
+    }
+
+    SECTION("destruction-cleans-up-queued-tasks") {
+        std::atomic<int> cancelledCount{0};
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::thread releaser;
+        {
+            BackgroundExecutor executor(1);
+            std::promise<void> started;
+            executor.post(BackgroundExecutor::Priority::Visible, nullptr, [&started, released](bool) {
+                started.set_value();
+                released.wait();
+            });
+            started.get_future().wait();
+            for (int i = 0; i < 3; i++) {
+                executor.post(BackgroundExecutor::Priority::Background, nullptr, [&](bool cancelled) {
+                    if (cancelled) {
+                        cancelledCount++;
+                    }
+                });
+            }
+            // The running task ends while the executor is being destroyed, the queued ones don't run.
+            releaser = std::thread([&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                release.set_value();
+            });
+        }
+        releaser.join();
+        CHECK(cancelledCount == 3);
+    }
+}
+
+TEST_CASE("backgroundexecutor-off-screen") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+    Tui::ZRoot root;
+    Tui::ZWindow *w = new Tui::ZWindow(&root);
+    terminal.setMainWidget(&root);
+    w->setGeometry({0, 0, 80, 24});
+
+    File *f = new File(terminal.textMetrics(), w);
+    f->setFocus();
+    f->setGeometry({0, 0, 80, 24});
+    f->insertText("aa\nbb\naa");
+
+    EventRecorder recorder;
+    auto searchCountSignal = recorder.watchSignal(f, RECORDER_SIGNAL(&File::searchCountChanged));
+
+    auto runEventLoop = [] {
+        QEventLoop loop;
+        QTimer::singleShot(100, &loop, &QEventLoop::quit);
+        loop.exec();
+    };
+
+    f->setOnScreen(false);
+    CHECK(f->isOnScreen() == false);
+
+    // Counting search matches is background work, it waits until the file can be seen again.
+    f->setSearchText("aa");
+    runEventLoop();
+    CHECK(recorder.noMoreEvents());
+
+    f->setOnScreen(true);
+    recorder.waitForEvent(searchCountSignal);
+    CHECK(recorder.consumeFirst(searchCountSignal, 2));
+    CHECK(recorder.noMoreEvents());
+
+    SECTION("edit-while-off-screen") {
+        f->setOnScreen(false);
+        f->insertText("\naa");
+        f->setSearchText("aa");
+        runEventLoop();
+        CHECK(recorder.noMoreEvents());
+
+        f->setOnScreen(true);
+        recorder.waitForEvent(searchCountSignal);
+        CHECK(recorder.consumeFirst(searchCountSignal, 3));
+        CHECK(recorder.noMoreEvents());
+    }
+}
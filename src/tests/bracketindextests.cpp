@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include "bracketindex.h"
+
+#include <QStringList>
+
+// Plain scan over the whole document, as reference.
+static bool scanMatch(const QStringList &lines, int line, int codeUnit, int *matchLine, int *matchCodeUnit) {
+    const QChar ch = lines[line][codeUnit];
+    const bool forward = ch == '(';
+    int depth = 0;
+    int l = line;
+    int i = codeUnit;
+    while (true) {
+        const QChar current = lines[l][i];
+        if (current == '(') {
+            depth += forward ? 1 : -1;
+        } else if (current == ')') {
+            depth += forward ? -1 : 1;
+        }
+        if (depth == 0) {
+            *matchLine = l;
+            *matchCodeUnit = i;
+            return true;
+        }
+        if (forward) {
+            i++;
+            while (l < lines.size() && i >= lines[l].size()) {
+                l++;
+                i = 0;
+            }
+            if (l >= lines.size()) {
+                return false;
+            }
+        } else {
+            i--;
+            while (l >= 0 && i < 0) {
+                l--;
+                if (l >= 0) {
+                    i = lines[l].size() - 1;
+                }
+            }
+            if (l < 0) {
+                return false;
+            }
+        }
+    }
+}
+
+static void syncIndex(BracketIndex &index, const QStringList &lines, const QVector<unsigned> &revisions) {
+    index.invalidate();
+    index.sync(lines.size(), [&](int line) { return revisions[line]; }, [&](int line) { return lines[line]; });
+}
+
+// Sync that only looks around the edited lines, returns the number of lines scanned.
+static int syncHinted(BracketIndex &index, const QStringList &lines, const QVector<unsigned> &revisions,
+                      const QVector<int> &hints) {
+    int scanned = 0;
+    index.invalidate();
+    index.sync(lines.size(), [&](int line) { return revisions[line]; },
+               [&](int line) { scanned++; return lines[line]; }, hints, false);
+    return scanned;
+}
+
+static void checkAllBrackets(const BracketIndex &index, const QStringList &lines) {
+    for (int line = 0; line < lines.size(); line++) {
+        for (int i = 0; i < lines[line].size(); i++) {
+            if (lines[line][i] != '(' && lines[line][i] != ')') {
+                continue;
+            }
+            CAPTURE(line);
+            CAPTURE(i);
+            int expectedLine = -1;
+            int expectedCodeUnit = -1;
+            const bool expected = scanMatch(lines, line, i, &expectedLine, &expectedCodeUnit);
+            int matchLine = -1;
+            int matchCodeUnit = -1;
+            const bool found = index.findMatch(line, i, [&](int l) { return lines[l]; }, &matchLine, &matchCodeUnit);
+            CHECK(found == expected);
+            if (found && expected) {
+                CHECK(matchLine == expectedLine);
+                CHECK(matchCodeUnit == expectedCodeUnit);
+            }
+        }
+    }
+}
+
+TEST_CASE("bracketindex") {
+    BracketIndex index('(', ')');
+
+    SECTION("single-line") {
+        const QStringList lines = {"a(b(c)d)e", "(", ")x)"};
+        syncIndex(index, lines, {0, 0, 0});
+        int matchLine = -1;
+        int matchCodeUnit = -1;
+        CHECK(index.findMatch(0, 1, [&](int l) { return lines[l]; }, &matchLine, &matchCodeUnit));
+        CHECK(matchLine == 0);
+        CHECK(matchCodeUnit == 7);
+        CHECK_FALSE(index.findMatch(0, 0, [&](int l) { return lines[l]; }, &matchLine, &matchCodeUnit));
+        checkAllBrackets(index, lines);
+    }
+
+    SECTION("other-brackets-ignored") {
+        const QStringList lines = {"{(", "}", ")"};
+        syncIndex(index, lines, {0, 0, 0});
+        int matchLine = -1;
+        int matchCodeUnit = -1;
+        CHECK(index.findMatch(0, 1, [&](int l) { return lines[l]; }, &matchLine, &matchCodeUnit));
+        CHECK(matchLine == 2);
+        CHECK(matchCodeUnit == 0);
+    }
+
+    SECTION("many-lines") {
+        // Deep nesting across many blocks, with unbalanced brackets at both ends.
+        QStringList lines;
+        lines.append("))");
+        for (int i = 0; i < 500; i++) {
+            lines.append(QString("x(").repeated(i % 3) + "y");
+        }
+        lines.append("");
+        for (int i = 0; i < 600; i++) {
+            lines.append(QString(")").repeated(i % 2) + "(" + QString(")").repeated(i % 3));
+        }
+        lines.append("((");
+        // Like in a document, every line has its own revision.
+        QVector<unsigned> revisions;
+        for (int line = 0; line < lines.size(); line++) {
+            revisions.append(line);
+        }
+        syncIndex(index, lines, revisions);
+        checkAllBrackets(index, lines);
+
+        SECTION("edit-same-line-count") {
+            lines[250] = "(((";
+            revisions[250] = 10000;
+            lines[900] = ")";
+            revisions[900] = 10001;
+            syncIndex(index, lines, revisions);
+            checkAllBrackets(index, lines);
+        }
+
+        SECTION("insert-and-remove-lines") {
+            for (int i = 0; i < 70; i++) {
+                lines.insert(300, ")");
+                revisions.insert(300, 10002 + i);
+            }
+            syncIndex(index, lines, revisions);
+            checkAllBrackets(index, lines);
+
+            lines.erase(lines.begin() + 10, lines.begin() + 400);
+            revisions.remove(10, 390);
+            syncIndex(index, lines, revisions);
+            checkAllBrackets(index, lines);
+        }
+
+        SECTION("hinted-edits") {
+            lines[250] = "(((";
+            revisions[250] = 10000;
+            CHECK(syncHinted(index, lines, revisions, {250}) == 1);
+            checkAllBrackets(index, lines);
+
+            for (int i = 0; i < 3; i++) {
+                lines.insert(700, "))");
+                revisions.insert(700, 10001 + i);
+            }
+            CHECK(syncHinted(index, lines, revisions, {702}) == 3);
+            checkAllBrackets(index, lines);
+
+            lines.erase(lines.begin() + 100, lines.begin() + 105);
+            revisions.remove(100, 5);
+            lines[99] = "x";
+            revisions[99] = 10004;
+            CHECK(syncHinted(index, lines, revisions, {99}) == 1);
+            checkAllBrackets(index, lines);
+        }
+
+        SECTION("hinted-edits-split-blocks") {
+            // Inserting line by line at one place makes its block grow past its size and split again.
+            unsigned revision = 20000;
+            for (int i = 0; i < 200; i++) {
+                const int line = 400 + i % 7;
+                lines.insert(line, i % 2 ? "(" : ")");
+                revisions.insert(line, revision++);
+                syncHinted(index, lines, revisions, {line});
+            }
+            checkAllBrackets(index, lines);
+            for (int i = 0; i < 150; i++) {
+                const int line = 380 + i % 11;
+                lines.removeAt(line);
+                revisions.remove(line);
+                syncHinted(index, lines, revisions, {line});
+            }
+            checkAllBrackets(index, lines);
+        }
+    }
+
+    SECTION("unchanged-revision-is-not-rescanned") {
+        QStringList lines = {"(", ")"};
+        syncIndex(index, lines, {0, 0});
+        int rescanned = 0;
+        index.invalidate();
+        index.sync(lines.size(), [](int) { return 0u; }, [&](int line) { rescanned++; return lines[line]; });
+        CHECK(rescanned == 0);
+    }
+}
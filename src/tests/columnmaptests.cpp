@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include "columnmap.h"
+
+TEST_CASE("columnmap") {
+    ColumnPosition position;
+
+    SECTION("ascii") {
+        REQUIRE(columnPositionWithoutLayout("abcdef", 3, 8, &position));
+        CHECK(position.codeUnit == 3);
+        CHECK(position.width == 6);
+        CHECK(position.simple);
+    }
+
+    SECTION("past-end") {
+        REQUIRE(columnPositionWithoutLayout("abc", 10, 8, &position));
+        CHECK(position.codeUnit == 3);
+        CHECK(position.width == 3);
+    }
+
+    SECTION("tabs") {
+        REQUIRE(columnPositionWithoutLayout("a\tb", 4, 4, &position));
+        CHECK(position.codeUnit == 2);
+        CHECK(position.width == 5);
+        REQUIRE(columnPositionWithoutLayout("a\tb", 1, 4, &position));
+        CHECK(position.codeUnit == 1);
+    }
+
+    SECTION("inside-tab") {
+        CHECK(!columnPositionWithoutLayout("a\tb", 2, 4, &position));
+        CHECK(!columnPositionWithoutLayout("a\t", 6, 8, &position));
+        REQUIRE(columnPositionWithoutLayout("a\t", 8, 8, &position));
+        CHECK(position.codeUnit == 2);
+        CHECK(position.width == 8);
+    }
+
+    SECTION("non-ascii") {
+        CHECK(!columnPositionWithoutLayout("abcä", 1, 8, &position));
+        CHECK(!columnPositionWithoutLayout(QString("ab") + QChar(0x1b), 1, 8, &position));
+    }
+
+    SECTION("column-of-code-unit") {
+        int column = -1;
+        REQUIRE(columnOfCodeUnitWithoutLayout("a\tbc", 3, 4, &column));
+        CHECK(column == 5);
+        REQUIRE(columnOfCodeUnitWithoutLayout("abc", 0, 4, &column));
+        CHECK(column == 0);
+        CHECK(!columnOfCodeUnitWithoutLayout("äbc", 2, 4, &column));
+    }
+
+    SECTION("cache") {
+        ColumnLayoutCache cache;
+        CHECK(!cache.find("äbc", 2, 8).has_value());
+        cache.insert("äbc", 2, 8, ColumnPosition{2, 3, false});
+        REQUIRE(cache.find("äbc", 2, 8).has_value());
+        CHECK(cache.find("äbc", 2, 8)->codeUnit == 2);
+        CHECK(!cache.find("äbc", 2, 4).has_value());
+        CHECK(!cache.find("äbd", 2, 8).has_value());
+        cache.clear();
+        CHECK(!cache.find("äbc", 2, 8).has_value());
+    }
+}
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+#include "editjournal.h"
+#include "file.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <Tui/ZTerminal.h>
+
+
+static QStringList documentLines(File *f) {
+    QStringList lines;
+    for (int line = 0; line < f->document()->lineCount(); line++) {
+        lines.append(f->document()->line(line));
+    }
+    return lines;
+}
+
+TEST_CASE("EditJournal") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+
+    QTemporaryDir dir;
+    const QString filename = dir.path() + "/file";
+    const QString journalDirectory = dir.path() + "/journal";
+    {
+        QFile file(filename);
+        REQUIRE(file.open(QIODevice::WriteOnly));
+        file.write("one\ntwo\nthree\nfour\n");
+    }
+
+    File *f = new File(terminal.textMetrics(), nullptr);
+    f->setJournalDirectory(journalDirectory);
+    REQUIRE(f->openText(filename));
+    CHECK(!f->hasJournal());
+
+    SECTION("recover") {
+        f->setCursorPosition({0, 1});
+        f->insertText("second ");
+        f->flushJournal();
+        f->setCursorPosition({0, 3});
+        f->insertText("new\n");
+        f->flushJournal();
+        const QStringList expected = documentLines(f);
+        delete f;
+
+        File *g = new File(terminal.textMetrics(), nullptr);
+        g->setJournalDirectory(journalDirectory);
+        REQUIRE(g->openText(filename));
+        REQUIRE(g->hasJournal());
+        CHECK(g->recoverFromJournal());
+        CHECK(documentLines(g) == expected);
+        CHECK(g->isModified());
+        g->discardJournal();
+        CHECK(!g->hasJournal());
+        delete g;
+    }
+
+    SECTION("not modified") {
+        f->insertText("x");
+        f->undo();
+        f->flushJournal();
+        CHECK(!f->hasJournal());
+        delete f;
+    }
+
+    SECTION("only readable by the user") {
+        f->insertText("x");
+        f->flushJournal();
+        REQUIRE(f->hasJournal());
+        const QString journal = EditJournal::journalFile(journalDirectory, filename);
+        const QFileDevice::Permissions others = QFileDevice::ReadGroup | QFileDevice::WriteGroup | QFileDevice::ExeGroup
+                | QFileDevice::ReadOther | QFileDevice::WriteOther | QFileDevice::ExeOther;
+        CHECK((QFile::permissions(journalDirectory) & others) == 0);
+        CHECK((QFile::permissions(journal) & others) == 0);
+        delete f;
+    }
+
+    SECTION("save removes journal") {
+        f->insertText("x");
+        f->flushJournal();
+        CHECK(f->hasJournal());
+        f->setSyncOnSave(false);
+        CHECK(f->saveText());
+        CHECK(!f->hasJournal());
+        delete f;
+    }
+
+    SECTION("file changed on disk") {
+        f->insertText("x");
+        f->flushJournal();
+        delete f;
+        {
+            QFile file(filename);
+            REQUIRE(file.open(QIODevice::WriteOnly));
+            file.write("other content\n");
+        }
+
+        File *g = new File(terminal.textMetrics(), nullptr);
+        g->setJournalDirectory(journalDirectory);
+        REQUIRE(g->openText(filename));
+        REQUIRE(g->hasJournal());
+        CHECK(!g->recoverFromJournal());
+        delete g;
+    }
+}
+
+TEST_CASE("EditJournalRuns") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+
+    QTemporaryDir dir;
+    const QString filename = dir.path() + "/file";
+    const QString journalDirectory = dir.path() + "/journal";
+    {
+        QFile file(filename);
+        REQUIRE(file.open(QIODevice::WriteOnly));
+        for (int i = 0; i < 10000; i++) {
+            file.write(QByteArray::number(i * 7919) + " some text of line " + QByteArray::number(i) + "\n");
+        }
+    }
+
+    File *f = new File(terminal.textMetrics(), nullptr);
+    f->setJournalDirectory(journalDirectory);
+    REQUIRE(f->openText(filename));
+    const QString journal = EditJournal::journalFile(journalDirectory, filename);
+
+    auto recovered = [&] {
+        File *g = new File(terminal.textMetrics(), nullptr);
+        g->setJournalDirectory(journalDirectory);
+        REQUIRE(g->openText(filename));
+        REQUIRE(g->hasJournal());
+        CHECK(g->recoverFromJournal());
+        const QStringList lines = documentLines(g);
+        g->disableJournal();
+        delete g;
+        return lines;
+    };
+
+    SECTION("edits far apart") {
+        // Only the two changed lines are written, not the lines between them.
+        f->setCursorPosition({0, 1});
+        f->insertText("top ");
+        f->setCursorPosition({0, 9998});
+        f->insertText("bottom ");
+        f->flushJournal();
+        CHECK(QFileInfo(journal).size() < 1000);
+        CHECK(recovered() == documentLines(f));
+    }
+
+    SECTION("lines inserted and removed") {
+        f->setCursorPosition({0, 2});
+        f->insertText("new\nlines\n");
+        f->setCursorPosition({0, 5000});
+        f->setCursorPosition({0, 5003}, true);
+        f->removeSelectedText();
+        f->setCursorPosition({0, 9000});
+        f->insertText("x");
+        f->flushJournal();
+        CHECK(QFileInfo(journal).size() < 1000);
+        CHECK(recovered() == documentLines(f));
+
+        SECTION("undo") {
+            f->undo();
+            f->undo();
+            f->flushJournal();
+            CHECK(recovered() == documentLines(f));
+        }
+    }
+}
@@ -2,6 +2,7 @@
 
 #include "catchwrapper.h"
 #include "filecategorize.h"
+#include "filelistparser.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -170,6 +171,32 @@ TEST_CASE("FileOpen") {
     chmod(fileRO.toUtf8().data(), 0600);
 }
 
+TEST_CASE("FileListCheck") {
+    QTemporaryDir dir;
+    QDir tmpd(dir.path());
+    tmpd.mkdir("sub");
+
+    QFile tmpf(dir.path() + "/existing");
+    tmpf.open(QIODevice::WriteOnly);
+    tmpf.close();
+
+    const QString existing = dir.path() + "/existing";
+    const QString newFile = dir.path() + "/new";
+    const QString subDir = dir.path() + "/sub";
+    const QString missingDir = dir.path() + "/missing/";
+
+    CHECK(checkFileList(parseFileList({existing, newFile, subDir})) == "");
+    CHECK(checkFileList(parseFileList({"+3", existing, "+/foo", newFile})) == "");
+
+    // An invalid entry anywhere in the list rejects the whole list, also when valid files come before it.
+    CHECK(checkFileList(parseFileList({existing, missingDir, newFile}))
+          == "Directory not exist, cannot be opened: " + missingDir);
+    CHECK(checkFileList(parseFileList({existing, newFile, "/dev/null"}))
+          == "File type cannot be opened: /dev/null");
+    CHECK(checkFileList(parseFileList({"/dev/null", missingDir}))
+          == "File type cannot be opened: /dev/null");
+}
+
 TEST_CASE("FileChange") {
     // RO
 
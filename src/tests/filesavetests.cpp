@@ -1,3 +1,343 @@
 // SPDX-License-Identifier: BSL-1.0
 
 #include "catchwrapper.h"
+#include "file.h"
+#include "filesaver.h"
+#include "filewindow.h"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <Tui/ZRoot.h>
+#include <Tui/ZTerminal.h>
+
+
+static QByteArray readAll(const QString &filename) {
+    QFile file(filename);
+    file.open(QIODevice::ReadOnly);
+    return file.readAll();
+}
+
+static void writeAll(const QString &filename, const QByteArray &data) {
+    QFile file(filename);
+    file.open(QIODevice::WriteOnly);
+    file.write(data);
+    file.close();
+}
+
+TEST_CASE("FileSave") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+
+    QTemporaryDir dir;
+    const QString filename = dir.path() + "/file";
+
+    File *f = new File(terminal.textMetrics(), nullptr);
+    f->setSyncOnSave(false);
+
+    SECTION("replaces content") {
+        writeAll(filename, "old content\n");
+        CHECK(f->openText(filename));
+        f->insertText("new ");
+        CHECK(f->saveText());
+        CHECK(readAll(filename) == "new old content\n");
+        CHECK(!f->isModified());
+        CHECK(QDir(dir.path()).entryList(QDir::Files | QDir::Hidden) == QStringList{"file"});
+    }
+
+    SECTION("crlf and missing newline") {
+        writeAll(filename, "a\r\nb");
+        CHECK(f->openText(filename));
+        CHECK(f->saveText());
+        CHECK(readAll(filename) == "a\r\nb");
+    }
+
+    SECTION("keeps mode") {
+        writeAll(filename, "text\n");
+        REQUIRE(::chmod(QFile::encodeName(filename).constData(), 0640) == 0);
+        CHECK(f->openText(filename));
+        CHECK(f->saveText());
+        struct stat st;
+        REQUIRE(::stat(QFile::encodeName(filename).constData(), &st) == 0);
+        CHECK((st.st_mode & 07777) == 0640);
+    }
+
+    SECTION("keeps symlink") {
+        writeAll(filename, "text\n");
+        const QString link = dir.path() + "/link";
+        REQUIRE(QFile::link(filename, link));
+        CHECK(f->openText(link));
+        f->insertText("more ");
+        CHECK(f->saveText());
+        CHECK(QFileInfo(link).isSymLink());
+        CHECK(readAll(filename) == "more text\n");
+    }
+
+    SECTION("keeps hard link") {
+        writeAll(filename, "text\n");
+        const QString hardLink = dir.path() + "/hardlink";
+        REQUIRE(::link(QFile::encodeName(filename).constData(), QFile::encodeName(hardLink).constData()) == 0);
+        CHECK(f->openText(filename));
+        f->insertText("more ");
+        CHECK(f->saveText());
+        CHECK(readAll(hardLink) == "more text\n");
+    }
+
+    delete f;
+}
+
+TEST_CASE("FileSaveInBackground") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+    Tui::ZRoot root;
+    terminal.setMainWidget(&root);
+
+    QTemporaryDir dir;
+    const QString filename = dir.path() + "/file";
+    writeAll(filename, "text\n");
+
+    FileSaver saver;
+    FileWindow *win = new FileWindow(&root);
+    win->setFileSaver(&saver);
+    win->openFile(filename);
+    File *f = win->getFileWidget();
+    f->setSyncOnSave(false);
+
+    bool done = false;
+    bool result = false;
+    QEventLoop loop;
+    auto callback = [&] (bool ok) {
+        done = true;
+        result = ok;
+        loop.quit();
+    };
+    auto waitForSave = [&] {
+        if (!done) {
+            loop.exec();
+        }
+        REQUIRE(done);
+    };
+
+    SECTION("edit while saving") {
+        f->insertText("saved ");
+        win->saveFile(filename, std::nullopt, callback);
+        // The save only completes on the event loop, so this edit is always made while it is running.
+        f->insertText("unsaved ");
+        waitForSave();
+        CHECK(result);
+        CHECK(readAll(filename) == "saved text\n");
+        CHECK(f->isModified());
+        CHECK(f->document()->line(0) == "saved unsaved text");
+    }
+
+    SECTION("no edit while saving") {
+        f->insertText("saved ");
+        win->saveFile(filename, std::nullopt, callback);
+        waitForSave();
+        CHECK(result);
+        CHECK(readAll(filename) == "saved text\n");
+        CHECK(!f->isModified());
+    }
+
+    SECTION("split views save in order") {
+        FileWindow *split = new FileWindow(&root, win);
+        split->setFileSaver(&saver);
+        bool firstDone = false;
+        f->insertText("first ");
+        win->saveFile(filename, std::nullopt, [&] (bool ok) {
+            CHECK(ok);
+            CHECK(!done);
+            firstDone = true;
+        });
+        f->insertText("second ");
+        // Waits for the save of the other view, its newer text must be what ends up in the file.
+        split->saveFile(filename, std::nullopt, callback);
+        waitForSave();
+        CHECK(firstDone);
+        CHECK(result);
+        CHECK(readAll(filename) == "first second text\n");
+        CHECK(!f->isModified());
+        delete split;
+    }
+
+    SECTION("failed write") {
+        f->insertText("unsaved ");
+        const QString missing = dir.path() + "/missing/file";
+        win->saveFile(missing, std::nullopt, callback);
+        waitForSave();
+        CHECK(!result);
+        CHECK(!QFileInfo::exists(missing));
+        CHECK(readAll(filename) == "text\n");
+        CHECK(f->isModified());
+    }
+
+    delete win;
+}
+
+TEST_CASE("FileUnload") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+
+    QTemporaryDir dir;
+    const QString filename = dir.path() + "/file";
+    writeAll(filename, "first\nsecond\n");
+
+    File *f = new File(terminal.textMetrics(), nullptr);
+    CHECK(f->openText(filename));
+    f->unloadText();
+    CHECK(f->isUnloaded());
+
+    SECTION("unchanged") {
+        CHECK(!f->changedOnDiskSinceUnload());
+        REQUIRE(f->beginReload());
+        QFile file(filename);
+        REQUIRE(file.open(QIODevice::ReadOnly));
+        CHECK(f->reloadText(&file));
+        CHECK(!f->isUnloaded());
+        CHECK(f->document()->line(0) == "first");
+        CHECK(f->document()->line(1) == "second");
+        CHECK(!f->changedOnDiskSinceUnload());
+    }
+
+    SECTION("changed") {
+        writeAll(filename, "first\nchanged\n");
+        CHECK(f->changedOnDiskSinceUnload());
+    }
+
+    SECTION("removed") {
+        REQUIRE(QFile::remove(filename));
+        CHECK(f->changedOnDiskSinceUnload());
+    }
+
+    delete f;
+}
+
+TEST_CASE("StdinUnload") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+
+    QTemporaryDir dir;
+
+    File *f = new File(terminal.textMetrics(), nullptr);
+    f->setSyncOnSave(false);
+    CHECK(f->stdinText());
+    f->appendInput("first\nsecond");
+
+    auto reload = [f] {
+        REQUIRE(f->beginReload());
+        f->reloadStream();
+        CHECK(!f->isUnloaded());
+    };
+
+    SECTION("not saved") {
+        CHECK(f->isModified());
+        f->unloadText();
+        CHECK(f->isUnloaded());
+        CHECK(f->isStream());
+        // The input only exists in memory, closing must still ask to save it.
+        CHECK(f->isModified());
+
+        f->appendInput("third");
+        CHECK(f->isModified());
+
+        reload();
+        CHECK(f->document()->lineCount() == 3);
+        CHECK(f->document()->line(0) == "first");
+        CHECK(f->document()->line(1) == "second");
+        CHECK(f->document()->line(2) == "third");
+        CHECK(f->isModified());
+    }
+
+    SECTION("saved") {
+        CHECK(f->setFilename(dir.path() + "/input"));
+        CHECK(f->saveText());
+        CHECK(!f->isModified());
+        f->unloadText();
+        CHECK(f->isUnloaded());
+        CHECK(!f->isModified());
+
+        SECTION("nothing appended") {
+            reload();
+            CHECK(f->document()->lineCount() == 2);
+            CHECK(f->document()->line(1) == "second");
+            CHECK(!f->isModified());
+        }
+
+        SECTION("appended") {
+            f->appendInput("third");
+            CHECK(f->isModified());
+            reload();
+            CHECK(f->document()->lineCount() == 3);
+            CHECK(f->document()->line(2) == "third");
+            CHECK(f->isModified());
+        }
+    }
+
+    delete f;
+}
+
+TEST_CASE("StdinUndoLimit") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+
+    QTemporaryDir dir;
+
+    File *f = new File(terminal.textMetrics(), nullptr);
+    f->setSyncOnSave(false);
+    CHECK(f->stdinText());
+    f->appendInput("first\nsecond");
+    f->appendInput("third");
+
+    auto checkText = [f] {
+        CHECK(f->document()->lineCount() == 3);
+        CHECK(f->document()->line(0) == "first");
+        CHECK(f->document()->line(1) == "second");
+        CHECK(f->document()->line(2) == "third");
+    };
+
+    SECTION("dropped") {
+        f->dropStreamHistory();
+        checkText();
+        CHECK(f->isStream());
+        // Reading the text again marked it as saved, but it is not.
+        CHECK(f->isModified());
+        f->undo();
+        checkText();
+
+        f->appendInput("fourth");
+        CHECK(f->document()->lineCount() == 4);
+        CHECK(f->document()->line(3) == "fourth");
+        CHECK(f->isModified());
+
+        CHECK(f->setFilename(dir.path() + "/input"));
+        CHECK(f->saveText());
+        CHECK(!f->isModified());
+    }
+
+    SECTION("edited") {
+        f->setCursorPosition({0, 0});
+        f->insertText("x");
+        f->dropStreamHistory();
+        CHECK(f->document()->line(0) == "xfirst");
+        // The edit can still be undone.
+        f->undo();
+        checkText();
+    }
+
+    SECTION("saved") {
+        CHECK(f->setFilename(dir.path() + "/input"));
+        CHECK(f->saveText());
+        f->appendInput("fourth");
+        f->dropStreamHistory();
+        f->undo();
+        CHECK(f->document()->lineCount() == 3);
+    }
+
+    delete f;
+}
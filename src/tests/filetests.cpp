@@ -365,6 +365,20 @@ TEST_CASE("actions") {
         CHECK(f->cursorPosition() == Tui::ZDocumentCursor::Position{8,2});
         CHECK(doc.lineCount() == 3);
     }
+    SECTION("lazy-copy-paste") {
+        // A copy this large is kept as a document range, the clipboard must not look empty meanwhile.
+        f->insertText((QString("\n") + QString(99, 'x')).repeated(11000));
+        CHECK(doc.lineCount() == 11002);
+        Tui::ZTest::sendText(&terminal, "a", Qt::KeyboardModifier::ControlModifier);
+        Tui::ZTest::sendText(&terminal, "c", Qt::KeyboardModifier::ControlModifier);
+        Tui::ZClipboard *clipboard = root.findFacet<Tui::ZClipboard>();
+        CHECK(LazyClipboard::forClipboard(clipboard)->hasRange());
+        CHECK(clipboard->contents() == "    text");
+        Tui::ZTest::sendKey(&terminal, Tui::Key_Right, Qt::KeyboardModifier::NoModifier);
+        Tui::ZTest::sendText(&terminal, "v", Qt::KeyboardModifier::ControlModifier);
+        CHECK(doc.lineCount() == 2 * 11002 - 1);
+        CHECK(doc.line(11001) == QString(99, 'x') + "    text");
+    }
     SECTION("axv") {
         Tui::ZTest::sendText(&terminal, "a", Qt::KeyboardModifier::ControlModifier);
         CHECK(f->cursorPosition() == Tui::ZDocumentCursor::Position{8,1});
@@ -463,6 +477,37 @@ TEST_CASE("actions") {
         CHECK(doc.line(1) == "2");
         CHECK(doc.line(2) == "1");
     }
+    SECTION("convert-tabs") {
+        f->newText("");
+        f->setTabStopDistance(4);
+        f->insertText("\ta\tb\nno tabs\nab\t\tc");
+        CHECK(f->convertTabsToSpaces() == 2);
+        CHECK(doc.line(0) == "    a   b");
+        CHECK(doc.line(1) == "no tabs");
+        CHECK(doc.line(2) == "ab      c");
+        Tui::ZTest::sendText(&terminal, "z", Qt::KeyboardModifier::ControlModifier);
+        CHECK(doc.line(0) == "\ta\tb");
+        CHECK(doc.line(2) == "ab\t\tc");
+    }
+    SECTION("block-multi-insert") {
+        f->newText("");
+        f->insertText("abc\n\nef\tgh");
+        f->setCursorPosition({1, 0});
+        Tui::ZTest::sendKey(&terminal, Qt::Key_Down, Qt::AltModifier | Qt::ShiftModifier);
+        Tui::ZTest::sendKey(&terminal, Qt::Key_Down, Qt::AltModifier | Qt::ShiftModifier);
+        Tui::ZTest::sendText(&terminal, "X", Qt::KeyboardModifier::NoModifier);
+        CHECK(doc.line(0) == "aXbc");
+        CHECK(doc.line(1) == " X");
+        CHECK(doc.line(2) == "eXf\tgh");
+        Tui::ZTest::sendKey(&terminal, Qt::Key_Backspace, Qt::KeyboardModifier::NoModifier);
+        CHECK(doc.line(0) == "abc");
+        CHECK(doc.line(1) == " ");
+        CHECK(doc.line(2) == "ef\tgh");
+        Tui::ZTest::sendKey(&terminal, Qt::Key_Delete, Qt::KeyboardModifier::NoModifier);
+        CHECK(doc.line(0) == "ac");
+        CHECK(doc.line(1) == " ");
+        CHECK(doc.line(2) == "e\tgh");
+    }
 
     //delete
     SECTION("key-delete") {
@@ -1265,5 +1310,84 @@ TEST_CASE("actions") {
         CHECK(f->cursorPosition() == Tui::ZDocumentCursor::Position{12,1});
         recorder.clearEvents();
     }
+
+    SECTION("replace-regex-matching-empty-text") {
+        f->setRegex(true);
+        CHECK(f->matchesEmptyText("^") == true);
+        CHECK(f->matchesEmptyText("$") == true);
+        CHECK(f->matchesEmptyText("e*") == true);
+        CHECK(f->matchesEmptyText("e") == false);
+
+        CHECK(f->replaceAll("^", "x") == 0);
+        CHECK(doc.line(0) == "    text");
+        CHECK(doc.line(1) == "    new1");
+
+        f->setRegex(false);
+        CHECK(f->matchesEmptyText("^") == false);
+    }
 }
 
+
+TEST_CASE("file-split-views") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+    Tui::ZRoot root;
+    Tui::ZWindow *w = new Tui::ZWindow(&root);
+    terminal.setMainWidget(&root);
+    w->setGeometry({0, 0, 80, 24});
+
+    File *f = new File(terminal.textMetrics(), w);
+    f->setGeometry({0, 0, 80, 12});
+    File *g = new File(terminal.textMetrics(), w, f);
+    g->setGeometry({0, 12, 80, 12});
+
+    CHECK(f->document() == g->document());
+    CHECK(f->views() == QList<File*>{f, g});
+    CHECK(g->views() == QList<File*>{f, g});
+
+    f->insertText("one\ntwo");
+    CHECK(g->document()->line(1) == "two");
+    CHECK(f->isModified() == true);
+    CHECK(g->isModified() == true);
+
+    g->setCursorPosition({1, 0});
+    CHECK(g->cursorPosition() == Tui::ZDocumentCursor::Position{1,0});
+    CHECK(f->cursorPosition() == Tui::ZDocumentCursor::Position{3,1});
+
+    SECTION("close-first-view") {
+        delete f;
+        CHECK(g->views() == QList<File*>{g});
+        CHECK(g->document()->line(0) == "one");
+        g->insertText("x");
+        CHECK(g->document()->line(0) == "oxne");
+    }
+}
+
+TEST_CASE("file-whitespace") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+    Tui::ZRoot root;
+    Tui::ZWindow *w = new Tui::ZWindow(&root);
+    terminal.setMainWidget(&root);
+    w->setGeometry({0, 0, 80, 24});
+
+    File *f = new File(terminal.textMetrics(), w);
+    f->setGeometry({0, 0, 80, 24});
+    f->insertText("first\nsecond  \nthird\nfourth\t\nfifth");
+    f->setCursorPosition({3, 2});
+
+    CHECK(f->stripTrailingWhitespace() == 2);
+    CHECK(f->document()->lineCount() == 5);
+    CHECK(f->document()->line(0) == "first");
+    CHECK(f->document()->line(1) == "second");
+    CHECK(f->document()->line(2) == "third");
+    CHECK(f->document()->line(3) == "fourth");
+    CHECK(f->document()->line(4) == "fifth");
+    CHECK(f->cursorPosition() == Tui::ZDocumentCursor::Position{3, 2});
+
+    // One edit, undone as a whole.
+    f->undo();
+    CHECK(f->document()->line(1) == "second  ");
+    CHECK(f->document()->line(3) == "fourth\t");
+    CHECK(f->document()->line(4) == "fifth");
+}
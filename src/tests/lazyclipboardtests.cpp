@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <Tui/ZClipboard.h>
+#include <Tui/ZDocument.h>
+#include <Tui/ZDocumentCursor.h>
+#include <Tui/ZTerminal.h>
+#include <Tui/ZTextLayout.h>
+
+#include "lazyclipboard.h"
+
+TEST_CASE("lazyclipboard") {
+    Tui::ZTerminal::OffScreen of(80, 24);
+    Tui::ZTerminal terminal(of);
+    Tui::ZDocument doc;
+    Tui::ZDocumentCursor cursor{&doc, [&terminal, &doc](int line, bool wrappingAllowed) {
+            (void)wrappingAllowed;
+            Tui::ZTextLayout lay(terminal.textMetrics(), doc.line(line));
+            lay.doLayout(65000);
+            return lay;
+        }
+    };
+    cursor.insertText("first line\nsecond\nthird line");
+
+    Tui::ZClipboard clipboard;
+    LazyClipboard *lazy = LazyClipboard::forClipboard(&clipboard);
+    CHECK(LazyClipboard::forClipboard(&clipboard) == lazy);
+
+    SECTION("range") {
+        clipboard.setContents("old");
+        lazy->setRange(doc.snapshot(), &doc, 0, 6, 2, 5);
+        CHECK(lazy->hasRange());
+        CHECK(clipboard.contents() == "line");
+        CHECK(lazy->contents() == "line\nsecond\nthird");
+    }
+
+    SECTION("single-line-range") {
+        lazy->setRange(doc.snapshot(), &doc, 1, 1, 1, 4);
+        CHECK(lazy->contents() == "eco");
+    }
+
+    SECTION("block-range") {
+        lazy->setBlockRange(doc.snapshot(), &doc, 0, {{1, 3}, {1, 3}, {0, 0}});
+        CHECK(clipboard.contents() == "ir");
+        CHECK(lazy->contents() == "ir\nec\n");
+    }
+
+    SECTION("snapshot-is-kept") {
+        lazy->setRange(doc.snapshot(), &doc, 0, 0, 0, 5);
+        cursor.setPosition({0, 0});
+        cursor.insertText("new ");
+        CHECK(lazy->contents() == "first");
+    }
+
+    SECTION("placeholder-is-never-empty") {
+        lazy->setRange(doc.snapshot(), &doc, 0, 10, 1, 2);
+        CHECK(lazy->hasRange());
+        CHECK(clipboard.contents() == "\n");
+        CHECK(lazy->contents() == "\nse");
+    }
+
+    SECTION("placeholder-is-capped") {
+        cursor.setPosition({0, 2});
+        cursor.insertText(QString("x").repeated(100000));
+        lazy->setRange(doc.snapshot(), &doc, 2, 0, 2, 100010);
+        CHECK(clipboard.contents().size() < 1000);
+        CHECK(lazy->contents().size() == 100010);
+    }
+
+    SECTION("setting-contents-drops-range") {
+        lazy->setRange(doc.snapshot(), &doc, 0, 0, 0, 5);
+        clipboard.setContents("other");
+        CHECK_FALSE(lazy->hasRange());
+        CHECK(lazy->contents() == "other");
+    }
+
+    SECTION("materialize") {
+        lazy->setRange(doc.snapshot(), &doc, 0, 0, 1, 3);
+        lazy->materialize();
+        CHECK_FALSE(lazy->hasRange());
+        CHECK(clipboard.contents() == "first line\nsec");
+    }
+
+    SECTION("materialize-same-as-placeholder") {
+        lazy->setRange(doc.snapshot(), &doc, 1, 0, 1, 6);
+        lazy->materialize();
+        CHECK_FALSE(lazy->hasRange());
+        CHECK(clipboard.contents() == "second");
+    }
+
+    SECTION("release-source") {
+        lazy->setRange(doc.snapshot(), &doc, 2, 0, 2, 5);
+        int other = 0;
+        lazy->releaseSource(&other);
+        CHECK(lazy->hasRange());
+        lazy->releaseSource(&doc);
+        CHECK_FALSE(lazy->hasRange());
+        CHECK(clipboard.contents() == "third");
+    }
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <Tui/Misc/SurrogateEscape.h>
+
+#include "linearena.h"
+
+TEST_CASE("linearena") {
+    LineArena arena;
+    CHECK(arena.lineCount() == 0);
+
+    SECTION("append") {
+        arena.append("first\nsecond");
+        arena.append("third\n");
+        CHECK(arena.lineCount() == 4);
+        CHECK(arena.lineBytes(0) == "first");
+        CHECK(arena.lineBytes(1) == "second");
+        CHECK(arena.lineBytes(2) == "third");
+        CHECK(arena.lineBytes(3) == "");
+        CHECK(arena.lineSize(1) == 6);
+        CHECK(arena.lines(0, 4) == "first\nsecond\nthird\n");
+        CHECK(arena.lines(1, 2) == "second\nthird");
+        CHECK(arena.lines(2, 0) == "");
+    }
+
+    SECTION("decode") {
+        arena.append("gr\xc3\xbc\xc3\x9f\x65\nbroken \xff utf-8");
+        CHECK(arena.line(0) == QString("grüße"));
+        CHECK(Tui::Misc::SurrogateEscape::encode(arena.line(1)) == "broken \xff utf-8");
+    }
+
+    SECTION("long-lines") {
+        const QByteArray longLine(5 << 20, 'x');
+        arena.append("short");
+        arena.append(longLine);
+        arena.append("after");
+        CHECK(arena.lineCount() == 3);
+        CHECK(arena.lineBytes(0) == "short");
+        CHECK(arena.lineBytes(1) == longLine);
+        CHECK(arena.lineBytes(2) == "after");
+    }
+
+    SECTION("compact") {
+        const QByteArray line(100, 'a');
+        for (int i = 0; i < 100000; i++) {
+            arena.append(line);
+        }
+        CHECK(arena.lineCount() == 100000);
+        // Less than just the text as UTF-16 would take.
+        CHECK(arena.memoryUsage() < 100000 * 200);
+        CHECK(arena.lineBytes(99999) == line);
+    }
+
+    SECTION("clear") {
+        arena.append("a\nb");
+        arena.clear();
+        CHECK(arena.lineCount() == 0);
+        CHECK(arena.memoryUsage() == 0);
+        arena.append("c");
+        CHECK(arena.lineBytes(0) == "c");
+    }
+}
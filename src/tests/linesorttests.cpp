@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <QRandomGenerator>
+
+#include "linesort.h"
+
+static QStringList sorted(const QStringList &lines, const SortOptions &options) {
+    std::optional<QStringList> result = sortLines(lines, options);
+    REQUIRE(result.has_value());
+    return *result;
+}
+
+TEST_CASE("linesort") {
+    SortOptions options;
+
+    SECTION("plain") {
+        CHECK(sorted({"b", "c", "a", "B"}, options) == QStringList({"B", "a", "b", "c"}));
+    }
+
+    SECTION("case-insensitive-stable") {
+        options.caseInsensitive = true;
+        CHECK(sorted({"b", "B", "a", "A"}, options) == QStringList({"a", "A", "b", "B"}));
+    }
+
+    SECTION("reverse-stable") {
+        options.caseInsensitive = true;
+        options.reverse = true;
+        CHECK(sorted({"b", "B", "a", "A", "c"}, options) == QStringList({"c", "b", "B", "a", "A"}));
+    }
+
+    SECTION("numeric") {
+        options.numeric = true;
+        CHECK(sorted({"10", "9", "-1", "x", "2.5", " 3"}, options)
+              == QStringList({"-1", "x", "2.5", " 3", "9", "10"}));
+    }
+
+    SECTION("unique") {
+        options.unique = true;
+        CHECK(sorted({"b", "a", "b", "a", "c"}, options) == QStringList({"a", "b", "c"}));
+        options.caseInsensitive = true;
+        CHECK(sorted({"b", "B", "a"}, options) == QStringList({"a", "b"}));
+    }
+
+    SECTION("field-blanks") {
+        options.field = 2;
+        CHECK(sorted({"x  c", "  y b", "z a", "w"}, options) == QStringList({"w", "z a", "  y b", "x  c"}));
+    }
+
+    SECTION("field-separator") {
+        options.field = 3;
+        options.fieldSeparator = ",";
+        options.numeric = true;
+        CHECK(sorted({"a,b,10", "c,,2", "d,e"}, options) == QStringList({"d,e", "c,,2", "a,b,10"}));
+    }
+
+    SECTION("spill") {
+        QStringList lines;
+        QRandomGenerator random(42);
+        for (int i = 0; i < 50000; i++) {
+            lines.append(QString::number(random.bounded(1000)) + " " + QString::number(i));
+        }
+        options.field = 1;
+        options.numeric = true;
+        const QStringList inMemory = sorted(lines, options);
+        options.memoryLimit = 64 * 1024;
+        CHECK(sorted(lines, options) == inMemory);
+        for (int i = 1; i < inMemory.size(); i++) {
+            CHECK(inMemory[i - 1].section(' ', 0, 0).toInt() <= inMemory[i].section(' ', 0, 0).toInt());
+        }
+    }
+
+    SECTION("cancel") {
+        SortControl control;
+        control.cancel = true;
+        CHECK(!sortLines({"b", "a"}, options, &control).has_value());
+    }
+}
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <QStringList>
+
+#include "memorybudget.h"
+
+namespace {
+    struct FakeDocument {
+        QObject owner;
+        bool evictable = true;
+    };
+}
+
+static MemoryUsage usage(qint64 text, qint64 caches) {
+    MemoryUsage result;
+    result.text = text;
+    result.caches = caches;
+    return result;
+}
+
+TEST_CASE("memorybudget") {
+    MemoryBudget budget;
+    QStringList events;
+    FakeDocument a;
+    FakeDocument b;
+    FakeDocument c;
+    auto add = [&](FakeDocument *document, QString name) {
+        MemoryBudget::Document callbacks;
+        callbacks.evictable = [document] { return document->evictable; };
+        callbacks.dropCaches = [&events, name] { events.append("caches " + name); };
+        callbacks.unload = [&events, name] { events.append("unload " + name); };
+        budget.add(&document->owner, callbacks);
+    };
+    add(&a, "a");
+    add(&b, "b");
+    add(&c, "c");
+    budget.setUsage(&a.owner, usage(100, 10));
+    budget.setUsage(&b.owner, usage(200, 20));
+    budget.setUsage(&c.owner, usage(300, 30));
+    CHECK(budget.documentCount() == 3);
+    CHECK(budget.usage().total() == 660);
+
+    SECTION("no-limit") {
+        budget.enforce();
+        CHECK(events.isEmpty());
+    }
+
+    SECTION("within-limit") {
+        budget.setLimit(660);
+        budget.enforce();
+        CHECK(events.isEmpty());
+    }
+
+    SECTION("caches-first") {
+        budget.setLimit(640);
+        budget.enforce();
+        CHECK(events == QStringList{"caches a", "caches b"});
+        CHECK(budget.usage().total() == 630);
+        CHECK(budget.usage().caches == 30);
+    }
+
+    SECTION("least-recently-used") {
+        budget.touch(&a.owner);
+        budget.setLimit(400);
+        budget.enforce();
+        CHECK(events == QStringList{"caches b", "caches c", "caches a", "unload b"});
+        CHECK(budget.usage().total() == 400);
+    }
+
+    SECTION("not-evictable") {
+        b.evictable = false;
+        budget.setLimit(300);
+        budget.enforce();
+        CHECK(events == QStringList{"caches a", "caches c", "unload a", "unload c"});
+        CHECK(budget.usage().total() == 220);
+    }
+
+    SECTION("removed-when-destroyed") {
+        {
+            QObject owner;
+            budget.add(&owner, {});
+            CHECK(budget.documentCount() == 4);
+        }
+        CHECK(budget.documentCount() == 3);
+    }
+}
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include "pastenormalize.h"
+
+// The replacements done on pasted text before the single pass version.
+static QString reference(QString text, bool formattingCharacters) {
+    if (formattingCharacters) {
+        text.replace(QString("·"), QString(" "));
+        text.replace(QString("→"), QString(" "));
+        text.replace(QString("¶"), QString(""));
+    }
+    text.replace(QString("\r\n"), QString('\n'));
+    text.replace(QString('\r'), QString('\n'));
+    return text;
+}
+
+static QString normalized(QString text, bool formattingCharacters) {
+    normalizePastedText(&text, formattingCharacters);
+    return text;
+}
+
+TEST_CASE("pastenormalize") {
+    const bool formattingCharacters = GENERATE(true, false);
+    CAPTURE(formattingCharacters);
+
+    SECTION("unchanged") {
+        const QString text = "plain text\nwith\tno special characters, long enough for a few chunks";
+        QString copy = text;
+        normalizePastedText(&copy, formattingCharacters);
+        CHECK(copy == text);
+        // Not detached, still shares the data.
+        CHECK(copy.constData() == text.constData());
+    }
+
+    SECTION("cases") {
+        const QStringList cases = {
+            "",
+            "\r",
+            "\r\n",
+            "\n\r",
+            "a\r\nb\rc\nd",
+            "\r\r\n\r",
+            "a·b→c¶\nd",
+            "¶",
+            "\r¶\n",
+            "\r¶¶",
+            "trailing\r",
+            "0123456789abcde\r\n0123456789abcde\r0123456789·abcde→¶",
+            "äöü→€\r\n𝄞·",
+        };
+        for (const QString &text: cases) {
+            CAPTURE(text);
+            CHECK(normalized(text, formattingCharacters) == reference(text, formattingCharacters));
+        }
+    }
+
+    SECTION("long") {
+        QString text;
+        for (int i = 0; i < 2000; i++) {
+            text += QString("line %1").arg(i);
+            text += (i % 3 == 0) ? "\r\n" : (i % 3 == 1) ? "\r" : "·→¶\n";
+        }
+        CHECK(normalized(text, formattingCharacters) == reference(text, formattingCharacters));
+    }
+}
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include "positionmap.h"
+
+// Stands in for the text layout: every character other than printable ASCII and tabs is two columns wide.
+static int wideColumn(const QString &text, int tabStopDistance, int codeUnit) {
+    int column = 0;
+    for (int i = 0; i < codeUnit; i++) {
+        if (text[i] == '\t') {
+            column = (column / tabStopDistance + 1) * tabStopDistance;
+        } else if (text[i].unicode() >= 0x20 && text[i].unicode() < 0x7f) {
+            column += 1;
+        } else {
+            column += 2;
+        }
+    }
+    return column;
+}
+
+static LinePositionMap makeMap(const QString &text, int tabStopDistance, int *layoutCalls = nullptr) {
+    return LinePositionMap(text, tabStopDistance, [&](int codeUnit) {
+        if (layoutCalls) {
+            (*layoutCalls)++;
+        }
+        return wideColumn(text, tabStopDistance, codeUnit);
+    });
+}
+
+TEST_CASE("positionmap") {
+    SECTION("ascii") {
+        int layoutCalls = 0;
+        const QString text = QString("a\tbc").repeated(100);
+        LinePositionMap map = makeMap(text, 4, &layoutCalls);
+        CHECK(layoutCalls == 0);
+        for (int i = 0; i <= text.size(); i++) {
+            CAPTURE(i);
+            CHECK(map.columnForCodeUnit(i) == wideColumn(text, 4, i));
+            CHECK(map.utf8ForCodeUnit(i) == i);
+        }
+        CHECK(map.width() == 402);
+
+        int codeUnit = -1;
+        REQUIRE(map.codeUnitForColumn(398, &codeUnit));
+        CHECK(codeUnit == 396);
+        // inside of the first tab
+        CHECK(!map.codeUnitForColumn(2, &codeUnit));
+        REQUIRE(map.codeUnitForColumn(1000, &codeUnit));
+        CHECK(codeUnit == text.size());
+    }
+
+    SECTION("wide") {
+        const QString text = QString::fromUtf8("ab\xe3\x81\x82" "c\td\xf0\x9f\x98\x80" "e");
+        LinePositionMap map = makeMap(text, 8);
+        for (int i = 0; i <= text.size(); i++) {
+            CAPTURE(i);
+            CHECK(map.columnForCodeUnit(i) == wideColumn(text, 8, i));
+            if (!text[std::min(i, text.size() - 1)].isLowSurrogate()) {
+                CHECK(map.utf8ForCodeUnit(i) == text.left(i).toUtf8().size());
+            }
+        }
+        CHECK(map.width() == wideColumn(text, 8, text.size()));
+
+        int codeUnit = -1;
+        REQUIRE(map.codeUnitForColumn(1, &codeUnit));
+        CHECK(codeUnit == 1);
+        REQUIRE(map.codeUnitForColumn(4, &codeUnit));
+        CHECK(codeUnit == 3);
+        REQUIRE(map.codeUnitForColumn(8, &codeUnit));
+        CHECK(codeUnit == 5);
+        CHECK(!map.codeUnitForColumn(3, &codeUnit));
+    }
+
+    SECTION("empty") {
+        LinePositionMap map = makeMap("", 8);
+        CHECK(map.columnForCodeUnit(0) == 0);
+        CHECK(map.utf8ForCodeUnit(0) == 0);
+        CHECK(map.width() == 0);
+        int codeUnit = -1;
+        REQUIRE(map.codeUnitForColumn(5, &codeUnit));
+        CHECK(codeUnit == 0);
+    }
+
+    SECTION("window") {
+        const QString text = QString("abcdefgh").repeated(1000);
+        LinePositionMap map = makeMap(text, 8);
+        int startColumn = -1;
+        const int start = map.windowStart(5000, &startColumn);
+        CHECK(start <= 5000);
+        CHECK(start > 5000 - 128);
+        CHECK(startColumn == start);
+        const int end = map.windowEnd(5100);
+        CHECK(end >= 5100);
+        CHECK(end < 5100 + 128);
+        CHECK(map.windowEnd(100000) == text.size());
+        CHECK(map.windowStart(-10, &startColumn) == 0);
+        CHECK(startColumn == 0);
+    }
+
+    SECTION("window-wide") {
+        // combining marks are not a place to start a layout
+        const QString text = QString::fromUtf8("\xe3\x81\x82" "e\xcc\x81").repeated(1000);
+        LinePositionMap map = makeMap(text, 8);
+        int startColumn = -1;
+        const int start = map.windowStart(1000, &startColumn);
+        CHECK(start > 0);
+        CHECK(text[start].unicode() != 0x301);
+        CHECK(startColumn == wideColumn(text, 8, start));
+        CHECK(startColumn <= 1000);
+    }
+
+    SECTION("cache") {
+        PositionMapCache cache;
+        CHECK(cache.find(3, 1, "abc", 8) == nullptr);
+        cache.insert(3, 1, makeMap("abc", 8));
+        REQUIRE(cache.find(3, 1, "abc", 8) != nullptr);
+        CHECK(cache.find(3, 1, "abc", 8)->width() == 3);
+        CHECK(cache.find(3, 2, "abc", 8) == nullptr);
+        CHECK(cache.find(3, 1, "abd", 8) == nullptr);
+        CHECK(cache.find(3, 1, "abc", 4) == nullptr);
+        CHECK(cache.find(4, 1, "abc", 8) == nullptr);
+    }
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <future>
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+#include "remote.h"
+
+// Sends the request from a second thread, the server answers on the event loop of this one.
+static bool sendRequest(const QString &socketPath, const QStringList &args, QString *error) {
+    std::future<bool> result = std::async(std::launch::async, [&] {
+        return sendRemoteOpenRequest(socketPath, args, error);
+    });
+    QElapsedTimer timer;
+    timer.start();
+    while (result.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready) {
+        if (timer.hasExpired(10000)) {
+            FAIL_CHECK("sendRequest: Timeout");
+            break;
+        }
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+    }
+    return result.get();
+}
+
+// Leaves a socket file behind that nobody listens on, like a server that crashed.
+static void createStaleSocket(const QString &socketPath) {
+    const QByteArray path = QFile::encodeName(socketPath);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    REQUIRE(static_cast<size_t>(path.size()) < sizeof(addr.sun_path));
+    memcpy(addr.sun_path, path.constData(), path.size());
+    REQUIRE(::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+    ::close(fd);
+}
+
+TEST_CASE("remote") {
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const QString socketPath = dir.path() + "/chr.socket";
+
+    QStringList received;
+    QString reply;
+    auto handler = [&](QStringList args) {
+        received = args;
+        return reply;
+    };
+
+    SECTION("open") {
+        RemoteServer server(handler);
+        REQUIRE(server.listen(socketPath));
+        QString error;
+        CHECK(sendRequest(socketPath, {"+3", "a.txt", "+/word", "/tmp/b.txt"}, &error));
+        CHECK(error == "");
+        CHECK(received == QStringList{"+3", QFileInfo("a.txt").absoluteFilePath(), "+/word", "/tmp/b.txt"});
+    }
+
+    SECTION("rejected") {
+        RemoteServer server(handler);
+        REQUIRE(server.listen(socketPath));
+        reply = "File not readable: /tmp/b.txt";
+        QString error;
+        CHECK(!sendRequest(socketPath, {"/tmp/b.txt"}, &error));
+        CHECK(error == "File not readable: /tmp/b.txt");
+    }
+
+    SECTION("standard input") {
+        RemoteServer server(handler);
+        REQUIRE(server.listen(socketPath));
+        QString error;
+        CHECK(!sendRequest(socketPath, {"-"}, &error));
+        CHECK(error != "");
+        CHECK(received.isEmpty());
+    }
+
+    SECTION("no server") {
+        QString error;
+        CHECK(!sendRequest(socketPath, {"/tmp/b.txt"}, &error));
+        CHECK(error == "No running chr server found at " + socketPath + ".");
+    }
+
+    SECTION("stale socket") {
+        createStaleSocket(socketPath);
+        REQUIRE(QFileInfo::exists(socketPath));
+
+        QString error;
+        CHECK(!sendRequest(socketPath, {"/tmp/b.txt"}, &error));
+
+        RemoteServer server(handler);
+        REQUIRE(server.listen(socketPath));
+        CHECK(sendRequest(socketPath, {"/tmp/b.txt"}, &error));
+        CHECK(received == QStringList{"/tmp/b.txt"});
+    }
+
+    SECTION("already running") {
+        RemoteServer server(handler);
+        REQUIRE(server.listen(socketPath));
+        RemoteServer second([](QStringList) { return QString(); });
+        CHECK(!second.listen(socketPath));
+
+        // The second server must not take the socket away from the running one.
+        QString error;
+        CHECK(sendRequest(socketPath, {"/tmp/b.txt"}, &error));
+        CHECK(received == QStringList{"/tmp/b.txt"});
+    }
+}
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <QJsonArray>
+
+#include "session.h"
+
+TEST_CASE("session") {
+    SECTION("roundtrip") {
+        Session session;
+        session.mode = MdiLayout::LayoutMode::TileH;
+        SessionWindow a;
+        a.fileName = "/tmp/a.txt";
+        a.weight = 2.5;
+        a.cursor = {3, 10};
+        a.scrollColumn = 1;
+        a.scrollLine = 5;
+        a.scrollFineLine = 2;
+        session.windows.append(a);
+        SessionWindow b;
+        b.fileName = "/tmp/b.txt";
+        session.windows.append(b);
+        session.activeWindow = 1;
+
+        Session result;
+        REQUIRE(sessionFromJson(sessionToJson(session), &result));
+        CHECK(result.mode == MdiLayout::LayoutMode::TileH);
+        CHECK(result.activeWindow == 1);
+        REQUIRE(result.windows.size() == 2);
+        CHECK(result.windows[0].fileName == "/tmp/a.txt");
+        CHECK(result.windows[0].weight == 2.5);
+        CHECK(result.windows[0].cursor.codeUnit == 3);
+        CHECK(result.windows[0].cursor.line == 10);
+        CHECK(result.windows[0].scrollColumn == 1);
+        CHECK(result.windows[0].scrollLine == 5);
+        CHECK(result.windows[0].scrollFineLine == 2);
+        CHECK(result.windows[1].fileName == "/tmp/b.txt");
+        CHECK(result.windows[1].weight == 1);
+    }
+
+    SECTION("wrong version") {
+        QJsonObject json = sessionToJson(Session());
+        json.insert("version", 99);
+        Session result;
+        CHECK(!sessionFromJson(json, &result));
+    }
+
+    SECTION("invalid entries") {
+        QJsonObject json = sessionToJson(Session());
+        QJsonArray windows;
+        windows.append(QJsonObject{{"file", ""}});
+        windows.append(QJsonObject{{"file", "/tmp/a.txt"}, {"weight", -1}});
+        json.insert("windows", windows);
+        json.insert("active", 5);
+        Session result;
+        REQUIRE(sessionFromJson(json, &result));
+        REQUIRE(result.windows.size() == 1);
+        CHECK(result.windows[0].weight == 1);
+        CHECK(result.activeWindow == -1);
+    }
+}
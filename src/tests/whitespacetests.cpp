@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <Tui/ZDocument.h>
+#include <Tui/ZDocumentCursor.h>
+#include <Tui/ZTerminal.h>
+#include <Tui/ZTextLayout.h>
+
+#include "whitespace.h"
+
+static QString transform(const QString &line, const WhitespaceOptions &options) {
+    QString result;
+    REQUIRE(transformWhitespaceLine(line, options, &result));
+    return result;
+}
+
+TEST_CASE("whitespace") {
+    WhitespaceOptions options;
+    options.tabStopDistance = 4;
+
+    SECTION("expand-tabs") {
+        options.expandTabs = true;
+        CHECK(transform("\tfoo", options) == "    foo");
+        CHECK(transform("  \tfoo", options) == "    foo");
+        CHECK(transform("a\tb", options) == "a   b");
+        CHECK(transform("\tab\tc", options) == "    ab  c");
+        CHECK(transform("no tabs", options) == "no tabs");
+    }
+
+    SECTION("expand-tabs-needs-layout") {
+        options.expandTabs = true;
+        QString result;
+        CHECK(!transformWhitespaceLine("ä\tb", options, &result));
+        // Characters after the last tab do not matter.
+        CHECK(transform("a\tä", options) == "a   ä");
+    }
+
+    SECTION("strip-trailing") {
+        options.stripTrailingWhitespace = true;
+        CHECK(transform("foo  \t ", options) == "foo");
+        CHECK(transform("\t  ", options) == "");
+        CHECK(transform("\tfoo", options) == "\tfoo");
+    }
+
+    SECTION("reindent-spaces") {
+        options.reindent = true;
+        options.indentFrom = 4;
+        options.indentTo = 2;
+        CHECK(transform("        foo", options) == "    foo");
+        // One level and 2 columns of alignment.
+        CHECK(transform("      foo", options) == "    foo");
+        CHECK(transform("   foo", options) == "   foo");
+        CHECK(transform("\tfoo", options) == "  foo");
+        CHECK(transform("foo    bar", options) == "foo    bar");
+    }
+
+    SECTION("reindent-tabs") {
+        options.reindent = true;
+        options.indentFrom = 4;
+        options.indentTo = 4;
+        options.indentWithTabs = true;
+        CHECK(transform("        foo", options) == "\t\tfoo");
+        CHECK(transform("      foo", options) == "\t  foo");
+        CHECK(transform("\t    foo", options) == "\t\tfoo");
+    }
+
+    SECTION("snapshot") {
+        Tui::ZTerminal::OffScreen of(80, 24);
+        Tui::ZTerminal terminal(of);
+        Tui::ZDocument doc;
+        Tui::ZDocumentCursor cursor{&doc, [&terminal, &doc](int line, bool wrappingAllowed) {
+                (void)wrappingAllowed;
+                Tui::ZTextLayout lay(terminal.textMetrics(), doc.line(line));
+                lay.doLayout(65000);
+                return lay;
+            }
+        };
+        QString text;
+        for (int i = 0; i < 10000; i++) {
+            text += (i % 3 == 0) ? "\tline\n" : (i % 3 == 1) ? "ä\tline\n" : "line\n";
+        }
+        cursor.insertText(text);
+
+        options.expandTabs = true;
+        WhitespaceEdits result = computeWhitespaceEdits(doc.snapshot(), options);
+        CHECK(result.edits.size() == 3334);
+        CHECK(result.needsLayout.size() == 3333);
+        for (int i = 1; i < result.edits.size(); i++) {
+            CHECK(result.edits[i - 1].line < result.edits[i].line);
+        }
+        CHECK(result.edits[0].line == 0);
+        CHECK(result.edits[0].text == "    line");
+    }
+}
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "catchwrapper.h"
+
+#include <algorithm>
+
+#include "wrapindex.h"
+
+static void checkAgainstRows(const WrapIndex &index, const QVector<int> &rows) {
+    REQUIRE(index.lineCount() == rows.size());
+    int sum = 0;
+    for (int line = 0; line < rows.size(); line++) {
+        CAPTURE(line);
+        CHECK(index.rows(line) == rows[line]);
+        CHECK(index.rowsBefore(line) == sum);
+        for (int r = 0; r < rows[line]; r++) {
+            int rowInLine = -1;
+            CHECK(index.lineForRow(sum + r, &rowInLine) == line);
+            CHECK(rowInLine == r);
+        }
+        sum += rows[line];
+    }
+    CHECK(index.totalRows() == sum);
+    CHECK(index.rowsBefore(rows.size()) == sum);
+}
+
+TEST_CASE("wrapindex") {
+    WrapIndex index;
+
+    SECTION("empty") {
+        int rowInLine = -1;
+        CHECK(index.lineCount() == 0);
+        CHECK(index.totalRows() == 0);
+        CHECK(index.lineForRow(5, &rowInLine) == 0);
+        CHECK(rowInLine == 0);
+    }
+
+    SECTION("reset") {
+        const QVector<int> rows = {1, 3, 1, 2, 5, 1, 1};
+        index.reset(QVector<unsigned>(rows.size(), 7), rows);
+        checkAgainstRows(index, rows);
+        CHECK(index.estimatedLines() == rows.size());
+        CHECK(index.revision(3) == 7);
+        CHECK_FALSE(index.isExact(3));
+    }
+
+    SECTION("past-end") {
+        index.reset({1, 2}, {2, 3});
+        int rowInLine = -1;
+        CHECK(index.lineForRow(5, &rowInLine) == 1);
+        CHECK(rowInLine == 2);
+        CHECK(index.lineForRow(100, &rowInLine) == 1);
+        CHECK(rowInLine == 2);
+        CHECK(index.lineForRow(-3, &rowInLine) == 0);
+        CHECK(rowInLine == 0);
+    }
+
+    SECTION("set-rows") {
+        QVector<int> rows(100, 1);
+        index.reset(QVector<unsigned>(rows.size(), 0), rows);
+        for (int line = 0; line < rows.size(); line += 3) {
+            rows[line] = line % 7 + 1;
+            index.setRows(line, rows[line]);
+        }
+        checkAgainstRows(index, rows);
+        CHECK(index.estimatedLines() == 100 - 34);
+        CHECK(index.estimatedLines(0, 2) == 2);
+        CHECK(index.estimatedLines(3, 3) == 0);
+        CHECK(index.estimatedLines(0, 99) == 100 - 34);
+        CHECK(index.isExact(99));
+        CHECK_FALSE(index.isExact(98));
+    }
+
+    SECTION("replace-same-count") {
+        QVector<int> rows = {2, 2, 2, 2, 2};
+        index.reset({0, 1, 2, 3, 4}, rows);
+        for (int line = 0; line < rows.size(); line++) {
+            index.setRows(line, rows[line]);
+        }
+        CHECK(index.estimatedLines() == 0);
+        index.replace(1, 2, {10, 11}, {4, 1});
+        rows = {2, 4, 1, 2, 2};
+        checkAgainstRows(index, rows);
+        CHECK(index.revision(1) == 10);
+        CHECK(index.revision(2) == 11);
+        CHECK(index.estimatedLines() == 2);
+        CHECK(index.estimatedLines(1, 2) == 2);
+    }
+
+    SECTION("replace-insert-remove") {
+        index.reset({0, 1, 2, 3}, {1, 2, 3, 4});
+        index.setRows(3, 4);
+        index.replace(1, 1, {5, 6, 7}, {2, 2, 2});
+        checkAgainstRows(index, {1, 2, 2, 2, 3, 4});
+        CHECK(index.revision(4) == 2);
+        CHECK(index.isExact(5));
+        CHECK(index.estimatedLines() == 5);
+
+        index.replace(0, 4, {}, {});
+        checkAgainstRows(index, {3, 4});
+        CHECK(index.revision(0) == 2);
+        CHECK(index.estimatedLines() == 1);
+    }
+
+    SECTION("replace-every-position") {
+        // Only the blocks of the replaced lines are rebuilt, compare against the whole document.
+        const int blockLines = GENERATE(2, 3, 512);
+        for (int lineCount: {1, 7, 8, 9, 33}) {
+            for (int first = 0; first <= lineCount; first++) {
+                for (int count = 0; count <= std::min(3, lineCount - first); count++) {
+                    for (int inserted = 0; inserted <= 3; inserted++) {
+                        CAPTURE(blockLines, lineCount, first, count, inserted);
+                        WrapIndex blocked(blockLines);
+                        QVector<int> rows;
+                        for (int line = 0; line < lineCount; line++) {
+                            rows.append(line % 5 + 1);
+                        }
+                        blocked.reset(QVector<unsigned>(lineCount, 0), rows);
+                        for (int line = 0; line < lineCount; line += 2) {
+                            blocked.setRows(line, rows[line]);
+                        }
+                        QVector<int> estimates;
+                        for (int i = 0; i < inserted; i++) {
+                            estimates.append(i + 2);
+                        }
+                        blocked.replace(first, count, QVector<unsigned>(inserted, 1), estimates);
+
+                        int expectedEstimated = inserted;
+                        for (int line = 0; line < lineCount; line++) {
+                            if ((line < first || line >= first + count) && line % 2) {
+                                expectedEstimated++;
+                            }
+                        }
+                        rows.remove(first, count);
+                        rows.insert(first, inserted, 0);
+                        std::copy(estimates.begin(), estimates.end(), rows.begin() + first);
+                        checkAgainstRows(blocked, rows);
+                        CHECK(blocked.estimatedLines() == expectedEstimated);
+                        CHECK(blocked.estimatedLines(0, rows.size() - 1) == expectedEstimated);
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("replace-repeatedly") {
+        // Inserting and removing lines in many places splits and merges blocks.
+        WrapIndex blocked(4);
+        QVector<int> rows;
+        for (int line = 0; line < 40; line++) {
+            rows.append(line % 3 + 1);
+        }
+        blocked.reset(QVector<unsigned>(rows.size(), 0), rows);
+        for (int step = 0; step < 200; step++) {
+            CAPTURE(step);
+            const int first = (step * 7) % (rows.size() + 1);
+            const int count = std::min(step % 3, rows.size() - first);
+            const int inserted = (step * 5) % 4;
+            const QVector<int> estimates(inserted, step % 4 + 1);
+            blocked.replace(first, count, QVector<unsigned>(inserted, step), estimates);
+            rows.remove(first, count);
+            rows.insert(first, inserted, step % 4 + 1);
+            if (rows.size()) {
+                blocked.setRows(step % rows.size(), 2);
+                rows[step % rows.size()] = 2;
+            }
+            checkAgainstRows(blocked, rows);
+        }
+    }
+
+    SECTION("clear") {
+        index.reset({0, 1}, {1, 2});
+        index.clear();
+        CHECK(index.lineCount() == 0);
+        CHECK(index.totalRows() == 0);
+        CHECK(index.estimatedLines() == 0);
+    }
+}
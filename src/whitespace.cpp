@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "whitespace.h"
+
+#include <algorithm>
+
+#include <QFuture>
+#include <QtConcurrent>
+
+static const int linesPerJob = 4096;
+
+static int nextTabStop(int column, int tabStopDistance) {
+    return (column / tabStopDistance + 1) * tabStopDistance;
+}
+
+// Printable ASCII takes exactly one column, everything else is left to the text layout.
+static bool isSingleColumn(QChar ch) {
+    return ch.unicode() >= 0x20 && ch.unicode() < 0x7f;
+}
+
+bool transformWhitespaceLine(const QString &line, const WhitespaceOptions &options, QString *result) {
+    const int tabStopDistance = std::max(1, options.tabStopDistance);
+
+    int indentEnd = 0;
+    int indentColumns = 0;
+    bool indentHasTabs = false;
+    for (; indentEnd < line.size(); indentEnd++) {
+        if (line[indentEnd] == ' ') {
+            indentColumns++;
+        } else if (line[indentEnd] == '\t') {
+            indentColumns = nextTabStop(indentColumns, tabStopDistance);
+            indentHasTabs = true;
+        } else {
+            break;
+        }
+    }
+
+    QString text;
+    text.reserve(line.size());
+
+    if (options.reindent || (options.expandTabs && indentHasTabs)) {
+        int columns = indentColumns;
+        if (options.reindent) {
+            const int indentFrom = std::max(1, options.indentFrom);
+            const int indentTo = std::max(1, options.indentTo);
+            columns = columns / indentFrom * indentTo + columns % indentFrom;
+        }
+        if (options.reindent && options.indentWithTabs) {
+            const int indentTo = std::max(1, options.indentTo);
+            text.append(QString(columns / indentTo, '\t'));
+            columns %= indentTo;
+        }
+        text.append(QString(columns, ' '));
+    } else {
+        text.append(line.leftRef(indentEnd));
+    }
+
+    if (options.expandTabs && line.indexOf('\t', indentEnd) != -1) {
+        // Keep the alignment the tabs had in the original line.
+        int column = indentColumns;
+        for (int i = indentEnd; i < line.size(); i++) {
+            const QChar ch = line[i];
+            if (ch == '\t') {
+                const int next = nextTabStop(column, tabStopDistance);
+                text.append(QString(next - column, ' '));
+                column = next;
+            } else if (isSingleColumn(ch)) {
+                text.append(ch);
+                column++;
+            } else if (line.indexOf('\t', i) != -1) {
+                return false;
+            } else {
+                text.append(line.midRef(i));
+                break;
+            }
+        }
+    } else {
+        text.append(line.midRef(indentEnd));
+    }
+
+    if (options.stripTrailingWhitespace) {
+        int end = text.size();
+        while (end > 0 && (text[end - 1] == ' ' || text[end - 1] == '\t')) {
+            end--;
+        }
+        text.truncate(end);
+    }
+
+    *result = text;
+    return true;
+}
+
+WhitespaceEdits computeWhitespaceEdits(const Tui::ZDocumentSnapshot &snapshot, const WhitespaceOptions &options,
+                                       JobControl *control) {
+    const int lineCount = snapshot.lineCount();
+    std::atomic<int> linesDone{0};
+
+    QVector<QFuture<WhitespaceEdits>> jobs;
+    for (int start = 0; start < lineCount; start += linesPerJob) {
+        const int end = std::min(start + linesPerJob, lineCount);
+        jobs.append(QtConcurrent::run([&snapshot, &options, &linesDone, control, lineCount, start, end] {
+            WhitespaceEdits part;
+            if (control && control->cancel) {
+                return part;
+            }
+            QString text;
+            for (int line = start; line < end; line++) {
+                const QString original = snapshot.line(line);
+                if (!transformWhitespaceLine(original, options, &text)) {
+                    part.needsLayout.append(line);
+                } else if (text != original) {
+                    part.edits.append(WhitespaceEdit{line, text});
+                }
+            }
+            if (control) {
+                control->progress = static_cast<int>(100LL * (linesDone += end - start) / lineCount);
+            }
+            return part;
+        }));
+    }
+
+    WhitespaceEdits result;
+    for (QFuture<WhitespaceEdits> &job: jobs) {
+        const WhitespaceEdits part = job.result();
+        result.edits += part.edits;
+        result.needsLayout += part.needsLayout;
+    }
+    return result;
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef WHITESPACE_H
+#define WHITESPACE_H
+
+#include <QString>
+#include <QVector>
+
+#include <Tui/ZDocumentSnapshot.h>
+
+#include "jobcontrol.h"
+
+
+struct WhitespaceOptions {
+    // Tab width the text was written with.
+    int tabStopDistance = 8;
+    // Replace all tabs by spaces, including those after the indentation.
+    bool expandTabs = false;
+    // Rewrite the indentation, converting indentation levels of indentFrom columns to levels of indentTo columns.
+    // Columns left over after the last full level are kept as they are, they usually align with the line above.
+    bool reindent = false;
+    int indentFrom = 8;
+    int indentTo = 8;
+    // Indent with tabs of indentTo columns instead of spaces when reindenting.
+    bool indentWithTabs = false;
+    bool stripTrailingWhitespace = false;
+};
+
+struct WhitespaceEdit {
+    int line;
+    QString text;
+};
+
+struct WhitespaceEdits {
+    // Changed lines in ascending order.
+    QVector<WhitespaceEdit> edits;
+    // Lines that have tabs after characters whose width depends on the terminal. Those need to be
+    // expanded with the text layout before transformWhitespaceLine can handle them.
+    QVector<int> needsLayout;
+};
+
+// Returns false if the line needs the text layout. Otherwise *result is the transformed line.
+bool transformWhitespaceLine(const QString &line, const WhitespaceOptions &options, QString *result);
+
+// Transforms all lines of the snapshot on the global thread pool and waits for the result.
+// If control is set, progress is reported there and the result is incomplete once cancel is set.
+WhitespaceEdits computeWhitespaceEdits(const Tui::ZDocumentSnapshot &snapshot, const WhitespaceOptions &options,
+                                       JobControl *control = nullptr);
+
+#endif // WHITESPACE_H
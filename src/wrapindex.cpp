@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#include "wrapindex.h"
+
+#include <algorithm>
+#include <numeric>
+
+
+WrapIndex::WrapIndex(int blockLines) : _blockLines(std::max(1, blockLines)) {
+}
+
+void WrapIndex::reset(const QVector<unsigned> &revisions, const QVector<int> &estimates) {
+    _blocks.clear();
+    appendBlocks(_blocks, revisions, estimates, QVector<bool>(estimates.size(), false));
+    _lineCount = estimates.size();
+    _totalRows = 0;
+    _estimatedLines = 0;
+    for (const Block &block: _blocks) {
+        _totalRows += block.totalRows;
+        _estimatedLines += block.estimatedLines;
+    }
+    rebuildTrees();
+}
+
+void WrapIndex::replace(int first, int count, const QVector<unsigned> &revisions, const QVector<int> &estimates) {
+    if (count == revisions.size()) {
+        // Same number of lines, update the blocks and trees in place.
+        for (int i = 0; i < count; i++) {
+            int index = 0;
+            const int b = blockOf(first + i, &index);
+            Block &block = _blocks[b];
+            block.revisions[index] = revisions[i];
+            const int delta = estimates[i] - block.rows[index];
+            block.rows[index] = estimates[i];
+            block.totalRows += delta;
+            _totalRows += delta;
+            add(_rowTree, b, delta);
+            if (block.exact[index]) {
+                block.exact[index] = false;
+                block.estimatedLines++;
+                _estimatedLines++;
+                add(_estimatedTree, b, 1);
+            }
+        }
+        return;
+    }
+
+    // The blocks holding the replaced lines are split again with the new lines in place of the old ones.
+    int firstBlock = 0;
+    int firstIndex = 0;
+    int endBlock = 0;
+    int lastEnd = 0;
+    if (!_blocks.isEmpty()) {
+        if (first == _lineCount) {
+            firstBlock = _blocks.size() - 1;
+            firstIndex = _blocks[firstBlock].rows.size();
+        } else {
+            firstBlock = blockOf(first, &firstIndex);
+        }
+        if (count == 0) {
+            endBlock = firstBlock + 1;
+            lastEnd = firstIndex;
+        } else {
+            endBlock = blockOf(first + count - 1, &lastEnd) + 1;
+            lastEnd++;
+        }
+    }
+
+    QVector<unsigned> newRevisions;
+    QVector<int> newRows;
+    QVector<bool> newExact;
+    if (endBlock > firstBlock) {
+        const Block &head = _blocks[firstBlock];
+        const Block &tail = _blocks[endBlock - 1];
+        newRevisions = head.revisions.mid(0, firstIndex) + revisions + tail.revisions.mid(lastEnd);
+        newRows = head.rows.mid(0, firstIndex) + estimates + tail.rows.mid(lastEnd);
+        newExact = head.exact.mid(0, firstIndex) + QVector<bool>(estimates.size(), false) + tail.exact.mid(lastEnd);
+    } else {
+        newRevisions = revisions;
+        newRows = estimates;
+        newExact = QVector<bool>(estimates.size(), false);
+    }
+    // Take in a neighbour when few lines are left, so that removing lines does not leave tiny blocks behind.
+    if (newRows.size() < _blockLines / 2 && endBlock < _blocks.size()) {
+        const Block &next = _blocks[endBlock];
+        newRevisions += next.revisions;
+        newRows += next.rows;
+        newExact += next.exact;
+        endBlock++;
+    }
+    if (newRows.size() < _blockLines / 2 && firstBlock > 0) {
+        firstBlock--;
+        const Block &previous = _blocks[firstBlock];
+        newRevisions = previous.revisions + newRevisions;
+        newRows = previous.rows + newRows;
+        newExact = previous.exact + newExact;
+    }
+
+    for (int b = firstBlock; b < endBlock; b++) {
+        _totalRows -= _blocks[b].totalRows;
+        _estimatedLines -= _blocks[b].estimatedLines;
+    }
+    QVector<Block> blocks = _blocks.mid(0, firstBlock);
+    appendBlocks(blocks, newRevisions, newRows, newExact);
+    for (int b = firstBlock; b < blocks.size(); b++) {
+        _totalRows += blocks[b].totalRows;
+        _estimatedLines += blocks[b].estimatedLines;
+    }
+    blocks += _blocks.mid(endBlock);
+    _blocks = blocks;
+    _lineCount += revisions.size() - count;
+    rebuildTrees();
+}
+
+void WrapIndex::clear() {
+    reset({}, {});
+}
+
+void WrapIndex::setRows(int line, int rows) {
+    rows = std::max(1, rows);
+    int index = 0;
+    const int b = blockOf(line, &index);
+    Block &block = _blocks[b];
+    const int delta = rows - block.rows[index];
+    block.rows[index] = rows;
+    block.totalRows += delta;
+    _totalRows += delta;
+    add(_rowTree, b, delta);
+    if (!block.exact[index]) {
+        block.exact[index] = true;
+        block.estimatedLines--;
+        _estimatedLines--;
+        add(_estimatedTree, b, -1);
+    }
+}
+
+int WrapIndex::lineCount() const {
+    return _lineCount;
+}
+
+unsigned WrapIndex::revision(int line) const {
+    int index = 0;
+    return _blocks[blockOf(line, &index)].revisions[index];
+}
+
+int WrapIndex::rows(int line) const {
+    int index = 0;
+    return _blocks[blockOf(line, &index)].rows[index];
+}
+
+bool WrapIndex::isExact(int line) const {
+    int index = 0;
+    return _blocks[blockOf(line, &index)].exact[index];
+}
+
+int WrapIndex::rowsBefore(int line) const {
+    if (line >= _lineCount) {
+        return _totalRows;
+    }
+    if (line <= 0) {
+        return 0;
+    }
+    int index = 0;
+    const int b = blockOf(line, &index);
+    const QVector<int> &rows = _blocks[b].rows;
+    return prefixSum(_rowTree, b) + std::accumulate(rows.begin(), rows.begin() + index, 0);
+}
+
+int WrapIndex::totalRows() const {
+    return _totalRows;
+}
+
+int WrapIndex::lineForRow(int row, int *rowInLine) const {
+    if (_lineCount == 0) {
+        *rowInLine = 0;
+        return 0;
+    }
+    if (row >= _totalRows) {
+        *rowInLine = _blocks.last().rows.last() - 1;
+        return _lineCount - 1;
+    }
+    row = std::max(0, row);
+
+    const int b = descend(_rowTree, row, &row);
+    const QVector<int> &rows = _blocks[b].rows;
+    int index = 0;
+    while (row >= rows[index]) {
+        row -= rows[index];
+        index++;
+    }
+    *rowInLine = row;
+    return prefixSum(_lineTree, b) + index;
+}
+
+int WrapIndex::estimatedLines(int first, int last) const {
+    first = std::max(0, first);
+    last = std::min(_lineCount - 1, last);
+    if (first > last) {
+        return 0;
+    }
+    return estimatedBefore(last + 1) - estimatedBefore(first);
+}
+
+int WrapIndex::estimatedLines() const {
+    return _estimatedLines;
+}
+
+int WrapIndex::blockOf(int line, int *indexInBlock) const {
+    return descend(_lineTree, line, indexInBlock);
+}
+
+int WrapIndex::estimatedBefore(int line) const {
+    if (line >= _lineCount) {
+        return _estimatedLines;
+    }
+    int index = 0;
+    const int b = blockOf(line, &index);
+    const QVector<bool> &exact = _blocks[b].exact;
+    return prefixSum(_estimatedTree, b) + static_cast<int>(std::count(exact.begin(), exact.begin() + index, false));
+}
+
+void WrapIndex::appendBlocks(QVector<Block> &blocks, const QVector<unsigned> &revisions, const QVector<int> &rows,
+                             const QVector<bool> &exact) const {
+    const int n = rows.size();
+    const int parts = (n + _blockLines - 1) / _blockLines;
+    for (int part = 0; part < parts; part++) {
+        const int start = static_cast<qint64>(n) * part / parts;
+        const int end = static_cast<qint64>(n) * (part + 1) / parts;
+        Block block;
+        block.revisions = revisions.mid(start, end - start);
+        block.rows = rows.mid(start, end - start);
+        block.exact = exact.mid(start, end - start);
+        block.totalRows = std::accumulate(block.rows.begin(), block.rows.end(), 0);
+        block.estimatedLines = static_cast<int>(std::count(block.exact.begin(), block.exact.end(), false));
+        blocks.append(block);
+    }
+}
+
+void WrapIndex::rebuildTrees() {
+    const int n = _blocks.size();
+    _lineTree = QVector<int>(n + 1, 0);
+    _rowTree = QVector<int>(n + 1, 0);
+    _estimatedTree = QVector<int>(n + 1, 0);
+    for (int i = 1; i <= n; i++) {
+        const Block &block = _blocks[i - 1];
+        _lineTree[i] += block.rows.size();
+        _rowTree[i] += block.totalRows;
+        _estimatedTree[i] += block.estimatedLines;
+        // Linear construction: every node passes its sum on to its parent.
+        const int parent = i + (i & -i);
+        if (parent <= n) {
+            _lineTree[parent] += _lineTree[i];
+            _rowTree[parent] += _rowTree[i];
+            _estimatedTree[parent] += _estimatedTree[i];
+        }
+    }
+}
+
+void WrapIndex::add(QVector<int> &tree, int index, int delta) {
+    if (delta == 0) {
+        return;
+    }
+    for (int i = index + 1; i < tree.size(); i += i & -i) {
+        tree[i] += delta;
+    }
+}
+
+int WrapIndex::prefixSum(const QVector<int> &tree, int count) {
+    int sum = 0;
+    for (int i = count; i > 0; i -= i & -i) {
+        sum += tree[i];
+    }
+    return sum;
+}
+
+int WrapIndex::descend(const QVector<int> &tree, int value, int *rest) {
+    // Descend the tree to the last position whose prefix sum does not exceed value.
+    const int n = tree.size() - 1;
+    int step = 1;
+    while (step * 2 <= n) {
+        step *= 2;
+    }
+    int pos = 0;
+    for (; step > 0; step /= 2) {
+        if (pos + step <= n && tree[pos + step] <= value) {
+            pos += step;
+            value -= tree[pos];
+        }
+    }
+    *rest = value;
+    return pos;
+}
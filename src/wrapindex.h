@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: BSL-1.0
+
+#ifndef WRAPINDEX_H
+#define WRAPINDEX_H
+
+#include <QVector>
+
+
+// Number of visual rows of each line when wrapping. Lines are kept in blocks of limited size, with Fenwick
+// trees over the blocks, so that converting between lines and visual rows and inserting or removing lines
+// do not depend on the number of lines. Lines start out with an estimate and become exact once their
+// layout is known. Each line carries the document line revision the row count belongs to.
+class WrapIndex {
+public:
+    explicit WrapIndex(int blockLines = 512);
+
+public:
+    // Replaces all lines, every line counts as estimated.
+    void reset(const QVector<unsigned> &revisions, const QVector<int> &estimates);
+    // Replaces count lines starting at first by estimated lines. Only the blocks holding these lines are touched.
+    void replace(int first, int count, const QVector<unsigned> &revisions, const QVector<int> &estimates);
+    void clear();
+
+    // Sets the exact row count of a line.
+    void setRows(int line, int rows);
+
+    int lineCount() const;
+    unsigned revision(int line) const;
+    int rows(int line) const;
+    bool isExact(int line) const;
+
+    // Visual rows of all lines before line.
+    int rowsBefore(int line) const;
+    int totalRows() const;
+    // Line that contains the visual row, *rowInLine is set to the row within that line.
+    // Rows past the end map to the last row of the last line.
+    int lineForRow(int row, int *rowInLine) const;
+
+    // Number of lines in [first, last] that only have an estimate.
+    int estimatedLines(int first, int last) const;
+    int estimatedLines() const;
+
+private:
+    struct Block {
+        QVector<unsigned> revisions;
+        QVector<int> rows;
+        QVector<bool> exact;
+        int totalRows = 0;
+        int estimatedLines = 0;
+    };
+
+private:
+    // Block of the line and the index of the line in it, line must be below lineCount().
+    int blockOf(int line, int *indexInBlock) const;
+    int estimatedBefore(int line) const;
+    // Splits the lines into blocks of about equal size, at most _blockLines each.
+    void appendBlocks(QVector<Block> &blocks, const QVector<unsigned> &revisions, const QVector<int> &rows,
+                      const QVector<bool> &exact) const;
+    void rebuildTrees();
+    static void add(QVector<int> &tree, int index, int delta);
+    static int prefixSum(const QVector<int> &tree, int count);
+    // Number of blocks whose sum together does not exceed value, *rest is set to what is left of value.
+    static int descend(const QVector<int> &tree, int value, int *rest);
+
+private:
+    int _blockLines;
+    QVector<Block> _blocks;
+    // Fenwick trees over the lines, rows and estimated lines of the blocks.
+    QVector<int> _lineTree;
+    QVector<int> _rowTree;
+    QVector<int> _estimatedTree;
+    int _lineCount = 0;
+    int _totalRows = 0;
+    int _estimatedLines = 0;
+};
+
+#endif // WRAPINDEX_H